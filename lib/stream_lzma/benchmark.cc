@@ -0,0 +1,114 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Decoding speed of StreamInputStorageLZMA by number of threads.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+// Usage: benchmark [MIB [BLOCK_KIB [THREADS]]]
+// Writes MIB (default 64) of generated text as .xz in blocks of BLOCK_KIB
+// (default 1024), then decodes it with 1, 2, 4 ... threads up to THREADS
+// (default the number of CPUs).
+
+#define BENCHMARK_CC 1
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "base.hh"
+#include "stream_input.hh"
+#include "stream_output.hh"
+#include "stream_input_storage_lzma.hh"
+#include "stream_output_storage_lzma.hh"
+using namespace base;
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+static double Seconds( void )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/*******************************************************************************
+ * Decode the whole file, returning the uncompressed size (0 if it failed).
+ *******************************************************************************/
+static uint64_t Decode( const string& pathname, const uint threads )
+{
+    shptr<StreamInputStorageLZMA> storage = new StreamInputStorageLZMA( pathname, 0, threads );
+    StreamInput in( storage.PTR() );
+    std::vector<char> buf( 0x100000 );
+    uint64_t total = 0;
+    while ( in.read( &buf[0], buf.size() ) or (in.gcount() > 0) )
+        total += in.gcount();
+    return in.bad() ? 0 : total;
+}
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+int main( int argc, char** argv )
+{
+    const uint64_t size      = uint64_t( argc > 1 ? atoi( argv[1] ) : 64 ) << 20;
+    const uint64_t blockSize = uint64_t( argc > 2 ? atoi( argv[2] ) : 1024 ) << 10;
+    const string pathname = "benchmark.dat.xz";
+
+    // Text that compresses about as well as firmware (a few to one).
+    {
+        shptr<StreamOutputStorageLZMA> storage = new StreamOutputStorageLZMA( pathname, blockSize );
+        StreamOutput out( storage.PTR() );
+        uint32_t seed = 1;
+        char line[64];
+        for ( uint64_t written = 0; written < size; )
+        {
+            seed = seed * 1103515245 + 12345;
+            const int n = snprintf( line, sizeof(line), "%08x %u %s\n", seed, seed >> 20, (seed & 0x100) ? "load" : "store" );
+            out.write( line, n );
+            written += n;
+        }
+    }
+
+    const uint cpus = std::max<uint32_t>( lzma_cputhreads(), 1 );
+    const uint maxThreads = argc > 3 ? std::max( atoi( argv[3] ), 1 ) : cpus;
+    std::cout << "liblzma " << lzma_version_string() << ", " << cpus << " CPU(s), "
+              << (size >> 20) << " MiB in " << (blockSize >> 10) << " KiB blocks"
+              << (StreamInputStorageLZMA::IfThreadsSupported() ? "" : " (no multithreaded decoder)") << std::endl;
+
+    double base = 0;
+    for ( uint threads = 1; ; threads = std::min( threads * 2, maxThreads ) )
+    {
+        const double start = Seconds();
+        const uint64_t total = Decode( pathname, threads );
+        const double seconds = Seconds() - start;
+        if ( total == 0 )
+        {
+            std::cerr << "Decoding failed" << std::endl;
+            return 1;
+        }
+        if ( threads == 1 )
+            base = seconds;
+        printf( "%3u thread(s): %7.3f s %8.1f MiB/s  x%.2f\n", threads, seconds, total / seconds / (1 << 20), base / seconds );
+        if ( threads >= maxThreads )
+            break;
+    }
+
+    remove( pathname.c_str() );
+    return 0;
+}
@@ -28,10 +28,10 @@ namespace base {
 template<typename BYTE=byte>
 class ByteBuffer final : public Shared
 {
-    private: CLASS_CONSTEXPR uint MARGIN = 0x100;
+    private: CLASS_CONSTEXPR size_t MARGIN = 0x100;
 
     /// ctor.  Count must be > 0.
-    public: ByteBuffer( const uint byteCount )
+    public: ByteBuffer( const size_t byteCount )
     :   mBuf(new BYTE[byteCount + MARGIN]),
         mByteCount(byteCount)
     {
@@ -67,7 +67,7 @@ class ByteBuffer final : public Shared
     }
 
     /// @return Size in bytes.
-    public: uint Size( void ) const
+    public: size_t Size( void ) const
     {
   //ASSERT( IfValid() );  // allow getting size in any case
 
@@ -75,7 +75,7 @@ class ByteBuffer final : public Shared
     }
 
     private: BYTE* mBuf;
-    private: uint  mByteCount;
+    private: size_t mByteCount;
 };
 
 } // namespace base
@@ -27,11 +27,11 @@ public:
                   StringBuffer( void ) { }
                   ~StringBuffer() { }
     void          Set( const char* buf )           { mBuf.assign( buf ); }
-    void          Set( const char* buf, int len )  { mBuf.assign( buf, len ); }
-    void          Set( const uchar* buf, int len ) { mBuf.assign( reinterpret_cast<const char*>(buf), len ); }
+    void          Set( const char* buf, size_t len )  { mBuf.assign( buf, len ); }
+    void          Set( const uchar* buf, size_t len ) { mBuf.assign( reinterpret_cast<const char*>(buf), len ); }
     void          Erase( void )           { mBuf.erase(); }
     bool          IfEmpty( void )   const { return mBuf.size() == 0; }
-    uint          Size( void )      const { return mBuf.size(); }
+    size_t        Size( void )      const { return mBuf.size(); }
     const string* GetString( void ) const { return &mBuf; }
     const char*   GetChars( void )  const { return mBuf.c_str(); }
     const uchar*  GetUchars( void ) const { return reinterpret_cast<const uchar*>(mBuf.c_str()); }
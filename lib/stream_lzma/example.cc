@@ -15,7 +15,9 @@
 #include "stream_input_storage.hh"
 #include "stream_output_storage.hh"
 #include "stream_input_storage_lzma.hh"
+#include "stream_input_storage_lzma_indexed.hh"
 #include "stream_output_storage_lzma.hh"
+#include <cstdio>
 using namespace base;
 
 /*******************************************************************************
@@ -72,12 +74,55 @@ bool Test( const uint n )
     return true;
 }
 
+/*******************************************************************************
+ * Random access: fixed-size records written in small blocks, read back
+ * out of order, each read decoding only the block that holds the record.
+ *******************************************************************************/
+bool TestIndexed( const uint n )
+{
+    const string pathname = "test.dat.xz";
+    const uint RECORD_SIZE = 9;
+
+    {
+        shptr<StreamOutputStorageLZMA> streamOutputStorageLZMA = new StreamOutputStorageLZMA( pathname, 0x1000 );
+        StreamOutput out( streamOutputStorageLZMA.PTR() );
+        char record[16];
+        for ( uint i = 0; i < n; ++i )
+        {
+            snprintf( record, sizeof(record), "%08u\n", i );
+            out.write( record, RECORD_SIZE );
+        }
+        if ( not out.good() )
+            return false;
+    }
+
+    {
+        shptr<StreamInputStorageLZMAIndexed> streamInputStorage = new StreamInputStorageLZMAIndexed( pathname );
+        StreamInput in( streamInputStorage.PTR() );
+        if ( streamInputStorage->GetSize() != uint64_t(n) * RECORD_SIZE )
+            return false;
+        for ( uint k = 0; k < 100; ++k )
+        {
+            const uint i = (k * 7919) % n;
+            char record[RECORD_SIZE + 1] = {};
+            in.seekg( uint64_t(i) * RECORD_SIZE );
+            in.read( record, RECORD_SIZE );
+            if ( (not in.good()) or (uint(atoi( record )) != i) )
+                return false;
+        }
+        if ( streamInputStorage->GetBlocksDecoded() > 100 + 1 )  // 1 record may span 2 blocks
+            return false;
+    }
+
+    return true;
+}
+
 /*******************************************************************************
  * 
  *******************************************************************************/
 int main( int argc, char** argv )
 {
-    if ( Test( 1000 ) )
+    if ( Test( 1000 ) and TestIndexed( 100000 ) )
         std::cout << "Test passed." << std::endl;
     else
         std::cerr << "Test FAILED!" << std::endl;
@@ -80,7 +80,7 @@ bool ReadFile( const string& fname, string& obuf )
         if ( fileSize > 0 )
         {
             ByteBuffer<> byteBuffer( fileSize );
-            uint bytesRead = fread( byteBuffer.Get(), 1, fileSize, file );  // should return 0..fileSize
+            size_t bytesRead = fread( byteBuffer.Get(), 1, fileSize, file );  // should return 0..fileSize
             obuf.assign( byteBuffer.Get(), bytesRead );                     // assign to string the bytes actually read
         }
         fclose( file );
@@ -0,0 +1,101 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Per-thread pool of reusable LZMA decoder contexts.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#define BASE_LZMA_DECODER_POOL_CC 1
+#include "base.hh"
+#include "lzma_decoder_pool.hh"
+
+namespace base {
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////  LzmaDecoderContext  ////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * 
+ *******************************************************************************/
+LzmaDecoderContext::LzmaDecoderContext( void )
+:   mAllocator(),
+    mStream(LZMA_STREAM_INIT)
+{
+    mStream.allocator = mAllocator.get();
+}
+
+LzmaDecoderContext::~LzmaDecoderContext()
+{
+    // lzma_end() tolerates a stream that was never initialized.
+    lzma_end( &mStream );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////  LzmaDecoderPool  /////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+LzmaDecoderPool::~LzmaDecoderPool()
+{
+    for ( auto context : mIdle )
+        delete context;
+}
+
+/*******************************************************************************
+ * @return The calling thread's pool (destroyed with its thread).
+ *******************************************************************************/
+LzmaDecoderPool& LzmaDecoderPool::Local( void )
+{
+    static thread_local LzmaDecoderPool pool;
+    return pool;
+}
+
+/*******************************************************************************
+ * @return A context of the calling thread's pool.
+ *******************************************************************************/
+LzmaDecoderContext* LzmaDecoderPool::Acquire( void )
+{
+    LzmaDecoderPool& pool = Local();
+    if ( pool.mIdle.empty() )
+        return new LzmaDecoderContext;
+
+    LzmaDecoderContext* context = pool.mIdle.back();
+    pool.mIdle.pop_back();
+    return context;
+}
+
+/*******************************************************************************
+ * Return a context to the calling thread's pool.
+ *******************************************************************************/
+void LzmaDecoderPool::Release( LzmaDecoderContext* context )
+{
+    if ( context == nullptr )
+        return;
+
+    LzmaDecoderPool& pool = Local();
+    if ( pool.mIdle.size() >= MAX_IDLE )
+    {
+        delete context;
+        return;
+    }
+    pool.mIdle.push_back( context );
+}
+
+} // namespace base
@@ -0,0 +1,84 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Per-thread pool of reusable LZMA decoder contexts.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef BASE_LZMA_DECODER_POOL_HH
+#define BASE_LZMA_DECODER_POOL_HH 1
+
+#include <vector>
+#include <lzma.h>
+#include "base.hh"
+#include "../../ros_pool.hpp"
+
+namespace base {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief An lzma_stream with the toolkit's ros_lzma_allocator.
+///
+/// Re-initializing a decoder on a context that was used before lets liblzma
+/// keep its coder state and, for an equal dictionary size, the dictionary.
+/// Blocks liblzma frees anyway (a different dictionary size) are recycled
+/// by the allocator.
+///
+class LzmaDecoderContext final
+{
+PREVENT_COPYING( LzmaDecoderContext )
+friend class LzmaDecoderPool;
+
+    private: LzmaDecoderContext( void );
+    public:  ~LzmaDecoderContext();
+
+    /// @return The stream, to be initialized with an lzma_*_decoder() function.
+    public: lzma_stream* GetStream( void ) { return &mStream; }
+
+    private: ros_lzma_allocator  mAllocator;    ///< declared first: outlives mStream
+    private: lzma_stream         mStream;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Per-thread pool of LzmaDecoderContext.
+///
+/// Acquire() returns a context of the calling thread, Release() returns it
+/// to that thread's pool.  A context must be released by the thread that
+/// acquired it.  A few contexts are kept per thread; more are freed.
+///
+class LzmaDecoderPool final
+{
+PREVENT_COPYING( LzmaDecoderPool )
+
+    public: static LzmaDecoderContext* Acquire( void );
+    public: static void                Release( LzmaDecoderContext* context );
+
+    private: static LzmaDecoderPool& Local( void );
+
+    private: LzmaDecoderPool( void ) { }
+    private: ~LzmaDecoderPool();
+
+    private: CLASS_CONSTEXPR uint MAX_IDLE = 4;
+
+    private: std::vector<LzmaDecoderContext*> mIdle;
+};
+
+} // namespace base
+
+#endif // BASE_LZMA_DECODER_POOL_HH
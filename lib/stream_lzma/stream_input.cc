@@ -48,8 +48,9 @@ StreamInput::~StreamInput()
  * 
  *******************************************************************************/
 StreamInput::StreamBuffer::StreamBuffer( shptr<StreamInputStorage> streamInputStorage )
-:   mStreamInputStorage(streamInputStorage)
+:   mStreamInputStorage(streamInputStorage),
   //mBuffer[]
+    mPosition(0)
 {
     // Open the storage of the stream.
     mStreamInputStorage->Open();
@@ -98,6 +99,7 @@ ASSERT( numPutback >= 0 );
     StreamSize num = mStreamInputStorage->Read( mBuffer + PUTBACK_SIZE, DATA_SIZE );  // similar to UNIX read()
     if ( num <= 0 )
         return EOF;  // stdio EOF
+    mPosition += num;
 
     // Reset buffer pointers.
     setg( mBuffer + (PUTBACK_SIZE - numPutback),  // beginning of putback area
@@ -108,4 +110,42 @@ ASSERT( numPutback >= 0 );
     return traits_type::to_int_type( *gptr() );
 }
 
+/*******************************************************************************
+ * 
+ *******************************************************************************/
+std::streampos StreamInput::StreamBuffer::seekoff( std::streamoff off, std::ios_base::seekdir dir, std::ios_base::openmode which )
+{
+    // The read position trails the storage by what is left in the buffer.
+    // The end isn't known to a stream, so can't seek from it.
+    if ( dir == std::ios_base::cur )
+        return seekpos( std::streamoff(mPosition) - (egptr() - gptr()) + off, which );
+    else if ( dir == std::ios_base::beg )
+        return seekpos( off, which );
+    else
+        return std::streampos( std::streamoff(-1) );
+}
+
+std::streampos StreamInput::StreamBuffer::seekpos( std::streampos pos, std::ios_base::openmode which )
+{
+    const std::streamoff offset = pos;
+    if ( UX( not (which & std::ios_base::in) or (offset < 0) ) )
+        return std::streampos( std::streamoff(-1) );
+
+    // Within the buffer (including the putback area): only move the read position.
+    // tellg() always ends up here.
+    const std::streamoff bufferOffset = std::streamoff(mPosition) - (egptr() - eback());
+    if ( (offset >= bufferOffset) and (offset <= std::streamoff(mPosition)) )
+    {
+        setg( eback(), eback() + (offset - bufferOffset), egptr() );
+        return pos;
+    }
+
+    // Else the storage has to seek, and the buffer is emptied.
+    if ( not mStreamInputStorage->Seek( uint64_t(offset) ) )
+        return std::streampos( std::streamoff(-1) );
+    mPosition = offset;
+    setg( mBuffer + PUTBACK_SIZE, mBuffer + PUTBACK_SIZE, mBuffer + PUTBACK_SIZE );
+    return pos;
+}
+
 } // namespace base
@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <streambuf>
+#include <stdint.h>
 #include "base.hh"
 
 namespace base {
@@ -32,6 +33,9 @@ class StreamInputStorage;
 ///
 /// The streambuf code is derived from Nicolai Josuttis's STL book.
 ///
+/// seekg() and tellg() work within what is buffered, and beyond it
+/// if the storage can seek (StreamInputStorage::Seek()).
+///
 /// @verbatim
 /// Example:
 ///     StreamInput in( new StreamInputStorageDerived() );
@@ -65,6 +69,8 @@ PREVENT_COPYING(StreamInput)
         public: StreamBuffer( shptr<StreamInputStorage> streamInputStorage );
         public: virtual ~StreamBuffer();
         private: virtual int underflow( void ) override;
+        private: virtual std::streampos seekoff( std::streamoff off, std::ios_base::seekdir dir, std::ios_base::openmode which ) override;
+        private: virtual std::streampos seekpos( std::streampos pos, std::ios_base::openmode which ) override;
 
         // Data:
         private: CLASS_CONSTEXPR int PUTBACK_SIZE = 4;    ///< size of putback area
@@ -73,6 +79,7 @@ PREVENT_COPYING(StreamInput)
 
         private: shptr<StreamInputStorage> mStreamInputStorage;  ///< the source of the stream
         private: char                      mBuffer[BUFFER_SIZE]; ///< data buffer
+        private: uint64_t                  mPosition;            ///< stream offset of egptr()
     };
 
 //------------------------------------------------------------------------------
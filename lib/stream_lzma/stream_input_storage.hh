@@ -12,6 +12,7 @@
 #ifndef BASE_STREAM_INPUT_STORAGE_HH
 #define BASE_STREAM_INPUT_STORAGE_HH 1
 
+#include <stdint.h>
 #include "base.hh"
 #include "stream_defs.hh"
 
@@ -70,6 +71,13 @@ friend class StreamInput;
     ***************************************************************************/
     protected: virtual StreamSize Read( char* buf/*OUT*/, const StreamSize count ) = 0;
 
+    /***************************************************************************
+     * (For StreamInput.)
+     * Move the read position to an offset into the (uncompressed) stream.
+     * Returns false if the storage cannot seek (the default).
+     ***************************************************************************/
+    protected: virtual bool Seek( const uint64_t offset/*unused*/ ) { return false; }
+
 //------------------------------------------------------------------------------
 // Data:
 //------------------------------------------------------------------------------
@@ -8,12 +8,14 @@
  ******************************************************************************/
 
 #define BASE_STREAM_INPUT_STORAGE_LZMA_CC 1
+#include <algorithm>
 #include "base.hh"
 #include "file.hh"
 #include "buffer_string.hh"
 #include "stream_defs.hh"
 #include "stream_input_storage.hh"
 #include "stream_input_storage_lzma.hh"
+#include "lzma_decoder_pool.hh"
 
 namespace base {
 
@@ -24,20 +26,20 @@ namespace base {
 /*******************************************************************************
  * 
  *******************************************************************************/
-StreamInputStorageLZMA::StreamInputStorageLZMA( const string& pathname )
+StreamInputStorageLZMA::StreamInputStorageLZMA( const string& pathname, const uint64_t memLimit, const uint threads )
 :   mPathname(pathname),
+    mMemLimit(memLimit ? memLimit : (lzma_physmem() ? lzma_physmem() / 4 : UINT64_MAX)),
+    mThreads(threads ? threads : std::max<uint32_t>( lzma_cputhreads(), 1 )),
     mOpen(false),
     mInputStringBuf{},
     mInputStringIdx(0),
-    mLzmaStream{}
+    mLzmaContext(nullptr),
+    mLzmaStream(nullptr),
+    mThreadedStream(LZMA_STREAM_INIT)
 {
 ASSERT( not mPathname.empty() );
 
     // (Do not open file yet, wait until StreamInput will call Open().)
-    mLzmaStream.next_in   = nullptr;
-    mLzmaStream.avail_in  = 0;
-    mLzmaStream.next_out  = nullptr;
-    mLzmaStream.avail_out = 0;
 }
 
 StreamInputStorageLZMA::~StreamInputStorageLZMA()
@@ -46,6 +48,18 @@ StreamInputStorageLZMA::~StreamInputStorageLZMA()
     Close();
 }
 
+/*******************************************************************************
+ * 
+ *******************************************************************************/
+bool StreamInputStorageLZMA::IfThreadsSupported( void )
+{
+#if LZMA_VERSION >= 50040002  // lzma_stream_decoder_mt() is stable from xz-5.4.0
+    return true;
+#else
+    return false;
+#endif
+}
+
 /*******************************************************************************
  * 
  *******************************************************************************/
@@ -67,13 +81,51 @@ ASSERT( not mPathname.empty() );
     }
 
     // Prepare LZMA stream for use later by Read().
-    mLzmaStream = LZMA_STREAM_INIT;
-    mLzmaStream.next_in   = mInputStringBuf.GetUchars();
-    mLzmaStream.avail_in  = std::min( INPUT_CHUNK_SIZE, mInputStringBuf.Size() );
-    mLzmaStream.next_out  = nullptr;  // to be assigned from Read() arg
-    mLzmaStream.avail_out = 0;    // to be assigned from Read() arg
-    if ( lzma_stream_decoder( &mLzmaStream, UINT64_MAX, LZMA_CONCATENATED ) != LZMA_OK )
+    // The decoder context comes from this thread's pool: re-initializing a
+    // used context reuses its memory instead of allocating the dictionary anew.
+    // A multithreaded decoder allocates from its own threads, so it has a
+    // stream of its own with liblzma's (thread-safe) allocator instead.
+    if ( mThreads > 1 and IfThreadsSupported() )
+    {
+        mThreadedStream = LZMA_STREAM_INIT;
+        mLzmaStream = &mThreadedStream;
+    }
+    else
+    {
+        mLzmaContext = LzmaDecoderPool::Acquire();
+        mLzmaStream = mLzmaContext->GetStream();
+    }
+    mLzmaStream->next_in   = mInputStringBuf.GetUchars();
+    mLzmaStream->avail_in  = std::min<size_t>( INPUT_CHUNK_SIZE, mInputStringBuf.Size() );
+    mLzmaStream->next_out  = nullptr;  // to be assigned from Read() arg
+    mLzmaStream->avail_out = 0;    // to be assigned from Read() arg
+    lzma_ret lzmaRet;
+#if LZMA_VERSION >= 50040002
+    if ( mLzmaContext == nullptr )
+    {
+        // Threads beyond what memlimit_threading allows aren't started
+        // (liblzma falls back to one); memlimit_stop is the hard limit.
+        lzma_mt mt{};
+        mt.flags              = LZMA_CONCATENATED;
+        mt.threads            = mThreads;
+        mt.timeout            = 0;
+        mt.memlimit_threading = mMemLimit;
+        mt.memlimit_stop      = mMemLimit;
+        lzmaRet = lzma_stream_decoder_mt( mLzmaStream, &mt );
+    }
+    else
+#endif
+    {
+        lzmaRet = lzma_stream_decoder( mLzmaStream, mMemLimit, LZMA_CONCATENATED );
+    }
+    if ( lzmaRet != LZMA_OK )
+    {
+        lzma_end( &mThreadedStream );
+        LzmaDecoderPool::Release( mLzmaContext );
+        mLzmaContext = nullptr;
+        mLzmaStream = nullptr;
         throw std::runtime_error( "base:StreamInputStorageLZMA: lzma_stream_decoder" );
+    }
 
     // Opened OK.
     mOpen = true;
@@ -93,8 +145,12 @@ bool StreamInputStorageLZMA::Close( void )
         // Free StringBuffer.
         mInputStringBuf.Erase();
 
-        // Free lzma_stream.
-        lzma_end( &mLzmaStream );
+        // Return the lzma_stream to the pool (it keeps its memory for the next Open()),
+        // or end the multithreaded decoder and its threads.
+        lzma_end( &mThreadedStream );
+        LzmaDecoderPool::Release( mLzmaContext );
+        mLzmaContext = nullptr;
+        mLzmaStream = nullptr;
 
         // Last step.
         mOpen = false;
@@ -121,16 +177,16 @@ ASSERT( mOpen );
         return defs::STREAM_EOF;
 
     // To hold a decompressed chunk.
-    mLzmaStream.next_out  = reinterpret_cast<uchar*>(buf);
-    mLzmaStream.avail_out = count;
+    mLzmaStream->next_out  = reinterpret_cast<uchar*>(buf);
+    mLzmaStream->avail_out = count;
 
     // Continue loop until LZMA finished decompressing this chunk of input.
     lzma_action lzmaAction = LZMA_RUN;
-    while ( mLzmaStream.avail_out > 0 )
+    while ( mLzmaStream->avail_out > 0 )
     {
         // Advance read index if LZMA has read the entire chunk (LZMA decremented avail_in down to 0).
         // avail_in will be 0 while LZMA is finished decompressing its final chunk.
-        if ( (mLzmaStream.avail_in == 0) and (lzmaAction == LZMA_RUN) )
+        if ( (mLzmaStream->avail_in == 0) and (lzmaAction == LZMA_RUN) )
         {
             mInputStringIdx += INPUT_CHUNK_SIZE;
             if ( mInputStringIdx < mInputStringBuf.Size() )
@@ -140,8 +196,8 @@ ASSERT( mOpen );
                 ASSERT( remaining >= 0 );
                 if ( remaining > INPUT_CHUNK_SIZE )
                     remaining = INPUT_CHUNK_SIZE;
-                mLzmaStream.next_in  = reinterpret_cast<const uchar*>( mInputStringBuf.GetChars() + mInputStringIdx );
-                mLzmaStream.avail_in = remaining;
+                mLzmaStream->next_in  = reinterpret_cast<const uchar*>( mInputStringBuf.GetChars() + mInputStringIdx );
+                mLzmaStream->avail_in = remaining;
 
                 ASSERT( mInputStringIdx + remaining <= mInputStringBuf.Size() );  // this too is a size which can be equal to StringBuf size
             }
@@ -155,12 +211,12 @@ ASSERT( mOpen );
         }
 
         // Don't overrun input buffer (end=end is ok so <=).
-      //ASSERT( mLzmaStream.next_in + mLzmaStream.avail_in < reinterpret_cast<const uchar*>(mInputStringBuf.GetChars() + mInputStringBuf.Size()) );
-        ASSERT( mLzmaStream.next_in + mLzmaStream.avail_in <= reinterpret_cast<const uchar*>(mInputStringBuf.GetChars() + mInputStringBuf.Size()) );
-        ASSERT( mInputStringIdx + mLzmaStream.avail_in <= mInputStringBuf.Size() );  // alternative check
+      //ASSERT( mLzmaStream->next_in + mLzmaStream->avail_in < reinterpret_cast<const uchar*>(mInputStringBuf.GetChars() + mInputStringBuf.Size()) );
+        ASSERT( mLzmaStream->next_in + mLzmaStream->avail_in <= reinterpret_cast<const uchar*>(mInputStringBuf.GetChars() + mInputStringBuf.Size()) );
+        ASSERT( mInputStringIdx + mLzmaStream->avail_in <= mInputStringBuf.Size() );  // alternative check
 
         // Decompress the next chunk.
-        const lzma_ret lzmaRet = lzma_code( &mLzmaStream, lzmaAction );
+        const lzma_ret lzmaRet = lzma_code( mLzmaStream, lzmaAction );
         switch ( lzmaRet )
         {
             case LZMA_OK: case LZMA_NO_CHECK: case LZMA_UNSUPPORTED_CHECK: case LZMA_GET_CHECK:
@@ -172,7 +228,7 @@ ASSERT( mOpen );
             case LZMA_STREAM_END:
             {
                 // LZMA has finished.
-                const StreamSize bytesRead = count - StreamSize(mLzmaStream.avail_out);
+                const StreamSize bytesRead = count - StreamSize(mLzmaStream->avail_out);
                 ASSERT( bytesRead >= 0 );
                 return bytesRead;
             }
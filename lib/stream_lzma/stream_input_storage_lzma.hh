@@ -18,6 +18,7 @@
 namespace base {
 
 class StreamInput;
+class LzmaDecoderContext;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief C++ input stream implemented with LZMA/XZ decompression.
@@ -44,10 +45,26 @@ friend class StreamInput;  // needs access to Open() etc
     /***************************************************************************
      * @param   pathname
      *          Pathname of compressed file.
+     * @param   memLimit
+     *          Most memory the decoder may use, so concurrent decoders can be
+     *          kept within a budget.  0 selects a quarter of physical memory.
+     *          A file needing more fails to decode (Read() returns STREAM_ERROR).
+     * @param   threads
+     *          Decoder threads, 0 for one per CPU.  More than one uses
+     *          liblzma's multithreaded decoder (xz-5.4.0 or later, else the
+     *          file is decoded in this thread), which decodes the blocks of
+     *          a multi-block file in parallel.  Threads are only started
+     *          while their memory fits in memLimit: a file whose blocks
+     *          need more is decoded by fewer threads, down to one.
      ***************************************************************************/
-    public: StreamInputStorageLZMA( const string& pathname );
+    public: StreamInputStorageLZMA( const string& pathname, const uint64_t memLimit = 0, const uint threads = 1 );
     public: virtual ~StreamInputStorageLZMA();
 
+    /***************************************************************************
+     * @return True if multithreaded decoding is available in this liblzma.
+     ***************************************************************************/
+    public: static bool IfThreadsSupported( void );
+
 //------------------------------------------------------------------------------
 // Methods (internal to stream classes):
 //------------------------------------------------------------------------------
@@ -78,10 +95,14 @@ friend class StreamInput;  // needs access to Open() etc
 //------------------------------------------------------------------------------
 
     private: const string mPathname;       ///< pathname of compressed file
+    private: const uint64_t mMemLimit;     ///< decoder memory limit
+    private: const uint   mThreads;        ///< decoder threads
     private: bool         mOpen;           ///< if opened
     private: StringBuffer mInputStringBuf; ///< will contain compressed file that was read
-    private: uint         mInputStringIdx; ///< index into input StringBuffer
-    private: lzma_stream  mLzmaStream;     ///< underlying LZMA encoder/decoder
+    private: size_t       mInputStringIdx; ///< index into input StringBuffer
+    private: LzmaDecoderContext* mLzmaContext; ///< pooled decoder context
+    private: lzma_stream* mLzmaStream;     ///< underlying LZMA encoder/decoder (of mLzmaContext)
+    private: lzma_stream  mThreadedStream; ///< multithreaded decoder (not pooled)
 };
 
 } // namespace base
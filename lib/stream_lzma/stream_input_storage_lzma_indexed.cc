@@ -0,0 +1,284 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Random access input stream over block-split .xz files.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#define BASE_STREAM_INPUT_STORAGE_LZMA_INDEXED_CC 1
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "base.hh"
+#include "file.hh"
+#include "buffer_string.hh"
+#include "stream_defs.hh"
+#include "stream_input_storage.hh"
+#include "stream_input_storage_lzma_indexed.hh"
+#include "lzma_decoder_pool.hh"
+
+namespace base {
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////  StreamInputStorageLZMAIndexed  /////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+StreamInputStorageLZMAIndexed::StreamInputStorageLZMAIndexed( const string& pathname, const uint64_t memLimit )
+:   mPathname(pathname),
+    mMemLimit(memLimit ? memLimit : (lzma_physmem() ? lzma_physmem() / 4 : UINT64_MAX)),
+    mOpen(false),
+    mInputStringBuf{},
+    mLzmaContext(nullptr),
+    mLzmaStream(nullptr),
+    mIndex(nullptr),
+    mPosition(0),
+    mBlock{},
+    mBlockOffset(0),
+    mBlockValid(false),
+    mBlocksDecoded(0)
+{
+ASSERT( not mPathname.empty() );
+
+    // (Do not open file yet, wait until StreamInput will call Open().)
+}
+
+StreamInputStorageLZMAIndexed::~StreamInputStorageLZMAIndexed()
+{
+    // Call Close() to ensure memory is released.
+    Close();
+}
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+uint64_t StreamInputStorageLZMAIndexed::GetSize( void ) const
+{
+    return mIndex ? lzma_index_uncompressed_size( mIndex ) : 0;
+}
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+bool StreamInputStorageLZMAIndexed::Open( void )
+{
+ASSERT( not mOpen );  // don't re-open
+ASSERT( not mPathname.empty() );
+
+    // Open the compressed file.
+    // Read it into a memory buffer (owned by this).
+    if ( not ReadFile( mPathname, mInputStringBuf ) )
+        return false;  // failed/error
+
+    mLzmaContext = LzmaDecoderPool::Acquire();
+    mLzmaStream = mLzmaContext->GetStream();
+
+#if LZMA_VERSION >= 50040002  // lzma_file_info_decoder() is stable from xz-5.4.0
+    // Decode the index of every stream in the file (it is found from the end).
+    // The decoder asks for the parts of the file it needs with LZMA_SEEK_NEEDED.
+    const uint64_t fileSize = mInputStringBuf.Size();
+    if ( lzma_file_info_decoder( mLzmaStream, &mIndex, mMemLimit, fileSize ) != LZMA_OK )
+    {
+        LzmaDecoderPool::Release( mLzmaContext );
+        mLzmaContext = nullptr;
+        mLzmaStream = nullptr;
+        throw std::runtime_error( "base:StreamInputStorageLZMAIndexed: lzma_file_info_decoder" );
+    }
+    mLzmaStream->next_in  = mInputStringBuf.GetUchars();
+    mLzmaStream->avail_in = fileSize;
+    lzma_ret lzmaRet;
+    while ( true )
+    {
+        lzmaRet = lzma_code( mLzmaStream, LZMA_RUN );
+        if ( lzmaRet == LZMA_SEEK_NEEDED )
+        {
+            ASSERT( mLzmaStream->seek_pos <= fileSize );
+            mLzmaStream->next_in  = mInputStringBuf.GetUchars() + mLzmaStream->seek_pos;
+            mLzmaStream->avail_in = fileSize - mLzmaStream->seek_pos;
+        }
+        else if ( lzmaRet != LZMA_OK )
+        {
+            break;
+        }
+    }
+#else
+    const lzma_ret lzmaRet = LZMA_OPTIONS_ERROR;  // no file info decoder
+#endif
+
+    if ( lzmaRet != LZMA_STREAM_END )
+    {
+    #if DEBUG
+        CDEBUG << "base:StreamInputStorageLZMAIndexed: Failed to read the index of '" << mPathname << "' lzmaRet=" << lzmaRet << std::endl;
+    #endif
+        if ( mIndex != nullptr )
+            lzma_index_end( mIndex, mLzmaStream->allocator );
+        mIndex = nullptr;
+        LzmaDecoderPool::Release( mLzmaContext );
+        mLzmaContext = nullptr;
+        mLzmaStream = nullptr;
+        mInputStringBuf.Erase();
+        return false;
+    }
+
+    // Opened OK.
+    mPosition      = 0;
+    mBlockValid    = false;
+    mBlocksDecoded = 0;
+    mOpen = true;
+    return true;
+}
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+bool StreamInputStorageLZMAIndexed::Close( void )
+{
+    // In this class, Close() is responsible for freeing memory and must tolerate re-closing.
+    // Not an error if already closed as Close() could be called after failed open.
+
+    if ( mOpen )
+    {
+        // The index was allocated with the stream's allocator.
+        lzma_index_end( mIndex, mLzmaStream->allocator );
+        mIndex = nullptr;
+
+        // Free buffers.
+        mInputStringBuf.Erase();
+        std::vector<char>().swap( mBlock );
+        mBlockValid = false;
+
+        // Return the lzma_stream to the pool (it keeps its memory for the next Open()).
+        LzmaDecoderPool::Release( mLzmaContext );
+        mLzmaContext = nullptr;
+        mLzmaStream = nullptr;
+
+        // Last step.
+        mOpen = false;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+bool StreamInputStorageLZMAIndexed::Seek( const uint64_t offset )
+{
+    // The block is decoded when it is read.
+    mPosition = offset;
+    return mOpen;
+}
+
+/*******************************************************************************
+ *
+ *******************************************************************************/
+StreamSize StreamInputStorageLZMAIndexed::Read( char* buf/*OUT*/, const StreamSize count )
+{
+ASSERT( mOpen );
+
+    if ( UX( not mOpen ) )
+        return defs::STREAM_EOF;
+
+    // Copy from the decoded block.  A read that reaches the end of the block
+    // stops there rather than decode the next block before it is wanted
+    // (StreamInput reads ahead).
+    StreamSize done = 0;
+    while ( done < count )
+    {
+        if ( not mBlockValid
+          or (mPosition < mBlockOffset)
+          or (mPosition >= mBlockOffset + mBlock.size()) )
+        {
+            if ( (done > 0) or (mPosition >= GetSize()) )
+                break;  // short read or EOF
+            if ( UX( not DecodeBlock( mPosition ) ) )
+                return defs::STREAM_ERROR;  // error
+        }
+
+        const size_t     skip = mPosition - mBlockOffset;
+        const StreamSize size = StreamSize( std::min<uint64_t>( count - done, mBlock.size() - skip ) );
+        memcpy( buf + done, &mBlock[skip], size );
+        done      += size;
+        mPosition += size;
+    }
+
+    return done;  // 0 is STREAM_EOF
+}
+
+/*******************************************************************************
+ * Decode the block holding an uncompressed offset into mBlock.
+ *******************************************************************************/
+bool StreamInputStorageLZMAIndexed::DecodeBlock( const uint64_t offset )
+{
+    // Find the block in the index.
+    lzma_index_iter iter;
+    lzma_index_iter_init( &iter, mIndex );
+    if ( lzma_index_iter_locate( &iter, offset ) )
+        return false;  // past the end
+    if ( iter.block.compressed_file_offset + iter.block.total_size > mInputStringBuf.Size() )
+        return false;  // truncated file
+    const uchar* in     = mInputStringBuf.GetUchars() + iter.block.compressed_file_offset;
+    const size_t inSize = iter.block.total_size;
+
+    // Decode the block header, with the sizes of the block from the index.
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block  block{};
+    block.version     = 0;
+    block.check       = iter.stream.flags->check;
+    block.filters     = filters;
+    block.header_size = lzma_block_header_size_decode( in[0] );
+    if ( (block.header_size > inSize)
+      or (lzma_block_header_decode( &block, nullptr, in ) != LZMA_OK) )
+        return false;  // corrupt
+    bool ok = (lzma_block_compressed_size( &block, iter.block.unpadded_size ) == LZMA_OK)
+          and (lzma_raw_decoder_memusage( filters ) <= mMemLimit)
+          and (lzma_block_decoder( mLzmaStream, &block ) == LZMA_OK);
+
+    // Decode the whole block at once.
+    mBlockValid = false;
+    if ( ok )
+    {
+        mBlock.resize( iter.block.uncompressed_size );
+        mLzmaStream->next_in   = in + block.header_size;
+        mLzmaStream->avail_in  = inSize - block.header_size;
+        mLzmaStream->next_out  = reinterpret_cast<uchar*>( mBlock.data() );
+        mLzmaStream->avail_out = mBlock.size();
+        lzma_ret lzmaRet;
+        do {
+            lzmaRet = lzma_code( mLzmaStream, LZMA_FINISH );
+        } while ( lzmaRet == LZMA_OK );
+        ok = (lzmaRet == LZMA_STREAM_END) and (mLzmaStream->avail_out == 0);
+    }
+
+    // The filter options were allocated by lzma_block_header_decode().
+    for ( uint i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i )
+        free( filters[i].options );
+
+    if ( UX( not ok ) )
+        return false;
+    mBlockOffset = iter.block.uncompressed_file_offset;
+    mBlockValid  = true;
+    ++mBlocksDecoded;
+    return true;
+}
+
+} // namespace base
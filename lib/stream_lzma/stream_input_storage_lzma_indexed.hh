@@ -0,0 +1,139 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Random access input stream over block-split .xz files.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef STREAM_INPUT_STORAGE_LIBLZMA_INDEXED_HH
+#define STREAM_INPUT_STORAGE_LIBLZMA_INDEXED_HH 1
+
+#include <vector>
+#include <lzma.h>
+#include "buffer_string.hh"
+#include "stream_defs.hh"
+#include "stream_input_storage.hh"
+
+namespace base {
+
+class StreamInput;
+class LzmaDecoderContext;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief C++ input stream that seeks using the index of an .xz file.
+///
+/// Open() decodes only the index (lzma_index) at the end of the file.
+/// A read decodes the one block that holds the read position and keeps it,
+/// so reads of a small window cost one block decode however far into the
+/// file it lies, and reading on through the block costs nothing more.
+///
+/// Any .xz file can be read, but a file written as a single block (as by
+/// StreamOutputStorageLZMA without a block size, or xz without --block-size)
+/// is decoded whole on the first read.
+///
+/// @verbatim
+/// Example:
+///     shptr<StreamInputStorageLZMAIndexed> storage = new StreamInputStorageLZMAIndexed( pathname );
+///     StreamInput in( storage.PTR() );
+///     in.seekg( offset );
+///     in.read( buf, sizeof(buf) );
+/// @endverbatim
+///
+class StreamInputStorageLZMAIndexed final : public StreamInputStorage
+{
+PREVENT_COPYING( StreamInputStorageLZMAIndexed )
+friend class StreamInput;  // needs access to Open() etc
+
+//------------------------------------------------------------------------------
+// Methods:
+//------------------------------------------------------------------------------
+
+    /***************************************************************************
+     * @param   pathname
+     *          Pathname of compressed file.
+     * @param   memLimit
+     *          Most memory the decoder may use (as StreamInputStorageLZMA).
+     ***************************************************************************/
+    public: StreamInputStorageLZMAIndexed( const string& pathname, const uint64_t memLimit = 0 );
+    public: virtual ~StreamInputStorageLZMAIndexed();
+
+    /***************************************************************************
+     * Uncompressed size of the stream, and the number of blocks decoded so far.
+     ***************************************************************************/
+    public: uint64_t GetSize( void ) const;
+    public: uint64_t GetBlocksDecoded( void ) const { return mBlocksDecoded; }
+
+//------------------------------------------------------------------------------
+// Methods (internal to stream classes):
+//------------------------------------------------------------------------------
+
+    /***************************************************************************
+     * (For StreamInput.)
+     * Open the storage of the stream.
+     ***************************************************************************/
+    private: virtual bool Open( void ) override;
+
+    /***************************************************************************
+     * (For StreamInput.)
+     * Close the storage of the stream.
+     ***************************************************************************/
+    private: virtual bool Close( void ) override;
+
+    /***************************************************************************
+     * (For StreamInput.)
+     * Read from storage into a memory buffer.
+     * Returns:
+     * If > 0, number of bytes read.
+     * If <= 0, error or EOF (STREAM_ERROR,STREAM_EOF).
+     ***************************************************************************/
+    private: virtual StreamSize Read( char* buf/*OUT*/, const StreamSize count ) override;
+
+    /***************************************************************************
+     * (For StreamInput.)
+     * Move the read position (to any offset, past the end reads EOF).
+     ***************************************************************************/
+    private: virtual bool Seek( const uint64_t offset ) override;
+
+    /***************************************************************************
+     * Subroutines.
+     ***************************************************************************/
+    private: bool DecodeBlock( const uint64_t offset );
+
+//------------------------------------------------------------------------------
+// Data:
+//------------------------------------------------------------------------------
+
+    private: const string mPathname;       ///< pathname of compressed file
+    private: const uint64_t mMemLimit;     ///< decoder memory limit
+    private: bool         mOpen;           ///< if opened
+    private: StringBuffer mInputStringBuf; ///< will contain compressed file that was read
+    private: LzmaDecoderContext* mLzmaContext; ///< pooled decoder context
+    private: lzma_stream* mLzmaStream;     ///< underlying LZMA decoder (of mLzmaContext)
+    private: lzma_index*  mIndex;          ///< index of every stream in the file
+    private: uint64_t     mPosition;       ///< uncompressed read position
+    private: std::vector<char> mBlock;     ///< the last block decoded
+    private: uint64_t     mBlockOffset;    ///< its uncompressed offset
+    private: bool         mBlockValid;     ///< if mBlock holds a block
+    private: uint64_t     mBlocksDecoded;  ///< count of block decodes
+};
+
+} // namespace base
+
+#endif // STREAM_INPUT_STORAGE_LIBLZMA_INDEXED_HH
@@ -11,6 +11,7 @@
 #define BASE_STREAM_OUTPUT_CC 1
 #include <cstring>
 #include <cstdio> // EOF
+#include <algorithm>
 #include <limits>
 #include "base.hh"
 #include "stream_output.hh"
@@ -25,9 +26,9 @@ namespace base {
 /*******************************************************************************
  * 
  *******************************************************************************/
-StreamOutput::StreamOutput( shptr<StreamOutputStorage> streamOutputStorage )
+StreamOutput::StreamOutput( shptr<StreamOutputStorage> streamOutputStorage, const size_t bufferSize )
 :   std::ostream(0),  // call ctor variant instead of the default ctor (for arcane reason)
-    mStreamBuffer(streamOutputStorage)
+    mStreamBuffer(streamOutputStorage,bufferSize)
 {
 COMPILE_TIME_ASSERT( std::numeric_limits<StreamSize>::is_signed, "StreamSize should be signed" );
 
@@ -47,19 +48,41 @@ StreamOutput::~StreamOutput()
 /*******************************************************************************
  * 
  *******************************************************************************/
-StreamOutput::StreamBuffer::StreamBuffer( shptr<StreamOutputStorage> streamOutputStorage )
-:   mStreamOutputStorage(streamOutputStorage)
+StreamOutput::StreamBuffer::StreamBuffer( shptr<StreamOutputStorage> streamOutputStorage, const size_t bufferSize )
+:   mStreamOutputStorage(streamOutputStorage),
+    mBuffer(std::min<size_t>(bufferSize,std::numeric_limits<int>::max())),  // pbump() takes an int
+    mFailed(false)
 {
     // Open the storage of the stream.
     mStreamOutputStorage->Open();
+
+    // Put area.  Without one, every char goes through overflow().
+    if ( not mBuffer.empty() )
+        setp( &mBuffer[0], &mBuffer[0] + mBuffer.size() );
 }
 
 StreamOutput::StreamBuffer::~StreamBuffer()
 {
-    // Close the storage of the stream.
+    // Write the remaining partial chunk, then close the storage of the stream.
+    FlushBuffer();
     mStreamOutputStorage->Close();
 }
 
+/*******************************************************************************
+ * Write the put area to storage and empty it.
+ *******************************************************************************/
+bool StreamOutput::StreamBuffer::FlushBuffer( void )
+{
+    const StreamSize count = pptr() - pbase();
+    if ( count > 0 )
+    {
+        if ( UX( mStreamOutputStorage->Write( pbase(), count ) != count ) )
+            mFailed = true;
+        pbump( -int(count) );
+    }
+    return not mFailed;
+}
+
 /*******************************************************************************
  * 
  *******************************************************************************/
@@ -70,7 +93,15 @@ int StreamOutput::StreamBuffer::overflow( int c_int )
     ASSERT( (c_int >= 0) and (c_int <= 0xff) );
 
         char c = char(c_int);
-        return mStreamOutputStorage->Write( &c, 1 );
+        if ( mBuffer.empty() )
+            return mStreamOutputStorage->Write( &c, 1 ) == 1 ? c_int : EOF;
+
+        // The put area is full: write it as a whole chunk, then start the next with c.
+        if ( UX( not FlushBuffer() ) )
+            return EOF;
+        *pptr() = c;
+        pbump( 1 );
+        return c_int;
     }
     else
     {
@@ -80,7 +111,46 @@ int StreamOutput::StreamBuffer::overflow( int c_int )
 
 std::streamsize StreamOutput::StreamBuffer::xsputn( const char* buf, std::streamsize count )
 {
-    return mStreamOutputStorage->Write( buf, count );
+    const std::streamsize total = count;
+
+    // Fill the put area while it is partly used, and write it once it is full.
+    if ( pptr() != pbase() )
+    {
+        const std::streamsize avail = epptr() - pptr();
+        const std::streamsize n = std::min( count, avail );
+        std::memcpy( pptr(), buf, n );
+        pbump( int(n) );
+        if ( n == count )
+            return total;
+        if ( UX( not FlushBuffer() ) )
+            return n;
+        buf   += n;
+        count -= n;
+    }
+
+    // The put area is empty.  At least a chunk goes straight to storage, skipping the copy.
+    if ( count >= std::streamsize(mBuffer.size()) )
+    {
+        const StreamSize written = mStreamOutputStorage->Write( buf, count );
+        if ( UX( written != count ) )
+        {
+            mFailed = true;
+            return total - count + std::max<StreamSize>( written, 0 );
+        }
+        return total;
+    }
+    std::memcpy( pptr(), buf, count );
+    pbump( int(count) );
+    return total;
+}
+
+/*******************************************************************************
+ * A flush keeps a partial chunk in the put area (the encoder buffers its own
+ * output until Close() anyway), but reports an earlier failure to write.
+ *******************************************************************************/
+int StreamOutput::StreamBuffer::sync( void )
+{
+    return mFailed ? -1 : 0;
 }
 
 } // namespace base
@@ -13,7 +13,9 @@
 
 #include <iostream>
 #include <streambuf>
+#include <vector>
 #include "base.hh"
+#include "stream_defs.hh"
 
 namespace base {
 
@@ -32,6 +34,12 @@ class StreamOutputStorage;
 ///
 /// The streambuf code is derived from Nicolai Josuttis's STL book.
 ///
+/// Output is collected in a put area and handed to the storage in whole chunks,
+/// so writing a character at a time costs no more than a memory store.
+/// Writes at least as large as a chunk go to the storage directly.
+/// A flush (std::endl etc) doesn't break up chunks: the storage is written
+/// when the put area fills and when the stream is destroyed.
+///
 /// @verbatim
 /// Example:
 ///     StreamOutput out( new StreamOutputStorageDerived() );
@@ -48,9 +56,12 @@ PREVENT_COPYING(StreamOutput)
     /***************************************************************************
      * Compose StreamOutput with a StreamOutputStorage object.
      ***************************************************************************/
-    public: StreamOutput( shptr<StreamOutputStorage> streamOutputStorage );
+    public: StreamOutput( shptr<StreamOutputStorage> streamOutputStorage,
+                          const size_t bufferSize = DEFAULT_BUFFER_SIZE );  // 0 = unbuffered
     public: virtual ~StreamOutput();
 
+    public: CLASS_CONSTEXPR size_t DEFAULT_BUFFER_SIZE = 0x10000;
+
 //------------------------------------------------------------------------------
 // (internal class)
 //------------------------------------------------------------------------------
@@ -62,13 +73,17 @@ PREVENT_COPYING(StreamOutput)
     {
     PREVENT_COPYING(StreamBuffer)
         // Methods:
-        public: StreamBuffer( shptr<StreamOutputStorage> streamOutputStorage );
+        public: StreamBuffer( shptr<StreamOutputStorage> streamOutputStorage, const size_t bufferSize );
         public: virtual ~StreamBuffer();
-        private: virtual int overflow( int c ) override;  // write one char
+        private: virtual int overflow( int c ) override;  // put area is full: write one char
         private: virtual std::streamsize xsputn( const char* buf, std::streamsize count ) override;  // write multiple chars
+        private: virtual int sync( void ) override;
+        private: bool FlushBuffer( void );  // write the put area to storage
 
         // Data:
         private: shptr<StreamOutputStorage> mStreamOutputStorage;  ///< the storage of the stream
+        private: std::vector<char>          mBuffer;               ///< put area (empty if unbuffered)
+        private: bool                       mFailed;               ///< storage failed to write
     };
 
 //------------------------------------------------------------------------------
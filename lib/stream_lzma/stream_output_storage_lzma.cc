@@ -8,6 +8,7 @@
  ******************************************************************************/
 
 #define BASE_STREAM_OUTPUT_STORAGE_LZMA_CC 1
+#include <algorithm>
 #include "base.hh"
 #include "file.hh"
 #include "buffer_string.hh"
@@ -24,10 +25,14 @@ namespace base {
 /*******************************************************************************
  * 
  *******************************************************************************/
-StreamOutputStorageLZMA::StreamOutputStorageLZMA( const string& pathname )
+StreamOutputStorageLZMA::StreamOutputStorageLZMA( const string& pathname, const uint64_t blockSize,
+                                                  const uint32_t preset )
 :   mPathname(pathname),
     mOpen(false),
     mFile(nullptr),
+    mBlockSize(blockSize),
+    mPreset(preset),
+    mBlockFill(0),
     mOutputBuf{},  // std::array
     mLzmaStream{}
 {
@@ -68,11 +73,12 @@ ASSERT( not mPathname.empty() );
     mLzmaStream.avail_in  = 0;
     mLzmaStream.next_out  = nullptr;
     mLzmaStream.avail_out = 0;
-    if ( lzma_easy_encoder( &mLzmaStream, COMPRESSION_LEVEL, LZMA_CHECK_CRC64 ) != LZMA_OK )
+    if ( lzma_easy_encoder( &mLzmaStream, mPreset, LZMA_CHECK_CRC64 ) != LZMA_OK )
         throw std::runtime_error( "base:StreamOutputStorageLZMA: lzma_easy_encoder" );
 
     // Opened OK.
     mOpen = true;
+    mBlockFill = 0;
     return true;
 }
 
@@ -92,7 +98,7 @@ bool StreamOutputStorageLZMA::Close( void )
         mLzmaStream.avail_in  = 0;               // no more input
         mLzmaStream.next_out  = &mOutputBuf[0];
         mLzmaStream.avail_out = OUTPUT_BUF_SIZE;
-        CompressChunk( true/*inputHasClosed*/ );
+        CompressChunk( LZMA_FINISH );
 
         // 2. Close LZMA.
         lzma_end( &mLzmaStream );
@@ -116,17 +122,47 @@ bool StreamOutputStorageLZMA::Close( void )
  *******************************************************************************/
 StreamSize StreamOutputStorageLZMA::Write( const char* buf, const StreamSize count )
 {
-    mLzmaStream.next_in   = reinterpret_cast<const uchar*>(buf);
-    mLzmaStream.avail_in  = count;
-    mLzmaStream.next_out  = &mOutputBuf[0];
-    mLzmaStream.avail_out = OUTPUT_BUF_SIZE;
-    return CompressChunk( false/*inputHasClosed*/ );
+    if ( mBlockSize == 0 )
+    {
+        mLzmaStream.next_in   = reinterpret_cast<const uchar*>(buf);
+        mLzmaStream.avail_in  = count;
+        mLzmaStream.next_out  = &mOutputBuf[0];
+        mLzmaStream.avail_out = OUTPUT_BUF_SIZE;
+        return CompressChunk( LZMA_RUN );
+    }
+
+    // Split into blocks: the input up to the end of the current block,
+    // then LZMA_FULL_FLUSH ends the block (the next begins with more input).
+    StreamSize done = 0;
+    while ( done < count )
+    {
+        const StreamSize size = StreamSize( std::min<uint64_t>( count - done, mBlockSize - mBlockFill ) );
+        mLzmaStream.next_in   = reinterpret_cast<const uchar*>(buf + done);
+        mLzmaStream.avail_in  = size;
+        mLzmaStream.next_out  = &mOutputBuf[0];
+        mLzmaStream.avail_out = OUTPUT_BUF_SIZE;
+        if ( UX( CompressChunk( LZMA_RUN ) != size ) )
+            return defs::STREAM_ERROR;
+        done       += size;
+        mBlockFill += size;
+
+        if ( mBlockFill == mBlockSize )
+        {
+            mLzmaStream.avail_in  = 0;
+            mLzmaStream.next_out  = &mOutputBuf[0];
+            mLzmaStream.avail_out = OUTPUT_BUF_SIZE;
+            if ( UX( CompressChunk( LZMA_FULL_FLUSH ) < 0 ) )
+                return defs::STREAM_ERROR;
+            mBlockFill = 0;
+        }
+    }
+    return count;
 }
 
 /*******************************************************************************
  * 
  *******************************************************************************/
-StreamSize StreamOutputStorageLZMA::CompressChunk( const bool inputHasClosed )
+StreamSize StreamOutputStorageLZMA::CompressChunk( const lzma_action lzmaAction )
 {
 ASSERT( mOpen );
 ASSERT( mOutputBuf.size() >= OUTPUT_BUF_SIZE );  // >= because of extra padding
@@ -161,6 +197,8 @@ ASSERT( mOutputBuf.size() >= OUTPUT_BUF_SIZE );  // >= because of extra padding
     //   the output buffer is likely to be only partially
     //    full. Calculate how much new data there is to
     //    be written to the output file."
+    // - LZMA_FULL_FLUSH and LZMA_FINISH also return LZMA_STREAM_END
+    //   once the block or the stream has been written out.
     // .........................................................................
 
     if ( UX( not mOpen ) )
@@ -168,12 +206,11 @@ ASSERT( mOutputBuf.size() >= OUTPUT_BUF_SIZE );  // >= because of extra padding
 
     // Loop until the file has been successfully compressed or until an error occurs.
     const StreamSize count = mLzmaStream.avail_in;
-    lzma_action lzmaAction = inputHasClosed ? LZMA_FINISH : LZMA_RUN;
     while ( true )
     {
         // If input hasn't closed (count>0) but compression of this chunk is done,
         // then return the count, and this will be called again.
-        if ( (mLzmaStream.avail_in == 0) and (not inputHasClosed) )
+        if ( (mLzmaStream.avail_in == 0) and (lzmaAction == LZMA_RUN) )
             return count;
 
         // Run LZMA compression.
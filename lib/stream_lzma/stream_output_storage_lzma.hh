@@ -27,6 +27,10 @@ class StreamOutput;
 /// This implements the StreamOutputStorage interface using LZMA/XZ decompression.
 /// A generic StreamOutput object will call these methods.
 ///
+/// With a block size, the input is cut into .xz blocks of that many
+/// uncompressed bytes, whose sizes the index at the end of the file records,
+/// so StreamInputStorageLZMAIndexed can seek by decoding a single block.
+///
 class StreamOutputStorageLZMA final : public StreamOutputStorage
 {
 PREVENT_COPYING( StreamOutputStorageLZMA )
@@ -36,7 +40,6 @@ friend class StreamOutput;  // needs access to Open() etc
 // Definitions:
 //------------------------------------------------------------------------------
 
-    private: CLASS_CONSTEXPR uint COMPRESSION_LEVEL = 4;
     private: CLASS_CONSTEXPR uint OUTPUT_BUF_SIZE = 0x1000;
     private: enum class EWriteChunk { YES, NO };
 
@@ -47,10 +50,18 @@ friend class StreamOutput;  // needs access to Open() etc
     /***************************************************************************
      * @param   pathname
      *          Pathname of compressed file.
+     * @param   blockSize
+     *          Uncompressed bytes per .xz block, 0 for a single block.
+     *          Smaller blocks seek faster but compress a little worse.
+     * @param   preset
+     *          LZMA preset 0..9, optionally | LZMA_PRESET_EXTREME.
      ***************************************************************************/
-    public: StreamOutputStorageLZMA( const string& pathname );
+    public: StreamOutputStorageLZMA( const string& pathname, const uint64_t blockSize = 0,
+                                     const uint32_t preset = COMPRESSION_LEVEL );
     public: virtual ~StreamOutputStorageLZMA();
 
+    public: CLASS_CONSTEXPR uint COMPRESSION_LEVEL = 4;  ///< default preset
+
 //------------------------------------------------------------------------------
 // Methods (internal to stream classes):
 //------------------------------------------------------------------------------
@@ -79,7 +90,7 @@ friend class StreamOutput;  // needs access to Open() etc
     /***************************************************************************
      * Subroutines.
      ***************************************************************************/
-    private: StreamSize CompressChunk( const bool inputHasClosed );
+    private: StreamSize CompressChunk( const lzma_action lzmaAction );
 
 //------------------------------------------------------------------------------
 // Data:
@@ -90,6 +101,9 @@ friend class StreamOutput;  // needs access to Open() etc
     private: const string mPathname;   ///< pathname of compressed file
     private: bool         mOpen;       ///< if compressed file was opened
     private: FILE*        mFile;       ///< file to write into
+    private: const uint64_t mBlockSize; ///< uncompressed bytes per block, 0 if not split
+    private: const uint32_t mPreset;    ///< LZMA preset
+    private: uint64_t     mBlockFill;  ///< uncompressed bytes in the current block
     private: OutputBuf    mOutputBuf;  ///< holds output of LZMA which will be written to file
     private: lzma_stream  mLzmaStream; ///< underlying LZMA encoder/decoder
 };
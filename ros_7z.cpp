@@ -0,0 +1,738 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Reader for the 7z archives that payload entries may hold.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "ros_7z.hpp"
+
+using namespace std;
+
+const uint8_t ros_7z_archive::signature[6] = { '7', 'z', 0xBC, 0xAF, 0x27, 0x1C };
+
+namespace {
+
+// property IDs of the 7z headers
+enum {
+  K_END = 0x00,
+  K_HEADER = 0x01,
+  K_ARCHIVE_PROPERTIES = 0x02,
+  K_ADDITIONAL_STREAMS_INFO = 0x03,
+  K_MAIN_STREAMS_INFO = 0x04,
+  K_FILES_INFO = 0x05,
+  K_PACK_INFO = 0x06,
+  K_UNPACK_INFO = 0x07,
+  K_SUBSTREAMS_INFO = 0x08,
+  K_SIZE = 0x09,
+  K_CRC = 0x0A,
+  K_FOLDER = 0x0B,
+  K_CODERS_UNPACK_SIZE = 0x0C,
+  K_NUM_UNPACK_STREAM = 0x0D,
+  K_EMPTY_STREAM = 0x0E,
+  K_EMPTY_FILE = 0x0F,
+  K_NAME = 0x11,
+  K_ENCODED_HEADER = 0x17
+};
+
+const size_t signature_header_length = 32;
+const unsigned max_header_depth = 4;    // of headers compressed in headers
+const size_t decode_chunk = 64 * 1024;
+
+const lzma_vli copy_coder = LZMA_VLI_UNKNOWN - 1;
+
+// the coders liblzma decodes, by their 7z method IDs
+struct coder_method {
+  const char *id;
+  size_t id_length;
+  lzma_vli filter;
+};
+
+const struct coder_method coder_methods[] = {
+  { "\x00", 1, copy_coder },
+  { "\x21", 1, LZMA_FILTER_LZMA2 },
+  { "\x03\x01\x01", 3, LZMA_FILTER_LZMA1 },
+  { "\x03", 1, LZMA_FILTER_DELTA },
+  { "\x03\x03\x01\x03", 4, LZMA_FILTER_X86 },
+  { "\x03\x03\x02\x05", 4, LZMA_FILTER_POWERPC },
+  { "\x03\x03\x04\x01", 4, LZMA_FILTER_IA64 },
+  { "\x03\x03\x05\x01", 4, LZMA_FILTER_ARM },
+  { "\x03\x03\x07\x01", 4, LZMA_FILTER_ARMTHUMB },
+  { "\x03\x03\x08\x05", 4, LZMA_FILTER_SPARC },
+#if defined LZMA_FILTER_ARM64
+  { "\x0A", 1, LZMA_FILTER_ARM64 },
+#endif
+};
+
+/* Bounds-checked reading of header fields; after any read runs past the
+ * end, ok is false and every read returns 0
+ */
+struct reader {
+  const uint8_t *p, *end;
+  bool ok;
+
+  reader(const uint8_t *data, size_t length) : p(data), end(data + length), ok(true) {}
+
+  size_t left() const { return end - p; }
+
+  uint8_t byte() {
+    if (p == end) {
+      ok = false;
+      return 0;
+    }
+    return *p++;
+  }
+
+  uint32_t uint16() {
+    uint32_t low = byte();
+    return low | static_cast<uint32_t>(byte()) << 8;
+  }
+
+  uint32_t uint32() {
+    uint32_t value = 0;
+    for (unsigned i = 0; i < 4; ++i)
+      value |= static_cast<uint32_t>(byte()) << (8 * i);
+    return value;
+  }
+
+  uint64_t uint64() {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < 8; ++i)
+      value |= static_cast<uint64_t>(byte()) << (8 * i);
+    return value;
+  }
+
+  /* 7z's variable length number: the count of leading 1 bits of the first
+   * byte is the count of little-endian bytes following, and the rest of
+   * the first byte is the most significant part
+   */
+  uint64_t number() {
+    uint8_t first = byte();
+    uint8_t mask = 0x80;
+    uint64_t value = 0;
+    for (unsigned i = 0; i < 8; ++i, mask >>= 1) {
+      if (!(first & mask))
+        return value | (static_cast<uint64_t>(first & (mask - 1)) << (8 * i));
+      value |= static_cast<uint64_t>(byte()) << (8 * i);
+    }
+    return value;
+  }
+
+  /* A count of items that each take at least a bit, so a corrupt header
+   * cannot ask for more memory than it could describe
+   */
+  size_t count() {
+    uint64_t n = number();
+    if (n > static_cast<uint64_t>(left()) * 8 + 8)
+      ok = false;
+    return ok ? n : 0;
+  }
+
+  const uint8_t *take(uint64_t length) {
+    if (length > left()) {
+      ok = false;
+      return nullptr;
+    }
+    const uint8_t *data = p;
+    p += length;
+    return data;
+  }
+
+  vector<bool> bits(size_t n) {
+    vector<bool> v(n);
+    uint8_t b = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (!(i % 8))
+        b = byte();
+      v[i] = b & (0x80 >> (i % 8));
+    }
+    return v;
+  }
+
+  // a bit vector that may be stored as "all set"
+  vector<bool> defined(size_t n) {
+    return byte() ? vector<bool>(n, true) : bits(n);
+  }
+};
+
+void
+append_utf8(string &out, uint32_t c)
+{
+  if (c < 0x80)
+    out += static_cast<char>(c);
+  else if (c < 0x800) {
+    out += static_cast<char>(0xC0 | (c >> 6));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  }
+  else if (c < 0x10000) {
+    out += static_cast<char>(0xE0 | (c >> 12));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  }
+  else {
+    out += static_cast<char>(0xF0 | (c >> 18));
+    out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (c & 0x3F));
+  }
+}
+
+} // namespace
+
+// what a StreamsInfo block describes
+struct ros_7z_archive::streams {
+  vector<struct folder> folders;
+  vector<uint64_t> sizes;           // of the folders' sub-streams, in order
+  vector<bool> has_crc;
+  vector<uint32_t> crcs;
+  vector<unsigned> stream_folder;
+  vector<uint64_t> stream_offset;   // in the folder's output
+
+  bool read(reader &r, uint64_t data_offset, size_t archive_length);
+};
+
+bool
+ros_7z_archive::streams::read(reader &r, uint64_t data_offset, size_t archive_length)
+{
+  uint64_t pack_pos = 0;
+  vector<uint64_t> pack_sizes;
+  vector<uint64_t> folder_unpack_streams;
+  struct coder {
+    lzma_vli filter;                // LZMA_VLI_UNKNOWN if not decodable
+    uint64_t in, out;
+    string properties;
+  };
+  vector<vector<struct coder> > coders;
+  vector<vector<pair<uint64_t, uint64_t> > > bind_pairs;
+  vector<uint64_t> packed_streams;  // of each folder
+
+  uint8_t type = r.byte();
+  if (type == K_PACK_INFO) {
+    pack_pos = r.number();
+    pack_sizes.resize(r.count());
+    for (type = r.byte(); r.ok && type != K_END; type = r.byte())
+      if (type == K_SIZE)
+        for (size_t i = 0; i < pack_sizes.size(); ++i)
+          pack_sizes[i] = r.number();
+      else if (type == K_CRC) {
+        vector<bool> defined = r.defined(pack_sizes.size());
+        for (size_t i = 0; i < defined.size(); ++i)
+          if (defined[i])
+            r.uint32();
+      }
+      else
+        return false;
+    type = r.byte();
+  }
+
+  if (type == K_UNPACK_INFO) {
+    if (r.byte() != K_FOLDER)
+      return false;
+    folders.resize(r.count());
+    if (r.byte() != 0)
+      return false;   // folders stored elsewhere
+    coders.resize(folders.size());
+    bind_pairs.resize(folders.size());
+    packed_streams.resize(folders.size());
+    for (size_t f = 0; f < folders.size() && r.ok; ++f) {
+      uint64_t in_total = 0, out_total = 0;
+      coders[f].resize(r.count());
+      if (coders[f].empty())
+        return false;
+      for (size_t c = 0; c < coders[f].size() && r.ok; ++c) {
+        struct coder &coder = coders[f][c];
+        uint8_t flags = r.byte();
+        size_t id_length = flags & 0x0F;
+        const uint8_t *id = r.take(id_length);
+        coder.filter = LZMA_VLI_UNKNOWN;
+        for (size_t m = 0; id && m < sizeof(coder_methods) / sizeof(coder_methods[0]); ++m)
+          if (coder_methods[m].id_length == id_length && memcmp(coder_methods[m].id, id, id_length) == 0)
+            coder.filter = coder_methods[m].filter;
+        coder.in = coder.out = 1;
+        if (flags & 0x10) {
+          coder.in = r.number();
+          coder.out = r.number();
+          if (coder.in > 64 || coder.out > 64)
+            return false;
+        }
+        if (flags & 0x20) {
+          uint64_t length = r.number();
+          const uint8_t *properties = r.take(length);
+          if (properties)
+            coder.properties.assign(reinterpret_cast<const char *>(properties), length);
+        }
+        if (flags & 0x80)
+          return false;   // alternative methods were never written
+        in_total += coder.in;
+        out_total += coder.out;
+      }
+      if (!r.ok || !out_total || out_total - 1 > in_total)
+        return false;
+      bind_pairs[f].resize(out_total - 1);
+      for (size_t b = 0; b < bind_pairs[f].size(); ++b) {
+        bind_pairs[f][b].first = r.number();
+        bind_pairs[f][b].second = r.number();
+      }
+      packed_streams[f] = in_total - bind_pairs[f].size();
+      if (packed_streams[f] > 1)
+        for (uint64_t p = 0; p < packed_streams[f]; ++p)
+          r.number();
+    }
+
+    if (r.byte() != K_CODERS_UNPACK_SIZE)
+      return false;
+    vector<vector<uint64_t> > out_sizes(folders.size());
+    for (size_t f = 0; f < folders.size() && r.ok; ++f) {
+      uint64_t out_total = bind_pairs[f].size() + 1;
+      for (uint64_t o = 0; o < out_total; ++o)
+        out_sizes[f].push_back(r.number());
+    }
+    for (type = r.byte(); r.ok && type != K_END; type = r.byte())
+      if (type == K_CRC) {
+        vector<bool> defined = r.defined(folders.size());
+        for (size_t f = 0; f < folders.size(); ++f)
+          if ((folders[f].has_crc = defined[f]))
+            folders[f].crc = r.uint32();
+      }
+      else
+        return false;
+    if (!r.ok)
+      return false;
+
+    /* A folder liblzma can decode is a chain of coders of one stream in and
+     * out: the coder whose output is unbound gives the folder's output, and
+     * following the bind pairs from its input leads to the packed stream.
+     * liblzma wants the chain in encoding order, which is the same order.
+     */
+    uint64_t pack_index = 0;
+    for (size_t f = 0; f < folders.size(); ++f) {
+      struct folder &folder = folders[f];
+      const vector<struct coder> &chain = coders[f];
+      bool simple = packed_streams[f] == 1;
+      for (size_t c = 0; c < chain.size(); ++c)
+        simple = simple && chain[c].in == 1 && chain[c].out == 1;
+
+      uint64_t main = 0;
+      while (main < out_sizes[f].size()
+             && any_of(bind_pairs[f].begin(), bind_pairs[f].end(),
+                       [main](const pair<uint64_t, uint64_t> &b) { return b.second == main; }))
+        ++main;
+      if (main == out_sizes[f].size())
+        return false;
+      folder.size = out_sizes[f][main];
+      folder.supported = simple;
+
+      if (pack_index + packed_streams[f] > pack_sizes.size())
+        return false;
+      folder.pack_offset = data_offset + pack_pos;
+      for (uint64_t p = 0; p < pack_index; ++p)
+        folder.pack_offset += pack_sizes[p];
+      folder.pack_size = pack_sizes[pack_index];
+      pack_index += packed_streams[f];
+      if (folder.pack_offset > archive_length || folder.pack_size > archive_length - folder.pack_offset)
+        return false;
+
+      for (uint64_t c = main, n = 0; simple && n < chain.size(); ++n) {
+        if (chain[c].filter == LZMA_VLI_UNKNOWN) {
+          folder.supported = false;
+          break;
+        }
+        if (chain[c].filter != copy_coder) {
+          folder.filters.push_back(chain[c].filter);
+          folder.properties.push_back(chain[c].properties);
+          folder.sizes.push_back(out_sizes[f][c]);
+        }
+        auto next = find_if(bind_pairs[f].begin(), bind_pairs[f].end(),
+                            [c](const pair<uint64_t, uint64_t> &b) { return b.first == c; });
+        if (next == bind_pairs[f].end())
+          break;
+        c = next->second;
+        if (c >= chain.size())
+          return false;
+      }
+
+      // liblzma ends a chain with LZMA or LZMA2, and only there
+      for (size_t i = 0; i < folder.filters.size(); ++i) {
+        bool lzma = folder.filters[i] == LZMA_FILTER_LZMA1 || folder.filters[i] == LZMA_FILTER_LZMA2;
+        if (lzma != (i + 1 == folder.filters.size()))
+          folder.supported = false;
+      }
+      if (folder.filters.size() > LZMA_FILTERS_MAX)
+        folder.supported = false;
+    }
+    type = r.byte();
+  }
+
+  folder_unpack_streams.assign(folders.size(), 1);
+  bool substreams = type == K_SUBSTREAMS_INFO;
+  if (substreams) {
+    type = r.byte();
+    if (type == K_NUM_UNPACK_STREAM) {
+      for (size_t f = 0; f < folders.size(); ++f)
+        folder_unpack_streams[f] = r.count();
+      type = r.byte();
+    }
+  }
+  for (size_t f = 0; f < folders.size() && r.ok; ++f) {
+    uint64_t n = folder_unpack_streams[f], sum = 0;
+    if (!n)
+      continue;
+    if (n > 1 && type != K_SIZE)
+      return false;
+    for (uint64_t s = 0; s + 1 < n && r.ok; ++s) {
+      sizes.push_back(r.number());
+      sum += sizes.back();
+      if (sum > folders[f].size)
+        return false;
+    }
+    sizes.push_back(folders[f].size - sum);
+    for (uint64_t s = 0, offset = 0; s < n; ++s) {
+      stream_folder.push_back(f);
+      stream_offset.push_back(offset);
+      offset += sizes[stream_offset.size() - 1];
+    }
+  }
+  if (type == K_SIZE)
+    type = r.byte();
+
+  // a folder of one stream has its CRC already; the others are listed here
+  has_crc.assign(sizes.size(), false);
+  crcs.assign(sizes.size(), 0);
+  size_t unknown = 0;
+  for (size_t f = 0, s = 0; f < folders.size(); s += folder_unpack_streams[f], ++f)
+    if (folder_unpack_streams[f] == 1 && folders[f].has_crc) {
+      has_crc[s] = true;
+      crcs[s] = folders[f].crc;
+    }
+    else
+      unknown += folder_unpack_streams[f];
+  for (; substreams && r.ok && type != K_END; type = r.byte())
+    if (type == K_CRC) {
+      vector<bool> defined = r.defined(unknown);
+      size_t d = 0;
+      for (size_t f = 0, s = 0; f < folders.size(); s += folder_unpack_streams[f], ++f)
+        if (!(folder_unpack_streams[f] == 1 && folders[f].has_crc))
+          for (uint64_t i = 0; i < folder_unpack_streams[f]; ++i, ++d)
+            if ((has_crc[s + i] = defined[d]))
+              crcs[s + i] = r.uint32();
+    }
+    else
+      return false;
+  if (substreams)
+    type = r.byte();
+  return r.ok && type == K_END;
+}
+
+ros_7z_archive::ros_7z_archive()
+  : base(nullptr), base_length(0), memory_limit(UINT64_MAX)
+{
+}
+
+bool
+ros_7z_archive::fail(const char *what)
+{
+  message = what;
+  return false;
+}
+
+bool
+ros_7z_archive::supported() const
+{
+  for (size_t f = 0; f < folders.size(); ++f)
+    if (!folders[f].supported)
+      return false;
+  return true;
+}
+
+bool
+ros_7z_archive::open(const void *data, size_t length, uint64_t memlimit)
+{
+  base = static_cast<const uint8_t *>(data);
+  base_length = length;
+  memory_limit = memlimit;
+  folders.clear();
+  files.clear();
+  message.clear();
+
+  if (length < signature_header_length || memcmp(base, signature, sizeof(signature)) != 0)
+    return fail("not a 7z archive");
+  if (base[6] != 0)
+    return fail("unknown 7z version");
+  reader r(base + 8, signature_header_length - 8);
+  uint32_t start_crc = r.uint32();
+  if (lzma_crc32(base + 12, signature_header_length - 12, 0) != start_crc)
+    return fail("7z start header CRC does not match");
+  uint64_t next_offset = r.uint64(), next_length = r.uint64();
+  uint32_t next_crc = r.uint32();
+  if (next_offset > length - signature_header_length
+      || next_length > length - signature_header_length - next_offset)
+    return fail("7z header runs past the end of the archive");
+  if (!next_length)
+    return true;  // an empty archive
+  const uint8_t *header = base + signature_header_length + next_offset;
+  if (lzma_crc32(header, next_length, 0) != next_crc)
+    return fail("7z header CRC does not match");
+  return parse_header(header, next_length, 0);
+}
+
+bool
+ros_7z_archive::parse_header(const uint8_t *data, size_t length, unsigned depth)
+{
+  reader r(data, length);
+  uint8_t type = r.byte();
+
+  if (type == K_ENCODED_HEADER) {
+    // the real header is the output of the folders described here
+    struct streams packed;
+    if (depth == max_header_depth || !packed.read(r, signature_header_length, base_length))
+      return fail("7z encoded header is not valid");
+    vector<uint8_t> header;
+    for (size_t f = 0; f < packed.folders.size(); ++f) {
+      if (!packed.folders[f].supported)
+        return fail("7z header is compressed with an unsupported method");
+      string error;
+      if (!decode(packed.folders[f], [&header](const uint8_t *out, size_t out_length) {
+            header.insert(header.end(), out, out + out_length);
+            return true;
+          }, error))
+        return fail(("7z header: " + error).c_str());
+    }
+    return parse_header(header.data(), header.size(), depth + 1);
+  }
+  if (type != K_HEADER)
+    return fail("7z header is not valid");
+
+  type = r.byte();
+  if (type == K_ARCHIVE_PROPERTIES) {
+    for (type = r.byte(); r.ok && type != K_END; type = r.byte())
+      r.take(r.number());
+    type = r.byte();
+  }
+  if (type == K_ADDITIONAL_STREAMS_INFO) {
+    struct streams additional;
+    if (!additional.read(r, signature_header_length, base_length))
+      return fail("7z header is not valid");
+    type = r.byte();
+  }
+
+  struct streams main;
+  if (type == K_MAIN_STREAMS_INFO) {
+    if (!main.read(r, signature_header_length, base_length))
+      return fail("7z streams are not valid");
+    type = r.byte();
+  }
+
+  if (type == K_FILES_INFO) {
+    size_t count = r.count();
+    vector<bool> empty_stream(count, false);
+    vector<string> names(count);
+    for (type = r.byte(); r.ok && type != K_END; type = r.byte()) {
+      uint64_t property_length = r.number();
+      const uint8_t *property = r.take(property_length);
+      if (!property)
+        break;
+      reader p(property, property_length);
+      if (type == K_EMPTY_STREAM)
+        empty_stream = p.bits(count);
+      else if (type == K_NAME) {
+        if (p.byte() != 0)
+          return fail("7z file names are stored elsewhere");
+        for (size_t i = 0; i < count && p.ok; ++i)
+          for (uint32_t c = p.uint16(); p.ok && c; c = p.uint16()) {
+            if (c >= 0xD800 && c < 0xDC00) {
+              uint32_t low = p.uint16();
+              c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            }
+            append_utf8(names[i], c);
+          }
+      }
+      // K_EMPTY_FILE, times, attributes and padding do not matter here
+      if (!p.ok)
+        return fail("7z file information is not valid");
+    }
+
+    size_t stream = 0;
+    files.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      struct ros_7z_member &member = files[i];
+      member.name.swap(names[i]);
+      member.has_stream = !empty_stream[i];
+      member.size = 0;
+      member.folder = 0;
+      member.offset = 0;
+      member.has_crc = false;
+      member.crc = 0;
+      if (!member.has_stream)
+        continue;
+      if (stream == main.sizes.size())
+        return fail("7z archive has more files than streams");
+      member.size = main.sizes[stream];
+      member.folder = main.stream_folder[stream];
+      member.offset = main.stream_offset[stream];
+      member.has_crc = main.has_crc[stream];
+      member.crc = main.crcs[stream];
+      main.folders[member.folder].members.push_back(i);
+      ++stream;
+    }
+    type = r.byte();
+  }
+  if (!r.ok || type != K_END)
+    return fail("7z header is not valid");
+
+  folders.swap(main.folders);
+  return true;
+}
+
+bool
+ros_7z_archive::decode(const struct folder &f, const function<bool(const uint8_t *, size_t)> &fn,
+                       string &error) const
+{
+  const uint8_t *in = base + f.pack_offset;
+  if (f.filters.empty()) {
+    if (f.pack_size < f.size) {
+      error = "stored data is truncated";
+      return false;
+    }
+    return fn(in, f.size);
+  }
+
+  lzma_filter chain[LZMA_FILTERS_MAX + 1];
+  size_t n = 0;
+  bool ok = true;
+  for (; n < f.filters.size() && ok; ++n) {
+    chain[n].id = f.filters[n];
+    chain[n].options = nullptr;
+    ok = lzma_properties_decode(&chain[n], nullptr, reinterpret_cast<const uint8_t *>(f.properties[n].data()),
+                                f.properties[n].size()) == LZMA_OK;
+#if defined LZMA_FILTER_LZMA1EXT
+    /* 7z stores LZMA without an end marker, so tell the decoder the size:
+     * it then ends the stream, which lets a filter before it flush its
+     * last bytes
+     */
+    if (ok && chain[n].id == LZMA_FILTER_LZMA1) {
+      lzma_options_lzma *options = static_cast<lzma_options_lzma *>(chain[n].options);
+      chain[n].id = LZMA_FILTER_LZMA1EXT;
+      options->ext_flags = LZMA_LZMA1EXT_ALLOW_EOPM;
+      options->ext_size_low = static_cast<uint32_t>(f.sizes[n]);
+      options->ext_size_high = static_cast<uint32_t>(f.sizes[n] >> 32);
+    }
+#endif
+  }
+  chain[n].id = LZMA_VLI_UNKNOWN;
+  chain[n].options = nullptr;
+
+  lzma_stream stream = LZMA_STREAM_INIT;
+  if (!ok)
+    error = "coder properties are not valid";
+  else if (lzma_raw_decoder_memusage(chain) > memory_limit) {
+    error = "decoding needs more memory than the limit";
+    ok = false;
+  }
+  else if (lzma_raw_decoder(&stream, chain) != LZMA_OK) {
+    error = "coders cannot be set up";
+    ok = false;
+  }
+  for (size_t i = 0; i < n; ++i)
+    free(chain[i].options);
+
+  bool stopped = false;
+  uint64_t produced = 0;
+  if (ok) {
+    vector<uint8_t> out(decode_chunk);
+    stream.next_in = in;
+    stream.avail_in = f.pack_size;
+    lzma_ret ret = LZMA_OK;
+    while (ret == LZMA_OK && produced < f.size && !stopped) {
+      stream.next_out = out.data();
+      stream.avail_out = min<uint64_t>(out.size(), f.size - produced);
+      ret = lzma_code(&stream, LZMA_RUN);
+      size_t length = stream.next_out - out.data();
+      produced += length;
+      if (length)
+        stopped = !fn(out.data(), length);
+    }
+    lzma_end(&stream);
+    if (!stopped && produced < f.size) {
+      error = ret == LZMA_MEMLIMIT_ERROR ? "decoding needs more memory than the limit" : "compressed data is corrupt";
+      ok = false;
+    }
+  }
+  return ok && !stopped;
+}
+
+bool
+ros_7z_archive::extract(unsigned folder, const member_fn &fn, string &error) const
+{
+  const struct folder &f = folders[folder];
+  if (!f.supported) {
+    error = "compressed with an unsupported method";
+    return false;
+  }
+
+  size_t m = 0;
+  uint64_t left = 0;
+  uint32_t crc = 0;
+  bool stopped = false;
+  // the next member with data, calling fn to complete those without
+  auto next_member = [&]() {
+    for (; m < f.members.size() && !stopped; ++m) {
+      left = files[f.members[m]].size;
+      crc = 0;
+      if (left)
+        return;
+      stopped = !fn(f.members[m], nullptr, 0);
+    }
+  };
+  next_member();
+  bool ok = decode(f, [&](const uint8_t *out, size_t length) {
+      while (length && m < f.members.size() && !stopped) {
+        const struct ros_7z_member &member = files[f.members[m]];
+        size_t take = min<uint64_t>(length, left);
+        crc = lzma_crc32(out, take, crc);
+        stopped = !fn(f.members[m], out, take);
+        out += take;
+        length -= take;
+        left -= take;
+        if (!left && !stopped) {
+          if (member.has_crc && crc != member.crc) {
+            error = "CRC of " + member.name + " does not match";
+            return false;
+          }
+          stopped = !fn(f.members[m], nullptr, 0);
+          ++m;
+          next_member();
+        }
+      }
+      return !stopped;
+    }, error);
+  return ok && !stopped;
+}
+
+bool
+ros_7z_archive::extract(const member_fn &fn, string &error) const
+{
+  for (unsigned f = 0; f < folders.size(); ++f)
+    if (!extract(f, fn, error))
+      return false;
+  return true;
+}
@@ -0,0 +1,115 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Reader for the 7z archives that payload entries may hold.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_7Z_HPP__
+#define __ROS_7Z_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <lzma.h>
+
+struct ros_7z_member {
+  std::string name;     // UTF-8
+  uint64_t size;
+  bool has_stream;      // false for directories and empty files
+  unsigned folder;      // holding its data, if it has a stream
+  uint64_t offset;      // of its data in the folder's output
+  bool has_crc;
+  uint32_t crc;
+};
+
+/* Reads a 7z archive held in memory, which must stay there while it is
+ * used. The archive's data is in folders, each a packed stream decoded by
+ * a chain of coders into the data of one or more members in turn.
+ *
+ * liblzma decodes the coders: LZMA, LZMA2, Delta and the branch/call/jump
+ * filters, in chains of single-stream coders, or data that is only stored.
+ * A folder with any other coder (Deflate, BZip2, BCJ2, AES ...) is opened
+ * but cannot be extracted. Headers may themselves be compressed.
+ *
+ * open() parses only the headers. After that an archive is only read, so
+ * extract() may be called from several threads at once.
+ */
+class ros_7z_archive {
+  public:
+    static const uint8_t signature[6];
+
+    ros_7z_archive();
+
+    /* Parse the headers; false with a description in error() if the data
+     * is not a 7z archive or one that can be read. memlimit bounds the
+     * memory of each decoder.
+     */
+    bool open(const void *data, size_t length, uint64_t memlimit = UINT64_MAX);
+
+    const std::vector<struct ros_7z_member> &members() const { return files; }
+    unsigned folder_count() const { return folders.size(); }
+    bool folder_supported(unsigned folder) const { return folders[folder].supported; }
+    bool supported() const;     // every folder can be decoded
+    const std::string &error() const { return message; }
+
+    /* Uncompress the members stored in a folder, or in every folder, in
+     * the order they are stored: fn is passed each member's data in pieces
+     * as it is decoded, then called once with length 0 when the member is
+     * complete and its CRC checked. fn returns false to stop. Returns false
+     * if fn stopped it, or with a description in error if a folder could
+     * not be decoded or a CRC does not match.
+     */
+    typedef std::function<bool(unsigned member, const uint8_t *data, size_t length)> member_fn;
+    bool extract(unsigned folder, const member_fn &fn, std::string &error) const;
+    bool extract(const member_fn &fn, std::string &error) const;
+
+  private:
+    struct folder {
+      uint64_t pack_offset;     // in the archive
+      uint64_t pack_size;
+      uint64_t size;            // of its output
+      bool supported;
+      bool has_crc;
+      uint32_t crc;
+      std::vector<lzma_vli> filters;    // decode chain in liblzma order, empty if only stored
+      std::vector<std::string> properties;
+      std::vector<uint64_t> sizes;      // of each filter's output
+      std::vector<unsigned> members;
+    };
+
+    struct streams;
+
+    bool parse_header(const uint8_t *data, size_t length, unsigned depth);
+    bool decode(const struct folder &f, const std::function<bool(const uint8_t *, size_t)> &fn,
+                std::string &error) const;
+    bool fail(const char *what);
+
+    const uint8_t *base;
+    size_t base_length;
+    uint64_t memory_limit;
+    std::vector<struct folder> folders;
+    std::vector<struct ros_7z_member> files;
+    std::string message;
+};
+
+#endif
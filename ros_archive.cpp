@@ -0,0 +1,95 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Primary header and directory of an archive, parsed and checked.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#include "ros_archive.hpp"
+
+ros_archive::ros_archive()
+  : header_sum(0), directory_sum(0)
+{
+  memset(&raw, 0, sizeof(raw));
+  memset(&info, 0, sizeof(info));
+}
+
+enum ros_archive_status
+ros_archive::parse_header(const void *data, size_t length, uint64_t file_length)
+{
+  entry_table.clear();
+  header_sum = 0;
+  directory_sum = 0;
+  if (length < sizeof(struct ros_header_version))
+    return ROS_ARCHIVE_SHORT_HEADER;
+
+  // a copy, so a short file reads as zeros rather than past its end
+  memset(&raw, 0, sizeof(raw));
+  memcpy(&raw, data, length < sizeof(raw) ? length : sizeof(raw));
+
+  // the header is only read through views in the archive's byte order, decided once here
+  enum ros_byte_order order = ros_detect_order(&raw, length, file_length);
+  if (!ros_parse_header(&raw, order, info))
+    return ROS_ARCHIVE_UNKNOWN_VERSION;
+
+  if (info.version > 1) {
+    // the checksum field itself counts as zero; a byte sum does not depend on the byte order
+    const char *bytes = reinterpret_cast<const char *>(&raw);
+    header_sum = 0xFFFFFFFF - (checksum_calc(0, bytes, sizeof(struct ros_header_v2))
+                               - checksum_calc(0, bytes + offsetof(struct ros_header_v2, header_checksum.checksum),
+                                               sizeof raw.v2.header_checksum.checksum));
+  }
+  return ROS_ARCHIVE_OK;
+}
+
+char *
+ros_archive::directory_buffer()
+{
+  dirents.resize(info.dir_entries_qty);
+  return reinterpret_cast<char *>(dirents.data());
+}
+
+enum ros_archive_status
+ros_archive::load_directory(size_t length)
+{
+  if (length != directory_length())
+    return ROS_ARCHIVE_SHORT_DIRECTORY;
+
+  directory_sum = checksum_calc(0, reinterpret_cast<const char *>(dirents.data()), length);
+  ros_load_dirents(dirents.data(), info.dir_entries_qty, info.order, dirents.data());
+
+  entry_table.assign(info.dir_entries_qty, ros_entry());
+  for (unsigned i = 0; i < info.dir_entries_qty; ++i) {
+    entry_table[i].index = i;
+    entry_table[i].dirent = dirents[i];
+    entry_table[i].data_sig = DATA_SIG_NONE;
+  }
+  return ROS_ARCHIVE_OK;
+}
+
+enum ros_archive_status
+ros_archive::load_directory(const void *data, size_t length)
+{
+  if (length < directory_length())
+    return ROS_ARCHIVE_SHORT_DIRECTORY;
+  memcpy(directory_buffer(), data, directory_length());
+  return load_directory(directory_length());
+}
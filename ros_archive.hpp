@@ -0,0 +1,93 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Primary header and directory of an archive, parsed and checked.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_ARCHIVE_HPP__
+#define __ROS_ARCHIVE_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "ros_pack.hpp"
+#include "ros_payload.hpp"
+#include "ros_view.hpp"
+
+/* Why an archive could not be parsed; the values are ros_unpack's exit codes */
+enum ros_archive_status {
+  ROS_ARCHIVE_OK = 0,
+  ROS_ARCHIVE_SHORT_HEADER = 4,     // not even the header version is there
+  ROS_ARCHIVE_UNKNOWN_VERSION = 5,
+  ROS_ARCHIVE_SHORT_DIRECTORY = 6
+};
+
+/* The primary header and directory of one archive, from wherever the bytes
+ * come from: the caller reads or maps them and hands them over. The stored
+ * directory is checksummed as it is, then converted to host order into the
+ * entries, ready for the payload to be processed.
+ *
+ * All the state of an archive is here, so any number of archives can be
+ * parsed at once on different threads. Parsing the next archive into the
+ * same object reuses its tables.
+ */
+class ros_archive {
+  public:
+    ros_archive();
+
+    /* From the first length bytes of a file of file_length bytes */
+    enum ros_archive_status parse_header(const void *data, size_t length, uint64_t file_length);
+
+    const struct ros_archive_header &header() const { return info; }
+    enum ros_byte_order order() const { return info.order; }
+    uint32_t header_checksum() const { return header_sum; }   // calculated, v2 only
+    /* what the header records for the payload: the inner payload of v2 */
+    const struct ros_header_checksum &payload() const { return info.version > 1 ? info.payload_inner : info.payload; }
+
+    uint64_t directory_offset() const { return info.length; }
+    size_t directory_length() const { return info.dir_entries_qty * sizeof(struct ros_dirent); }
+
+    /* directory_length() bytes for the stored directory to be read into,
+     * then load_directory() with the number of bytes read
+     */
+    char *directory_buffer();
+    enum ros_archive_status load_directory(size_t length);
+    /* or copy the stored directory from memory */
+    enum ros_archive_status load_directory(const void *data, size_t length);
+
+    unsigned directory_checksum() const { return directory_sum; } // the start of the payload checksum
+    unsigned entry_count() const { return entry_table.size(); }
+    struct ros_entry *entries() { return entry_table.data(); }
+    const struct ros_entry *entries() const { return entry_table.data(); }
+
+  private:
+    union {
+      struct ros_header_v1 v1;
+      struct ros_header_v2 v2;
+    } raw;                              // the header as stored
+    struct ros_archive_header info;
+    uint32_t header_sum;
+    unsigned directory_sum;
+    std::vector<struct ros_dirent> dirents;
+    std::vector<struct ros_entry> entry_table;
+};
+
+#endif
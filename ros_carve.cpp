@@ -0,0 +1,382 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Search entry data for embedded objects by their signatures.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif
+#include "ros_carve.hpp"
+
+using namespace std;
+
+/* Positions in data[0, length) of bytes in the set, 16 at a time: the low
+ * nibble of each byte picks a bit mask from the tables, and the byte is in
+ * the set if the mask has the bit for its high nibble.
+ */
+#if defined __x86_64__ || defined __i386__
+__attribute__((target("ssse3")))
+static unsigned
+find_bytes_ssse3(const uint8_t *low_clear, const uint8_t *low_set, const unsigned char *data, unsigned length,
+                 vector<uint32_t> &found)
+{
+  const __m128i clear = _mm_loadu_si128(reinterpret_cast<const __m128i *>(low_clear));
+  const __m128i set = _mm_loadu_si128(reinterpret_cast<const __m128i *>(low_set));
+  const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m128i high = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i seven = _mm_set1_epi8(7);
+  const __m128i zero = _mm_setzero_si128();
+
+  unsigned i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    // pshufb gives 0 where the index has its top bit set, so each table only answers for its half
+    __m128i masks = _mm_or_si128(_mm_shuffle_epi8(clear, v), _mm_shuffle_epi8(set, _mm_xor_si128(v, high)));
+    __m128i bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(v, 4), seven));
+    unsigned hits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(masks, bit), zero)) & 0xFFFF;
+    while (hits) {
+      found.push_back(i + __builtin_ctz(hits));
+      hits &= hits - 1;
+    }
+  }
+  return i;
+}
+#endif
+
+static void
+find_bytes(const uint8_t *low_clear, const uint8_t *low_set, const unsigned char *data, unsigned length,
+           vector<uint32_t> &found)
+{
+  unsigned i = 0;
+#if defined __x86_64__ || defined __i386__
+  static const bool ssse3 = __builtin_cpu_supports("ssse3");
+  if (ssse3)
+    i = find_bytes_ssse3(low_clear, low_set, data, length, found);
+#endif
+  for (; i < length; ++i) {
+    const uint8_t *table = data[i] & 0x80 ? low_set : low_clear;
+    if (table[data[i] & 0x0F] & (1 << ((data[i] >> 4) & 7)))
+      found.push_back(i);
+  }
+}
+
+/* How far past a start position the anchors the carver uses look; those
+ * anchored further in than half a block are left out rather than making
+ * every block carry that much of the next.
+ */
+static unsigned
+anchor_reach(const ros_sig_db &sigs, unsigned a)
+{
+  return sigs.anchor_offset(a) + sigs.anchor_depth(a);
+}
+
+static unsigned
+carve_reach(const ros_sig_db &sigs, unsigned limit)
+{
+  unsigned reach = 0;
+  for (unsigned a = 0; a < sigs.anchor_count(); ++a)
+    if (anchor_reach(sigs, a) <= limit && anchor_reach(sigs, a) > reach)
+      reach = anchor_reach(sigs, a);
+  return reach;
+}
+
+ros_carver::ros_carver(ros_io *io, const ros_sig_db &sigs, unsigned workers, bool extract)
+  : io(io), sigs(sigs), extract(extract), reach(carve_reach(sigs, block_size / 2)), buffers(block_size + reach),
+    position(0), current(nullptr), previous(nullptr), out_fd(-1), out_base(0), stopping(false)
+{
+  for (unsigned a = 0; a < sigs.anchor_count(); ++a) {
+    if (anchor_reach(sigs, a) > block_size / 2)
+      continue;
+    anchors.push_back(a);
+
+    struct byte_set set;
+    memset(&set, 0, sizeof(set));
+    for (unsigned byte = 0; byte < 256; ++byte)
+      if (sigs.anchor_starts(a, byte))
+        (byte & 0x80 ? set.low_set : set.low_clear)[byte & 0x0F] |= 1 << ((byte >> 4) & 7);
+    first_bytes.push_back(set);
+  }
+
+  if (!workers)
+    workers = 1;
+  // two for the feeding thread, the rest for the workers to be busy with
+  for (unsigned i = 0; i < workers + 4; ++i) {
+    struct block *b = new struct block;
+    b->buffer = buffers.get();
+    blocks.push_back(b);
+    free_blocks.push_back(b);
+  }
+  memset(&counts, 0, sizeof(counts));
+  for (unsigned i = 0; i < workers; ++i)
+    threads.push_back(thread(&ros_carver::work, this));
+}
+
+ros_carver::~ros_carver()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  work_ready.notify_all();
+  for (unsigned i = 0; i < threads.size(); ++i)
+    threads[i].join();
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    buffers.put(blocks[i]->buffer);
+    delete blocks[i];
+  }
+  if (out_fd >= 0)
+    close(out_fd);
+}
+
+void
+ros_carver::begin_entry(const char *name)
+{
+  this->name = name;
+  position = 0;
+  entry_found.clear();
+}
+
+struct ros_carver::block *
+ros_carver::get_block()
+{
+  while (free_blocks.empty())
+    retire(true);
+  struct block *b = free_blocks.back();
+  free_blocks.pop_back();
+  b->length = 0;
+  b->extension = 0;
+  b->base = position;
+  b->scanned = false;
+  b->found.clear();
+  return b;
+}
+
+void
+ros_carver::feed(const char *data, unsigned length)
+{
+  while (length) {
+    if (!current)
+      current = get_block();
+    unsigned n = block_size - current->length < length ? block_size - current->length : length;
+    memcpy(current->buffer + current->length, data, n);
+    current->length += n;
+    position += n;
+    data += n;
+    length -= n;
+
+    if (previous && current->length >= reach) {
+      dispatch(previous, current);
+      previous = nullptr;
+    }
+    if (current->length == block_size) {
+      if (previous)
+        dispatch(previous, current);
+      previous = current;
+      current = nullptr;
+    }
+  }
+  while (retire(false))
+    ;
+}
+
+/* Queue a block for the workers with the start of the block after it */
+void
+ros_carver::dispatch(struct block *b, const struct block *next)
+{
+  if (next) {
+    b->extension = next->length < reach ? next->length : reach;
+    memcpy(b->buffer + b->length, next->buffer, b->extension);
+  }
+  in_flight.push_back(b);
+  {
+    lock_guard<mutex> guard(lock);
+    queue.push_back(b);
+  }
+  work_ready.notify_one();
+}
+
+/* Retire the oldest block once it has been scanned; false if it has not */
+bool
+ros_carver::retire(bool wait)
+{
+  if (in_flight.empty())
+    return false;
+  struct block *b = in_flight.front();
+  {
+    unique_lock<mutex> guard(lock);
+    while (!b->scanned) {
+      if (!wait)
+        return false;
+      work_done.wait(guard);
+    }
+  }
+  in_flight.pop_front();
+
+  if (extract)
+    write_out(*b);
+  else
+    entry_found.insert(entry_found.end(), b->found.begin(), b->found.end());
+  free_blocks.push_back(b);
+  return true;
+}
+
+/* Write the block's data to the objects it holds, starting a file at each */
+void
+ros_carver::write_out(const struct block &b)
+{
+  unsigned done = 0;
+  for (unsigned i = 0; i <= b.found.size(); ++i) {
+    unsigned until = i < b.found.size() ? b.found[i].offset - b.base : b.length;
+    if (out_fd >= 0 && until > done) {
+      uint64_t at = b.base + done - out_base;
+      if (io->write_at(out_fd, b.buffer + done, until - done, at) != static_cast<ssize_t>(until - done))
+        entry_found.back().write_error = true;
+    }
+    done = until;
+    if (i == b.found.size())
+      break;
+
+    if (out_fd >= 0) {
+      close(out_fd);
+      entry_found.back().extracted = !entry_found.back().write_error;
+    }
+    entry_found.push_back(b.found[i]);
+    char suffix[24];
+    snprintf(suffix, sizeof(suffix), "-%08llx", static_cast<unsigned long long>(b.found[i].offset));
+    out_fd = open((name + suffix).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    out_base = b.found[i].offset;
+    if (out_fd < 0)
+      entry_found.back().write_error = true;
+  }
+}
+
+void
+ros_carver::end_entry(vector<struct ros_carve_match> &found)
+{
+  if (previous) {
+    dispatch(previous, current);
+    previous = nullptr;
+  }
+  if (current) {
+    dispatch(current, nullptr);
+    current = nullptr;
+  }
+  while (retire(true))
+    ;
+
+  if (out_fd >= 0) {
+    close(out_fd);
+    out_fd = -1;
+    entry_found.back().extracted = !entry_found.back().write_error;
+  }
+  for (unsigned i = 0; i < entry_found.size(); ++i)
+    entry_found[i].length = (i + 1 < entry_found.size() ? entry_found[i + 1].offset : position) - entry_found[i].offset;
+  found.swap(entry_found);
+  entry_found.clear();
+}
+
+struct ros_phase_stats
+ros_carver::take_stats()
+{
+  lock_guard<mutex> guard(lock);
+  struct ros_phase_stats taken = counts;
+  memset(&counts, 0, sizeof(counts));
+  return taken;
+}
+
+void
+ros_carver::work()
+{
+  vector<uint32_t> candidates;
+  for (;;) {
+    struct block *b;
+    {
+      unique_lock<mutex> guard(lock);
+      while (queue.empty() && !stopping)
+        work_ready.wait(guard);
+      if (queue.empty())
+        return;
+      b = queue.front();
+      queue.pop_front();
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    scan(*b, candidates);
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    {
+      lock_guard<mutex> guard(lock);
+      b->scanned = true;
+      counts.ns += ns;
+      counts.bytes += b->length;
+      ++counts.calls;
+    }
+    work_done.notify_all();
+  }
+}
+
+/* Find the objects that start in the block, at most one per position */
+void
+ros_carver::scan(struct block &b, vector<uint32_t> &candidates)
+{
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(b.buffer);
+  const unsigned available = b.length + b.extension;
+
+  for (unsigned i = 0; i < anchors.size(); ++i) {
+    const unsigned a = anchors[i];
+    const unsigned offset = sigs.anchor_offset(a);
+    if (offset >= available)
+      continue;
+    // the anchor byte of a start position in the block, as far as the data goes
+    unsigned length = b.length < available - offset ? b.length : available - offset;
+    candidates.clear();
+    find_bytes(first_bytes[i].low_clear, first_bytes[i].low_set, data + offset, length, candidates);
+
+    for (unsigned c = 0; c < candidates.size(); ++c) {
+      const unsigned start = candidates[c];
+      unsigned magic_length;
+      int sig = sigs.match_anchor(a, b.buffer + start + offset, available - start - offset, magic_length);
+      if (sig == DATA_SIG_NONE || magic_length < min_magic)
+        continue;
+      struct ros_carve_match match = { b.base + start, magic_length, sig, false, false };
+      b.found.push_back(match);
+    }
+  }
+
+  // order by position; where several anchors matched at one, keep the longest magic
+  sort(b.found.begin(), b.found.end(), [](const struct ros_carve_match &x, const struct ros_carve_match &y) {
+    return x.offset != y.offset ? x.offset < y.offset : x.length != y.length ? x.length > y.length : x.sig > y.sig;
+  });
+  unsigned kept = 0;
+  for (unsigned i = 0; i < b.found.size(); ++i)
+    if (!kept || b.found[kept - 1].offset != b.found[i].offset)
+      b.found[kept++] = b.found[i];
+  b.found.resize(kept);
+  for (unsigned i = 0; i < kept; ++i)
+    b.found[i].length = 0;  // worked out when the entry ends
+}
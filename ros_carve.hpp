@@ -0,0 +1,139 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Search entry data for embedded objects by their signatures.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_CARVE_HPP__
+#define __ROS_CARVE_HPP__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ros_io.hpp"
+#include "ros_pool.hpp"
+#include "ros_sigs.hpp"
+#include "ros_stats.hpp"
+
+/* An object found inside an entry's data */
+struct ros_carve_match {
+  uint64_t offset;      // in the entry's data, uncompressed if it was decoded
+  uint64_t length;      // up to the next object or the end of the data
+  int sig;              // index into the signature database
+  bool extracted;
+  bool write_error;
+};
+
+/* Finds signatures at any position in the data of an entry as it streams
+ * past, and optionally writes each object found to its own file named
+ * ENTRY-OFFSET (the offset in hex), running to where the next one starts.
+ *
+ * The data is copied into blocks that are scanned by a pool of worker
+ * threads. Each block carries a copy of the start of the next block, as far
+ * as the furthest-reaching signature can look, so objects that straddle a
+ * block boundary are found by the block they start in and by no other.
+ * Candidate positions are found by testing 16 bytes at a time against the
+ * set of first bytes of each signature anchor (SSSE3 when the CPU has it),
+ * and only those are checked against the signature trie. Signatures with
+ * magic shorter than min_magic bytes are ignored, they turn up by chance.
+ *
+ * Blocks complete in any order but are retired in data order by the thread
+ * feeding the carver, which writes the extracted objects, so the files are
+ * written sequentially. feed() waits for blocks to be retired when all are
+ * in use, so memory stays bounded however fast the data arrives.
+ *
+ * One thread feeds the carver; the workers live as long as it does.
+ */
+class ros_carver {
+  public:
+    ros_carver(ros_io *io, const ros_sig_db &sigs, unsigned workers, bool extract);
+    ~ros_carver();
+
+    void begin_entry(const char *name);  // name prefixes the extracted files
+    void feed(const char *data, unsigned length);
+    void end_entry(std::vector<struct ros_carve_match> &found);
+
+    /* time and bytes the workers spent scanning since the last call */
+    struct ros_phase_stats take_stats();
+
+    static const unsigned min_magic = 3;
+
+  private:
+    ros_carver(const ros_carver &);
+    ros_carver &operator=(const ros_carver &);
+
+    struct block {
+      char *buffer;
+      unsigned length;      // bytes of the entry at base; candidates start in here
+      unsigned extension;   // bytes of the following data copied after them
+      uint64_t base;        // offset of buffer in the entry's data
+      bool scanned;
+      std::vector<struct ros_carve_match> found;
+    };
+
+    struct byte_set {
+      uint8_t low_clear[16];  // per low nibble, bit per (byte >> 4) of bytes below 0x80
+      uint8_t low_set[16];    // the same for bytes from 0x80
+    };
+
+    void work();
+    void scan(struct block &b, std::vector<uint32_t> &candidates);
+    struct block *get_block();
+    void dispatch(struct block *b, const struct block *next);
+    bool retire(bool wait);
+    void write_out(const struct block &b);
+
+    static const unsigned block_size = 1024 * 1024;
+
+    ros_io *io;
+    const ros_sig_db &sigs;
+    const bool extract;
+    const unsigned reach;         // bytes past a start position a signature may look at
+    std::vector<unsigned> anchors;  // those within reach
+    std::vector<struct byte_set> first_bytes; // for each of anchors
+    ros_buffer_pool buffers;
+    std::vector<struct block *> blocks;
+
+    // the feeding thread's entry
+    std::string name;
+    uint64_t position;
+    struct block *current;    // being filled
+    struct block *previous;   // full, waiting for the start of the next block
+    std::deque<struct block *> in_flight;   // dispatched, in data order
+    std::vector<struct block *> free_blocks;
+    std::vector<struct ros_carve_match> entry_found;
+    int out_fd;               // the object being extracted
+    uint64_t out_base;        // its offset in the entry's data
+
+    std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::deque<struct block *> queue;   // waiting for a worker
+    bool stopping;
+    struct ros_phase_stats counts;
+    std::vector<std::thread> threads;
+};
+
+#endif
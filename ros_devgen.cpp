@@ -0,0 +1,360 @@
+/* VxWorks ROS Firmware device database compiler
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Compiles known_devices.csv into ros_devices_db.cpp: the devices with a
+ * header fingerprint, and a perfect hash table of them keyed on the ARC
+ * magic and header major version, for ros_device_identify().
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include "ros_devices.hpp"
+
+using namespace std;
+
+
+const uint32_t max_seed = 1 << 20;    // tried per bucket before the table is grown
+
+struct device {
+  string manufacturer, model, alternate_model;
+  string arc_magic, arc_index, firmware_version;
+  unsigned line;
+  uint64_t key;
+  bool distinct;      // the fingerprint tells the model apart
+};
+
+struct slot {
+  uint64_t key;
+  unsigned first, count;
+};
+
+void
+usage(char *prog_name)
+{
+  cout << "Usage: " << prog_name << " CSV OUTPUT" << endl
+       << "CSV: the device list, with columns Manufacturer, Model, Alternate Model, ARC Magic, ARC Index" << endl
+       << "     and Firmware Version; devices without an ARC Magic are left out" << endl
+       << "OUTPUT: the C++ source of the compiled table to write" << endl;
+}
+
+/* Split a CSV line into fields; a field may be quoted, with "" for a quote */
+bool
+split(const string &line, vector<string> &fields)
+{
+  fields.clear();
+  string field;
+  bool quoted = false;
+  for (size_t i = 0; i < line.size(); ++i) {
+    char c = line[i];
+    if (quoted) {
+      if (c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+        field += line[++i];
+      else if (c == '"')
+        quoted = false;
+      else
+        field += c;
+    }
+    else if (c == '"')
+      quoted = true;
+    else if (c == ',') {
+      fields.push_back(field);
+      field.clear();
+    }
+    else if (c != '\r')
+      field += c;
+  }
+  fields.push_back(field);
+  return !quoted;
+}
+
+int
+column(const vector<string> &header, const char *name)
+{
+  for (unsigned i = 0; i < header.size(); ++i)
+    if (header[i] == name)
+      return i;
+  return -1;
+}
+
+string
+field(const vector<string> &fields, int c)
+{
+  return c >= 0 && static_cast<unsigned>(c) < fields.size() ? fields[c] : string();
+}
+
+/* A C++ string literal of s */
+string
+literal(const string &s)
+{
+  string out("\"");
+  for (size_t i = 0; i < s.size(); ++i) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\')
+      out += '\\';
+    if (c < 0x20 || c == 0x7F) {
+      char octal[5];
+      snprintf(octal, sizeof(octal), "\\%03o", c);
+      out += octal;
+    }
+    else
+      out += c;
+  }
+  return out + '"';
+}
+
+/* Read the fingerprinted devices of the CSV and mark those whose fingerprint
+ * names the model. Returns false with a description in error.
+ */
+bool
+load(const char *path, vector<struct device> &devices, string &error)
+{
+  ifstream csv(path);
+  if (!csv) {
+    error = string("cannot open ") + path;
+    return false;
+  }
+
+  string line;
+  vector<string> header, fields;
+  if (!getline(csv, line) || !split(line, header)) {
+    error = string(path) + ": no header line";
+    return false;
+  }
+  const int manufacturer = column(header, "Manufacturer");
+  const int model = column(header, "Model");
+  const int alternate_model = column(header, "Alternate Model");
+  const int arc_magic = column(header, "ARC Magic");
+  const int arc_index = column(header, "ARC Index");
+  const int firmware_version = column(header, "Firmware Version");
+  if (manufacturer < 0 || model < 0 || arc_magic < 0) {
+    error = string(path) + ": the header needs Manufacturer, Model and ARC Magic columns";
+    return false;
+  }
+
+  for (unsigned number = 2; getline(csv, line); ++number) {
+    ostringstream where;
+    where << path << ":" << number << ": ";
+    if (line.empty() || line == "\r")
+      continue;
+    if (!split(line, fields)) {
+      error = where.str() + "unterminated quote";
+      return false;
+    }
+
+    struct device d;
+    d.manufacturer = field(fields, manufacturer);
+    d.model = field(fields, model);
+    d.alternate_model = field(fields, alternate_model);
+    d.arc_magic = field(fields, arc_magic);
+    d.arc_index = field(fields, arc_index);
+    d.firmware_version = field(fields, firmware_version);
+    d.line = number;
+    if (d.arc_magic.empty())
+      continue;
+    if (d.arc_magic.size() != 4) {
+      error = where.str() + "the ARC Magic must be 4 characters: " + d.arc_magic;
+      return false;
+    }
+    if (d.arc_index.size() > 4) {
+      error = where.str() + "the ARC Index is longer than 4 characters: " + d.arc_index;
+      return false;
+    }
+    if (d.firmware_version.size() > 16) {
+      error = where.str() + "the Firmware Version is longer than 16 characters: " + d.firmware_version;
+      return false;
+    }
+
+    // a device listed again for another test file is the same device
+    bool listed = false;
+    for (unsigned i = 0; i < devices.size() && !listed; ++i)
+      listed = devices[i].manufacturer == d.manufacturer && devices[i].model == d.model &&
+               devices[i].alternate_model == d.alternate_model && devices[i].arc_magic == d.arc_magic &&
+               devices[i].arc_index == d.arc_index && devices[i].firmware_version == d.firmware_version;
+    if (listed)
+      continue;
+
+    // without an ARC index the device is keyed on major 0, which any major falls back to
+    d.key = ros_device_key(d.arc_magic.data(), d.arc_index.empty() ? '\0' : d.arc_index[0]);
+    devices.push_back(d);
+  }
+
+  // only a fingerprint beyond the ARC magic that no other model shares names the model
+  for (unsigned i = 0; i < devices.size(); ++i) {
+    struct device &d = devices[i];
+    d.distinct = !d.arc_index.empty() || !d.firmware_version.empty();
+    for (unsigned j = 0; j < devices.size() && d.distinct; ++j)
+      d.distinct = devices[j].arc_magic != d.arc_magic || devices[j].arc_index != d.arc_index ||
+                   devices[j].firmware_version != d.firmware_version || devices[j].model == d.model;
+  }
+  return true;
+}
+
+/* Devices with the same key most specific first, then in CSV order */
+bool
+before(const struct device &a, const struct device &b)
+{
+  if (a.key != b.key)
+    return a.key < b.key;
+  size_t a_length = a.arc_index.size() + a.firmware_version.size();
+  size_t b_length = b.arc_index.size() + b.firmware_version.size();
+  if (a_length != b_length)
+    return a_length > b_length;
+  return a.line < b.line;
+}
+
+/* Hash and displace: the keys are spread over buckets, and the buckets,
+ * fullest first, are each given the first seed that places all their keys
+ * in free slots. Returns false if some bucket has no such seed.
+ */
+bool
+place(const vector<struct slot> &keys, uint32_t slot_count, vector<uint32_t> &seeds, vector<struct slot> &slots)
+{
+  const uint32_t bucket_count = seeds.size();
+  vector<vector<unsigned> > buckets(bucket_count);
+  for (unsigned k = 0; k < keys.size(); ++k)
+    buckets[ros_device_hash(keys[k].key, 0) % bucket_count].push_back(k);
+  vector<uint32_t> order(bucket_count);
+  for (uint32_t b = 0; b < bucket_count; ++b)
+    order[b] = b;
+  stable_sort(order.begin(), order.end(),
+              [&buckets](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+  struct slot empty = { 0, 0, 0 };
+  slots.assign(slot_count, empty);
+  vector<bool> used(slot_count, false);
+  for (uint32_t i = 0; i < bucket_count; ++i) {
+    const vector<unsigned> &bucket = buckets[order[i]];
+    if (bucket.empty())
+      break;
+    uint32_t seed;
+    vector<uint32_t> taken;
+    for (seed = 1; seed < max_seed; ++seed) {
+      taken.clear();
+      for (unsigned k = 0; k < bucket.size(); ++k) {
+        uint32_t s = ros_device_hash(keys[bucket[k]].key, seed) & (slot_count - 1);
+        if (used[s] || find(taken.begin(), taken.end(), s) != taken.end())
+          break;
+        taken.push_back(s);
+      }
+      if (taken.size() == bucket.size())
+        break;
+    }
+    if (seed == max_seed)
+      return false;
+    seeds[order[i]] = seed;
+    for (unsigned k = 0; k < bucket.size(); ++k) {
+      used[taken[k]] = true;
+      slots[taken[k]] = keys[bucket[k]];
+    }
+  }
+  return true;
+}
+
+int
+main(int argc, char **argv, char **env)
+{
+  if (argc != 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  vector<struct device> devices;
+  string error;
+  if (!load(argv[1], devices, error)) {
+    cerr << "Error: " << error << endl;
+    return 1;
+  }
+  stable_sort(devices.begin(), devices.end(), before);
+  if (devices.size() > 0xFFFF) {
+    cerr << "Error: too many devices: " << devices.size() << endl;
+    return 1;
+  }
+
+  // a device that matches whatever a more specific one does is never identified
+  for (unsigned i = 1; i < devices.size(); ++i)
+    for (unsigned j = i; j-- > 0 && devices[j].key == devices[i].key; )
+      if (devices[j].arc_index == devices[i].arc_index && devices[j].firmware_version == devices[i].firmware_version) {
+        cerr << "Warning: " << argv[1] << ":" << devices[i].line << ": " << devices[i].manufacturer << " "
+             << devices[i].model << " has the fingerprint of line " << devices[j].line << " and is never identified" << endl;
+        break;
+      }
+
+  vector<struct slot> keys;
+  for (unsigned i = 0; i < devices.size(); ++i) {
+    if (keys.empty() || keys.back().key != devices[i].key) {
+      struct slot k = { devices[i].key, i, 0 };
+      keys.push_back(k);
+    }
+    ++keys.back().count;
+  }
+
+  // a quarter of the slots spare, and four keys to a bucket, find seeds quickly
+  uint32_t slot_count = 1;
+  while (slot_count < keys.size() + keys.size() / 4)
+    slot_count <<= 1;
+  vector<uint32_t> seeds((keys.size() + 3) / 4 ? (keys.size() + 3) / 4 : 1, 0);
+  vector<struct slot> slots;
+  while (!place(keys, slot_count, seeds, slots))
+    slot_count <<= 1;
+
+  ofstream out(argv[2]);
+  out << "/* Generated by ros_devgen from " << argv[1] << ": do not edit */\n"
+      << "\n"
+      << "#include \"ros_devices.hpp\"\n"
+      << "\n"
+      << "const struct ros_device ros_devices[] = {\n";
+  for (unsigned i = 0; i < devices.size(); ++i)
+    out << "  { " << literal(devices[i].manufacturer) << ", "
+        << literal(devices[i].distinct ? devices[i].model : string()) << ", "
+        << literal(devices[i].distinct ? devices[i].alternate_model : string()) << ", " << literal(devices[i].arc_magic) << ", "
+        << literal(devices[i].arc_index) << ", " << literal(devices[i].firmware_version) << " },\n";
+  if (devices.empty())
+    out << "  { \"\", \"\", \"\", \"\", \"\", \"\" }\n";
+  out << "};\n"
+      << "\n"
+      << "const unsigned ros_device_count = " << devices.size() << ";\n"
+      << "\n"
+      << "const struct ros_device_slot ros_device_slots[] = {\n";
+  for (unsigned s = 0; s < slots.size(); ++s)
+    out << "  { 0x" << hex << slots[s].key << dec << "ull, " << slots[s].first << ", " << slots[s].count << " },\n";
+  out << "};\n"
+      << "\n"
+      << "const uint32_t ros_device_slot_mask = " << slot_count - 1 << ";\n"
+      << "\n"
+      << "const uint32_t ros_device_seeds[] = {";
+  for (unsigned b = 0; b < seeds.size(); ++b)
+    out << (b ? ", " : " ") << seeds[b];
+  out << " };\n"
+      << "\n"
+      << "const uint32_t ros_device_buckets = " << seeds.size() << ";\n";
+  out.close();
+  if (!out) {
+    cerr << "Error: cannot write " << argv[2] << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Identify the device a firmware archive is for from its header.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#include "ros_devices.hpp"
+
+using namespace std;
+
+/* prefix, a NUL terminated string, begins field[0, length) */
+static bool
+begins(const char *field, unsigned length, const char *prefix)
+{
+  size_t n = strlen(prefix);
+  return n <= length && strncmp(field, prefix, n) == 0;
+}
+
+/* The first device with the key whose prefixes the header fields begin with */
+static const struct ros_device *
+probe(uint64_t key, const char *arc_index, const char *firmware_version, unsigned firmware_version_length)
+{
+  const uint32_t seed = ros_device_seeds[ros_device_hash(key, 0) % ros_device_buckets];
+  const struct ros_device_slot &slot = ros_device_slots[ros_device_hash(key, seed) & ros_device_slot_mask];
+
+  if (!slot.count || slot.key != key)
+    return nullptr;
+  for (unsigned i = slot.first; i < slot.first + slot.count; ++i) {
+    const struct ros_device &device = ros_devices[i];
+    if (!begins(arc_index, 4, device.arc_index))
+      continue;
+    if (device.firmware_version[0] && !(firmware_version && begins(firmware_version, firmware_version_length, device.firmware_version)))
+      continue;
+    return &device;
+  }
+  return nullptr;
+}
+
+const struct ros_device *
+ros_device_identify(const char *arc_magic, const char *arc_index,
+                    const char *firmware_version, unsigned firmware_version_length)
+{
+  const struct ros_device *device = nullptr;
+  if (arc_index[0])
+    device = probe(ros_device_key(arc_magic, arc_index[0]), arc_index, firmware_version, firmware_version_length);
+  if (!device)
+    device = probe(ros_device_key(arc_magic, '\0'), arc_index, firmware_version, firmware_version_length);
+  return device;
+}
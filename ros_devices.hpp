@@ -0,0 +1,97 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Identify the device a firmware archive is for from its header.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_DEVICES_HPP__
+#define __ROS_DEVICES_HPP__
+
+#include <stdint.h>
+
+/* A device of known_devices.csv and the header fields that identify its
+ * firmware: the ARC magic, and prefixes of the ARC index and of the v2
+ * firmware version, empty where any will do. The model is empty when those
+ * fields do not tell the manufacturer's models apart: the ARC magic alone
+ * is shared by many, and so is a fingerprint listed for several models.
+ */
+struct ros_device {
+  const char *manufacturer;
+  const char *model;              // empty if the fingerprint does not single it out
+  const char *alternate_model;    // empty if there is none, or no model
+  const char *arc_magic;
+  const char *arc_index;
+  const char *firmware_version;
+};
+
+/* The device whose fingerprint the header fields match, or nullptr. Where
+ * several match, the one with the longest prefixes is taken, and a device
+ * with an ARC index only before one without. arc_magic and
+ * arc_index are the 4 characters of the header; firmware_version is up to
+ * firmware_version_length characters, NUL padded, or nullptr for v1.
+ *
+ * ros_devgen compiles known_devices.csv into a perfect hash table
+ * keyed on the ARC magic and the major version (the first character of the
+ * ARC index), so this is one table probe and a compare of the few devices
+ * that share the key, with no allocation or locking.
+ */
+const struct ros_device *ros_device_identify(const char *arc_magic, const char *arc_index,
+                                             const char *firmware_version, unsigned firmware_version_length);
+
+/* The key of the compiled table, shared with ros_devgen; a device without
+ * an ARC index is keyed on major 0 and matches any
+ */
+inline uint64_t
+ros_device_key(const char *arc_magic, char major)
+{
+  uint64_t key = static_cast<unsigned char>(major);
+  for (unsigned i = 0; i < 4; ++i)
+    key = key << 8 | static_cast<unsigned char>(arc_magic[i]);
+  return key;
+}
+
+inline uint32_t
+ros_device_hash(uint64_t key, uint32_t seed)
+{
+  key ^= seed * 0x9E3779B97F4A7C15ull;
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDull;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ull;
+  key ^= key >> 33;
+  return static_cast<uint32_t>(key);
+}
+
+/* The compiled table, generated from known_devices.csv into ros_devices_db.cpp */
+struct ros_device_slot {
+  uint64_t key;
+  uint16_t first;       // of the devices with the key in ros_devices[], most specific first
+  uint16_t count;       // 0 for an empty slot
+};
+
+extern const struct ros_device ros_devices[];
+extern const unsigned ros_device_count;
+extern const struct ros_device_slot ros_device_slots[];
+extern const uint32_t ros_device_slot_mask;
+extern const uint32_t ros_device_seeds[];
+extern const uint32_t ros_device_buckets;
+
+#endif
@@ -0,0 +1,287 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * SHA-256 and CRC32C digests of archive and entry data.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif
+#include "ros_digest.hpp"
+
+using namespace std;
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t
+rotr(uint32_t x, unsigned n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+static void
+sha256_blocks_scalar(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+  for (; blocks; --blocks, data += 64) {
+    uint32_t w[64];
+    for (unsigned i = 0; i < 16; ++i)
+      w[i] = static_cast<uint32_t>(data[i * 4]) << 24 | data[i * 4 + 1] << 16 | data[i * 4 + 2] << 8 | data[i * 4 + 3];
+    for (unsigned i = 16; i < 64; ++i) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (unsigned i = 0; i < 64; ++i) {
+      uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+#if defined __x86_64__ || defined __i386__
+/* The SHA extensions keep the state as ABEF and CDGH and do two rounds an
+ * instruction; each group of four rounds also extends the message schedule
+ * by four words, from the four groups before it.
+ */
+__attribute__((target("sha,sse4.1")))
+static void
+sha256_blocks_ni(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+  const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0])), 0xB1);
+  __m128i hgfe = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4])), 0x1B);
+  __m128i abef = _mm_alignr_epi8(dcba, hgfe, 8);
+  __m128i cdgh = _mm_blend_epi16(hgfe, dcba, 0xF0);
+
+  for (; blocks; --blocks, data += 64) {
+    const __m128i abef_saved = abef, cdgh_saved = cdgh;
+    __m128i msg[4];
+    for (unsigned i = 0; i < 4; ++i)
+      msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)), byte_swap);
+
+    for (unsigned r = 0; r < 16; ++r) {
+      __m128i words = _mm_add_epi32(msg[r & 3], _mm_loadu_si128(reinterpret_cast<const __m128i *>(&sha256_k[r * 4])));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(words, 0x0E));
+      if (r < 12) {
+        __m128i next = _mm_sha256msg1_epu32(msg[r & 3], msg[(r + 1) & 3]);
+        next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(r + 3) & 3], msg[(r + 2) & 3], 4));
+        msg[r & 3] = _mm_sha256msg2_epu32(next, msg[(r + 3) & 3]);
+      }
+    }
+    abef = _mm_add_epi32(abef, abef_saved);
+    cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+  }
+
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+  __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), _mm_blend_epi16(feba, dchg, 0xF0));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+static const bool sha_ni = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+static const bool sse42 = __builtin_cpu_supports("sse4.2");
+#else
+static const bool sha_ni = false;
+static const bool sse42 = false;
+#endif
+
+static void
+sha256_blocks(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+#if defined __x86_64__ || defined __i386__
+  if (sha_ni) {
+    sha256_blocks_ni(state, data, blocks);
+    return;
+  }
+#endif
+  sha256_blocks_scalar(state, data, blocks);
+}
+
+/* CRC32C (Castagnoli) with the reflected polynomial, eight bytes a step from
+ * eight tables
+ */
+struct crc32c_tables {
+  uint32_t t[8][256];
+
+  crc32c_tables() {
+    for (unsigned b = 0; b < 256; ++b) {
+      uint32_t crc = b;
+      for (unsigned i = 0; i < 8; ++i)
+        crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+      t[0][b] = crc;
+    }
+    for (unsigned b = 0; b < 256; ++b)
+      for (unsigned k = 1; k < 8; ++k)
+        t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+  }
+};
+
+static uint32_t
+crc32c_scalar(uint32_t crc, const uint8_t *data, size_t length)
+{
+  static const struct crc32c_tables tables;
+  const uint32_t (*t)[256] = tables.t;
+
+  for (; length >= 8; length -= 8, data += 8) {
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+    v ^= crc;
+    crc = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF] ^
+          t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+  }
+  for (; length; --length, ++data)
+    crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+  return crc;
+}
+
+#if defined __x86_64__ || defined __i386__
+/* A word a step: eight bytes on x86-64, four on i386 */
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t *data, size_t length)
+{
+#if defined __x86_64__
+  uint64_t crc64 = crc;
+  for (; length >= 8; length -= 8, data += 8) {
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+  }
+  crc = static_cast<uint32_t>(crc64);
+#else
+  for (; length >= 4; length -= 4, data += 4) {
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    crc = _mm_crc32_u32(crc, v);
+  }
+#endif
+  for (; length; --length, ++data)
+    crc = _mm_crc32_u8(crc, *data);
+  return crc;
+}
+#endif
+
+const char *
+ros_sha256_engine()
+{
+  return sha_ni ? "sha-ni" : "scalar";
+}
+
+const char *
+ros_crc32c_engine()
+{
+  return sse42 ? "sse4.2" : "scalar";
+}
+
+void
+ros_hasher::begin()
+{
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(state, initial, sizeof(state));
+  pending = 0;
+  length = 0;
+  crc = 0xFFFFFFFF;
+}
+
+void
+ros_hasher::update(const char *data, size_t n)
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+
+#if defined __x86_64__ || defined __i386__
+  crc = sse42 ? crc32c_sse42(crc, bytes, n) : crc32c_scalar(crc, bytes, n);
+#else
+  crc = crc32c_scalar(crc, bytes, n);
+#endif
+  length += n;
+
+  if (pending) {
+    size_t take = 64 - pending < n ? 64 - pending : n;
+    memcpy(block + pending, bytes, take);
+    pending += take;
+    bytes += take;
+    n -= take;
+    if (pending < 64)
+      return;
+    sha256_blocks(state, block, 1);
+    pending = 0;
+  }
+  if (n >= 64) {
+    sha256_blocks(state, bytes, n / 64);
+    bytes += n & ~static_cast<size_t>(63);
+    n &= 63;
+  }
+  memcpy(block, bytes, n);
+  pending = n;
+}
+
+void
+ros_hasher::end(struct ros_digests &digests)
+{
+  const uint64_t bits = length * 8;
+
+  // the padding: a 1 bit, zeroes up to 8 bytes short of a block, and the length in bits
+  block[pending++] = 0x80;
+  if (pending > 56) {
+    memset(block + pending, 0, 64 - pending);
+    sha256_blocks(state, block, 1);
+    pending = 0;
+  }
+  memset(block + pending, 0, 56 - pending);
+  for (unsigned i = 0; i < 8; ++i)
+    block[56 + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+  sha256_blocks(state, block, 1);
+
+  for (unsigned i = 0; i < 8; ++i)
+    for (unsigned j = 0; j < 4; ++j)
+      digests.sha256[i * 4 + j] = static_cast<uint8_t>(state[i] >> (24 - j * 8));
+  digests.crc32c = ~crc;
+  digests.length = length;
+  digests.valid = true;
+  begin();
+}
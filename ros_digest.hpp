@@ -0,0 +1,66 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * SHA-256 and CRC32C digests of archive and entry data.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_DIGEST_HPP__
+#define __ROS_DIGEST_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ros_digests {
+  bool valid;             // false if the data was not all hashed
+  uint64_t length;        // bytes hashed
+  uint32_t crc32c;
+  uint8_t sha256[32];
+};
+
+/* Which implementations the CPU runs: "sha-ni" or "scalar" for SHA-256,
+ * "sse4.2" or "scalar" for CRC32C
+ */
+const char *ros_sha256_engine();
+const char *ros_crc32c_engine();
+
+/* Hashes data with SHA-256 and CRC32C at once as it streams past, each
+ * piece while it is still in cache. SHA-256 uses the SHA extensions and
+ * CRC32C the SSE4.2 crc32 instruction where the CPU has them, chosen once
+ * at run time; otherwise the portable versions, which give the same
+ * digests.
+ */
+class ros_hasher {
+  public:
+    ros_hasher() { begin(); }
+
+    void begin();
+    void update(const char *data, size_t length);
+    void end(struct ros_digests &digests);
+
+  private:
+    uint32_t state[8];
+    uint8_t block[64];      // a partial block waiting for more data
+    unsigned pending;       // bytes in block
+    uint64_t length;
+    uint32_t crc;
+};
+
+#endif
@@ -0,0 +1,321 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Profile the byte entropy of entry data block by block.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include "ros_entropy.hpp"
+
+using namespace std;
+
+static const char *class_names[ENTROPY_CLASSES] = {
+  "padding",
+  "text",
+  "code",
+  "compressed",
+  "random"
+};
+
+const char *
+ros_entropy_class_name(int c)
+{
+  return c >= 0 && c < ENTROPY_CLASSES ? class_names[c] : "none";
+}
+
+char
+ros_entropy_glyph(uint8_t entropy)
+{
+  static const char glyphs[] = " .:-=+*#%@";
+  return glyphs[entropy * (sizeof(glyphs) - 1) / 256];
+}
+
+/* Count the bytes of data[0, length) into counts. Four tables take turns,
+ * so a run of one byte value is four chains of increments rather than one.
+ */
+static void
+histogram(const unsigned char *data, unsigned length, uint32_t counts[256])
+{
+  uint32_t tables[4][256];
+  memset(tables, 0, sizeof(tables));
+
+  unsigned i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t v;
+    memcpy(&v, data + i, sizeof(v));
+    ++tables[0][v & 0xFF];
+    ++tables[1][(v >> 8) & 0xFF];
+    ++tables[2][(v >> 16) & 0xFF];
+    ++tables[3][(v >> 24) & 0xFF];
+    ++tables[0][(v >> 32) & 0xFF];
+    ++tables[1][(v >> 40) & 0xFF];
+    ++tables[2][(v >> 48) & 0xFF];
+    ++tables[3][v >> 56];
+  }
+  for (; i < length; ++i)
+    ++tables[0][data[i]];
+  for (unsigned b = 0; b < 256; ++b)
+    counts[b] = tables[0][b] + tables[1][b] + tables[2][b] + tables[3][b];
+}
+
+/* Shannon entropy in bits per byte */
+template <typename T>
+static double
+entropy_of(const T counts[256], uint64_t total)
+{
+  if (!total)
+    return 0;
+  double sum = 0;
+  for (unsigned b = 0; b < 256; ++b)
+    if (counts[b])
+      sum += counts[b] * log2(static_cast<double>(counts[b]));
+  double h = log2(static_cast<double>(total)) - sum / total;
+  return h > 0 ? h : 0;
+}
+
+/* Random bytes give a chi-square statistic against the uniform distribution
+ * of about 255, with 255 degrees of freedom; above this it is less than a
+ * 0.1% chance. Deflate output lands well above, LZMA output does not.
+ */
+static const double chi_square_random = 330.5;
+
+static enum ros_entropy_class
+classify(const uint32_t counts[256], unsigned total, double entropy)
+{
+  uint32_t most = 0;
+  uint64_t text = counts['\t'] + counts['\n'] + counts['\r'];
+  for (unsigned b = 0; b < 256; ++b) {
+    if (counts[b] > most)
+      most = counts[b];
+    if (b >= 0x20 && b < 0x7F)
+      text += counts[b];
+  }
+  if (static_cast<uint64_t>(most) * 10 >= static_cast<uint64_t>(total) * 9)
+    return ENTROPY_PADDING;
+  if (text * 10 >= static_cast<uint64_t>(total) * 9)
+    return ENTROPY_TEXT;
+  // a short last block cannot reach 8 bits per byte, so it is held to what it could reach
+  if (entropy < 7.0 / 8 * log2(total < 256 ? total : 256.0))
+    return ENTROPY_CODE;
+
+  const double expected = total / 256.0;
+  double chi_square = 0;
+  for (unsigned b = 0; b < 256; ++b)
+    chi_square += (counts[b] - expected) * (counts[b] - expected) / expected;
+  return chi_square < chi_square_random ? ENTROPY_RANDOM : ENTROPY_COMPRESSED;
+}
+
+ros_entropy::ros_entropy(unsigned block_size, unsigned workers)
+  : block_size(block_size), buffers(work_size), current(nullptr), stopping(false)
+{
+  if (!workers)
+    workers = 1;
+  // two for the feeding thread, the rest for the workers to be busy with
+  for (unsigned i = 0; i < workers + 2; ++i) {
+    struct block *b = new struct block;
+    b->buffer = buffers.get();
+    blocks.push_back(b);
+    free_blocks.push_back(b);
+  }
+  memset(&counts, 0, sizeof(counts));
+  for (unsigned i = 0; i < workers; ++i)
+    threads.push_back(thread(&ros_entropy::work, this));
+}
+
+ros_entropy::~ros_entropy()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  work_ready.notify_all();
+  for (unsigned i = 0; i < threads.size(); ++i)
+    threads[i].join();
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    buffers.put(blocks[i]->buffer);
+    delete blocks[i];
+  }
+}
+
+void
+ros_entropy::begin_entry()
+{
+  entry.length = 0;
+  entry.block_size = block_size;
+  entry.entropy = 0;
+  entry.blocks.clear();
+  entry.block_classes.clear();
+  memset(entry.classes, 0, sizeof(entry.classes));
+  entry.guess = -1;
+  memset(entry_counts, 0, sizeof(entry_counts));
+}
+
+struct ros_entropy::block *
+ros_entropy::get_block()
+{
+  while (free_blocks.empty())
+    retire(true);
+  struct block *b = free_blocks.back();
+  free_blocks.pop_back();
+  b->length = 0;
+  b->scanned = false;
+  return b;
+}
+
+void
+ros_entropy::feed(const char *data, unsigned length)
+{
+  while (length) {
+    if (!current)
+      current = get_block();
+    unsigned n = work_size - current->length < length ? work_size - current->length : length;
+    memcpy(current->buffer + current->length, data, n);
+    current->length += n;
+    data += n;
+    length -= n;
+
+    if (current->length == work_size) {
+      dispatch(current);
+      current = nullptr;
+    }
+  }
+  while (retire(false))
+    ;
+}
+
+void
+ros_entropy::dispatch(struct block *b)
+{
+  in_flight.push_back(b);
+  {
+    lock_guard<mutex> guard(lock);
+    queue.push_back(b);
+  }
+  work_ready.notify_one();
+}
+
+/* Add the oldest block to the entry once it has been scanned; false if it has not */
+bool
+ros_entropy::retire(bool wait)
+{
+  if (in_flight.empty())
+    return false;
+  struct block *b = in_flight.front();
+  {
+    unique_lock<mutex> guard(lock);
+    while (!b->scanned) {
+      if (!wait)
+        return false;
+      work_done.wait(guard);
+    }
+  }
+  in_flight.pop_front();
+
+  entry.length += b->length;
+  for (unsigned i = 0; i < 256; ++i)
+    entry_counts[i] += b->counts[i];
+  entry.blocks.insert(entry.blocks.end(), b->entropy.begin(), b->entropy.end());
+  entry.block_classes.insert(entry.block_classes.end(), b->classes.begin(), b->classes.end());
+  for (unsigned i = 0; i < b->classes.size(); ++i)
+    ++entry.classes[b->classes[i]];
+  free_blocks.push_back(b);
+  return true;
+}
+
+void
+ros_entropy::end_entry(struct ros_entropy_profile &profile)
+{
+  if (current) {
+    dispatch(current);
+    current = nullptr;
+  }
+  while (retire(true))
+    ;
+
+  entry.entropy = entropy_of(entry_counts, entry.length);
+  for (unsigned c = 0; c < ENTROPY_CLASSES; ++c)
+    if (entry.classes[c] && (entry.guess < 0 || entry.classes[c] > entry.classes[entry.guess]))
+      entry.guess = c;
+  profile = entry;
+}
+
+struct ros_phase_stats
+ros_entropy::take_stats()
+{
+  lock_guard<mutex> guard(lock);
+  struct ros_phase_stats taken = counts;
+  memset(&counts, 0, sizeof(counts));
+  return taken;
+}
+
+void
+ros_entropy::work()
+{
+  for (;;) {
+    struct block *b;
+    {
+      unique_lock<mutex> guard(lock);
+      while (queue.empty() && !stopping)
+        work_ready.wait(guard);
+      if (queue.empty())
+        return;
+      b = queue.front();
+      queue.pop_front();
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    scan(*b);
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    {
+      lock_guard<mutex> guard(lock);
+      b->scanned = true;
+      counts.ns += ns;
+      counts.bytes += b->length;
+      ++counts.calls;
+    }
+    work_done.notify_all();
+  }
+}
+
+/* Profile each block in the work block and total their histograms */
+void
+ros_entropy::scan(struct block &b)
+{
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(b.buffer);
+  uint32_t block_counts[256];
+
+  memset(b.counts, 0, sizeof(b.counts));
+  b.entropy.clear();
+  b.classes.clear();
+  for (unsigned offset = 0; offset < b.length; offset += block_size) {
+    unsigned length = b.length - offset < block_size ? b.length - offset : block_size;
+    histogram(data + offset, length, block_counts);
+    double h = entropy_of(block_counts, length);
+    unsigned scaled = static_cast<unsigned>(h * 32 + 0.5);
+    b.entropy.push_back(scaled > 255 ? 255 : scaled);
+    b.classes.push_back(classify(block_counts, length, h));
+    for (unsigned i = 0; i < 256; ++i)
+      b.counts[i] += block_counts[i];
+  }
+}
@@ -0,0 +1,132 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Profile the byte entropy of entry data block by block.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_ENTROPY_HPP__
+#define __ROS_ENTROPY_HPP__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ros_pool.hpp"
+#include "ros_stats.hpp"
+
+/* What a block of data looks like from its byte histogram */
+enum ros_entropy_class {
+  ENTROPY_PADDING = 0,  // nine tenths or more one byte value
+  ENTROPY_TEXT,         // nine tenths or more printable ASCII and line ends
+  ENTROPY_CODE,         // below 7 bits per byte: machine code, tables, structured data
+  ENTROPY_COMPRESSED,   // dense but measurably uneven, as Deflate output is
+  ENTROPY_RANDOM,       // as even as random bytes: encrypted, or LZMA and xz output
+  ENTROPY_CLASSES
+};
+
+struct ros_entropy_profile {
+  uint64_t length;          // bytes profiled, 0 if the entry was not
+  unsigned block_size;
+  double entropy;           // of all the data, in bits per byte
+  std::vector<uint8_t> blocks;        // entropy of each block in 1/32 bits per byte
+  std::vector<uint8_t> block_classes; // ros_entropy_class of each block
+  uint64_t classes[ENTROPY_CLASSES];  // blocks of each class
+  int guess;                // the class of most of the data, -1 if there is none
+};
+
+const char *ros_entropy_class_name(int c);
+
+/* The one character glyph of an entropy from the profile, ' ' for none
+ * up to '@' for 8 bits per byte
+ */
+char ros_entropy_glyph(uint8_t entropy);
+
+/* Builds the entropy profile of an entry's data as it streams past: the
+ * Shannon entropy of each block of block_size bytes, its class, and the
+ * entropy of the whole. Byte histograms are counted into four interleaved
+ * tables, eight bytes per load, so consecutive equal bytes do not wait on
+ * each other's increments.
+ *
+ * The data is copied into work blocks of 1 MiB, a whole number of profile
+ * blocks, that a pool of worker threads histograms; they are retired in
+ * data order by the thread feeding the profiler, which stitches the
+ * entry's profile together. feed() waits for blocks to be retired when all
+ * are in use, so memory stays bounded however fast the data arrives.
+ *
+ * One thread feeds it; the workers live as long as it does.
+ */
+class ros_entropy {
+  public:
+    ros_entropy(unsigned block_size, unsigned workers);
+    ~ros_entropy();
+
+    void begin_entry();
+    void feed(const char *data, unsigned length);
+    void end_entry(struct ros_entropy_profile &profile);
+
+    /* time and bytes the workers spent histogramming since the last call */
+    struct ros_phase_stats take_stats();
+
+    static const unsigned work_size = 1024 * 1024;
+    static const unsigned min_block_size = 256;
+
+  private:
+    ros_entropy(const ros_entropy &);
+    ros_entropy &operator=(const ros_entropy &);
+
+    struct block {
+      char *buffer;
+      unsigned length;
+      bool scanned;
+      uint64_t counts[256];           // of the whole block
+      std::vector<uint8_t> entropy;   // of each profile block in it
+      std::vector<uint8_t> classes;
+    };
+
+    void work();
+    void scan(struct block &b);
+    struct block *get_block();
+    void dispatch(struct block *b);
+    bool retire(bool wait);
+
+    const unsigned block_size;
+    ros_buffer_pool buffers;
+    std::vector<struct block *> blocks;
+
+    // the feeding thread's entry
+    struct block *current;    // being filled
+    std::deque<struct block *> in_flight;   // dispatched, in data order
+    std::vector<struct block *> free_blocks;
+    struct ros_entropy_profile entry;
+    uint64_t entry_counts[256];
+
+    std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::deque<struct block *> queue;   // waiting for a worker
+    bool stopping;
+    struct ros_phase_stats counts;
+    std::vector<std::thread> threads;
+};
+
+#endif
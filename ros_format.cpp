@@ -0,0 +1,224 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Buffered, allocation-free formatter for structured (NDJSON) output.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include "ros_format.hpp"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+ros_writer::ros_writer(int fd, size_t capacity)
+  : fd(fd), buffer(new char[capacity]), capacity(capacity), used(0),
+    failed(false), depth(0), after_key(false)
+{
+  first[0] = true;
+}
+
+ros_writer::~ros_writer()
+{
+  flush();
+  delete[] buffer;
+}
+
+ros_writer &
+ros_writer::raw(const char *s, size_t length)
+{
+  while (length > 0) {
+    if (used == capacity)
+      drain();
+    size_t n = capacity - used < length ? capacity - used : length;
+    memcpy(buffer + used, s, n);
+    used += n;
+    s += n;
+    length -= n;
+  }
+  return *this;
+}
+
+ros_writer &
+ros_writer::dec(uint64_t v, unsigned width)
+{
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  do {
+    *--p = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (static_cast<unsigned>(digits + sizeof(digits) - p) < width && p > digits)
+    *--p = '0';
+  return raw(p, digits + sizeof(digits) - p);
+}
+
+ros_writer &
+ros_writer::hex(uint64_t v)
+{
+  char digits[20];
+  char *p = digits + sizeof(digits);
+  do {
+    *--p = hex_digits[v & 0xF];
+    v >>= 4;
+  } while (v);
+  *--p = 'x';
+  *--p = '0';
+  return raw(p, digits + sizeof(digits) - p);
+}
+
+ros_writer &
+ros_writer::fixed(double v, unsigned decimals)
+{
+  if (v != v) // NaN has no JSON representation
+    return raw("0");
+  if (v < 0) {
+    put('-');
+    v = -v;
+  }
+  uint64_t scale = 1;
+  for (unsigned i = 0; i < decimals; ++i)
+    scale *= 10;
+  uint64_t scaled = static_cast<uint64_t>(v * scale + 0.5);
+  dec(scaled / scale);
+  if (decimals) {
+    put('.');
+    dec(scaled % scale, decimals);
+  }
+  return *this;
+}
+
+void
+ros_writer::value()
+{
+  if (after_key)
+    after_key = false;
+  else if (!first[depth])
+    put(',');
+  first[depth] = false;
+}
+
+ros_writer &
+ros_writer::begin_object()
+{
+  value();
+  put('{');
+  if (depth + 1 < depth_max)
+    first[++depth] = true;
+  return *this;
+}
+
+ros_writer &
+ros_writer::end_object()
+{
+  if (depth)
+    --depth;
+  return put('}');
+}
+
+ros_writer &
+ros_writer::begin_array()
+{
+  value();
+  put('[');
+  if (depth + 1 < depth_max)
+    first[++depth] = true;
+  return *this;
+}
+
+ros_writer &
+ros_writer::end_array()
+{
+  if (depth)
+    --depth;
+  return put(']');
+}
+
+ros_writer &
+ros_writer::key(const char *name)
+{
+  value();
+  quote(name, SIZE_MAX);
+  put(':');
+  after_key = true;
+  return *this;
+}
+
+ros_writer &
+ros_writer::string(const char *s, size_t max_length)
+{
+  value();
+  return quote(s, max_length);
+}
+
+ros_writer &
+ros_writer::quote(const char *s, size_t max_length)
+{
+  put('"');
+  for (size_t i = 0; i < max_length && s[i]; ++i) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(c);
+    }
+    else if (c < 0x20 || c >= 0x7F) { // control and non-ASCII bytes from firmware fields
+      raw("\\u00", 4);
+      put(hex_digits[c >> 4]);
+      put(hex_digits[c & 0xF]);
+    }
+    else
+      put(c);
+  }
+  return put('"');
+}
+
+ros_writer &
+ros_writer::end_record()
+{
+  depth = 0;
+  first[0] = true;
+  after_key = false;
+  return put('\n');
+}
+
+void
+ros_writer::drain()
+{
+  if (!flush())
+    used = 0; // discard rather than overrun the buffer
+}
+
+bool
+ros_writer::flush()
+{
+  size_t done = 0;
+  while (done < used) {
+    ssize_t n = write(fd, buffer + done, used - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      failed = true;
+      return false;
+    }
+    done += n;
+  }
+  used = 0;
+  return true;
+}
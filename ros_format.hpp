@@ -0,0 +1,98 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Buffered, allocation-free formatter for structured (NDJSON) output.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_FORMAT_HPP__
+#define __ROS_FORMAT_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Formats values directly into a fixed buffer that is written to a file
+ * descriptor by flush(). The buffer is allocated once by the constructor;
+ * nothing else allocates, so records can be produced in the hot path.
+ * If a record outgrows the buffer it is written early rather than grown.
+ *
+ * The JSON helpers track nesting so callers never emit separators:
+ *   out.begin_object().key("length").number(n).end_object().end_record();
+ */
+class ros_writer {
+  public:
+    explicit ros_writer(int fd, size_t capacity = 256 * 1024);
+    ~ros_writer();
+
+    // raw output
+    ros_writer &put(char c) {
+      if (used == capacity)
+        drain();
+      buffer[used++] = c;
+      return *this;
+    }
+    ros_writer &raw(const char *s, size_t length);
+    ros_writer &raw(const char *s) { return raw(s, strlen(s)); }
+    ros_writer &dec(uint64_t v, unsigned width = 0);  // zero-padded to width
+    ros_writer &hex(uint64_t v);                      // with 0x prefix
+    ros_writer &fixed(double v, unsigned decimals);
+
+    // JSON values; each one is preceded by a separator when required
+    ros_writer &begin_object();
+    ros_writer &end_object();
+    ros_writer &begin_array();
+    ros_writer &end_array();
+    ros_writer &key(const char *name);
+    ros_writer &number(uint64_t v) { value(); return dec(v); }
+    ros_writer &real(double v, unsigned decimals = 3) { value(); return fixed(v, decimals); }
+    ros_writer &boolean(bool v) { value(); return raw(v ? "true" : "false"); }
+    ros_writer &null() { value(); return raw("null"); }
+    ros_writer &string(const char *s, size_t max_length = SIZE_MAX); // stops at NUL or max_length
+    ros_writer &begin_string() { value(); return put('"'); }        // for composed strings
+    ros_writer &end_string() { return put('"'); }
+
+    ros_writer &end_record();  // terminate one NDJSON line
+
+    bool flush();              // write the buffer to the file descriptor
+    size_t pending() const { return used; }  // bytes not yet flushed
+    bool good() const { return !failed; }
+
+  private:
+    ros_writer(const ros_writer &);
+    ros_writer &operator=(const ros_writer &);
+
+    void value();              // emit a separator if this is not the first value
+    ros_writer &quote(const char *s, size_t max_length);
+    void drain();              // flush part-way through a record
+
+    static const unsigned depth_max = 16;
+
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t used;
+    bool failed;
+    unsigned depth;
+    bool first[depth_max];     // no value yet at this nesting level
+    bool after_key;            // the next value belongs to the preceding key
+};
+
+#endif
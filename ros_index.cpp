@@ -0,0 +1,1065 @@
+/* VxWorks ROS Firmware content index
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Builds a trigram index of the uncompressed content of ROS PACK archives,
+ * the members of 7z archives in their entries included, and answers which
+ * entries contain a string or byte sequence from it.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rospack.h"
+#include "ros_7z.hpp"
+#include "ros_format.hpp"
+#include "ros_util.hpp"
+
+using namespace std;
+
+
+// command-line switches
+const char *switch_build = "--build=";
+const char *switch_index = "--index=";
+const char *switch_hex = "--hex";
+const char *switch_candidates = "--candidates";
+const char *switch_max_trigrams = "--max-trigrams=";
+const char *switch_buffer = "--buffer=";
+const char *switch_jobs = "--jobs=";
+const char *switch_memory = "--memory=";
+const char *switch_output = "--output=";
+const char *switch_help = "--help";
+
+unsigned jobs = 0;                          // archives read at once; 0 for one per CPU
+uint64_t memory_budget = 0;                 // of each LZMA decoder
+uint64_t max_trigrams = 4 << 20;            // a document with more is verified on every query
+uint64_t buffer_size = 256 << 20;           // of postings held before a sorted run is written out
+bool hex_patterns = false;
+bool candidates_only = false;
+bool json = false;
+
+/* The index is one file, mapped when it is queried. Every document -- an
+ * entry, or a member of a 7z archive in an entry -- has a sorted list of
+ * the documents holding each of the 2^24 three-byte sequences (trigrams)
+ * that occur anywhere in the corpus. Posting lists are the differences
+ * between successive document numbers, as base-128 varints.
+ *
+ *   header
+ *   postings        (padded to 8 bytes)
+ *   trigram table   sorted by trigram
+ *   files
+ *   documents
+ *   strings         NUL-terminated, referenced by offset
+ *
+ * Numbers are in the byte order of the host that built it.
+ */
+const char index_magic[8] = { 'R', 'O', 'S', 'T', 'R', 'I', '1', '\n' };
+const uint32_t index_byte_order = 0x01020304;
+const uint32_t no_member = UINT32_MAX;
+const uint64_t no_string = UINT64_MAX;
+
+struct index_header {
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t files;
+  uint32_t docs;
+  uint32_t trigrams;
+  uint32_t unindexed;               // documents with too many trigrams to list
+  uint32_t reserved;
+  uint64_t postings_offset, postings_length;
+  uint64_t table_offset;
+  uint64_t files_offset;
+  uint64_t docs_offset;
+  uint64_t strings_offset, strings_length;
+};
+
+struct index_file {
+  uint64_t path;
+  uint64_t size;                    // when it was indexed
+  int64_t mtime;
+};
+
+struct index_doc {
+  uint32_t file;
+  uint32_t entry;
+  uint32_t member;                  // in the entry's 7z archive, or no_member
+  uint32_t unindexed;               // not in any posting list
+  uint64_t name;                    // of the entry
+  uint64_t member_name;             // or no_string
+  uint64_t length;
+};
+
+struct index_trigram {
+  uint32_t trigram;
+  uint32_t count;
+  uint64_t offset;                  // of its postings
+};
+
+static_assert(sizeof(struct index_header) == 88, "index_header layout");
+static_assert(sizeof(struct index_file) == 24, "index_file layout");
+static_assert(sizeof(struct index_doc) == 40, "index_doc layout");
+static_assert(sizeof(struct index_trigram) == 16, "index_trigram layout");
+
+/* The data of an entry, uncompressed; data points into the archive or at
+ * buffer
+ */
+int
+entry_content(rospack_decoder *decoder, const rospack_archive *archive, unsigned index, vector<char> &buffer,
+              const uint8_t *&data, size_t &length)
+{
+  int error;
+  buffer.clear();
+  if (rospack_entry(archive, index)->compressed) {
+    error = rospack_decode(decoder, archive, index, ros_append_output, &buffer);
+    data = reinterpret_cast<const uint8_t *>(buffer.data());
+    length = buffer.size();
+  }
+  else {
+    const void *in_place;
+    error = rospack_entry_data(archive, index, &in_place, &length);
+    data = static_cast<const uint8_t *>(in_place);
+  }
+  return error;
+}
+
+bool
+is_7z(const uint8_t *data, size_t length)
+{
+  return length >= sizeof(ros_7z_archive::signature)
+         && memcmp(data, ros_7z_archive::signature, sizeof(ros_7z_archive::signature)) == 0;
+}
+
+/* The distinct trigrams of a document fed in pieces: a bitmap of all 2^24
+ * for testing, and a list of those set for the postings and for clearing
+ * the bitmap again
+ */
+struct trigram_set {
+  vector<uint64_t> bitmap;
+  vector<uint32_t> list;
+  uint32_t window;
+  uint64_t seen;                    // bytes of the document so far
+  bool overflow;                    // more than max_trigrams
+
+  trigram_set() : bitmap((1 << 24) / 64), window(0), seen(0), overflow(false) {}
+
+  void add(const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length && !overflow; ++i) {
+      window = ((window << 8) | data[i]) & 0xFFFFFF;
+      if (++seen < 3)
+        continue;
+      uint64_t &word = bitmap[window / 64], bit = static_cast<uint64_t>(1) << (window % 64);
+      if (!(word & bit)) {
+        word |= bit;
+        list.push_back(window);
+        overflow = list.size() > max_trigrams;
+      }
+    }
+  }
+
+  void reset() {
+    for (size_t i = 0; i < list.size(); ++i)
+      bitmap[list[i] / 64] = 0;
+    list.clear();
+    window = 0;
+    seen = 0;
+    overflow = false;
+  }
+};
+
+/* What the archive workers hand in. Postings are kept as trigram << 32 |
+ * document; when buffer_size of them are held they are sorted and written
+ * to a temporary file as a run, and the runs are merged at the end.
+ */
+struct index_builder {
+  mutex lock;
+  string strings;
+  vector<struct index_file> files;
+  vector<struct index_doc> docs;
+  vector<uint64_t> postings;
+  FILE *runs_file;
+  vector<pair<uint64_t, uint64_t> > runs;   // offset and count of keys
+  uint64_t unindexed;
+  bool failed;
+
+  index_builder() : runs_file(nullptr), unindexed(0), failed(false) {}
+  ~index_builder() { if (runs_file) fclose(runs_file); }
+
+  uint64_t add_string(const string &s) {
+    uint64_t offset = strings.size();
+    strings.append(s.c_str(), s.size() + 1);
+    return offset;
+  }
+
+  void warn(const string &message) {
+    lock_guard<mutex> hold(lock);
+    cerr << message << endl;
+  }
+
+  uint32_t add_file(const char *path, const struct stat &st) {
+    lock_guard<mutex> hold(lock);
+    struct index_file file;
+    file.path = add_string(path);
+    file.size = st.st_size;
+    file.mtime = st.st_mtime;
+    files.push_back(file);
+    return files.size() - 1;
+  }
+
+  void add_doc(uint32_t file, uint32_t entry, const char *name, uint32_t member, const string *member_name,
+               uint64_t length, const struct trigram_set &trigrams) {
+    lock_guard<mutex> hold(lock);
+    struct index_doc doc;
+    doc.file = file;
+    doc.entry = entry;
+    doc.member = member;
+    doc.unindexed = trigrams.overflow;
+    doc.name = add_string(name);
+    doc.member_name = member_name ? add_string(*member_name) : no_string;
+    doc.length = length;
+    uint64_t id = docs.size();
+    docs.push_back(doc);
+    if (trigrams.overflow) {
+      ++unindexed;
+      return;
+    }
+    for (size_t i = 0; i < trigrams.list.size(); ++i)
+      postings.push_back(static_cast<uint64_t>(trigrams.list[i]) << 32 | id);
+    if (postings.size() * sizeof(uint64_t) >= buffer_size)
+      spill();
+  }
+
+  void spill() {
+    if (postings.empty() || failed)
+      return;
+    if (!runs_file && !(runs_file = tmpfile())) {
+      cerr << "Error creating a temporary file: " << strerror(errno) << endl;
+      failed = true;
+      return;
+    }
+    sort(postings.begin(), postings.end());
+    uint64_t offset = runs.empty() ? 0 : runs.back().first + runs.back().second * sizeof(uint64_t);
+    if (fwrite(postings.data(), sizeof(uint64_t), postings.size(), runs_file) != postings.size()
+        || fflush(runs_file) != 0) {
+      cerr << "Error writing a temporary file: " << strerror(errno) << endl;
+      failed = true;
+      return;
+    }
+    runs.push_back(make_pair(offset, static_cast<uint64_t>(postings.size())));
+    postings.clear();
+  }
+};
+
+void
+index_archive(const char *path, rospack_decoder *decoder, struct trigram_set &trigrams, struct index_builder &builder)
+{
+  struct stat st;
+  rospack_archive *archive;
+  int error = stat(path, &st) == 0 ? rospack_open_path(path, &archive) : ROSPACK_ERR_IO;
+  if (error != ROSPACK_OK) {
+    builder.warn(string("Error opening ") + path + ": " + rospack_strerror(error));
+    return;
+  }
+  uint32_t file = builder.add_file(path, st);
+
+  vector<char> buffer;
+  for (unsigned i = 0; i < rospack_entry_count(archive); ++i) {
+    const struct rospack_entry *entry = rospack_entry(archive, i);
+    const uint8_t *data;
+    size_t length;
+    error = entry_content(decoder, archive, i, buffer, data, length);
+    if (error != ROSPACK_OK) {
+      builder.warn(string("Error uncompressing ") + path + ": " + entry->filename + ": " + rospack_strerror(error)
+                   + "; not indexed");
+      continue;
+    }
+
+    // a 7z archive is indexed by the content of its members
+    if (is_7z(data, length)) {
+      ros_7z_archive z;
+      if (z.open(data, length, memory_budget ? memory_budget : UINT64_MAX) && z.supported()) {
+        uint64_t member_length = 0;
+        string z_error;
+        if (!z.extract([&](unsigned member, const uint8_t *out, size_t out_length) {
+              trigrams.add(out, out_length);
+              member_length += out_length;
+              if (!out_length) {
+                builder.add_doc(file, i, entry->filename, member, &z.members()[member].name, member_length, trigrams);
+                trigrams.reset();
+                member_length = 0;
+              }
+              return true;
+            }, z_error))
+          builder.warn(string("Error uncompressing ") + path + ": " + entry->filename + ": " + z_error
+                       + "; the rest of it is not indexed");
+        trigrams.reset();
+        continue;
+      }
+      builder.warn(string("Warning: ") + path + ": " + entry->filename + ": "
+                   + (z.error().empty() ? "7z compressed with an unsupported method" : z.error())
+                   + "; indexing it as it is");
+    }
+
+    trigrams.add(data, length);
+    builder.add_doc(file, i, entry->filename, no_member, nullptr, length, trigrams);
+    trigrams.reset();
+  }
+  rospack_close(archive);
+}
+
+void
+put_varint(string &out, uint64_t v)
+{
+  for (; v >= 0x80; v >>= 7)
+    out += static_cast<char>(v | 0x80);
+  out += static_cast<char>(v);
+}
+
+/* The postings in order, from memory or merged from the runs */
+class posting_source {
+  public:
+    posting_source(struct index_builder &builder) : b(builder), next_key(0) {
+      if (b.runs.empty())
+        sort(b.postings.begin(), b.postings.end());
+      else {
+        b.spill();
+        readers.resize(b.runs.size());
+        for (size_t r = 0; r < readers.size(); ++r) {
+          readers[r].offset = b.runs[r].first;
+          readers[r].left = b.runs[r].second;
+          if (fill(r))
+            heap.push(make_pair(readers[r].buffer[0], r));
+        }
+      }
+    }
+
+    bool next(uint64_t &key) {
+      if (b.runs.empty()) {
+        if (next_key == b.postings.size())
+          return false;
+        key = b.postings[next_key++];
+        return true;
+      }
+      if (heap.empty())
+        return false;
+      size_t r = heap.top().second;
+      key = heap.top().first;
+      heap.pop();
+      struct run_reader &reader = readers[r];
+      if (++reader.pos < reader.buffer.size() || fill(r))
+        heap.push(make_pair(reader.buffer[reader.pos], r));
+      return true;
+    }
+
+  private:
+    struct run_reader {
+      uint64_t offset;
+      uint64_t left;
+      vector<uint64_t> buffer;
+      size_t pos;
+    };
+
+    bool fill(size_t r) {
+      struct run_reader &reader = readers[r];
+      size_t count = min<uint64_t>(reader.left, 64 * 1024);
+      reader.buffer.resize(count);
+      reader.pos = 0;
+      if (!count)
+        return false;
+      ssize_t got = pread(fileno(b.runs_file), reader.buffer.data(), count * sizeof(uint64_t), reader.offset);
+      if (got != static_cast<ssize_t>(count * sizeof(uint64_t))) {
+        b.failed = true;
+        return false;
+      }
+      reader.offset += got;
+      reader.left -= count;
+      return true;
+    }
+
+    struct index_builder &b;
+    size_t next_key;
+    vector<struct run_reader> readers;
+    priority_queue<pair<uint64_t, size_t>, vector<pair<uint64_t, size_t> >, greater<pair<uint64_t, size_t> > > heap;
+};
+
+bool
+write_index(const char *path, struct index_builder &builder)
+{
+  string temporary = string(path) + ".tmp";
+  FILE *out = fopen(temporary.c_str(), "wb");
+  if (!out) {
+    cerr << "Error: cannot create " << temporary << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  struct index_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, index_magic, sizeof(header.magic));
+  header.byte_order = index_byte_order;
+  header.files = builder.files.size();
+  header.docs = builder.docs.size();
+  header.unindexed = builder.unindexed;
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+  // postings, a trigram at a time
+  header.postings_offset = sizeof(header);
+  vector<struct index_trigram> table;
+  posting_source source(builder);
+  string encoded;
+  uint64_t key;
+  bool more = source.next(key);
+  while (ok && more) {
+    struct index_trigram t;
+    t.trigram = key >> 32;
+    t.count = 0;
+    t.offset = header.postings_length;
+    uint32_t previous = 0;
+    encoded.clear();
+    do {
+      uint32_t doc = static_cast<uint32_t>(key);
+      put_varint(encoded, doc - previous);
+      previous = doc;
+      ++t.count;
+      more = source.next(key);
+    } while (more && key >> 32 == t.trigram);
+    table.push_back(t);
+    ok = fwrite(encoded.data(), 1, encoded.size(), out) == encoded.size();
+    header.postings_length += encoded.size();
+  }
+  ok = ok && !builder.failed;
+  header.trigrams = table.size();
+
+  char padding[8] = { 0 };
+  size_t pad = -header.postings_length % 8;
+  ok = ok && fwrite(padding, 1, pad, out) == pad;
+  header.table_offset = header.postings_offset + header.postings_length + pad;
+  ok = ok && fwrite(table.data(), sizeof(table[0]), table.size(), out) == table.size();
+  header.files_offset = header.table_offset + table.size() * sizeof(table[0]);
+  ok = ok && fwrite(builder.files.data(), sizeof(builder.files[0]), builder.files.size(), out) == builder.files.size();
+  header.docs_offset = header.files_offset + builder.files.size() * sizeof(builder.files[0]);
+  ok = ok && fwrite(builder.docs.data(), sizeof(builder.docs[0]), builder.docs.size(), out) == builder.docs.size();
+  header.strings_offset = header.docs_offset + builder.docs.size() * sizeof(builder.docs[0]);
+  header.strings_length = builder.strings.size();
+  ok = ok && fwrite(builder.strings.data(), 1, builder.strings.size(), out) == builder.strings.size();
+
+  ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+  ok = (fclose(out) == 0) && ok;
+  if (ok && rename(temporary.c_str(), path) == 0) {
+    cerr << "Indexed " << header.docs << " documents in " << header.files << " archives: " << header.trigrams
+         << " trigrams, " << header.postings_length << " bytes of postings, " << header.unindexed
+         << " documents with too many trigrams to index" << endl;
+    return true;
+  }
+  cerr << "Error writing " << path << ": " << strerror(errno) << endl;
+  unlink(temporary.c_str());
+  return false;
+}
+
+int
+build(const char *path, const vector<const char *> &archives)
+{
+  struct index_builder builder;
+  builder.postings.reserve(min<uint64_t>(buffer_size / sizeof(uint64_t), 1 << 20));
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  // each worker has its own decoder and trigram bitmap
+  vector<rospack_decoder *> decoders(max(jobs, 1u), nullptr);
+  vector<struct trigram_set> trigrams(decoders.size());
+  atomic<unsigned> next_worker(0);
+  atomic<size_t> next(0);
+  auto work = [&]() {
+    unsigned w = next_worker++;
+    decoders[w] = rospack_decoder_new(memory_budget);
+    for (size_t i = next++; i < archives.size(); i = next++)
+      index_archive(archives[i], decoders[w], trigrams[w], builder);
+    rospack_decoder_free(decoders[w]);
+  };
+  vector<thread> threads;
+  for (unsigned t = 1; t < decoders.size() && t < archives.size(); ++t)
+    threads.push_back(thread(work));
+  work();
+  for (size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+
+  if (builder.docs.size() >= no_member) {
+    cerr << "Error: too many documents for one index" << endl;
+    return 1;
+  }
+  if (!write_index(path, builder))
+    return 1;
+  char line[80];
+  snprintf(line, sizeof(line), "Built in %.2f s", ros_elapsed_ms(start) / 1000);
+  cerr << line << endl;
+  return 0;
+}
+
+/* A mapped index, with its sections checked against its length */
+struct index_view {
+  const uint8_t *base;
+  size_t length;
+  const struct index_header *header;
+  const struct index_trigram *table;
+  const struct index_file *files;
+  const struct index_doc *docs;
+  const uint8_t *postings;
+  const char *strings;
+
+  index_view() : base(nullptr), length(0) {}
+  ~index_view() { if (base) munmap(const_cast<uint8_t *>(base), length); }
+
+  static bool section(uint64_t offset, uint64_t count, uint64_t size, size_t length) {
+    return offset <= length && count <= (length - offset) / size;
+  }
+
+  bool open(const char *path, string &error) {
+    int fd = ::open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      error = strerror(errno);
+      if (fd >= 0)
+        close(fd);
+      return false;
+    }
+    length = st.st_size;
+    void *mapped = length >= sizeof(struct index_header) ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      length = 0;
+      error = "not an index";
+      return false;
+    }
+    base = static_cast<const uint8_t *>(mapped);
+    header = reinterpret_cast<const struct index_header *>(base);
+    if (memcmp(header->magic, index_magic, sizeof(index_magic)) != 0) {
+      error = "not an index";
+      return false;
+    }
+    if (header->byte_order != index_byte_order) {
+      error = "index built on a host of the other byte order";
+      return false;
+    }
+    if (!section(header->postings_offset, header->postings_length, 1, length)
+        || !section(header->table_offset, header->trigrams, sizeof(*table), length)
+        || !section(header->files_offset, header->files, sizeof(*files), length)
+        || !section(header->docs_offset, header->docs, sizeof(*docs), length)
+        || !section(header->strings_offset, header->strings_length, 1, length)
+        || (header->strings_length && base[header->strings_offset + header->strings_length - 1] != 0)) {
+      error = "index is truncated or corrupt";
+      return false;
+    }
+    table = reinterpret_cast<const struct index_trigram *>(base + header->table_offset);
+    files = reinterpret_cast<const struct index_file *>(base + header->files_offset);
+    docs = reinterpret_cast<const struct index_doc *>(base + header->docs_offset);
+    postings = base + header->postings_offset;
+    strings = reinterpret_cast<const char *>(base + header->strings_offset);
+    return true;
+  }
+
+  const char *string_at(uint64_t offset) const {
+    return offset < header->strings_length ? strings + offset : "";
+  }
+
+  const struct index_trigram *find(uint32_t trigram) const {
+    const struct index_trigram *end = table + header->trigrams;
+    const struct index_trigram *t = lower_bound(table, end, trigram,
+        [](const struct index_trigram &a, uint32_t b) { return a.trigram < b; });
+    return t != end && t->trigram == trigram ? t : nullptr;
+  }
+
+  void decode(const struct index_trigram &t, vector<uint32_t> &out) const {
+    out.clear();
+    out.reserve(t.count);
+    uint64_t pos = t.offset;
+    uint32_t doc = 0;
+    for (uint32_t n = 0; n < t.count && pos < header->postings_length; ++n) {
+      uint64_t delta = 0;
+      for (unsigned shift = 0; pos < header->postings_length && shift < 64; shift += 7) {
+        uint8_t b = postings[pos++];
+        delta |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80))
+          break;
+      }
+      doc += delta;
+      if (doc < header->docs)
+        out.push_back(doc);
+    }
+  }
+};
+
+/* The documents that may hold the pattern: those in the posting list of
+ * every trigram of it, and those that have no postings
+ */
+vector<uint32_t>
+candidates(const struct index_view &index, const string &pattern)
+{
+  vector<uint32_t> found;
+  if (pattern.size() < 3) {
+    for (uint32_t d = 0; d < index.header->docs; ++d)
+      found.push_back(d);
+    return found;
+  }
+
+  vector<const struct index_trigram *> lists;
+  bool missing = false;
+  for (size_t i = 0; i + 3 <= pattern.size() && !missing; ++i) {
+    uint32_t trigram = static_cast<uint8_t>(pattern[i]) << 16 | static_cast<uint8_t>(pattern[i + 1]) << 8
+                       | static_cast<uint8_t>(pattern[i + 2]);
+    const struct index_trigram *t = index.find(trigram);
+    if (!t)
+      missing = true;
+    else if (find(lists.begin(), lists.end(), t) == lists.end())
+      lists.push_back(t);
+  }
+  if (!missing) {
+    sort(lists.begin(), lists.end(), [](const struct index_trigram *a, const struct index_trigram *b) {
+      return a->count < b->count;
+    });
+    index.decode(*lists[0], found);
+    vector<uint32_t> list, common;
+    for (size_t l = 1; l < lists.size() && !found.empty(); ++l) {
+      index.decode(*lists[l], list);
+      common.clear();
+      set_intersection(found.begin(), found.end(), list.begin(), list.end(), back_inserter(common));
+      found.swap(common);
+    }
+  }
+
+  if (index.header->unindexed) {
+    vector<uint32_t> all;
+    for (uint32_t d = 0; d < index.header->docs; ++d)
+      if (index.docs[d].unindexed)
+        all.push_back(d);
+    vector<uint32_t> merged;
+    set_union(found.begin(), found.end(), all.begin(), all.end(), back_inserter(merged));
+    found.swap(merged);
+  }
+  return found;
+}
+
+struct match {
+  uint32_t doc;
+  uint64_t count;         // of occurrences
+  uint64_t first;         // offset of the first
+  string error;           // the document could not be read
+};
+
+void
+search(const uint8_t *data, size_t length, const string &pattern, struct match &m)
+{
+  m.count = 0;
+  const uint8_t *end = data + length;
+  for (const uint8_t *p = data; p + pattern.size() <= end; ++p) {
+    p = static_cast<const uint8_t *>(memmem(p, end - p, pattern.data(), pattern.size()));
+    if (!p)
+      break;
+    if (!m.count++)
+      m.first = p - data;
+  }
+}
+
+/* Read the candidate documents of one archive and look for the pattern */
+void
+verify_archive(const struct index_view &index, uint32_t file, vector<struct match> &matches, const string &pattern,
+               rospack_decoder *decoder)
+{
+  const struct index_file &indexed = index.files[file];
+  const char *path = index.string_at(indexed.path);
+  struct stat st;
+  rospack_archive *archive;
+  int error = stat(path, &st) == 0 ? rospack_open_path(path, &archive) : ROSPACK_ERR_IO;
+  if (error != ROSPACK_OK) {
+    for (size_t m = 0; m < matches.size(); ++m)
+      matches[m].error = rospack_strerror(error);
+    return;
+  }
+  bool changed = static_cast<uint64_t>(st.st_size) != indexed.size || st.st_mtime != indexed.mtime;
+
+  vector<char> buffer;
+  for (size_t m = 0; m < matches.size();) {
+    const struct index_doc &doc = index.docs[matches[m].doc];
+    size_t end = m;
+    while (end < matches.size() && index.docs[matches[end].doc].entry == doc.entry)
+      ++end;
+    const uint8_t *data;
+    size_t length;
+    string failed;
+    error = doc.entry < rospack_entry_count(archive) ? entry_content(decoder, archive, doc.entry, buffer, data, length)
+                                                     : ROSPACK_ERR_RANGE;
+    if (error != ROSPACK_OK)
+      failed = rospack_strerror(error);
+    else if (changed && strcmp(rospack_entry(archive, doc.entry)->filename, index.string_at(doc.name)) != 0)
+      failed = "the archive has changed since it was indexed";
+
+    // the members wanted from the entry's 7z archive, by folder
+    ros_7z_archive z;
+    map<unsigned, vector<size_t> > folders;
+    for (size_t i = m; i < end && failed.empty(); ++i) {
+      const struct index_doc &d = index.docs[matches[i].doc];
+      if (d.member == no_member)
+        search(data, length, pattern, matches[i]);
+      else if (!z.folder_count() && !z.open(data, length, memory_budget ? memory_budget : UINT64_MAX))
+        failed = z.error();
+      else if (d.member >= z.members().size() || !z.members()[d.member].has_stream)
+        failed = "the archive has changed since it was indexed";
+      else
+        folders[z.members()[d.member].folder].push_back(i);
+    }
+    for (auto f = folders.begin(); f != folders.end() && failed.empty(); ++f) {
+      map<unsigned, size_t> wanted;
+      for (size_t i = 0; i < f->second.size(); ++i)
+        wanted[index.docs[matches[f->second[i]].doc].member] = f->second[i];
+      vector<uint8_t> content;
+      string z_error;
+      z.extract(f->first, [&](unsigned member, const uint8_t *out, size_t out_length) {
+          auto w = wanted.find(member);
+          if (w == wanted.end())
+            return true;
+          if (out_length) {
+            content.insert(content.end(), out, out + out_length);
+            return true;
+          }
+          search(content.data(), content.size(), pattern, matches[w->second]);
+          content.clear();
+          wanted.erase(w);
+          return !wanted.empty();
+        }, z_error);
+      if (!wanted.empty())
+        failed = z_error.empty() ? "the archive has changed since it was indexed" : z_error;
+    }
+
+    for (size_t i = m; i < end && !failed.empty(); ++i)
+      matches[i].error = failed;
+    m = end;
+  }
+  rospack_close(archive);
+}
+
+void
+json_doc(ros_writer &out, const struct index_view &index, const struct index_doc &doc)
+{
+  out.key("file").string(index.string_at(index.files[doc.file].path))
+     .key("index").number(doc.entry)
+     .key("filename").string(index.string_at(doc.name))
+     .key("member");
+  if (doc.member == no_member)
+    out.null();
+  else
+    out.string(index.string_at(doc.member_name));
+  out.key("length").number(doc.length);
+}
+
+string
+doc_name(const struct index_view &index, const struct index_doc &doc)
+{
+  string name = string(index.string_at(index.files[doc.file].path)) + ": " + index.string_at(doc.name);
+  if (doc.member != no_member)
+    name += string("/") + index.string_at(doc.member_name);
+  return name;
+}
+
+int
+query(const struct index_view &index, const string &pattern, const char *shown, ros_writer *out)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<uint32_t> found = candidates(index, pattern);
+  double lookup_ms = ros_elapsed_ms(start);
+
+  vector<struct match> matches(found.size());
+  for (size_t i = 0; i < found.size(); ++i) {
+    matches[i].doc = found[i];
+    matches[i].count = 0;
+    matches[i].first = 0;
+  }
+  double verify_ms = 0;
+  if (!candidates_only) {
+    // by archive, then in entry order, so each entry is uncompressed once
+    sort(matches.begin(), matches.end(), [&index](const struct match &a, const struct match &b) {
+      const struct index_doc &x = index.docs[a.doc], &y = index.docs[b.doc];
+      return x.file != y.file ? x.file < y.file : x.entry != y.entry ? x.entry < y.entry : a.doc < b.doc;
+    });
+    vector<pair<size_t, size_t> > groups;
+    for (size_t i = 0; i < matches.size();) {
+      size_t end = i;
+      while (end < matches.size() && index.docs[matches[end].doc].file == index.docs[matches[i].doc].file)
+        ++end;
+      groups.push_back(make_pair(i, end));
+      i = end;
+    }
+    vector<rospack_decoder *> decoders(max(jobs, 1u), nullptr);
+    atomic<unsigned> next_worker(0);
+    atomic<size_t> next(0);
+    auto work = [&]() {
+      unsigned w = next_worker++;
+      decoders[w] = rospack_decoder_new(memory_budget);
+      for (size_t g = next++; g < groups.size(); g = next++) {
+        vector<struct match> group(matches.begin() + groups[g].first, matches.begin() + groups[g].second);
+        verify_archive(index, index.docs[group[0].doc].file, group, pattern, decoders[w]);
+        copy(group.begin(), group.end(), matches.begin() + groups[g].first);
+      }
+      rospack_decoder_free(decoders[w]);
+    };
+    vector<thread> threads;
+    for (unsigned t = 1; t < decoders.size() && t < groups.size(); ++t)
+      threads.push_back(thread(work));
+    work();
+    for (size_t t = 0; t < threads.size(); ++t)
+      threads[t].join();
+    verify_ms = ros_elapsed_ms(start) - lookup_ms;
+  }
+
+  size_t matched = 0, errors = 0;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const struct match &m = matches[i];
+    const struct index_doc &doc = index.docs[m.doc];
+    if (!m.error.empty()) {
+      ++errors;
+      cerr << "Error reading " << doc_name(index, doc) << ": " << m.error << endl;
+      continue;
+    }
+    if (!candidates_only && !m.count)
+      continue;
+    ++matched;
+    if (out) {
+      out->begin_object()
+          .key("type").string(candidates_only ? "candidate" : "match")
+          .key("pattern").string(shown);
+      json_doc(*out, index, doc);
+      if (!candidates_only)
+        out->key("matches").number(m.count).key("offset").number(m.first);
+      out->end_object().end_record();
+    }
+    else if (candidates_only)
+      cout << doc_name(index, doc) << "\n";
+    else {
+      char line[64];
+      snprintf(line, sizeof(line), ": %llu match%s, first at 0x%llx", static_cast<unsigned long long>(m.count),
+               m.count == 1 ? "" : "es", static_cast<unsigned long long>(m.first));
+      cout << doc_name(index, doc) << line << "\n";
+    }
+  }
+
+  char line[200];
+  if (candidates_only)
+    snprintf(line, sizeof(line), "%s: %zu candidates of %u documents in %.3f ms", shown, found.size(),
+             index.header->docs, lookup_ms);
+  else
+    snprintf(line, sizeof(line), "%s: %zu matching of %zu candidates of %u documents, looked up in %.3f ms, verified in %.1f ms",
+             shown, matched, found.size(), index.header->docs, lookup_ms, verify_ms);
+  if (out) {
+    out->begin_object()
+        .key("type").string("query")
+        .key("pattern").string(shown)
+        .key("documents").number(index.header->docs)
+        .key("candidates").number(found.size());
+    if (!candidates_only)
+      out->key("matching").number(matched);
+    out->key("errors").number(errors)
+        .key("lookup_ms").real(lookup_ms)
+        .key("verify_ms").real(verify_ms)
+        .end_object().end_record();
+    out->flush();
+  }
+  else {
+    cout.flush();
+    cerr << line << endl;
+  }
+  return errors ? 1 : 0;
+}
+
+/* Hex digits, with any spaces or colons between bytes */
+bool
+parse_hex(const char *text, string &bytes)
+{
+  bytes.clear();
+  for (const char *p = text; *p;) {
+    if (*p == ' ' || *p == ':') {
+      ++p;
+      continue;
+    }
+    if (!isxdigit(static_cast<unsigned char>(p[0])) || !isxdigit(static_cast<unsigned char>(p[1])))
+      return false;
+    char digits[3] = { p[0], p[1], 0 };
+    bytes += static_cast<char>(strtoul(digits, nullptr, 16));
+    p += 2;
+  }
+  return !bytes.empty();
+}
+
+void
+usage(char *prog_name)
+{
+  cout << "Usage: " << prog_name << " " << switch_build << "INDEX ["
+       << " " << switch_max_trigrams << "N"
+       << " " << switch_buffer << "SIZE"
+       << " " << switch_jobs << "N"
+       << " " << switch_memory << "SIZE"
+       << " ] FILENAME..." << endl
+       << "       " << prog_name << " " << switch_index << "INDEX ["
+       << " " << switch_hex
+       << " " << switch_candidates
+       << " " << switch_jobs << "N"
+       << " " << switch_memory << "SIZE"
+       << " " << switch_output << "text|json"
+       << " " << switch_help
+       << " ] PATTERN..." << endl
+       << switch_build << ": index the content of the archives, '-' reading their names from stdin" << endl
+       << switch_max_trigrams << ": verify documents with more distinct trigrams on every query instead (default 4M)" << endl
+       << switch_buffer << ": postings held in memory before they are sorted to a temporary file (default 256M)" << endl
+       << switch_index << ": find the archive entries and 7z members containing each PATTERN" << endl
+       << switch_hex << ": PATTERNs are bytes in hex, e.g. 7f454c46" << endl
+       << switch_candidates << ": list the documents the index gives without reading them" << endl
+       << switch_jobs << ": read N archives at once (default: one per CPU)" << endl
+       << switch_memory << ": memory limit of each LZMA decoder" << endl
+       << switch_output << ": report as text or as one JSON record per document and per query" << endl
+       << switch_help << ": display this help text" << endl;
+}
+
+int
+main(int argc, char **argv, char **env)
+{
+  const char *build_path = nullptr, *index_path = nullptr;
+  vector<const char *> args;
+  for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
+    char *end;
+    if (strcmp(argv[i], switch_hex) == 0)
+      hex_patterns = true;
+    else if (strncmp(argv[i], switch_help, 3) == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (strncmp(argv[i], switch_build, strlen(switch_build)) == 0)
+      build_path = argv[i] + strlen(switch_build);
+    else if (strncmp(argv[i], switch_index, strlen(switch_index)) == 0)
+      index_path = argv[i] + strlen(switch_index);
+    else if (strcmp(argv[i], switch_candidates) == 0)
+      candidates_only = true;
+    else if (strncmp(argv[i], switch_max_trigrams, strlen(switch_max_trigrams)) == 0) {
+      max_trigrams = ros_parse_size(argv[i] + strlen(switch_max_trigrams));
+      if (!max_trigrams) {
+        cerr << "Error: invalid number of trigrams: " << argv[i] + strlen(switch_max_trigrams) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_buffer, strlen(switch_buffer)) == 0) {
+      buffer_size = ros_parse_size(argv[i] + strlen(switch_buffer));
+      if (buffer_size < sizeof(uint64_t)) {
+        cerr << "Error: invalid buffer size: " << argv[i] + strlen(switch_buffer) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_jobs, strlen(switch_jobs)) == 0) {
+      jobs = strtoul(argv[i] + strlen(switch_jobs), &end, 10);
+      if (*end || jobs < 1) {
+        cerr << "Error: invalid number of jobs: " << argv[i] + strlen(switch_jobs) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_memory, strlen(switch_memory)) == 0) {
+      memory_budget = ros_parse_size(argv[i] + strlen(switch_memory));
+      if (!memory_budget) {
+        cerr << "Error: invalid memory budget: " << argv[i] + strlen(switch_memory) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_output, strlen(switch_output)) == 0) {
+      const char *format = argv[i] + strlen(switch_output);
+      if (strcmp(format, "json") == 0)
+        json = true;
+      else if (strcmp(format, "text") == 0)
+        json = false;
+      else {
+        cerr << "Error: unknown output format: " << format << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    else
+      args.push_back(argv[i]);
+  }
+  if (args.empty() || !build_path == !index_path) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!jobs)
+    jobs = thread::hardware_concurrency() ? thread::hardware_concurrency() : 1;
+
+  if (build_path) {
+    // names from stdin are kept here for the archive list to point into
+    vector<string> names;
+    vector<const char *> archives;
+    for (size_t a = 0; a < args.size(); ++a)
+      if (strcmp(args[a], "-") == 0) {
+        string name;
+        while (getline(cin, name))
+          if (!name.empty())
+            names.push_back(name);
+      }
+      else
+        archives.push_back(args[a]);
+    for (size_t n = 0; n < names.size(); ++n)
+      archives.push_back(names[n].c_str());
+    return build(build_path, archives);
+  }
+
+  struct index_view index;
+  string error;
+  if (!index.open(index_path, error)) {
+    cerr << "Error opening " << index_path << ": " << error << endl;
+    return 1;
+  }
+  ros_writer *out = json ? new ros_writer(STDOUT_FILENO) : nullptr;
+  int result = 0;
+  for (size_t a = 0; a < args.size(); ++a) {
+    string pattern = args[a];
+    if (hex_patterns && !parse_hex(args[a], pattern)) {
+      cerr << "Error: invalid hex pattern: " << args[a] << endl;
+      result = 1;
+      continue;
+    }
+    if (pattern.empty()) {
+      cerr << "Error: empty pattern" << endl;
+      result = 1;
+      continue;
+    }
+    result = max(result, query(index, pattern, args[a], out));
+  }
+  delete out;
+  return result;
+}
@@ -0,0 +1,411 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Pluggable positional I/O: io_uring with a portable pread/pwrite fall-back.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include "ros_io.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ROS_HAVE_IO_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+bool
+ros_io::submit_read(struct ros_io_request *request, int fd, char *buffer, size_t length, uint64_t offset)
+{
+  if (in_flight >= queue_depth)
+    return false;
+  request->op = ROS_IO_READ;
+  request->fd = fd;
+  request->buffer = buffer;
+  request->length = length;
+  request->offset = offset;
+  request->result = 0;
+  if (!queue(request))
+    return false;
+  ++in_flight;
+  return true;
+}
+
+bool
+ros_io::submit_write(struct ros_io_request *request, int fd, const char *buffer, size_t length, uint64_t offset)
+{
+  if (in_flight >= queue_depth)
+    return false;
+  request->op = ROS_IO_WRITE;
+  request->fd = fd;
+  request->buffer = const_cast<char *>(buffer);
+  request->length = length;
+  request->offset = offset;
+  request->result = 0;
+  if (!queue(request))
+    return false;
+  ++in_flight;
+  return true;
+}
+
+ssize_t
+ros_io::read_at(int fd, char *buffer, size_t length, uint64_t offset)
+{
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -errno;
+    if (n == 0)
+      break;
+    done += n;
+  }
+  return done;
+}
+
+ssize_t
+ros_io::write_at(int fd, const char *buffer, size_t length, uint64_t offset)
+{
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = pwrite(fd, buffer + done, length - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -errno;
+    done += n;
+  }
+  return done;
+}
+
+bool
+ros_mapped_file::open(const char *filename, uint64_t size, uint64_t input_length)
+{
+  close();
+  if (!size || size / max_ratio > input_length)
+    return false;
+  fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0)
+    return false;
+
+  // only space that is really allocated is written through the mapping; a
+  // sparse file could fail with SIGBUS when the disk fills
+  struct statvfs fs;
+  void *mapping = MAP_FAILED;
+  if (fstatvfs(fd, &fs) == 0 && size / fs.f_frsize < fs.f_bavail && fallocate(fd, 0, 0, size) == 0)
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    // leave no file, nor any space fallocate() got before it failed
+    unlink(filename);
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  map = static_cast<uint8_t *>(mapping);
+  this->size = size;
+  used = 0;
+  failed = false;
+  return true;
+}
+
+bool
+ros_mapped_file::append(const char *data, size_t length)
+{
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = pwrite(fd, data + done, length - done, used + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      failed = true;
+      return false;
+    }
+    done += n;
+  }
+  used += length;
+  return true;
+}
+
+bool
+ros_mapped_file::close()
+{
+  if (fd < 0)
+    return !failed;
+  if (munmap(map, size) < 0)
+    failed = true;
+  if (used < size && ftruncate(fd, used) < 0) // shorter than expected
+    failed = true;
+  if (::close(fd) < 0)
+    failed = true;
+  fd = -1;
+  map = nullptr;
+  size = 0;
+  return !failed;
+}
+
+/* Portable back-end: each request is carried out when it is queued and its
+ * completion is handed back by the following wait() calls.
+ */
+class ros_io_pread : public ros_io {
+  public:
+    explicit ros_io_pread(unsigned depth)
+      : ros_io(depth), completed(new struct ros_io_request *[depth]), head(0), count(0) {}
+    virtual ~ros_io_pread() { delete[] completed; }
+
+    virtual const char *name() const { return "pread"; }
+    virtual bool synchronous() const { return true; }
+    virtual void submit() {}
+
+    virtual struct ros_io_request *wait() {
+      if (!count)
+        return nullptr;
+      struct ros_io_request *request = completed[head];
+      head = (head + 1) % queue_depth;
+      --count;
+      --in_flight;
+      return request;
+    }
+
+  protected:
+    virtual bool queue(struct ros_io_request *request) {
+      if (request->op == ROS_IO_READ)
+        request->result = read_at(request->fd, request->buffer, request->length, request->offset);
+      else
+        request->result = write_at(request->fd, request->buffer, request->length, request->offset);
+      completed[(head + count) % queue_depth] = request;
+      ++count;
+      return true;
+    }
+
+  private:
+    struct ros_io_request **completed;
+    unsigned head;
+    unsigned count;
+};
+
+#if defined(ROS_HAVE_IO_URING)
+
+/* Linux io_uring back-end, driven through the raw system calls so there is no
+ * dependency on liburing. Vectored read/write opcodes are used because they
+ * are supported by every kernel that has io_uring.
+ */
+class ros_io_uring : public ros_io {
+  public:
+    explicit ros_io_uring(unsigned depth)
+      : ros_io(depth), ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sqes(nullptr),
+        sq_ring_size(0), cq_ring_size(0), sqes_size(0), to_submit(0) {}
+
+    virtual ~ros_io_uring() {
+      if (sqes)
+        munmap(sqes, sqes_size);
+      if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        munmap(cq_ring, cq_ring_size);
+      if (sq_ring != MAP_FAILED)
+        munmap(sq_ring, sq_ring_size);
+      if (ring_fd >= 0)
+        close(ring_fd);
+    }
+
+    bool init();
+
+    virtual const char *name() const { return "io_uring"; }
+    virtual void submit();
+    virtual struct ros_io_request *wait();
+
+  protected:
+    virtual bool queue(struct ros_io_request *request);
+
+  private:
+    int enter(unsigned submit, unsigned min_complete, unsigned flags) {
+      return syscall(__NR_io_uring_enter, ring_fd, submit, min_complete, flags, nullptr, 0);
+    }
+
+    int ring_fd;
+    void *sq_ring;
+    void *cq_ring;
+    struct io_uring_sqe *sqes;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;   // queued but not yet handed to the kernel
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+bool
+ros_io_uring::init()
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+  if (ring_fd < 0)
+    return false;
+
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cq_ring_size > sq_ring_size)
+      sq_ring_size = cq_ring_size;
+    cq_ring_size = sq_ring_size;
+  }
+
+  sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED)
+    return false;
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    cq_ring = sq_ring;
+  else {
+    cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED)
+      return false;
+  }
+  sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (map == MAP_FAILED)
+    return false;
+  sqes = static_cast<struct io_uring_sqe *>(map);
+
+  char *sq = static_cast<char *>(sq_ring);
+  char *cq = static_cast<char *>(cq_ring);
+  sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  // the kernel may round the ring up; never queue more than it holds
+  if (params.sq_entries < queue_depth)
+    queue_depth = params.sq_entries;
+  return true;
+}
+
+bool
+ros_io_uring::queue(struct ros_io_request *request)
+{
+  unsigned tail = *sq_tail;
+  unsigned index = tail & *sq_mask;
+  struct io_uring_sqe *sqe = &sqes[index];
+
+  request->iov.iov_base = request->buffer;
+  request->iov.iov_len = request->length;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = request->op == ROS_IO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+  sqe->fd = request->fd;
+  sqe->off = request->offset;
+  sqe->addr = reinterpret_cast<uintptr_t>(&request->iov);
+  sqe->len = 1;
+  sqe->user_data = reinterpret_cast<uintptr_t>(request);
+  sq_array[index] = index;
+
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++to_submit;
+  return true;
+}
+
+void
+ros_io_uring::submit()
+{
+  while (to_submit) {
+    int ret = enter(to_submit, 0, 0);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+      return; // left queued; wait() will retry
+    }
+    to_submit -= ret;
+  }
+}
+
+struct ros_io_request *
+ros_io_uring::wait()
+{
+  if (!in_flight)
+    return nullptr;
+
+  for (;;) {
+    unsigned head = *cq_head;
+    if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+      struct ros_io_request *request = reinterpret_cast<struct ros_io_request *>(static_cast<uintptr_t>(cqe->user_data));
+      request->result = cqe->res;
+      __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+      --in_flight;
+
+      // a short transfer that is not end-of-file is continued synchronously
+      if (request->result > 0 && static_cast<size_t>(request->result) < request->length) {
+        ssize_t rest = request->op == ROS_IO_READ
+          ? read_at(request->fd, request->buffer + request->result, request->length - request->result, request->offset + request->result)
+          : write_at(request->fd, request->buffer + request->result, request->length - request->result, request->offset + request->result);
+        request->result = rest < 0 ? rest : request->result + rest;
+      }
+      return request;
+    }
+
+    int ret = enter(to_submit, 1, IORING_ENTER_GETEVENTS);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+      return nullptr;
+    }
+    to_submit -= ret;
+  }
+}
+
+#endif
+
+ros_io *
+ros_io::create(enum ros_io_backend backend, unsigned depth)
+{
+  if (depth == 0)
+    depth = 1;
+#if defined(ROS_HAVE_IO_URING)
+  if (backend == ROS_IO_AUTO || backend == ROS_IO_URING) {
+    ros_io_uring *io = new ros_io_uring(depth);
+    if (io->init())
+      return io;
+    delete io;
+    if (backend == ROS_IO_URING)
+      return nullptr;
+  }
+#else
+  if (backend == ROS_IO_URING)
+    return nullptr;
+#endif
+  return new ros_io_pread(depth);
+}
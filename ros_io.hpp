@@ -0,0 +1,154 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Pluggable positional I/O: io_uring with a portable pread/pwrite fall-back.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_IO_HPP__
+#define __ROS_IO_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+enum ros_io_backend {
+  ROS_IO_AUTO = 0,   // io_uring when the kernel allows it, else pread
+  ROS_IO_PREAD,
+  ROS_IO_URING
+};
+
+enum ros_io_op {
+  ROS_IO_READ,
+  ROS_IO_WRITE
+};
+
+/* One positional read or write. The request is owned by the caller and must
+ * stay in place until it is returned by ros_io::wait().
+ */
+struct ros_io_request {
+  enum ros_io_op op;
+  int fd;
+  char *buffer;
+  size_t length;
+  uint64_t offset;
+  ssize_t result;     // bytes transferred, or -errno
+  void *user;         // for the caller to identify the request
+  struct iovec iov;   // (internal)
+};
+
+/* Asynchronous queue of positional I/O requests.
+ *
+ * Requests are queued with submit_read()/submit_write() and handed to the
+ * kernel by submit(), so callers can keep several reads in flight ahead of
+ * the data they are processing and let writes complete in the background.
+ * Completions are collected in any order with wait().
+ */
+class ros_io {
+  public:
+    virtual ~ros_io() {}
+
+    virtual const char *name() const = 0;
+
+    /* queue a request; false if depth() requests are already outstanding */
+    bool submit_read(struct ros_io_request *request, int fd, char *buffer, size_t length, uint64_t offset);
+    bool submit_write(struct ros_io_request *request, int fd, const char *buffer, size_t length, uint64_t offset);
+
+    /* start all queued requests without waiting for them */
+    virtual void submit() = 0;
+
+    /* return one completed request, blocking until there is one;
+     * nullptr if nothing is outstanding */
+    virtual struct ros_io_request *wait() = 0;
+
+    unsigned outstanding() const { return in_flight; }
+    unsigned depth() const { return queue_depth; }
+
+    /* requests are carried out within submit_read()/submit_write(), so wait()
+     * only hands back ones that have already completed */
+    virtual bool synchronous() const { return false; }
+
+    /* synchronous helpers for callers outside the hot path */
+    ssize_t read_at(int fd, char *buffer, size_t length, uint64_t offset);
+    ssize_t write_at(int fd, const char *buffer, size_t length, uint64_t offset);
+
+    /* the requested backend, or nullptr if it is not available */
+    static ros_io *create(enum ros_io_backend backend, unsigned depth);
+
+  protected:
+    explicit ros_io(unsigned depth) : queue_depth(depth), in_flight(0) {}
+
+    virtual bool queue(struct ros_io_request *request) = 0;
+
+    unsigned queue_depth;
+    unsigned in_flight;
+
+  private:
+    ros_io(const ros_io &);
+    ros_io &operator=(const ros_io &);
+};
+
+/* An output file whose size is known before it is written, such as an entry
+ * whose sub-header gives its uncompressed length. The space is allocated up
+ * front with fallocate() and the file mapped, so a decoder can put its output
+ * straight into the page cache without a copy through a buffer. Output past
+ * the expected size is appended with pwrite(), and the file is cut to what
+ * was actually written when it is closed.
+ */
+class ros_mapped_file {
+  public:
+    ros_mapped_file() : fd(-1), map(nullptr), size(0), used(0), failed(false) {}
+    ~ros_mapped_file() { close(); }
+
+    /* Create filename with size bytes allocated and mapped, for the output
+     * of input_length bytes of compressed data. False, with no file left
+     * behind, if size is more than max_ratio times input_length or than the
+     * free space (it comes from an untrusted header), or if the file system
+     * cannot allocate or map it, so the caller can write the file the
+     * ordinary way instead.
+     */
+    bool open(const char *filename, uint64_t size, uint64_t input_length);
+
+    static const uint64_t max_ratio = 1024;
+
+    /* The rest of the mapping, for the next output; length 0 once it is full */
+    uint8_t *space(size_t &length) const {
+      length = used < size ? size - used : 0;
+      return map + used;
+    }
+    void advance(size_t length) { used += length; }   // after filling space()
+    bool append(const char *data, size_t length);      // past the mapping
+
+    uint64_t written() const { return used; }
+    bool close();   // false if any of it could not be written
+
+  private:
+    ros_mapped_file(const ros_mapped_file &);
+    ros_mapped_file &operator=(const ros_mapped_file &);
+
+    int fd;
+    uint8_t *map;
+    uint64_t size;      // mapped
+    uint64_t used;      // written
+    bool failed;
+};
+
+#endif
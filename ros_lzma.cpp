@@ -0,0 +1,135 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Incremental LZMA decoder for payload data fed in chunks.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ros_lzma.hpp"
+
+ros_decoder::ros_decoder()
+  : stream(LZMA_STREAM_INIT), initialised(false), active(false)
+{
+  stream.allocator = allocator.get();
+}
+
+ros_decoder::~ros_decoder()
+{
+  release();
+}
+
+bool
+ros_decoder::begin(uint64_t memlimit)
+{
+  // re-initialising an existing context resets it without freeing its memory;
+  // accepts both .xz and the .lzma (LZMA_Alone) format used by payload entries
+  initialised = true;
+  active = lzma_auto_decoder(&stream, memlimit, 0) == LZMA_OK;
+  return active;
+}
+
+void
+ros_decoder::end()
+{
+  active = false;
+}
+
+void
+ros_decoder::release()
+{
+  if (initialised) {
+    lzma_end(&stream);
+    initialised = false;
+  }
+  active = false;
+}
+
+lzma_ret
+ros_decoder::decode(const uint8_t *&in, size_t &in_length, uint8_t *&out, size_t &out_length, bool finish)
+{
+  if (!active)
+    return LZMA_PROG_ERROR;
+
+  stream.next_in = in;
+  stream.avail_in = in_length;
+  stream.next_out = out;
+  stream.avail_out = out_length;
+
+  lzma_ret ret = LZMA_OK;
+  while (ret == LZMA_OK && stream.avail_out > 0 && (stream.avail_in > 0 || finish))
+    ret = lzma_code(&stream, finish ? LZMA_FINISH : LZMA_RUN);
+
+  in = stream.next_in;
+  in_length = stream.avail_in;
+  out = stream.next_out;
+  out_length = stream.avail_out;
+  return ret;
+}
+
+static uint64_t
+filters_memusage(lzma_filter *filters)
+{
+  uint64_t usage = lzma_raw_decoder_memusage(filters);
+  for (unsigned i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i)
+    free(filters[i].options);  // allocated by liblzma with malloc()
+  return usage == UINT64_MAX ? 0 : usage;
+}
+
+uint64_t
+ros_lzma_memusage(const uint8_t *data, size_t length)
+{
+  static const uint8_t xz_magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+
+  if (length >= LZMA_STREAM_HEADER_SIZE && memcmp(data, xz_magic, sizeof(xz_magic)) == 0) {
+    lzma_stream_flags flags;
+    if (lzma_stream_header_decode(&flags, data) != LZMA_OK || length < LZMA_STREAM_HEADER_SIZE + 1)
+      return 0;
+    const uint8_t *header = data + LZMA_STREAM_HEADER_SIZE;
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block;
+    memset(&block, 0, sizeof(block));
+    block.version = 1;
+    block.check = flags.check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode(header[0]);
+    if (header[0] == 0x00 || length < LZMA_STREAM_HEADER_SIZE + block.header_size) // index: empty stream
+      return 0;
+    if (lzma_block_header_decode(&block, nullptr, header) != LZMA_OK)
+      return 0;
+    return filters_memusage(filters);
+  }
+
+  // .lzma: properties byte, 32-bit little-endian dictionary size, 64-bit uncompressed size
+  if (length < 13)
+    return 0;
+  lzma_filter filters[2] = { { LZMA_FILTER_LZMA1, nullptr }, { LZMA_VLI_UNKNOWN, nullptr } };
+  if (lzma_properties_decode(&filters[0], nullptr, data, 5) != LZMA_OK)
+    return 0;
+  return filters_memusage(filters);
+}
+
+uint64_t
+ros_lzma_default_budget()
+{
+  uint64_t physical = lzma_physmem();
+  return physical ? physical / 4 : 1024ULL * 1024 * 1024;
+}
@@ -0,0 +1,84 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Incremental LZMA decoder for payload data fed in chunks.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_LZMA_HPP__
+#define __ROS_LZMA_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <lzma.h>
+#include "ros_pool.hpp"
+
+/* Decodes one payload entry at a time. Payload data is stored in the legacy
+ * .lzma (LZMA_Alone) format, but .xz is recognised too.
+ *
+ * The input is pushed in whatever chunks it arrives in; each decode() call
+ * consumes input and fills output until one of them is exhausted, so the
+ * caller can hand a full output buffer on and call again.
+ *
+ * The decoder context is kept between entries: begin() re-initialises the
+ * existing lzma_stream, which lets liblzma reuse its coder state and, when
+ * the dictionary size is unchanged, the dictionary itself. Other blocks are
+ * recycled through the decoder's ros_lzma_allocator.
+ */
+class ros_decoder {
+  public:
+    ros_decoder();
+    ~ros_decoder();
+
+    bool begin(uint64_t memlimit = UINT64_MAX);   // start a new stream
+    void end();     // finish the stream, keeping the context for the next
+    void release(); // free the context
+
+    /* Advances in/in_length and out/out_length past what was used.
+     * finish marks in as the last of the stream's input.
+     * Returns LZMA_OK, LZMA_STREAM_END at the end of the stream, or an error.
+     */
+    lzma_ret decode(const uint8_t *&in, size_t &in_length, uint8_t *&out, size_t &out_length, bool finish);
+
+    uint64_t total_out() const { return stream.total_out; }
+    const ros_lzma_allocator &memory() const { return allocator; }
+    void set_cache_limit(size_t limit) { allocator.set_cache_limit(limit); }
+
+  private:
+    ros_decoder(const ros_decoder &);
+    ros_decoder &operator=(const ros_decoder &);
+
+    ros_lzma_allocator allocator;
+    lzma_stream stream;
+    bool initialised;   // stream holds a liblzma context
+    bool active;        // a stream has begun and not ended
+};
+
+/* Decoder memory needed for the stream that starts with data, worked out
+ * from its first bytes: the properties and dictionary size of .lzma, or the
+ * filters in the first block header of .xz. Returns 0 if they are not
+ * recognised or not all there.
+ */
+uint64_t ros_lzma_memusage(const uint8_t *data, size_t length);
+
+/* The default memory budget for decoding: a quarter of physical memory */
+uint64_t ros_lzma_default_budget();
+
+#endif
@@ -114,7 +114,7 @@ struct ros_arc_header {
   struct ros_header_version version;
   struct ros_header_timestamp timestamp;
   unsigned int unknown1; // offset 16
-  unsigned int uncompressed_length; // may be 64-bit (unsigned long): see https://github.com/iam-TJ/ros_pack/issues/1
+  unsigned int uncompressed_length; // may be 64-bit with unknown2 (see ros_entry): see https://github.com/iam-TJ/ros_pack/issues/1
   unsigned int unknown2;
   unsigned int unknown3;
 };
@@ -124,6 +124,7 @@ struct data_sig {
   char magic[16];
   unsigned int  magic_length;
   const char *title;
+  unsigned int offset;   // of the magic from the start of the data
 };
 
 #endif
@@ -0,0 +1,89 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Payload entry checksum, sub-header and data type probing.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#include "ros_payload.hpp"
+#include "ros_view.hpp"
+
+unsigned int
+checksum_calc(unsigned int checksum, const char *data, size_t length)
+{
+  for (const unsigned char *p = reinterpret_cast<const unsigned char *>(data); p && p < reinterpret_cast<const unsigned char *>(data) + length; ++p)
+    checksum += *p;
+
+  return checksum;
+}
+
+template<enum ros_byte_order ORDER>
+static unsigned
+probe(struct ros_entry &entry, const ros_sig_db &sigs, const char *arc_magic, const char *data, unsigned length)
+{
+  unsigned real_offset = 0;
+  ros_arc_header_view<ORDER> arc_header(data);
+
+  entry.data_sig = DATA_SIG_NONE;
+
+  // examine the ARC sub-header
+  if (length >= ros_arc_header_view<ORDER>::size && strncmp(arc_header.arc_magic(), arc_magic, sizeof ros_header_version::arc_magic) == 0) {
+    // found an ARC sub-header - the data follows it
+    real_offset = ros_arc_header_view<ORDER>::size;
+
+    entry.sub_header = true;
+    entry.arc_header = arc_header.host();
+    // the year is often stored in the other byte order from the rest of the archive
+    entry.link_year = static_cast<int>(entry.arc_header.timestamp.link_year);
+    if (entry.link_year > 2100) { // probably need to swap byte order
+      entry.link_year = ((entry.link_year & 0xFF) << 8) | ((entry.link_year & 0xFF00) >> 8);
+      entry.link_year_swapped = true;
+    }
+    entry.uncompressed_length = entry.arc_header.uncompressed_length;
+    entry.uncompressed_length_64 = false;
+  }
+
+  // try to identify the payload data type
+  if (length > real_offset)
+    entry.data_sig = sigs.match(data + real_offset, length - real_offset);
+
+  // some sub-headers store uncompressed_length in 64 bits, over unknown2; an
+  // LZMA header that records the size tells which
+  const unsigned lzma_size_offset = 5;  // after the properties and dictionary size
+  if (entry.sub_header && entry.data_sig == DATA_SIG_LZMA && length >= real_offset + lzma_size_offset + 8) {
+    uint64_t size = ros_load<ROS_LITTLE_ENDIAN, uint64_t>(reinterpret_cast<const unsigned char *>(data) + real_offset + lzma_size_offset);
+    if (size != entry.uncompressed_length && size == arc_header.uncompressed_length64()) {
+      entry.uncompressed_length = size;
+      entry.uncompressed_length_64 = true;
+    }
+  }
+
+  return real_offset;
+}
+
+unsigned
+probe_entry(struct ros_entry &entry, const ros_sig_db &sigs, enum ros_byte_order order,
+            const char *arc_magic, const char *data, unsigned length)
+{
+  if (order == ROS_BIG_ENDIAN)
+    return probe<ROS_BIG_ENDIAN>(entry, sigs, arc_magic, data, length);
+  return probe<ROS_LITTLE_ENDIAN>(entry, sigs, arc_magic, data, length);
+}
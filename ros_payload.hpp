@@ -0,0 +1,79 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Payload entry checksum, sub-header and data type probing.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_PAYLOAD_HPP__
+#define __ROS_PAYLOAD_HPP__
+
+#include <stdint.h>
+#include <vector>
+#include "ros_carve.hpp"
+#include "ros_digest.hpp"
+#include "ros_entropy.hpp"
+#include "ros_pack.hpp"
+#include "ros_sigs.hpp"
+#include "ros_stats.hpp"
+#include "ros_view.hpp"
+
+/* What was learned about a payload entry while it was processed */
+struct ros_entry {
+  unsigned index;
+  struct ros_dirent dirent;         // from the directory, in host order
+  bool sub_header;
+  struct ros_arc_header arc_header; // in host order
+  int link_year;                    // arc_header link_year in host order
+  bool link_year_swapped;
+  uint64_t uncompressed_length;     // from the sub-header
+  bool uncompressed_length_64;      // the sub-header stores it in 64 bits
+  int data_sig;                     // index into the signature database, or DATA_SIG_NONE
+  uint64_t read_length;             // payload bytes actually read
+  bool decode;                      // data is to be uncompressed
+  bool deferred;                    // by the decode scheduler, after the pipeline
+  uint64_t decode_memory;           // decoder memory needed, 0 if unknown
+  bool over_budget;                 // decode_memory exceeds the memory budget
+  bool decode_error;
+  uint64_t decoded_length;
+  bool length_mismatch;             // decoded_length is not the sub-header's uncompressed_length
+  bool mapped;                      // decoded straight into its preallocated output file
+  bool extracted;
+  bool write_error;
+  std::vector<struct ros_carve_match> carved;   // objects found in the data
+  uint64_t strings;                 // printable strings found in the data
+  struct ros_entropy_profile entropy;   // of the data, uncompressed if it was decoded
+  struct ros_digests raw_digests;   // of the entry as stored in the archive, sub-header included
+  struct ros_digests data_digests;  // of the data, uncompressed if it was decoded
+  uint64_t ns[PHASE_MAX];           // time spent on this entry by each phase
+};
+
+unsigned int checksum_calc(unsigned int checksum, const char *data, size_t length);
+
+/* Examine the first chunk of an entry for an ARC sub-header whose magic
+ * matches the archive's arc_magic, and for a data type signature in sigs.
+ * The sub-header is read in the archive's byte order. Its uncompressed_length
+ * is taken as 64 bits when the size in an LZMA header says so.
+ * Returns the number of sub-header bytes that precede the data.
+ */
+unsigned probe_entry(struct ros_entry &entry, const ros_sig_db &sigs, enum ros_byte_order order,
+                     const char *arc_magic, const char *data, unsigned length);
+
+#endif
@@ -0,0 +1,553 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Staged read -> checksum/probe -> decode -> write pipeline for payload entries.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include "ros_pipeline.hpp"
+
+ros_pipeline::ros_pipeline(ros_io *io, ros_stats &stats, const ros_sig_db &sigs)
+  : io(io), stats(stats), sigs(sigs), buffers(chunk_size), carver(nullptr), strings(nullptr), entropy(nullptr), stream(nullptr), uncompress(true), digests(false), archive_hasher(nullptr), fd(-1), order(ROS_LITTLE_ENDIAN), arc_magic(nullptr), entries(nullptr), count(0),
+    checksum(0), extract(false), decode_mode(DECODE_NONE), memory_limit(UINT64_MAX)
+{
+  for (unsigned i = 0; i < input_chunks; ++i) {
+    inputs[i].buffer = buffers.get();
+    inputs[i].capacity = chunk_size;
+    inputs[i].request.user = &inputs[i];
+    free_inputs.push(&inputs[i]);
+  }
+  for (unsigned i = 0; i < output_chunks; ++i) {
+    outputs[i].buffer = buffers.get();
+    outputs[i].capacity = chunk_size;
+    free_outputs.push(&outputs[i]);
+  }
+  memset(&end_chunk, 0, sizeof(end_chunk));
+  end_chunk.flags = CHUNK_END;
+}
+
+ros_pipeline::~ros_pipeline()
+{
+  for (unsigned i = 0; i < input_chunks; ++i)
+    buffers.put(inputs[i].buffer);
+  for (unsigned i = 0; i < output_chunks; ++i)
+    buffers.put(outputs[i].buffer);
+}
+
+unsigned int
+ros_pipeline::run(int fd, enum ros_byte_order order, const char *arc_magic, struct ros_entry *entries, unsigned count,
+                  unsigned int checksum, bool extract, enum ros_decode_mode mode)
+{
+  this->fd = fd;
+  this->order = order;
+  this->arc_magic = arc_magic;
+  this->entries = entries;
+  this->count = count;
+  this->checksum = checksum;
+  this->extract = extract;
+  this->decode_mode = mode;
+  memset(&mapped_writes, 0, sizeof(mapped_writes));
+
+  std::thread check(&ros_pipeline::check_stage, this);
+  std::thread decode(&ros_pipeline::decode_stage, this);
+  std::thread write(&ros_pipeline::write_stage, this);
+  read_stage();
+  check.join();
+  decode.join();
+  write.join();
+  stats.add_phase(PHASE_WRITE, mapped_writes);
+  if (carver) // the carver's workers kept their own counts
+    stats.add_phase(PHASE_CARVE, carver->take_stats());
+  if (strings)
+    stats.add_phase(PHASE_STRINGS, strings->take_stats());
+  if (entropy)
+    stats.add_phase(PHASE_ENTROPY, entropy->take_stats());
+
+  return this->checksum;
+}
+
+/* Cut the entries into chunks and keep up to input_chunks reads in flight,
+ * passing the chunks on in payload order as their reads complete.
+ */
+void
+ros_pipeline::read_stage()
+{
+  struct ros_chunk *in_flight[input_chunks];
+  unsigned head = 0, queued = 0;
+  const unsigned depth = io->depth() < input_chunks ? io->depth() : input_chunks;
+  unsigned entry = 0;
+  uint64_t position = 0;      // within the entry
+  ros_backoff backoff;
+
+  for (;;) {
+    struct ros_chunk *chunk;
+    while (entry < count && queued < depth && free_inputs.try_pop(chunk)) {
+      const struct ros_dirent &dirent = entries[entry].dirent;
+      uint64_t left = dirent.length - position;
+      chunk->entry = entry;
+      chunk->flags = position == 0 ? CHUNK_FIRST : 0;
+      chunk->skip = 0;
+      chunk->length = left > chunk_size ? chunk_size : left;
+      chunk->done = chunk->length == 0;
+      chunk->read_ns = 0;
+      if (!chunk->done) {
+        chunk->submitted = stats.mark();
+        io->submit_read(&chunk->request, fd, chunk->buffer, chunk->length, dirent.offset + position);
+        if (io->synchronous())
+          chunk->read_ns = stats.mark() - chunk->submitted;
+      }
+      in_flight[(head + queued) % input_chunks] = chunk;
+      ++queued;
+
+      position += chunk->length;
+      if (position >= dirent.length) {
+        chunk->flags |= CHUNK_LAST;
+        position = 0;
+        ++entry;
+      }
+    }
+    io->submit();
+
+    if (!queued) {
+      if (entry >= count)
+        break;
+      backoff.pause(); // all buffers are further down the pipeline
+      continue;
+    }
+    backoff.reset();
+
+    // each read is timed from its submission to its completion, not by the
+    // wait for the head chunk, which read-ahead has usually already filled
+    chunk = in_flight[head];
+    while (!chunk->done) {
+      struct ros_io_request *request = io->wait();
+      if (!request) { // the I/O queue failed; give up on what is outstanding
+        for (unsigned i = 0; i < queued; ++i) {
+          in_flight[(head + i) % input_chunks]->request.result = -1;
+          in_flight[(head + i) % input_chunks]->done = true;
+        }
+        break;
+      }
+      struct ros_chunk *completed = static_cast<struct ros_chunk *>(request->user);
+      completed->done = true;
+      if (!io->synchronous())
+        completed->read_ns = stats.mark() - completed->submitted;
+    }
+    if (chunk->length && chunk->request.result != static_cast<ssize_t>(chunk->length)) // truncated archive
+      chunk->length = chunk->request.result > 0 ? chunk->request.result : 0;
+    entries[chunk->entry].ns[PHASE_READ] += chunk->read_ns;
+    struct ros_phase_stats read = { chunk->read_ns, chunk->length, 1 };
+    stats.add_phase(PHASE_READ, read);
+
+    head = (head + 1) % input_chunks;
+    --queued;
+    read_check.push(chunk);
+  }
+
+  read_check.push(&end_chunk);
+}
+
+/* Checksum every chunk in payload order and probe the first chunk of each
+ * entry for its sub-header and data type.
+ */
+void
+ros_pipeline::check_stage()
+{
+  for (;;) {
+    struct ros_chunk *chunk = read_check.pop();
+    if (chunk->flags & CHUNK_END) {
+      check_decode.push(chunk);
+      break;
+    }
+    struct ros_entry &entry = entries[chunk->entry];
+
+    ros_stats_mark mark;
+    if (!digests) {
+      mark = stats.mark();
+      checksum = checksum_calc(checksum, chunk->buffer, chunk->length);
+      entry.ns[PHASE_CHECKSUM] += stats.mark() - mark;
+      stats.add(PHASE_CHECKSUM, mark, chunk->length);
+    }
+    else {
+      // a slice at a time, so the hashers read what the checksum just brought into cache
+      if (chunk->flags & CHUNK_FIRST)
+        raw_hasher.begin();
+      for (unsigned offset = 0; offset < chunk->length; offset += digest_slice) {
+        const char *slice = chunk->buffer + offset;
+        unsigned length = chunk->length - offset < digest_slice ? chunk->length - offset : digest_slice;
+        mark = stats.mark();
+        checksum = checksum_calc(checksum, slice, length);
+        ros_stats_mark hashed = stats.mark();
+        entry.ns[PHASE_CHECKSUM] += hashed - mark;
+        stats.add(PHASE_CHECKSUM, mark, length);
+        raw_hasher.update(slice, length);
+        if (archive_hasher)
+          archive_hasher->update(slice, length);
+        entry.ns[PHASE_HASH_RAW] += stats.mark() - hashed;
+        stats.add(PHASE_HASH_RAW, hashed, length);
+      }
+    }
+    entry.read_length += chunk->length;
+    if (digests && (chunk->flags & CHUNK_LAST)) {
+      raw_hasher.end(entry.raw_digests);
+      entry.raw_digests.valid = entry.read_length == entry.dirent.length;
+    }
+
+    if (chunk->flags & CHUNK_FIRST) {
+      mark = stats.mark();
+      chunk->skip = probe_entry(entry, sigs, order, arc_magic, chunk->buffer, chunk->length);
+      entry.decode = decode_mode != DECODE_NONE && ros_sig_db::decodable(entry.data_sig);
+      if (entry.decode) {
+        entry.decode_memory = ros_lzma_memusage(reinterpret_cast<const uint8_t *>(chunk->buffer + chunk->skip),
+                                                chunk->length - chunk->skip);
+        entry.over_budget = entry.decode_memory > memory_limit;
+        entry.deferred = decode_mode == DECODE_DEFER;
+      }
+      entry.ns[PHASE_PROBE] += stats.mark() - mark;
+      stats.add(PHASE_PROBE, mark, 0);
+    }
+
+    check_decode.push(chunk);
+  }
+}
+
+/* Uncompress the entries marked for decoding into output chunks; the input
+ * chunks follow their output to the write stage to be returned. An entry
+ * extracted to a file whose size is known from its sub-header is decoded
+ * straight into the file instead, and the write stage passes it by.
+ */
+void
+ros_pipeline::decode_stage()
+{
+  struct ros_chunk *out = nullptr;
+  ros_mapped_file mapped;  // the output file of a mapped entry
+  bool began = false; // the decoder was started for the entry
+  bool ended = false; // the entry's stream has ended
+
+  for (;;) {
+    struct ros_chunk *chunk = check_decode.pop();
+    if (chunk->flags & CHUNK_END) {
+      if (out) {
+        out->flags = CHUNK_RETURN;
+        decode_write.push(out);
+      }
+      decode_write.push(chunk);
+      break;
+    }
+    struct ros_entry &entry = entries[chunk->entry];
+    if (!entry.decode || entry.deferred) {
+      decode_write.push(chunk);
+      continue;
+    }
+
+    if (chunk->flags & CHUNK_FIRST) {
+      ended = false;
+      began = !entry.over_budget && decoder.begin(memory_limit);
+      if (!began)
+        entry.decode_error = true;
+      else if (extract && uncompress && !carver && !strings && !entropy && !digests && !stream && entry.sub_header && entry.uncompressed_length) {
+        char filename[sizeof(entry.dirent.filename) + 1];
+        memcpy(filename, entry.dirent.filename, sizeof(entry.dirent.filename));
+        filename[sizeof(entry.dirent.filename)] = '\0';
+        ros_stats_mark mark = stats.mark();
+        entry.mapped = mapped.open(filename, entry.uncompressed_length, entry.dirent.length - chunk->skip);
+        add_mapped_write(entry, mark, 0);
+      }
+    }
+
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(chunk->buffer + chunk->skip);
+    size_t in_length = chunk->length - chunk->skip;
+    const bool finish = chunk->flags & CHUNK_LAST;
+    while (!entry.decode_error && !ended) {
+      // into the mapping while it has room, any more into an output chunk
+      size_t space = 0;
+      uint8_t *next_out = entry.mapped ? mapped.space(space) : nullptr;
+      const bool direct = space > 0;
+      if (!direct) {
+        if (!out) {
+          out = free_outputs.pop();
+          out->length = 0;
+        }
+        if (out->length == 0) {
+          out->entry = chunk->entry;
+          out->flags = CHUNK_DECODED;
+          out->skip = 0;
+        }
+        next_out = reinterpret_cast<uint8_t *>(out->buffer + out->length);
+        space = out->capacity - out->length;
+      }
+      size_t out_length = space;
+
+      ros_stats_mark mark = stats.mark();
+      lzma_ret ret = decoder.decode(in, in_length, next_out, out_length, finish);
+      size_t produced = space - out_length;
+      entry.ns[PHASE_DECOMPRESS] += stats.mark() - mark;
+      stats.add(PHASE_DECOMPRESS, mark, produced);
+      if (direct)
+        mapped.advance(produced);
+      else
+        out->length += produced;
+
+      if (ret == LZMA_STREAM_END)
+        ended = true;
+      else if (ret != LZMA_OK)
+        entry.decode_error = true;
+
+      if (!direct && out->length == out->capacity)
+        flush_output(entry, out, mapped);
+      else if (out_length > 0 && in_length == 0 && !finish)
+        break; // wants more input
+    }
+
+    if (finish) {
+      if (out && out->length)
+        flush_output(entry, out, mapped);
+      entry.decoded_length = began ? decoder.total_out() : 0;
+      if (!ended)
+        entry.decode_error = true; // the stream is truncated
+      else if (entry.sub_header && entry.decoded_length != entry.uncompressed_length)
+        entry.length_mismatch = true;
+      decoder.end();
+
+      if (entry.mapped) {
+        ros_stats_mark mark = stats.mark();
+        if (!mapped.close())
+          entry.write_error = true;
+        entry.extracted = !entry.write_error;
+        add_mapped_write(entry, mark, mapped.written());
+      }
+    }
+
+    chunk->flags |= CHUNK_DISCARD;
+    decode_write.push(chunk);
+  }
+}
+
+/* A full output chunk goes on to the write stage, or for a mapped entry
+ * whose output has outgrown its file is appended to it and reused
+ */
+void
+ros_pipeline::flush_output(struct ros_entry &entry, struct ros_chunk *&out, ros_mapped_file &mapped)
+{
+  if (!entry.mapped) {
+    decode_write.push(out);
+    out = nullptr;
+    return;
+  }
+  ros_stats_mark mark = stats.mark();
+  if (!mapped.append(out->buffer, out->length))
+    entry.write_error = true;
+  add_mapped_write(entry, mark, 0);
+  out->length = 0;
+}
+
+/* Count a write by the decode stage in its own mapped_writes */
+void
+ros_pipeline::add_mapped_write(struct ros_entry &entry, ros_stats_mark mark, uint64_t bytes)
+{
+  uint64_t ns = stats.mark() - mark;
+  entry.ns[PHASE_WRITE] += ns;
+  mapped_writes.ns += ns;
+  mapped_writes.bytes += bytes;
+  ++mapped_writes.calls;
+}
+
+/* Write the data of each entry to a file named after it, or to the stream,
+ * and pass it to the carver, the strings lister, the entropy profiler and
+ * the data hasher, then return the buffers to their pools.
+ */
+void
+ros_pipeline::write_stage()
+{
+  int payload = -1;
+  bool writing = false;         // an entry's file or stream member is open
+  unsigned payload_entry = 0;
+  uint64_t offset = 0;
+  bool carving = false;
+  unsigned carve_entry = 0;
+  bool listing = false;
+  unsigned list_entry = 0;
+  bool profiling = false;
+  unsigned profile_entry = 0;
+  bool hashing = false;
+  unsigned hash_entry = 0;
+
+  for (;;) {
+    struct ros_chunk *chunk = decode_write.pop();
+    if (chunk->flags & CHUNK_END)
+      break;
+
+    if (carver && !(chunk->flags & CHUNK_RETURN) && !entries[chunk->entry].deferred) {
+      struct ros_entry &entry = entries[chunk->entry];
+      ros_stats_mark mark = stats.mark();
+      if (!carving || carve_entry != chunk->entry) {
+        char filename[sizeof(entry.dirent.filename) + 1];
+        memcpy(filename, entry.dirent.filename, sizeof(entry.dirent.filename));
+        filename[sizeof(entry.dirent.filename)] = '\0';
+        carver->begin_entry(filename);
+        carving = true;
+        carve_entry = chunk->entry;
+      }
+      bool data = entry.decode ? (chunk->flags & CHUNK_DECODED) : !(chunk->flags & CHUNK_DISCARD);
+      if (data && chunk->length > chunk->skip)
+        carver->feed(chunk->buffer + chunk->skip, chunk->length - chunk->skip);
+      if ((chunk->flags & CHUNK_LAST) && !(chunk->flags & CHUNK_DECODED)) {
+        carver->end_entry(entry.carved);
+        carving = false;
+      }
+      entry.ns[PHASE_CARVE] += stats.mark() - mark;
+      stats.add(PHASE_CARVE, mark, 0);
+    }
+
+    if (strings && !(chunk->flags & CHUNK_RETURN) && !entries[chunk->entry].deferred) {
+      struct ros_entry &entry = entries[chunk->entry];
+      ros_stats_mark mark = stats.mark();
+      if (!listing || list_entry != chunk->entry) {
+        char filename[sizeof(entry.dirent.filename) + 1];
+        memcpy(filename, entry.dirent.filename, sizeof(entry.dirent.filename));
+        filename[sizeof(entry.dirent.filename)] = '\0';
+        strings->begin_entry(filename);
+        listing = true;
+        list_entry = chunk->entry;
+      }
+      bool data = entry.decode ? (chunk->flags & CHUNK_DECODED) : !(chunk->flags & CHUNK_DISCARD);
+      if (data && chunk->length > chunk->skip)
+        strings->feed(chunk->buffer + chunk->skip, chunk->length - chunk->skip);
+      if ((chunk->flags & CHUNK_LAST) && !(chunk->flags & CHUNK_DECODED)) {
+        entry.strings = strings->end_entry();
+        listing = false;
+      }
+      entry.ns[PHASE_STRINGS] += stats.mark() - mark;
+      stats.add(PHASE_STRINGS, mark, 0);
+    }
+
+    if (entropy && !(chunk->flags & CHUNK_RETURN) && !entries[chunk->entry].deferred) {
+      struct ros_entry &entry = entries[chunk->entry];
+      ros_stats_mark mark = stats.mark();
+      if (!profiling || profile_entry != chunk->entry) {
+        entropy->begin_entry();
+        profiling = true;
+        profile_entry = chunk->entry;
+      }
+      bool data = entry.decode ? (chunk->flags & CHUNK_DECODED) : !(chunk->flags & CHUNK_DISCARD);
+      if (data && chunk->length > chunk->skip)
+        entropy->feed(chunk->buffer + chunk->skip, chunk->length - chunk->skip);
+      if ((chunk->flags & CHUNK_LAST) && !(chunk->flags & CHUNK_DECODED)) {
+        entropy->end_entry(entry.entropy);
+        profiling = false;
+      }
+      entry.ns[PHASE_ENTROPY] += stats.mark() - mark;
+      stats.add(PHASE_ENTROPY, mark, 0);
+    }
+
+    if (digests && !(chunk->flags & CHUNK_RETURN) && !entries[chunk->entry].deferred) {
+      struct ros_entry &entry = entries[chunk->entry];
+      ros_stats_mark mark = stats.mark();
+      if (!hashing || hash_entry != chunk->entry) {
+        data_hasher.begin();
+        hashing = true;
+        hash_entry = chunk->entry;
+      }
+      bool data = entry.decode ? (chunk->flags & CHUNK_DECODED) : !(chunk->flags & CHUNK_DISCARD);
+      unsigned length = data && chunk->length > chunk->skip ? chunk->length - chunk->skip : 0;
+      if (length)
+        data_hasher.update(chunk->buffer + chunk->skip, length);
+      if ((chunk->flags & CHUNK_LAST) && !(chunk->flags & CHUNK_DECODED)) {
+        data_hasher.end(entry.data_digests);
+        // a truncated entry or stream has no digest of all its data
+        entry.data_digests.valid = entry.read_length == entry.dirent.length && !(entry.decode && entry.decode_error);
+        hashing = false;
+      }
+      entry.ns[PHASE_HASH_DATA] += stats.mark() - mark;
+      stats.add(PHASE_HASH_DATA, mark, length);
+    }
+
+    // an entry over the memory budget is not uncompressed, so it has nothing to extract
+    if (extract && !(chunk->flags & CHUNK_RETURN) && !entries[chunk->entry].deferred && !entries[chunk->entry].mapped &&
+        !(uncompress && entries[chunk->entry].over_budget)) {
+      struct ros_entry &entry = entries[chunk->entry];
+
+      // decoded output can arrive ahead of the entry's first input chunk
+      if (!writing || payload_entry != chunk->entry) {
+        if (payload >= 0)
+          close(payload);
+        ros_stats_mark mark = stats.mark();
+        if (stream) {
+          // the member's size goes before its data, which may arrive ahead of the input chunk that skips the sub-header
+          uint64_t size = !(entry.decode && uncompress) ? entry.dirent.length - (entry.sub_header ? sizeof(struct ros_arc_header) : 0)
+                        : entry.sub_header ? entry.uncompressed_length : ros_stream::unknown_size;
+          stream->begin(entry, size);
+        }
+        else {
+          char filename[sizeof(entry.dirent.filename) + 1];
+          memcpy(filename, entry.dirent.filename, sizeof(entry.dirent.filename));
+          filename[sizeof(entry.dirent.filename)] = '\0';
+          payload = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+          if (payload < 0)
+            entry.write_error = true;
+        }
+        writing = true;
+        payload_entry = chunk->entry;
+        offset = 0;
+        entry.ns[PHASE_WRITE] += stats.mark() - mark;
+        stats.add(PHASE_WRITE, mark, 0);
+      }
+
+      // an entry decoded only for the analysers is written as stored
+      bool data = entry.decode && uncompress ? (chunk->flags & CHUNK_DECODED) : !(chunk->flags & CHUNK_DECODED);
+      if ((stream || payload >= 0) && data && chunk->length > chunk->skip) {
+        ros_stats_mark mark = stats.mark();
+        unsigned length = chunk->length - chunk->skip;
+        if (stream)
+          stream->write(chunk->buffer + chunk->skip, length);
+        else if (io->write_at(payload, chunk->buffer + chunk->skip, length, offset) != static_cast<ssize_t>(length))
+          entry.write_error = true;
+        offset += length;
+        entry.ns[PHASE_WRITE] += stats.mark() - mark;
+        stats.add(PHASE_WRITE, mark, length);
+      }
+
+      if ((chunk->flags & CHUNK_LAST) && !(chunk->flags & CHUNK_DECODED)) {
+        ros_stats_mark mark = stats.mark();
+        if (payload >= 0)
+          close(payload);
+        else if (stream && !stream->end())
+          entry.write_error = true;
+        payload = -1;
+        writing = false;
+        entry.extracted = !entry.write_error;
+        entry.ns[PHASE_WRITE] += stats.mark() - mark;
+        stats.add(PHASE_WRITE, mark, 0);
+      }
+    }
+
+    if (chunk->flags & (CHUNK_DECODED | CHUNK_RETURN))
+      free_outputs.push(chunk);
+    else
+      free_inputs.push(chunk);
+  }
+
+  if (payload >= 0)
+    close(payload);
+}
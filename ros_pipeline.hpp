@@ -0,0 +1,181 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Staged read -> checksum/probe -> decode -> write pipeline for payload entries.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_PIPELINE_HPP__
+#define __ROS_PIPELINE_HPP__
+
+#include "ros_carve.hpp"
+#include "ros_entropy.hpp"
+#include "ros_strings.hpp"
+#include "ros_io.hpp"
+#include "ros_lzma.hpp"
+#include "ros_payload.hpp"
+#include "ros_pool.hpp"
+#include "ros_ring.hpp"
+#include "ros_stats.hpp"
+#include "ros_stream.hpp"
+
+enum ros_chunk_flags {
+  CHUNK_FIRST   = 1 << 0,   // first chunk of an entry
+  CHUNK_LAST    = 1 << 1,   // last chunk of an entry
+  CHUNK_DECODED = 1 << 2,   // holds decoder output
+  CHUNK_DISCARD = 1 << 3,   // input consumed by the decoder, nothing to write
+  CHUNK_RETURN  = 1 << 4,   // unused buffer on its way back to its pool
+  CHUNK_END     = 1 << 5    // no more entries
+};
+
+/* Where the LZMA entries are uncompressed */
+enum ros_decode_mode {
+  DECODE_NONE,      // not at all
+  DECODE_STREAM,    // by the pipeline's decode stage as the data goes past
+  DECODE_DEFER      // later by the decode scheduler; the pipeline only probes them
+};
+
+/* A reusable payload buffer travelling through the stages */
+struct ros_chunk {
+  char *buffer;
+  unsigned capacity;
+  unsigned length;          // valid bytes
+  unsigned skip;            // leading sub-header bytes that are not written
+  unsigned entry;           // index of the entry the data belongs to
+  unsigned flags;           // enum ros_chunk_flags
+  bool done;                // read has completed
+  ros_stats_mark submitted; // when the read was submitted
+  uint64_t read_ns;         // from submission to completion
+  struct ros_io_request request;
+};
+
+/* Processes the payload entries of an archive in four stages on their own
+ * threads: read (with read-ahead through ros_io), checksum and type probing,
+ * optional LZMA decoding, and writing the extracted files. The stages are
+ * connected by bounded single-producer/single-consumer rings; buffers return
+ * to their pools from the write stage, so a slow stage holds back the ones
+ * before it. Every chunk passes the checksum stage in payload order, so the
+ * checksum is exactly the one calculated sequentially.
+ *
+ * The buffers and the decoder context live as long as the pipeline, so one
+ * pipeline used for every archive allocates them once.
+ */
+class ros_pipeline {
+  public:
+    ros_pipeline(ros_io *io, ros_stats &stats, const ros_sig_db &sigs);
+    ~ros_pipeline();
+
+    /* Returns checksum with the data of all the entries added to it */
+    unsigned int run(int fd, enum ros_byte_order order, const char *arc_magic, struct ros_entry *entries, unsigned count,
+                     unsigned int checksum, bool extract, enum ros_decode_mode mode);
+
+    /* liblzma memory limit of the decode stage */
+    void set_memory_limit(uint64_t limit) { memory_limit = limit; }
+
+    /* Search the data of each entry, uncompressed where it is decoded, for
+     * embedded objects; the write stage feeds it
+     */
+    void set_carver(ros_carver *carver) { this->carver = carver; }
+
+    /* List the printable strings in the data of each entry, uncompressed
+     * where it is decoded; the write stage feeds it
+     */
+    void set_strings(ros_strings *strings) { this->strings = strings; }
+
+    /* Profile the entropy of the data of each entry, uncompressed where it
+     * is decoded, into its ros_entry; the write stage feeds it
+     */
+    void set_entropy(ros_entropy *entropy) { this->entropy = entropy; }
+
+    /* Hash each entry as stored into its raw_digests as it is checksummed,
+     * and its data, uncompressed where it is decoded, into its data_digests
+     * in the write stage. The stored bytes also go to archive, if there is
+     * one, in payload order.
+     */
+    void set_digests(bool digests, ros_hasher *archive) { this->digests = digests; archive_hasher = archive; }
+
+    /* Extract decoded entries uncompressed (the default); otherwise they are
+     * decoded only for the analysers above and extracted as stored
+     */
+    void set_uncompress(bool uncompress) { this->uncompress = uncompress; }
+
+    /* Extract the entries as the members of a tar or cpio stream rather
+     * than a file each
+     */
+    void set_stream(ros_stream *stream) { this->stream = stream; }
+
+  private:
+    ros_pipeline(const ros_pipeline &);
+    ros_pipeline &operator=(const ros_pipeline &);
+
+    void read_stage();
+    void check_stage();
+    void decode_stage();
+    void flush_output(struct ros_entry &entry, struct ros_chunk *&out, ros_mapped_file &mapped);
+    void add_mapped_write(struct ros_entry &entry, ros_stats_mark mark, uint64_t bytes);
+    void write_stage();
+
+    static const unsigned chunk_size = 1024 * 1024;
+    static const unsigned input_chunks = 8;
+    static const unsigned output_chunks = 4;
+    static const unsigned ring_size = 16;  // holds every chunk plus the end marker
+    static const unsigned digest_slice = 64 * 1024;  // checksummed then hashed while in cache
+
+    ros_io *io;
+    ros_stats &stats;
+    const ros_sig_db &sigs;     // payload data types
+    ros_buffer_pool buffers;    // page-aligned chunk buffers
+    ros_decoder decoder;        // used by the decode stage only
+    ros_carver *carver;         // used by the write stage only
+    ros_strings *strings;       // likewise
+    ros_entropy *entropy;       // likewise
+    ros_stream *stream;         // likewise
+    bool uncompress;            // write the decoded data of decoded entries
+    bool digests;
+    ros_hasher *archive_hasher; // used by the check stage only
+    ros_hasher raw_hasher;      // likewise
+    ros_hasher data_hasher;     // used by the write stage only
+
+    struct ros_chunk inputs[input_chunks];
+    struct ros_chunk outputs[output_chunks];
+    struct ros_chunk end_chunk;
+
+    ros_ring<struct ros_chunk *, ring_size> read_check;
+    ros_ring<struct ros_chunk *, ring_size> check_decode;
+    ros_ring<struct ros_chunk *, ring_size> decode_write;
+    ros_ring<struct ros_chunk *, ring_size> free_inputs;   // write -> read
+    ros_ring<struct ros_chunk *, ring_size> free_outputs;  // write -> decode
+
+    // the archive being processed by run()
+    int fd;
+    enum ros_byte_order order;
+    const char *arc_magic;
+    struct ros_entry *entries;
+    unsigned count;
+    unsigned int checksum;
+    bool extract;
+    enum ros_decode_mode decode_mode;
+    uint64_t memory_limit;
+    // writes of mapped entries by the decode stage, added to stats after the join
+    // as the write stage counts PHASE_WRITE meanwhile
+    struct ros_phase_stats mapped_writes;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Recycled I/O buffers and LZMA decoder memory.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <new>
+#include "ros_pool.hpp"
+
+ros_buffer_pool::ros_buffer_pool(size_t size)
+  : buffer_size(size), allocations(0)
+{
+}
+
+ros_buffer_pool::~ros_buffer_pool()
+{
+  for (size_t i = 0; i < free_buffers.size(); ++i)
+    free(free_buffers[i]);
+}
+
+char *
+ros_buffer_pool::get()
+{
+  if (!free_buffers.empty()) {
+    char *buffer = free_buffers.back();
+    free_buffers.pop_back();
+    return buffer;
+  }
+  void *buffer = nullptr;
+  if (posix_memalign(&buffer, alignment, buffer_size) != 0)
+    throw std::bad_alloc();
+  ++allocations;
+  return static_cast<char *>(buffer);
+}
+
+void
+ros_buffer_pool::put(char *buffer)
+{
+  if (buffer)
+    free_buffers.push_back(buffer);
+}
+
+/* Each block is preceded by a header recording its size, since liblzma
+ * frees without saying how large the block was. The header keeps the
+ * 16-byte alignment malloc() gives.
+ */
+union block_header {
+  size_t size;
+  max_align_t align;
+};
+
+ros_lzma_allocator::ros_lzma_allocator(size_t cache_limit)
+  : cache_limit(cache_limit), cached_bytes(0), reused(0), allocated(0)
+{
+  allocator.alloc = alloc;
+  allocator.free = release;
+  allocator.opaque = this;
+}
+
+ros_lzma_allocator::~ros_lzma_allocator()
+{
+  for (std::multimap<size_t, void *>::iterator i = cached.begin(); i != cached.end(); ++i)
+    free(i->second);
+}
+
+void
+ros_lzma_allocator::set_cache_limit(size_t limit)
+{
+  cache_limit = limit;
+  while (cached_bytes > cache_limit) {
+    std::multimap<size_t, void *>::iterator biggest = --cached.end();
+    cached_bytes -= biggest->first;
+    free(biggest->second);
+    cached.erase(biggest);
+  }
+}
+
+void *
+ros_lzma_allocator::alloc(void *opaque, size_t nmemb, size_t size)
+{
+  ros_lzma_allocator *self = static_cast<ros_lzma_allocator *>(opaque);
+  if (size && nmemb > (~static_cast<size_t>(0) - sizeof(block_header)) / size)
+    return nullptr;
+  size *= nmemb;
+
+  union block_header *block;
+  std::multimap<size_t, void *>::iterator i = self->cached.find(size);
+  if (i != self->cached.end()) {
+    block = static_cast<union block_header *>(i->second);
+    self->cached.erase(i);
+    self->cached_bytes -= size;
+    ++self->reused;
+  }
+  else {
+    block = static_cast<union block_header *>(malloc(sizeof(block_header) + size));
+    if (!block)
+      return nullptr;
+    block->size = size;
+    ++self->allocated;
+  }
+  return block + 1;
+}
+
+void
+ros_lzma_allocator::release(void *opaque, void *ptr)
+{
+  ros_lzma_allocator *self = static_cast<ros_lzma_allocator *>(opaque);
+  if (!ptr)
+    return;
+  union block_header *block = static_cast<union block_header *>(ptr) - 1;
+  if (self->cached_bytes + block->size > self->cache_limit) {
+    free(block);
+    return;
+  }
+  self->cached.insert(std::make_pair(block->size, static_cast<void *>(block)));
+  self->cached_bytes += block->size;
+}
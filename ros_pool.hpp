@@ -0,0 +1,94 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Recycled I/O buffers and LZMA decoder memory.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_POOL_HPP__
+#define __ROS_POOL_HPP__
+
+#include <stddef.h>
+#include <map>
+#include <vector>
+#include <lzma.h>
+
+/* Fixed-size page-aligned I/O buffers. Buffers that are put back are kept
+ * for the next get() rather than freed, so a long-lived owner allocates each
+ * buffer once however many archives and entries it processes. A pool is not
+ * locked and belongs to one thread; buffers may be lent to other threads.
+ */
+class ros_buffer_pool {
+  public:
+    static const size_t alignment = 4096;
+
+    ros_buffer_pool(size_t size);
+    ~ros_buffer_pool();
+
+    char *get();            // throws std::bad_alloc like new
+    void put(char *buffer);
+
+    size_t size() const { return buffer_size; }
+    unsigned allocated() const { return allocations; }
+
+  private:
+    ros_buffer_pool(const ros_buffer_pool &);
+    ros_buffer_pool &operator=(const ros_buffer_pool &);
+
+    size_t buffer_size;
+    unsigned allocations;
+    std::vector<char *> free_buffers;
+};
+
+/* An lzma_allocator that keeps the blocks liblzma frees and hands them back
+ * when a block of the same size is next allocated. liblzma reallocates its
+ * dictionary whenever a stream needs a different size, so decoding entries
+ * with a mix of dictionary sizes otherwise returns tens of MiB to malloc and
+ * asks for them again for every entry. At most cache_limit bytes are kept.
+ */
+class ros_lzma_allocator {
+  public:
+    ros_lzma_allocator(size_t cache_limit = 256 * 1024 * 1024);
+    ~ros_lzma_allocator();
+
+    const lzma_allocator *get() const { return &allocator; }
+
+    /* Keep at most limit bytes of freed blocks, freeing the biggest over it */
+    void set_cache_limit(size_t limit);
+
+    size_t hits() const { return reused; }
+    size_t misses() const { return allocated; }
+
+  private:
+    ros_lzma_allocator(const ros_lzma_allocator &);
+    ros_lzma_allocator &operator=(const ros_lzma_allocator &);
+
+    static void *alloc(void *opaque, size_t nmemb, size_t size);
+    static void release(void *opaque, void *ptr);
+
+    lzma_allocator allocator;
+    size_t cache_limit;
+    size_t cached_bytes;
+    size_t reused;
+    size_t allocated;
+    std::multimap<size_t, void *> cached;   // free blocks by size
+};
+
+#endif
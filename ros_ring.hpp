@@ -0,0 +1,114 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Bounded lock-free single-producer/single-consumer ring.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_RING_HPP__
+#define __ROS_RING_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/* Waiting strategy for a stage that cannot proceed: spin briefly, then yield
+ * the processor, then sleep, so an idle stage costs little CPU while a busy
+ * pipeline hands over with no system call.
+ */
+class ros_backoff {
+  public:
+    ros_backoff() : spins(0) {}
+
+    void pause() {
+      if (spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+      }
+      else if (spins < 256)
+        std::this_thread::yield();
+      else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      ++spins;
+    }
+
+    void reset() { spins = 0; }
+
+  private:
+    unsigned spins;
+};
+
+/* Fixed-capacity ring passing items from exactly one producer thread to
+ * exactly one consumer thread. CAPACITY must be a power of two. The indices
+ * run freely and are masked on access; each is written by one side only.
+ */
+template<typename T, unsigned CAPACITY>
+class ros_ring {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "ros_ring capacity must be a power of two");
+
+  public:
+    ros_ring() : head(0), tail(0) {}
+
+    bool try_push(const T &item) {
+      unsigned t = tail.load(std::memory_order_relaxed);
+      if (t - head.load(std::memory_order_acquire) == CAPACITY)
+        return false;
+      items[t & (CAPACITY - 1)] = item;
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool try_pop(T &item) {
+      unsigned h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire))
+        return false;
+      item = items[h & (CAPACITY - 1)];
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    /* block while the ring is full: back-pressure on the producer */
+    void push(const T &item) {
+      ros_backoff backoff;
+      while (!try_push(item))
+        backoff.pause();
+    }
+
+    /* block while the ring is empty */
+    T pop() {
+      T item;
+      ros_backoff backoff;
+      while (!try_pop(item))
+        backoff.pause();
+      return item;
+    }
+
+  private:
+    ros_ring(const ros_ring &);
+    ros_ring &operator=(const ros_ring &);
+
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<unsigned> head;
+    alignas(64) std::atomic<unsigned> tail;
+    alignas(64) T items[CAPACITY];
+};
+
+#endif
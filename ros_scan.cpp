@@ -0,0 +1,398 @@
+/* VxWorks ROS Firmware scanner
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Finds the firmware update files of many switches, routers and other devices
+ * that use VxWorks Realtime Operating System (ROS) in directory trees of mixed files
+ *
+ * The header signature of such files is the string "PACK" at offset 0x18 (24).
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "ros_pack.hpp"
+#include "ros_devices.hpp"
+#include "ros_format.hpp"
+
+using namespace std;
+
+
+const unsigned int probe_length = 32;       // bytes a file needs to be an archive
+const unsigned int header_length = sizeof(struct ros_header_v2);  // read from the start of each file
+const unsigned int signature_offset = 0x18; // of "PACK"
+const unsigned int dirents_size = 64 * 1024;
+
+// command-line switches
+const char *switch_threads = "--threads=";
+const char *switch_output = "--output=";
+const char *switch_help = "--help";
+
+bool json = false;
+unsigned threads = 8;
+
+/* Directory entry as returned by getdents64(2) */
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+struct scan_counts {
+  uint64_t directories;
+  uint64_t files;
+  uint64_t errors;
+  uint64_t matches[3];    // unknown major version, v1, v2
+  uint64_t identified;    // matches of a device in known_devices.csv
+};
+
+/* Directories waiting to be walked, shared by the walker threads. A walker
+ * takes a directory, queues its sub-directories and checks its files; the
+ * scan is over when the queue is empty and no walker is busy.
+ */
+class scan_queue {
+  public:
+    scan_queue() : busy(0) {}
+
+    void push(const string &path) {
+      {
+        lock_guard<mutex> guard(lock);
+        directories.push_back(path);
+      }
+      changed.notify_one();
+    }
+
+    bool pop(string &path) {
+      unique_lock<mutex> guard(lock);
+      while (directories.empty()) {
+        if (!busy)
+          return false;
+        changed.wait(guard);
+      }
+      path.swap(directories.back());  // depth first keeps the queue short
+      directories.pop_back();
+      ++busy;
+      return true;
+    }
+
+    void done() {
+      unique_lock<mutex> guard(lock);
+      if (--busy == 0 && directories.empty()) {
+        guard.unlock();
+        changed.notify_all();
+      }
+    }
+
+  private:
+    mutex lock;
+    condition_variable changed;
+    vector<string> directories;
+    unsigned busy;
+};
+
+scan_queue queue;
+mutex output_lock;        // serialises whole-record flushes to stdout
+
+void
+usage(char *prog_name)
+{
+  cout << "Usage: " << prog_name << " ["
+       << " " << switch_threads << "N"
+       << " " << switch_output << "text|json"
+       << " " << switch_help
+       << " ] PATH..." << endl
+       << switch_threads << ": number of directory walker threads (default " << threads << ")" << endl
+       << switch_output << "json: report one JSON record per line for each match" << endl
+       << switch_help    << ": display this help text" << endl
+       << "PATH: files and directory trees to scan for ROS PACK archives" << endl;
+}
+
+/* Classify the first bytes of a file: the header major version (1 or 2),
+ * 0 for a PACK signature with an unknown version, or -1 if it is not a ROS
+ * PACK archive at all.
+ */
+int
+classify(const char *header, ssize_t length)
+{
+  const struct ros_header_version *version = reinterpret_cast<const struct ros_header_version *>(header);
+
+  if (length < static_cast<ssize_t>(probe_length) || memcmp(header + signature_offset, "PACK", 4) != 0)
+    return -1;
+  switch (version->arc_index[0]) {
+    case '1':
+      return 1;
+    case '2':
+      return 2;
+  }
+  return 0;
+}
+
+void
+report(ros_writer &out, const string &directory, const char *name, const char *header, int major,
+       const struct ros_device *device)
+{
+  const struct ros_header_version *version = reinterpret_cast<const struct ros_header_version *>(header);
+
+  if (json) {
+    string path(directory);
+    if (!directory.empty() && directory != "/")
+      path += '/';
+    path += name;  // the file name needs escaping
+    out.begin_object()
+       .key("type").string("match")
+       .key("file").string(path.c_str())
+       .key("header_version");
+    if (major)
+      out.number(major);
+    else
+      out.null();
+    out.key("arc_magic").string(version->arc_magic, sizeof version->arc_magic)
+       .key("arc_index").string(version->arc_index, sizeof version->arc_index);
+    if (device)
+      out.key("manufacturer").string(device->manufacturer);
+    if (device && device->model[0])
+      out.key("model").string(device->model);
+    out.end_object()
+       .end_record();
+  }
+  else {
+    out.raw(major == 1 ? "v1 " : major == 2 ? "v2 " : "v? ")
+       .raw(version->arc_magic, sizeof version->arc_magic).put(' ')
+       .raw(version->arc_index, sizeof version->arc_index).put(' ');
+    out.raw(directory.c_str());
+    if (!directory.empty() && directory != "/")
+      out.put('/');
+    out.raw(name);
+    if (device) {
+      out.raw(" [").raw(device->manufacturer);
+      if (device->model[0])
+        out.put(' ').raw(device->model);
+      out.put(']');
+    }
+    out.put('\n');
+  }
+
+  // keep records whole: flush only between them
+  if (out.pending() > 48 * 1024) {
+    lock_guard<mutex> guard(output_lock);
+    out.flush();
+  }
+}
+
+/* Check one file with a single pread of the bytes that hold the signature
+ * and the fields that identify the device.
+ * name is relative to dir_fd, which is the directory's path, or is a path
+ * of its own with AT_FDCWD and an empty directory.
+ */
+void
+check_file(ros_writer &out, struct scan_counts &counts, int dir_fd, const string &directory, const char *name)
+{
+  char header[header_length];
+
+  ++counts.files;
+  int fd = openat(dir_fd, name, O_RDONLY | O_NOCTTY | O_NONBLOCK | (dir_fd == AT_FDCWD ? 0 : O_NOFOLLOW));
+  if (fd < 0) {
+    ++counts.errors;
+    return;
+  }
+  ssize_t length = pread(fd, header, sizeof(header), 0);
+  close(fd);
+
+  int major = classify(header, length);
+  if (major >= 0) {
+    // the firmware version is at the end of the v2 header, which a short file may not have
+    const struct ros_header_v2 *v2 = reinterpret_cast<const struct ros_header_v2 *>(header);
+    const bool versioned = major == 2 && length >= static_cast<ssize_t>(header_length);
+    const struct ros_device *device = ros_device_identify(v2->version.arc_magic, v2->version.arc_index,
+                                                          versioned ? v2->firmware_version : nullptr,
+                                                          sizeof v2->firmware_version);
+    ++counts.matches[major];
+    if (device)
+      ++counts.identified;
+    report(out, directory, name, header, major, device);
+  }
+}
+
+void
+walk_directory(ros_writer &out, struct scan_counts &counts, char *dirents, const string &directory)
+{
+  int dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_NOCTTY);
+  if (dir_fd < 0) {
+    ++counts.errors;
+    return;
+  }
+  ++counts.directories;
+
+  for (;;) {
+    long length = syscall(SYS_getdents64, dir_fd, dirents, dirents_size);
+    if (length <= 0) {
+      if (length < 0)
+        ++counts.errors;
+      break;
+    }
+    for (long position = 0; position < length; ) {
+      struct linux_dirent64 *entry = reinterpret_cast<struct linux_dirent64 *>(dirents + position);
+      position += entry->d_reclen;
+      const char *name = entry->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        continue;
+
+      unsigned char type = entry->d_type;
+      if (type == DT_UNKNOWN) { // not all file systems fill it in
+        struct stat st;
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+          ++counts.errors;
+          continue;
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+      }
+
+      // symbolic links are not followed, so there are no loops
+      if (type == DT_DIR)
+        queue.push(directory == "/" ? directory + name : directory + "/" + name);
+      else if (type == DT_REG)
+        check_file(out, counts, dir_fd, directory, name);
+    }
+  }
+  close(dir_fd);
+}
+
+void
+walker(struct scan_counts *counts)
+{
+  ros_writer out(STDOUT_FILENO, 64 * 1024);
+  char *dirents = new char[dirents_size];
+  string directory;
+
+  while (queue.pop(directory)) {
+    walk_directory(out, *counts, dirents, directory);
+    queue.done();
+  }
+
+  delete[] dirents;
+  lock_guard<mutex> guard(output_lock);
+  out.flush();
+}
+
+int
+main(int argc, char **argv, char **env)
+{
+  vector<const char *> paths;
+
+  for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
+    if (strncmp(argv[i], switch_help, 3) == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (strncmp(argv[i], switch_threads, strlen(switch_threads)) == 0) {
+      char *end;
+      threads = strtoul(argv[i] + strlen(switch_threads), &end, 10);
+      if (*end || threads < 1) {
+        cerr << "Error: invalid number of threads: " << argv[i] + strlen(switch_threads) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_output, strlen(switch_output)) == 0) {
+      const char *format = argv[i] + strlen(switch_output);
+      if (strcmp(format, "json") == 0)
+        json = true;
+      else if (strcmp(format, "text") == 0)
+        json = false;
+      else {
+        cerr << "Error: unknown output format: " << format << endl;
+        return 1;
+      }
+    }
+    else
+      paths.push_back(argv[i]);
+  }
+
+  if (paths.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<struct scan_counts> counts(threads + 1);
+  memset(counts.data(), 0, counts.size() * sizeof(struct scan_counts));
+
+  // files named on the command line are checked here, directories are queued
+  {
+    ros_writer out(STDOUT_FILENO, 64 * 1024);
+    for (unsigned i = 0; i < paths.size(); ++i) {
+      struct stat st;
+      string path(paths[i]);
+      while (path.size() > 1 && path[path.size() - 1] == '/')
+        path.erase(path.size() - 1);
+      if (stat(path.c_str(), &st) < 0) {
+        cerr << "Error: cannot access " << path << ": " << strerror(errno) << endl;
+        ++counts[threads].errors;
+      }
+      else if (S_ISDIR(st.st_mode))
+        queue.push(path);
+      else
+        check_file(out, counts[threads], AT_FDCWD, string(), path.c_str());
+    }
+    out.flush();
+  }
+
+  vector<thread> walkers;
+  for (unsigned i = 0; i < threads; ++i)
+    walkers.push_back(thread(walker, &counts[i]));
+  for (unsigned i = 0; i < threads; ++i)
+    walkers[i].join();
+
+  struct scan_counts total;
+  memset(&total, 0, sizeof(total));
+  for (unsigned i = 0; i < counts.size(); ++i) {
+    total.directories += counts[i].directories;
+    total.files += counts[i].files;
+    total.errors += counts[i].errors;
+    for (unsigned m = 0; m < 3; ++m)
+      total.matches[m] += counts[i].matches[m];
+    total.identified += counts[i].identified;
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cerr << "Scanned " << total.files << " files in " << total.directories << " directories in " << seconds << " s: "
+       << total.matches[1] + total.matches[2] + total.matches[0] << " ROS PACK archives ("
+       << total.matches[1] << " v1, " << total.matches[2] << " v2, " << total.matches[0] << " unknown version), "
+       << total.identified << " of known devices";
+  if (total.errors)
+    cerr << ", " << total.errors << " not readable";
+  cerr << endl;
+
+  return total.errors ? 2 : 0;
+}
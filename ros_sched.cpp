@@ -0,0 +1,259 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Memory-budgeted scheduler for parallel payload decoding.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include "ros_sched.hpp"
+
+ros_scheduler::ros_scheduler(ros_io *io, ros_stats &stats, unsigned workers, uint64_t budget)
+  : io(io), stats(stats), buffers(chunk_size), limit(budget), fd(-1), extract(false),
+    in_use(0), peak_use(0), running(0)
+{
+  if (!workers)
+    workers = 1;
+  // the blocks a decoder keeps for reuse are held beside the jobs' reservations: at most a share of the budget each
+  const uint64_t share = budget / workers;
+  for (unsigned i = 0; i < workers; ++i) {
+    struct worker_state *state = new struct worker_state;
+    state->decoder.set_cache_limit(share < SIZE_MAX ? share : SIZE_MAX);
+    state->in = buffers.get();
+    state->out = buffers.get();
+    this->workers.push_back(state);
+  }
+}
+
+ros_scheduler::~ros_scheduler()
+{
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    buffers.put(workers[i]->in);
+    buffers.put(workers[i]->out);
+    delete workers[i];
+  }
+}
+
+void
+ros_scheduler::add(const struct ros_decode_job &job)
+{
+  struct ros_decode_job reserved = job;
+  if (!reserved.memory) // unknown: as much as liblzma may use
+    reserved.memory = limit;
+  pending.push_back(reserved);
+}
+
+void
+ros_scheduler::run(int fd, bool extract)
+{
+  this->fd = fd;
+  this->extract = extract;
+  for (unsigned i = 0; i < workers.size(); ++i)
+    memset(workers[i]->phases, 0, sizeof(workers[i]->phases));
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < workers.size() && i < pending.size(); ++i)
+    threads.push_back(std::thread(&ros_scheduler::work, this, workers[i]));
+  work(workers[0]);
+  for (unsigned i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  // the workers kept their own counts; ros_stats is not shared between threads
+  for (unsigned i = 0; i < workers.size(); ++i)
+    for (unsigned p = 0; p < PHASE_MAX; ++p)
+      stats.add_phase(static_cast<enum ros_phase>(p), workers[i]->phases[p]);
+}
+
+void
+ros_scheduler::work(struct worker_state *state)
+{
+  struct ros_decode_job job;
+  while (take(job)) {
+    decode(*state, job);
+    finish(job);
+  }
+}
+
+/* Choose the next job for a free worker, waiting while none fits */
+bool
+ros_scheduler::take(struct ros_decode_job &job)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  for (;;) {
+    if (pending.empty())
+      return false;
+
+    unsigned best = pending.size();
+    for (unsigned i = 0; i < pending.size(); ++i) {
+      if (pending[i].memory > limit) { // can never fit
+        best = i;
+        break;
+      }
+      if (in_use + pending[i].memory <= limit && (best == pending.size() || pending[i].memory > pending[best].memory))
+        best = i;
+    }
+    if (best < pending.size()) {
+      job = pending[best];
+      pending.erase(pending.begin() + best);
+      if (job.memory > limit) {
+        job.entry->over_budget = true;
+        job.entry->decode_error = true;
+        continue;
+      }
+      in_use += job.memory;
+      if (in_use > peak_use)
+        peak_use = in_use;
+      ++running;
+      return true;
+    }
+    changed.wait(guard);  // a running job will return memory
+  }
+}
+
+void
+ros_scheduler::finish(const struct ros_decode_job &job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    in_use -= job.memory;
+    --running;
+  }
+  changed.notify_all();
+}
+
+void
+ros_scheduler::decode(struct worker_state &state, struct ros_decode_job &job)
+{
+  struct ros_entry &entry = *job.entry;
+  struct ros_phase_stats *phases = state.phases;
+  ros_stats_mark mark;
+
+  int payload = -1;
+  ros_mapped_file mapped;   // with the size known the output goes straight into the file
+  if (extract) {
+    mark = stats.mark();
+    char filename[sizeof(entry.dirent.filename) + 1];
+    memcpy(filename, entry.dirent.filename, sizeof(entry.dirent.filename));
+    filename[sizeof(entry.dirent.filename)] = '\0';
+    entry.mapped = entry.sub_header && entry.uncompressed_length && mapped.open(filename, entry.uncompressed_length, job.length);
+    if (!entry.mapped)
+      payload = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (!entry.mapped && payload < 0)
+      entry.write_error = true;
+    uint64_t ns = stats.mark() - mark;
+    entry.ns[PHASE_WRITE] += ns;
+    phases[PHASE_WRITE].ns += ns;
+    ++phases[PHASE_WRITE].calls;
+  }
+
+  if (!state.decoder.begin(limit)) {
+    entry.decode_error = true;
+    if (payload >= 0)
+      close(payload);
+    mapped.close();
+    return;
+  }
+
+  const uint8_t *in = nullptr;
+  size_t in_length = 0;
+  uint64_t position = 0, written = 0;
+  bool ended = false;
+  while (!ended && !entry.decode_error) {
+    if (!in_length && position < job.length) {
+      mark = stats.mark();
+      uint64_t left = job.length - position;
+      size_t length = left > chunk_size ? chunk_size : left;
+      ssize_t got = io->read_at(fd, state.in, length, job.offset + position);
+      uint64_t ns = stats.mark() - mark;
+      entry.ns[PHASE_READ] += ns;
+      phases[PHASE_READ].ns += ns;
+      ++phases[PHASE_READ].calls;
+      if (got <= 0) {
+        entry.decode_error = true; // the archive is truncated
+        break;
+      }
+      phases[PHASE_READ].bytes += got;
+      position += got;
+      in = reinterpret_cast<const uint8_t *>(state.in);
+      in_length = got;
+    }
+
+    // into the mapping while it has room, any more through the output buffer
+    size_t space = 0;
+    uint8_t *out = entry.mapped ? mapped.space(space) : nullptr;
+    const bool direct = space > 0;
+    if (!direct) {
+      out = reinterpret_cast<uint8_t *>(state.out);
+      space = chunk_size;
+    }
+    size_t out_length = space;
+    mark = stats.mark();
+    lzma_ret ret = state.decoder.decode(in, in_length, out, out_length, position >= job.length);
+    size_t produced = space - out_length;
+    uint64_t ns = stats.mark() - mark;
+    entry.ns[PHASE_DECOMPRESS] += ns;
+    phases[PHASE_DECOMPRESS].ns += ns;
+    phases[PHASE_DECOMPRESS].bytes += produced;
+    ++phases[PHASE_DECOMPRESS].calls;
+
+    if (ret == LZMA_STREAM_END)
+      ended = true;
+    else if (ret != LZMA_OK)
+      entry.decode_error = true;
+
+    if (direct)
+      mapped.advance(produced);
+    else if ((payload >= 0 || entry.mapped) && produced) {
+      mark = stats.mark();
+      if (entry.mapped ? !mapped.append(state.out, produced)
+          : io->write_at(payload, state.out, produced, written) != static_cast<ssize_t>(produced))
+        entry.write_error = true;
+      written += produced;
+      ns = stats.mark() - mark;
+      entry.ns[PHASE_WRITE] += ns;
+      phases[PHASE_WRITE].ns += ns;
+      phases[PHASE_WRITE].bytes += produced;
+      ++phases[PHASE_WRITE].calls;
+    }
+  }
+
+  entry.decoded_length = state.decoder.total_out();
+  if (ended && entry.sub_header && entry.decoded_length != entry.uncompressed_length)
+    entry.length_mismatch = true;
+  state.decoder.end();
+  if (payload >= 0) {
+    close(payload);
+    entry.extracted = !entry.write_error;
+  }
+  else if (entry.mapped) {
+    mark = stats.mark();
+    if (!mapped.close())
+      entry.write_error = true;
+    entry.extracted = !entry.write_error;
+    uint64_t ns = stats.mark() - mark;
+    entry.ns[PHASE_WRITE] += ns;
+    phases[PHASE_WRITE].ns += ns;
+    phases[PHASE_WRITE].bytes += mapped.written() - written;  // any past the mapping are counted already
+    ++phases[PHASE_WRITE].calls;
+  }
+}
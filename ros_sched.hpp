@@ -0,0 +1,107 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Memory-budgeted scheduler for parallel payload decoding.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_SCHED_HPP__
+#define __ROS_SCHED_HPP__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "ros_io.hpp"
+#include "ros_lzma.hpp"
+#include "ros_payload.hpp"
+#include "ros_pool.hpp"
+#include "ros_stats.hpp"
+
+/* Uncompressing one payload entry */
+struct ros_decode_job {
+  struct ros_entry *entry;
+  uint64_t offset;          // of the compressed data in the archive
+  uint64_t length;          // of the compressed data
+  uint64_t memory;          // decoder memory the job reserves
+};
+
+/* Runs the decode jobs of an archive on a pool of worker threads while the
+ * decoder memory they reserve stays within a budget.
+ *
+ * The decoder memory of each job is worked out from the LZMA properties at
+ * the start of its data. Whenever a worker is free it takes the largest
+ * pending job that fits in what is left of the budget, so the big entries
+ * start early and the small ones fill the room left beside them. A job whose
+ * size is unknown reserves the largest dictionary the decoder accepts within
+ * the budget; a job needing more than the whole budget fails without being
+ * started. The budget is also given to liblzma as the memory limit.
+ */
+class ros_scheduler {
+  public:
+    ros_scheduler(ros_io *io, ros_stats &stats, unsigned workers, uint64_t budget);
+    ~ros_scheduler();
+
+    void add(const struct ros_decode_job &job);
+
+    /* Decode all the jobs added, writing the output of each to a file named
+     * after its entry if extract is set. Returns when every job is done. */
+    void run(int fd, bool extract);
+
+    uint64_t budget() const { return limit; }
+    uint64_t peak() const { return peak_use; }   // most memory reserved at once
+
+  private:
+    ros_scheduler(const ros_scheduler &);
+    ros_scheduler &operator=(const ros_scheduler &);
+
+    struct worker_state {
+      ros_decoder decoder;
+      char *in;
+      char *out;
+      struct ros_phase_stats phases[PHASE_MAX];
+    };
+
+    void work(struct worker_state *state);
+    bool take(struct ros_decode_job &job);
+    void finish(const struct ros_decode_job &job);
+    void decode(struct worker_state &state, struct ros_decode_job &job);
+
+    static const unsigned chunk_size = 1024 * 1024;
+
+    ros_io *io;
+    ros_stats &stats;
+    ros_buffer_pool buffers;
+    std::vector<struct worker_state *> workers;
+    uint64_t limit;
+
+    // the archive being processed by run()
+    int fd;
+    bool extract;
+
+    std::mutex lock;              // guards the members below
+    std::condition_variable changed;
+    std::vector<struct ros_decode_job> pending;
+    uint64_t in_use;
+    uint64_t peak_use;
+    unsigned running;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Compiled database of payload data type signatures.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include "ros_sigs.hpp"
+
+using namespace std;
+
+/* The first entries are in enum data_sig_type order */
+static const struct data_sig builtin_sigs[] = {
+  { { '7', 'z', (char)0xBC, (char)0xAF, (char)0x27, (char)0x1C}, 6, "7z archive", 0},
+  { {(char)0x5D, (char)0x00, (char)0x00}, 3, "LZMA compressed", 0},  // properties, dictionary of 64KiB or more
+  { {(char)0xFD, '7', 'z', 'X', 'Z', (char)0x00}, 6, "xz compressed", 0},
+  { {(char)0x1F, (char)0x8B, (char)0x08}, 3, "gzip compressed", 0},
+  { {'B', 'Z', 'h'}, 3, "bzip2 compressed", 0},
+  { {'P', 'K', (char)0x03, (char)0x04}, 4, "zip archive", 0},
+  { {(char)0x7F, 'E', 'L', 'F'}, 4, "ELF executable", 0},
+  { {(char)0x27, (char)0x05, (char)0x19, (char)0x56}, 4, "U-Boot uImage", 0},
+  { {'h', 's', 'q', 's'}, 4, "squashfs filesystem (little-endian)", 0},
+  { {'s', 'q', 's', 'h'}, 4, "squashfs filesystem (big-endian)", 0},
+  { {(char)0x45, (char)0x3D, (char)0xCD, (char)0x28}, 4, "cramfs filesystem (little-endian)", 0},
+  { {(char)0x28, (char)0xCD, (char)0x3D, (char)0x45}, 4, "cramfs filesystem (big-endian)", 0},
+  { {(char)0x85, (char)0x19}, 2, "JFFS2 filesystem (little-endian)", 0},
+  { {(char)0x19, (char)0x85}, 2, "JFFS2 filesystem (big-endian)", 0},
+  { {'U', 'B', 'I', '#'}, 4, "UBI image", 0},
+  { {'u', 's', 't', 'a', 'r'}, 5, "tar archive", 257},
+  { {'0', '7', '0', '7', '0', '1'}, 6, "cpio archive", 0},
+  { {'0', '7', '0', '7', '0', '7'}, 6, "cpio archive (old)", 0},
+  { {'C', 'D', '0', '0', '1'}, 5, "ISO 9660 image", 0x8001},
+  { {'W', 'I', 'N', 'D', ' ', 'v', 'e', 'r', 's', 'i', 'o', 'n'}, 12, "VxWorks WIND kernel", 0},
+  { {(char)0x89, 'P', 'N', 'G', '\r', '\n', (char)0x1A, '\n'}, 8, "PNG image", 0},
+  { {(char)0xFF, (char)0xD8, (char)0xFF}, 3, "JPEG image", 0},
+  { {'G', 'I', 'F', '8', '7', 'a'}, 6, "GIF image", 0},
+  { {'G', 'I', 'F', '8', '9', 'a'}, 6, "GIF image", 0},
+  { {'-', '-', '-', '-', '-', 'B', 'E', 'G', 'I', 'N', ' '}, 11, "PEM data", 0},
+  { {'<', '?', 'x', 'm', 'l'}, 5, "XML document", 0}
+};
+
+ros_sig_db::ros_sig_db()
+{
+  for (unsigned i = 0; i < sizeof(builtin_sigs) / sizeof(builtin_sigs[0]); ++i)
+    add(builtin_sigs[i].offset, builtin_sigs[i].magic, builtin_sigs[i].magic_length, builtin_sigs[i].title);
+  compile();
+}
+
+int
+ros_sig_db::add(unsigned offset, const char *magic, unsigned magic_length, const char *title)
+{
+  struct signature sig;
+  sig.offset = offset;
+  sig.magic.assign(magic, magic_length);
+  sig.title = title;
+  sigs.push_back(sig);
+  return sigs.size() - 1;
+}
+
+static bool
+parse_hex(const string &text, string &bytes)
+{
+  if (text.empty() || text.size() % 2)
+    return false;
+  bytes.clear();
+  for (size_t i = 0; i < text.size(); i += 2) {
+    if (!isxdigit(static_cast<unsigned char>(text[i])) || !isxdigit(static_cast<unsigned char>(text[i + 1])))
+      return false;
+    bytes += static_cast<char>(strtoul(text.substr(i, 2).c_str(), nullptr, 16));
+  }
+  return true;
+}
+
+bool
+ros_sig_db::load(const char *path, string &error)
+{
+  ifstream file(path);
+  if (!file) {
+    error = string("cannot open ") + path;
+    return false;
+  }
+
+  string line;
+  for (unsigned number = 1; getline(file, line); ++number) {
+    istringstream fields(line);
+    string offset_text, magic_text, title, magic;
+    if (!(fields >> offset_text) || offset_text[0] == '#')
+      continue;
+    char *end;
+    unsigned long offset = strtoul(offset_text.c_str(), &end, 0);
+    fields >> magic_text >> ws;
+    getline(fields, title);
+    if (*end || !parse_hex(magic_text, magic) || title.empty()) {
+      ostringstream where;
+      where << path << ":" << number << ": expected OFFSET HEX-MAGIC TITLE";
+      error = where.str();
+      return false;
+    }
+    add(offset, magic.data(), magic.size(), title.c_str());
+  }
+
+  compile();
+  return true;
+}
+
+/* The trie while it is built, before it is flattened into nodes and edges */
+struct trie_node {
+  int sig;
+  map<unsigned char, unsigned> children;
+};
+
+void
+ros_sig_db::compile()
+{
+  anchors.clear();
+  nodes.clear();
+  edges.clear();
+
+  map<unsigned, vector<unsigned> > by_offset;
+  for (unsigned i = 0; i < sigs.size(); ++i)
+    if (!sigs[i].magic.empty())
+      by_offset[sigs[i].offset].push_back(i);
+
+  for (map<unsigned, vector<unsigned> >::const_iterator group = by_offset.begin(); group != by_offset.end(); ++group) {
+    struct anchor a;
+    a.offset = group->first;
+    a.depth = 0;
+
+    vector<struct trie_node> trie(1);
+    trie[0].sig = DATA_SIG_NONE;
+    for (unsigned i = 0; i < group->second.size(); ++i) {
+      const string &magic = sigs[group->second[i]].magic;
+      unsigned t = 0;
+      for (size_t j = 0; j < magic.size(); ++j) {
+        unsigned char byte = magic[j];
+        map<unsigned char, unsigned>::const_iterator child = trie[t].children.find(byte);
+        if (child == trie[t].children.end()) {
+          trie.push_back(trie_node());
+          trie.back().sig = DATA_SIG_NONE;
+          trie[t].children[byte] = trie.size() - 1;
+          t = trie.size() - 1;
+        }
+        else
+          t = child->second;
+      }
+      trie[t].sig = group->second[i];  // a later duplicate replaces the earlier
+      if (magic.size() > a.depth)
+        a.depth = magic.size();
+    }
+
+    // flatten breadth-first so the children of each node are contiguous edges
+    vector<unsigned> order(1, 0), index(trie.size());
+    for (unsigned i = 0; i < order.size(); ++i)
+      for (map<unsigned char, unsigned>::const_iterator c = trie[order[i]].children.begin(); c != trie[order[i]].children.end(); ++c)
+        order.push_back(c->second);
+    const unsigned base = nodes.size();
+    for (unsigned i = 1; i < order.size(); ++i)
+      index[order[i]] = base + i - 1;
+    for (unsigned i = 1; i < order.size(); ++i) {
+      const struct trie_node &t = trie[order[i]];
+      struct node n = { t.sig, static_cast<unsigned>(edges.size()), static_cast<unsigned>(t.children.size()) };
+      nodes.push_back(n);
+      for (map<unsigned char, unsigned>::const_iterator c = t.children.begin(); c != t.children.end(); ++c) {
+        struct edge e = { c->first, index[c->second] };
+        edges.push_back(e);
+      }
+    }
+    for (unsigned b = 0; b < 256; ++b)
+      a.root[b] = -1;
+    for (map<unsigned char, unsigned>::const_iterator c = trie[0].children.begin(); c != trie[0].children.end(); ++c)
+      a.root[c->first] = index[c->second];
+
+    anchors.push_back(a);
+  }
+}
+
+int
+ros_sig_db::match_anchor(unsigned a, const char *data, unsigned length, unsigned &magic_length) const
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  const unsigned available = length < anchors[a].depth ? length : anchors[a].depth;
+  int sig = DATA_SIG_NONE;
+
+  magic_length = 0;
+  if (!available)
+    return sig;
+  int n = anchors[a].root[p[0]];
+  for (unsigned depth = 1; n >= 0; ++depth) {
+    const struct node &node = nodes[n];
+    if (node.sig != DATA_SIG_NONE) { // deeper is longer
+      sig = node.sig;
+      magic_length = depth;
+    }
+    if (depth >= available)
+      break;
+    n = -1;
+    for (unsigned e = node.first_edge; e < node.first_edge + node.edge_count; ++e)
+      if (edges[e].byte == p[depth]) {
+        n = edges[e].node;
+        break;
+      }
+  }
+  return sig;
+}
+
+int
+ros_sig_db::match(const char *data, unsigned length) const
+{
+  int best = DATA_SIG_NONE;
+  unsigned best_length = 0;
+
+  for (unsigned a = 0; a < anchors.size(); ++a) {
+    if (length <= anchors[a].offset)
+      break;  // the rest are further in
+    unsigned magic_length;
+    int sig = match_anchor(a, data + anchors[a].offset, length - anchors[a].offset, magic_length);
+    if (sig != DATA_SIG_NONE && (magic_length > best_length || (magic_length == best_length && sig > best))) {
+      best = sig;
+      best_length = magic_length;
+    }
+  }
+
+  return best;
+}
+
+const char *
+ros_sig_db::title(int sig) const
+{
+  return sig < 0 || static_cast<unsigned>(sig) >= sigs.size() ? nullptr : sigs[sig].title.c_str();
+}
@@ -0,0 +1,126 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Compiled database of payload data type signatures.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_SIGS_HPP__
+#define __ROS_SIGS_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ros_pack.hpp"
+
+/* Index of the built-in signatures that other modules act on; the rest of
+ * the built-in and any loaded signatures follow them.
+ */
+enum data_sig_type {
+  DATA_SIG_NONE = -1,
+  DATA_SIG_7Z = 0,
+  DATA_SIG_LZMA,
+  DATA_SIG_XZ
+};
+
+/* Recognises the type of payload data from magic bytes anchored at fixed
+ * offsets from its start. Each magic is compared over its exact length,
+ * NUL bytes included, and never past the end of the data.
+ *
+ * compile() builds a byte trie for each distinct anchor offset, entered
+ * through a 256-way table on the first byte, so match() looks at no more
+ * bytes than the longest magic at each offset however many signatures
+ * there are. Where several match, the longest magic wins, then the one
+ * loaded last, so a database file can refine or rename a built-in type.
+ *
+ * A compiled database is only read by match(), so it may be shared by
+ * any number of threads.
+ */
+class ros_sig_db {
+  public:
+    ros_sig_db();   // holds the built-in signatures, compiled
+
+    /* Add a signature; compile() before the next match() */
+    int add(unsigned offset, const char *magic, unsigned magic_length, const char *title);
+
+    /* Add the signatures in a text file: one per line as
+     *   OFFSET HEX-MAGIC TITLE
+     * with OFFSET in C notation (e.g. 0 or 0x101), blank lines and lines
+     * starting with '#' are ignored. Compiles the database.
+     * Returns false with a description in error if a line is not valid.
+     */
+    bool load(const char *path, std::string &error);
+
+    void compile();
+
+    /* Index of the signature data begins with, or DATA_SIG_NONE */
+    int match(const char *data, unsigned length) const;
+
+    const char *title(int sig) const;
+    unsigned size() const { return sigs.size(); }
+
+    /* The signatures grouped by anchor offset, for searching data for a
+     * signature at any position rather than only at the start
+     */
+    unsigned anchor_count() const { return anchors.size(); }
+    unsigned anchor_offset(unsigned a) const { return anchors[a].offset; }
+    unsigned anchor_depth(unsigned a) const { return anchors[a].depth; }
+    bool anchor_starts(unsigned a, unsigned char byte) const { return anchors[a].root[byte] >= 0; }
+
+    /* The longest signature of anchor a whose magic data begins with, or
+     * DATA_SIG_NONE; data points at the anchor offset, not the start
+     */
+    int match_anchor(unsigned a, const char *data, unsigned length, unsigned &magic_length) const;
+
+    /* Whether ros_decoder can uncompress data of this type */
+    static bool decodable(int sig) { return sig == DATA_SIG_LZMA || sig == DATA_SIG_XZ; }
+
+  private:
+    struct signature {
+      unsigned offset;
+      std::string magic;
+      std::string title;
+    };
+
+    struct node {
+      int sig;              // signature ending at this node, or DATA_SIG_NONE
+      unsigned first_edge;  // children in edges[], sorted by byte
+      unsigned edge_count;
+    };
+
+    struct edge {
+      unsigned char byte;
+      unsigned node;
+    };
+
+    // the trie of the signatures anchored at one offset
+    struct anchor {
+      unsigned offset;
+      unsigned depth;       // length of the longest magic
+      int root[256];        // node after the first byte, or -1
+    };
+
+    std::vector<struct signature> sigs;
+    std::vector<struct anchor> anchors;   // in offset order
+    std::vector<struct node> nodes;
+    std::vector<struct edge> edges;
+};
+
+#endif
@@ -0,0 +1,235 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Per-phase timing and byte counters for the --stats report.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <string.h>
+#include "ros_format.hpp"
+#include "ros_stats.hpp"
+
+using namespace std;
+
+static const char *phase_names[PHASE_MAX] = {
+  "header",
+  "read",
+  "checksum",
+  "probe",
+  "decompress",
+  "write",
+  "carve",
+  "strings",
+  "entropy",
+  "hash-raw",
+  "hash-data"
+};
+
+static const unsigned slowest_max = 5; // number of entries listed in the report
+
+ros_stats::ros_stats()
+  : enabled(false), json_report(false), archive(nullptr), archive_length(0),
+    start(0), elapsed_ns(0), current(-1)
+{
+  memset(phases, 0, sizeof(phases));
+}
+
+void
+ros_stats::begin_archive(const char *filename, uint64_t file_length)
+{
+  if (!enabled)
+    return;
+  archive = filename;
+  archive_length = file_length;
+  elapsed_ns = 0;
+  memset(phases, 0, sizeof(phases));
+  entries.clear();
+  current = -1;
+  start = mark();
+}
+
+void
+ros_stats::end_archive()
+{
+  if (!enabled)
+    return;
+  end_entry();
+  elapsed_ns = mark() - start;
+}
+
+void
+ros_stats::begin_entry(unsigned index, const char *filename, uint64_t length)
+{
+  if (!enabled)
+    return;
+  end_entry();
+  struct ros_entry_stats entry;
+  memset(&entry, 0, sizeof(entry));
+  strncpy(entry.filename, filename, sizeof(entry.filename) - 1);
+  entry.index = index;
+  entry.length = length;
+  entries.push_back(entry);
+  current = entries.size() - 1;
+}
+
+void
+ros_stats::set_uncompressed_length(uint64_t length)
+{
+  if (!enabled || current < 0)
+    return;
+  entries[current].uncompressed_length = length;
+}
+
+void
+ros_stats::add_entry_time(uint64_t ns)
+{
+  if (!enabled || current < 0)
+    return;
+  entries[current].ns += ns;
+}
+
+void
+ros_stats::add_phase(enum ros_phase phase, const struct ros_phase_stats &counts)
+{
+  if (!enabled)
+    return;
+  phases[phase].ns += counts.ns;
+  phases[phase].bytes += counts.bytes;
+  phases[phase].calls += counts.calls;
+}
+
+void
+ros_stats::end_entry()
+{
+  current = -1;
+}
+
+void
+ros_stats::report(ostream &out) const
+{
+  if (!enabled)
+    return;
+  report_text(out);
+}
+
+void
+ros_stats::report(ros_writer &out) const
+{
+  if (!enabled)
+    return;
+  report_json(out);
+}
+
+// bytes per second expressed in MiB/s
+static double
+throughput(uint64_t bytes, uint64_t ns)
+{
+  return ns ? (static_cast<double>(bytes) / (1024.0 * 1024.0)) / (static_cast<double>(ns) / 1e9) : 0.0;
+}
+
+static double
+compression_ratio(const struct ros_entry_stats &entry)
+{
+  return entry.length ? static_cast<double>(entry.uncompressed_length) / static_cast<double>(entry.length) : 0.0;
+}
+
+static bool
+slower(const struct ros_entry_stats &a, const struct ros_entry_stats &b)
+{
+  return a.ns > b.ns;
+}
+
+void
+ros_stats::report_text(ostream &out) const
+{
+  vector<struct ros_entry_stats> slowest(entries);
+  sort(slowest.begin(), slowest.end(), slower);
+  if (slowest.size() > slowest_max)
+    slowest.resize(slowest_max);
+
+  ios_base::fmtflags flags = out.flags();
+  char fill = out.fill(' ');
+
+  out << dec << noshowbase << endl
+      << "Statistics" << endl
+      << "          elapsed: " << fixed << setprecision(3) << elapsed_ns / 1e6 << " ms" << endl
+      << "       throughput: " << setprecision(1) << throughput(archive_length, elapsed_ns) << " MiB/s" << endl
+      << "  phase           calls          bytes      time ms      MiB/s" << endl;
+  for (unsigned p = 0; p < PHASE_MAX; ++p)
+    out << "  " << left << setw(10) << phase_names[p] << right
+        << setw(11) << phases[p].calls
+        << setw(15) << phases[p].bytes
+        << setw(13) << setprecision(3) << phases[p].ns / 1e6
+        << setw(11) << setprecision(1) << throughput(phases[p].bytes, phases[p].ns) << endl;
+
+  out << "Slowest entries" << endl
+      << "  entry filename               length   uncompressed  ratio      time ms" << endl;
+  for (unsigned i = 0; i < slowest.size(); ++i) {
+    out << "  " << setw(5) << slowest[i].index << " " << left << setw(16) << slowest[i].filename << right
+        << setw(12) << slowest[i].length
+        << setw(15) << slowest[i].uncompressed_length;
+    if (slowest[i].uncompressed_length)
+      out << setw(7) << setprecision(2) << compression_ratio(slowest[i]);
+    else
+      out << setw(7) << "-";
+    out << setw(13) << setprecision(3) << slowest[i].ns / 1e6 << endl;
+  }
+
+  out.fill(fill);
+  out.flags(flags);
+}
+
+void
+ros_stats::report_json(ros_writer &out) const
+{
+  vector<struct ros_entry_stats> slowest(entries);
+  sort(slowest.begin(), slowest.end(), slower);
+
+  out.begin_object()
+     .key("type").string("stats")
+     .key("file").string(archive ? archive : "")
+     .key("file_length").number(archive_length)
+     .key("elapsed_ns").number(elapsed_ns)
+     .key("throughput_mib_s").real(throughput(archive_length, elapsed_ns))
+     .key("phases").begin_object();
+  for (unsigned p = 0; p < PHASE_MAX; ++p)
+    out.key(phase_names[p]).begin_object()
+       .key("calls").number(phases[p].calls)
+       .key("bytes").number(phases[p].bytes)
+       .key("ns").number(phases[p].ns)
+       .key("mib_s").real(throughput(phases[p].bytes, phases[p].ns))
+       .end_object();
+  out.end_object()
+     .key("entries").begin_array();
+  for (unsigned i = 0; i < slowest.size(); ++i)
+    out.begin_object()
+       .key("index").number(slowest[i].index)
+       .key("filename").string(slowest[i].filename)
+       .key("length").number(slowest[i].length)
+       .key("uncompressed_length").number(slowest[i].uncompressed_length)
+       .key("ratio").real(compression_ratio(slowest[i]))
+       .key("ns").number(slowest[i].ns)
+       .end_object();
+  out.end_array()
+     .end_object()
+     .end_record();
+}
@@ -0,0 +1,127 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Per-phase timing and byte counters for the --stats report.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_STATS_HPP__
+#define __ROS_STATS_HPP__
+
+#include <stdint.h>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+class ros_writer;
+
+/* Phases of archive processing that are timed separately */
+enum ros_phase {
+  PHASE_HEADER = 0,   // primary header and directory entry reads
+  PHASE_READ,         // payload data reads, from submission to completion
+  PHASE_CHECKSUM,     // payload checksum calculation
+  PHASE_PROBE,        // sub-header and data type signature probing
+  PHASE_DECOMPRESS,   // payload data decompression
+  PHASE_WRITE,        // extracted payload data writes
+  PHASE_CARVE,        // searching entry data for embedded objects
+  PHASE_STRINGS,      // listing the printable strings in entry data
+  PHASE_ENTROPY,      // profiling the byte entropy of entry data
+  PHASE_HASH_RAW,     // SHA-256 and CRC32C of the entries as stored
+  PHASE_HASH_DATA,    // SHA-256 and CRC32C of the entry data, uncompressed
+  PHASE_MAX
+};
+
+struct ros_phase_stats {
+  uint64_t ns;        // accumulated monotonic time
+  uint64_t bytes;     // accumulated bytes processed
+  uint64_t calls;     // number of timed operations
+};
+
+struct ros_entry_stats {
+  char filename[17];  // ros_dirent::filename plus terminator
+  unsigned index;
+  uint64_t length;
+  uint64_t uncompressed_length; // from the sub-header, 0 if there is none
+  uint64_t ns;
+};
+
+/* Monotonic time stamp as returned by ros_stats::mark() */
+typedef uint64_t ros_stats_mark;
+
+/* Collects timings and byte counts per phase and per payload entry.
+ * When disabled every method returns immediately without reading the clock
+ * so the instrumentation can stay in the hot path.
+ *
+ * add() may be called from several threads as long as each phase is only
+ * added to by one of them and no entry is current.
+ */
+class ros_stats {
+  public:
+    ros_stats();
+
+    void enable(bool json) { enabled = true; json_report = json; }
+    bool is_enabled() const { return enabled; }
+    bool is_json() const { return json_report; }
+
+    ros_stats_mark mark() const {
+      if (!enabled)
+        return 0;
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /* account the time since start (and bytes) to a phase and the current entry */
+    void add(enum ros_phase phase, ros_stats_mark start, uint64_t bytes) {
+      if (!enabled)
+        return;
+      uint64_t ns = mark() - start;
+      phases[phase].ns += ns;
+      phases[phase].bytes += bytes;
+      ++phases[phase].calls;
+      if (current >= 0)
+        entries[current].ns += ns;
+    }
+
+    void begin_archive(const char *filename, uint64_t file_length);
+    void end_archive();
+    void begin_entry(unsigned index, const char *filename, uint64_t length);
+    void set_uncompressed_length(uint64_t length);
+    void add_entry_time(uint64_t ns);     // time accounted to the entry elsewhere
+    void add_phase(enum ros_phase phase, const struct ros_phase_stats &counts); // counted elsewhere
+    void end_entry();
+
+    void report(std::ostream &out) const;  // human form
+    void report(ros_writer &out) const;    // JSON record
+
+  private:
+    void report_text(std::ostream &out) const;
+    void report_json(ros_writer &out) const;
+
+    bool enabled;
+    bool json_report;
+    const char *archive;
+    uint64_t archive_length;
+    ros_stats_mark start;
+    uint64_t elapsed_ns;
+    struct ros_phase_stats phases[PHASE_MAX];
+    std::vector<struct ros_entry_stats> entries;
+    int current;        // index into entries of the entry being processed, or -1
+};
+
+#endif
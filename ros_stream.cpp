@@ -0,0 +1,246 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Extracted entries written as the members of one tar or cpio stream.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ros_stream.hpp"
+
+static const unsigned tar_block = 512;
+static const uint64_t cpio_size_max = 0xFFFFFFFF;
+
+/* Seconds since the epoch of a link time; 0 if it is not a date */
+static int64_t
+link_time(const struct ros_header_timestamp &timestamp, int year)
+{
+  if (!timestamp.link_month || timestamp.link_month > 12 || !timestamp.link_day || year < 1970)
+    return 0;
+  struct tm fields;
+  memset(&fields, 0, sizeof(fields));
+  fields.tm_year = year - 1900;
+  fields.tm_mon = timestamp.link_month - 1;
+  fields.tm_mday = timestamp.link_day;
+  fields.tm_hour = timestamp.link_hour;
+  fields.tm_min = timestamp.link_minute;
+  fields.tm_sec = timestamp.link_second;
+  return timegm(&fields);
+}
+
+/* A tar number: octal with a NUL, or base-256 when it does not fit */
+static void
+tar_number(char *field, unsigned width, uint64_t value)
+{
+  if (value < (1ULL << (3 * (width - 1)))) {
+    field[width - 1] = '\0';
+    for (unsigned i = width - 1; i-- > 0; value >>= 3)
+      field[i] = '0' + (value & 7);
+    return;
+  }
+  for (unsigned i = width; i-- > 1; value >>= 8)
+    field[i] = value & 0xFF;
+  field[0] = static_cast<char>(0x80);
+}
+
+/* A name that cannot climb out of the directory it is extracted into */
+static std::string
+safe_name(const char *name, size_t length, const char *fallback)
+{
+  std::string safe(name, strnlen(name, length));
+  for (size_t i = 0; i < safe.size(); ++i)
+    if (safe[i] == '/')
+      safe[i] = '_';
+  if (safe.empty() || safe == "." || safe == "..")
+    safe = fallback;
+  return safe;
+}
+
+ros_stream::ros_stream(int fd, enum ros_stream_format format)
+  : out(fd), format(format), archive_time(0), members(0), failed(0),
+    time(0), size(0), written(0), held(false), dropped(false)
+{
+}
+
+void
+ros_stream::begin_archive(const char *path, const struct ros_header_timestamp &timestamp)
+{
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  // short enough that ARCHIVE/ENTRY always fits a tar header
+  prefix = safe_name(base, 99, "archive");
+  archive_time = link_time(timestamp, timestamp.link_year);
+
+  // a directory member, so the entries can be extracted without creating it first
+  name = prefix;
+  time = archive_time;
+  if (format == ROS_STREAM_TAR) {
+    name += '/';
+    header(0);
+  }
+  else
+    cpio_header(name, 0, 040755, 2);
+  prefix += '/';
+}
+
+void
+ros_stream::begin(const struct ros_entry &entry, uint64_t size)
+{
+  char fallback[24];
+  snprintf(fallback, sizeof(fallback), "entry-%u", entry.index);
+  name = prefix + safe_name(entry.dirent.filename, sizeof entry.dirent.filename, fallback);
+  time = entry.sub_header ? link_time(entry.arc_header.timestamp, entry.link_year) : 0;
+  if (!time)
+    time = archive_time;
+
+  this->size = size;
+  written = 0;
+  dropped = false;
+  held = size == unknown_size;
+  spool.clear();
+  if (!held)
+    header(size);
+}
+
+void
+ros_stream::write(const char *data, size_t length)
+{
+  if (held) {
+    spool.insert(spool.end(), data, data + length);
+    return;
+  }
+  if (length > size - written) {
+    length = size - written;
+    dropped = true;
+  }
+  out.raw(data, length);
+  written += length;
+}
+
+bool
+ros_stream::end()
+{
+  if (held) {
+    size = spool.size();
+    if (format == ROS_STREAM_CPIO && size > cpio_size_max) {
+      size = cpio_size_max;
+      dropped = true;
+    }
+    header(size);
+    out.raw(spool.data(), size);
+    written = size;
+    held = false;
+    std::vector<char>().swap(spool);
+  }
+
+  // a short member is padded out to the size in its header, so the members after it can still be read
+  const bool complete = written == size;
+  static const char zeros[tar_block] = { 0 };
+  for (uint64_t left = size - written; left; ) {
+    size_t length = left < sizeof(zeros) ? left : sizeof(zeros);
+    out.raw(zeros, length);
+    left -= length;
+  }
+  pad(size);
+  if (!complete || dropped)
+    ++failed;
+  return complete && !dropped && out.good();
+}
+
+bool
+ros_stream::finish()
+{
+  if (format == ROS_STREAM_TAR) {
+    static const char zeros[2 * tar_block] = { 0 };
+    out.raw(zeros, sizeof(zeros));
+  }
+  else
+    cpio_header("TRAILER!!!", 0, 0, 1);
+  return out.flush();
+}
+
+void
+ros_stream::header(uint64_t length)
+{
+  if (format == ROS_STREAM_TAR)
+    tar_header(length);
+  else {
+    if (length > cpio_size_max) {
+      size = cpio_size_max;
+      dropped = true;
+    }
+    cpio_header(name, size, 0100644, 1);
+  }
+}
+
+void
+ros_stream::tar_header(uint64_t length)
+{
+  char block[tar_block];
+  memset(block, 0, sizeof(block));
+  bool directory = name[name.size() - 1] == '/';
+
+  if (name.size() <= 100)
+    memcpy(block, name.data(), name.size());
+  else {
+    // ARCHIVE in the prefix field, ENTRY in the name
+    size_t slash = name.rfind('/');
+    memcpy(block, name.data() + slash + 1, name.size() - slash - 1);
+    memcpy(block + 345, name.data(), slash);
+  }
+  tar_number(block + 100, 8, directory ? 0755 : 0644);
+  tar_number(block + 108, 8, 0);
+  tar_number(block + 116, 8, 0);
+  tar_number(block + 124, 12, length);
+  tar_number(block + 136, 12, time);
+  block[156] = directory ? '5' : '0';
+  memcpy(block + 257, "ustar", 6);
+  memcpy(block + 263, "00", 2);
+
+  // summed with the checksum field as spaces
+  memset(block + 148, ' ', 8);
+  unsigned sum = 0;
+  for (unsigned i = 0; i < sizeof(block); ++i)
+    sum += static_cast<unsigned char>(block[i]);
+  tar_number(block + 148, 7, sum);
+  out.raw(block, sizeof(block));
+}
+
+void
+ros_stream::cpio_header(const std::string &member, uint64_t length, uint32_t mode, uint32_t links)
+{
+  char fields[111];
+  snprintf(fields, sizeof(fields), "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08zX%08X",
+           ++members, mode, 0, 0, links, static_cast<uint32_t>(time), static_cast<uint32_t>(length),
+           0, 0, 0, 0, member.size() + 1, 0);
+  out.raw(fields, 110).raw(member.c_str(), member.size() + 1);
+  static const char zeros[4] = { 0 };
+  out.raw(zeros, (4 - (110 + member.size() + 1) % 4) % 4);
+}
+
+void
+ros_stream::pad(uint64_t length)
+{
+  static const char zeros[tar_block] = { 0 };
+  unsigned alignment = format == ROS_STREAM_TAR ? tar_block : 4;
+  out.raw(zeros, (alignment - length % alignment) % alignment);
+}
@@ -0,0 +1,97 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Extracted entries written as the members of one tar or cpio stream.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_STREAM_HPP__
+#define __ROS_STREAM_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ros_format.hpp"
+#include "ros_pack.hpp"
+#include "ros_payload.hpp"
+
+enum ros_stream_format {
+  ROS_STREAM_TAR,     // POSIX ustar
+  ROS_STREAM_CPIO     // SVR4 "newc" without CRC
+};
+
+/* Writes extracted entries one after another as the members of a single
+ * archive on a file descriptor, so extraction can feed a pipe instead of
+ * creating a file per entry. Each member is named ARCHIVE/ENTRY after the
+ * base name of the ROS PACK file, so several archives can share one stream
+ * without their entries colliding, and is dated by the entry's sub-header
+ * or else the archive's link time.
+ *
+ * Both formats record a member's size before its data. When the size is not
+ * known in advance, as for an LZMA entry without a sub-header, the data is
+ * held in memory until the member ends. Data short of the size given is
+ * padded with zeros and data beyond it is dropped, so the stream stays
+ * readable, but either fails the member.
+ */
+class ros_stream {
+  public:
+    static const uint64_t unknown_size = UINT64_MAX;
+
+    ros_stream(int fd, enum ros_stream_format format);
+
+    /* The ROS PACK file the following entries come from */
+    void begin_archive(const char *path, const struct ros_header_timestamp &timestamp);
+
+    void begin(const struct ros_entry &entry, uint64_t size);
+    void write(const char *data, size_t length);
+    bool end();       // false if data fell short, was dropped or could not be written
+
+    unsigned failures() const { return failed; }  // the members end() failed
+
+    bool finish();    // the end-of-archive marker, then flush
+    bool good() const { return out.good(); }
+
+  private:
+    ros_stream(const ros_stream &);
+    ros_stream &operator=(const ros_stream &);
+
+    void header(uint64_t length);
+    void tar_header(uint64_t length);
+    void cpio_header(const std::string &member, uint64_t length, uint32_t mode, uint32_t links);
+    void pad(uint64_t length);    // to the format's alignment
+
+    ros_writer out;
+    enum ros_stream_format format;
+    std::string prefix;           // ARCHIVE/
+    int64_t archive_time;
+    unsigned members;             // the cpio inode numbers
+    unsigned failed;              // members short of or over their size
+
+    // the member being written
+    std::string name;
+    int64_t time;
+    uint64_t size;
+    uint64_t written;
+    bool held;                    // size unknown: the data is in spool
+    bool dropped;
+    std::vector<char> spool;
+};
+
+#endif
@@ -0,0 +1,491 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * List the printable strings in entry data.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif
+#include "ros_strings.hpp"
+
+using namespace std;
+
+static const char *encoding_names[] = { "ascii", "utf16le", "utf16le" };
+
+/* Offset in a block of the character of a kind with the given index */
+static inline uint64_t
+char_offset(unsigned kind, unsigned index)
+{
+  return kind == 0 ? index : 2 * index + (kind == 2);
+}
+
+/* Set the bits of printable and zero for the printable and zero bytes of
+ * data[0, length), 64 at a time; returns how many bytes were done. Bytes
+ * from 0x80 compare as negative, so one signed range test covers 0x20-0x7E.
+ */
+#if defined __x86_64__ || defined __i386__
+__attribute__((target("avx2")))
+static unsigned
+classify_avx2(const unsigned char *data, unsigned length, uint64_t *printable, uint64_t *zero)
+{
+  const __m256i below = _mm256_set1_epi8(0x1F);
+  const __m256i above = _mm256_set1_epi8(0x7F);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i nul = _mm256_setzero_si256();
+
+  unsigned i = 0;
+  for (; i + 64 <= length; i += 64) {
+    uint64_t p = 0, z = 0;
+    for (unsigned half = 0; half < 2; ++half) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + half * 32));
+      __m256i print = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v)),
+                                      _mm256_cmpeq_epi8(v, tab));
+      p |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(print))) << (half * 32);
+      z |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nul)))) << (half * 32);
+    }
+    printable[i / 64] = p;
+    zero[i / 64] = z;
+  }
+  return i;
+}
+
+__attribute__((target("sse2")))
+static unsigned
+classify_sse2(const unsigned char *data, unsigned length, uint64_t *printable, uint64_t *zero)
+{
+  const __m128i below = _mm_set1_epi8(0x1F);
+  const __m128i above = _mm_set1_epi8(0x7F);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i nul = _mm_setzero_si128();
+
+  unsigned i = 0;
+  for (; i + 64 <= length; i += 64) {
+    uint64_t p = 0, z = 0;
+    for (unsigned quarter = 0; quarter < 4; ++quarter) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + quarter * 16));
+      __m128i print = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above)),
+                                   _mm_cmpeq_epi8(v, tab));
+      p |= static_cast<uint64_t>(_mm_movemask_epi8(print)) << (quarter * 16);
+      z |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nul))) << (quarter * 16);
+    }
+    printable[i / 64] = p;
+    zero[i / 64] = z;
+  }
+  return i;
+}
+#endif
+
+static void
+classify(const unsigned char *data, unsigned length, uint64_t *printable, uint64_t *zero)
+{
+  unsigned i = 0;
+#if defined __x86_64__ || defined __i386__
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  static const bool sse2 = __builtin_cpu_supports("sse2");
+  if (avx2)
+    i = classify_avx2(data, length, printable, zero);
+  else if (sse2)
+    i = classify_sse2(data, length, printable, zero);
+#endif
+  for (unsigned w = i / 64; w < (length + 63) / 64; ++w)
+    printable[w] = zero[w] = 0;
+  for (; i < length; ++i) {
+    if ((data[i] >= 0x20 && data[i] < 0x7F) || data[i] == '\t')
+      printable[i / 64] |= 1ULL << (i % 64);
+    else if (!data[i])
+      zero[i / 64] |= 1ULL << (i % 64);
+  }
+}
+
+/* The even bits of a word gathered into its low 32 */
+static inline uint32_t
+even_bits(uint64_t x)
+{
+  x &= 0x5555555555555555ULL;
+  x = (x | x >> 1) & 0x3333333333333333ULL;
+  x = (x | x >> 2) & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | x >> 4) & 0x00FF00FF00FF00FFULL;
+  x = (x | x >> 8) & 0x0000FFFF0000FFFFULL;
+  return static_cast<uint32_t>(x | x >> 16);
+}
+
+ros_strings::ros_strings(ros_writer &out, bool json, unsigned min_length, bool utf16, unsigned workers)
+  : out(out), json(json), min_length(min_length ? min_length : 1), kinds(utf16 ? KIND_MAX : KIND_UTF16_EVEN),
+    reach(utf16 ? 1 : 0), buffers(block_size + 1), position(0), found(0), current(nullptr), previous(nullptr),
+    stopping(false)
+{
+  if (!workers)
+    workers = 1;
+  // two for the feeding thread, the rest for the workers to be busy with
+  for (unsigned i = 0; i < workers + 4; ++i) {
+    struct block *b = new struct block;
+    b->buffer = buffers.get();
+    blocks.push_back(b);
+    free_blocks.push_back(b);
+  }
+  for (unsigned k = 0; k < KIND_MAX; ++k)
+    carries[k].active = false;
+  memset(&counts, 0, sizeof(counts));
+  for (unsigned i = 0; i < workers; ++i)
+    threads.push_back(thread(&ros_strings::work, this));
+}
+
+ros_strings::~ros_strings()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  work_ready.notify_all();
+  for (unsigned i = 0; i < threads.size(); ++i)
+    threads[i].join();
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    buffers.put(blocks[i]->buffer);
+    delete blocks[i];
+  }
+}
+
+void
+ros_strings::set_file(const char *file)
+{
+  this->file = file;
+}
+
+void
+ros_strings::begin_entry(const char *name)
+{
+  this->name = name;
+  position = 0;
+  found = 0;
+}
+
+struct ros_strings::block *
+ros_strings::get_block()
+{
+  while (free_blocks.empty())
+    retire(true);
+  struct block *b = free_blocks.back();
+  free_blocks.pop_back();
+  b->length = 0;
+  b->extension = 0;
+  b->base = position;
+  b->scanned = false;
+  b->runs.clear();
+  return b;
+}
+
+void
+ros_strings::feed(const char *data, unsigned length)
+{
+  while (length) {
+    if (!current)
+      current = get_block();
+    unsigned n = block_size - current->length < length ? block_size - current->length : length;
+    memcpy(current->buffer + current->length, data, n);
+    current->length += n;
+    position += n;
+    data += n;
+    length -= n;
+
+    if (previous && current->length >= reach) {
+      dispatch(previous, current);
+      previous = nullptr;
+    }
+    if (current->length == block_size) {
+      if (previous)
+        dispatch(previous, current);
+      previous = current;
+      current = nullptr;
+    }
+  }
+  while (retire(false))
+    ;
+}
+
+/* Queue a block for the workers with the start of the block after it */
+void
+ros_strings::dispatch(struct block *b, const struct block *next)
+{
+  if (next) {
+    b->extension = next->length < reach ? next->length : reach;
+    memcpy(b->buffer + b->length, next->buffer, b->extension);
+  }
+  in_flight.push_back(b);
+  {
+    lock_guard<mutex> guard(lock);
+    queue.push_back(b);
+  }
+  work_ready.notify_one();
+}
+
+/* Retire the oldest block once it has been scanned; false if it has not */
+bool
+ros_strings::retire(bool wait)
+{
+  if (in_flight.empty())
+    return false;
+  struct block *b = in_flight.front();
+  {
+    unique_lock<mutex> guard(lock);
+    while (!b->scanned) {
+      if (!wait)
+        return false;
+      work_done.wait(guard);
+    }
+  }
+  in_flight.pop_front();
+
+  report(*b);
+  free_blocks.push_back(b);
+  return true;
+}
+
+/* The characters [start, end) of a kind in the block, as bytes */
+void
+ros_strings::append(string &text, const struct block &b, enum kind kind, unsigned start, unsigned end) const
+{
+  if (kind == KIND_ASCII) {
+    text.append(b.buffer + start, end - start);
+    return;
+  }
+  for (unsigned c = start; c < end; ++c)
+    text.push_back(b.buffer[char_offset(kind, c)]);
+}
+
+void
+ros_strings::emit(enum kind kind, uint64_t offset, const char *s, size_t length)
+{
+  ++found;
+  if (json) {
+    out.begin_object()
+       .key("type").string("string")
+       .key("file").string(file.c_str())
+       .key("filename").string(name.c_str())
+       .key("offset").number(offset)
+       .key("encoding").string(encoding_names[kind])
+       .key("length").number(length)
+       .key("string").string(s, length)
+       .end_object()
+       .end_record();
+  }
+  else {
+    out.raw(name.c_str()).put(' ').hex(offset).put(' ').raw(encoding_names[kind]).put(' ');
+    out.raw(s, length).put('\n');
+  }
+}
+
+/* Write the strings the block ends and holds, and carry on those it leaves open */
+void
+ros_strings::report(const struct block &b)
+{
+  for (unsigned k = 0; k < kinds; ++k) {
+    const enum kind kind = static_cast<enum kind>(k);
+    const struct edges &e = b.edges[k];
+    struct carry &c = carries[k];
+    if (!e.count)
+      continue;
+    if (c.active) {
+      append(c.text, b, kind, 0, e.head);
+      if (e.head < e.count) {
+        if (c.text.size() >= min_length)
+          emit(kind, c.offset, c.text.data(), c.text.size());
+        c.active = false;
+      }
+    }
+    else if (e.head == e.count) {
+      c.active = true;
+      c.offset = b.base + char_offset(k, 0);
+      c.text.clear();
+      append(c.text, b, kind, 0, e.count);
+    }
+    else if (e.head >= min_length) {
+      text.clear();
+      append(text, b, kind, 0, e.head);
+      emit(kind, b.base + char_offset(k, 0), text.data(), text.size());
+    }
+  }
+
+  for (unsigned i = 0; i < b.runs.size(); ++i) {
+    const struct run &r = b.runs[i];
+    if (r.kind == KIND_ASCII)
+      emit(r.kind, b.base + r.start, b.buffer + r.start, r.end - r.start);
+    else {
+      text.clear();
+      append(text, b, r.kind, r.start, r.end);
+      emit(r.kind, b.base + char_offset(r.kind, r.start), text.data(), text.size());
+    }
+  }
+
+  for (unsigned k = 0; k < kinds; ++k) {
+    const struct edges &e = b.edges[k];
+    if (e.head == e.count || e.tail == e.count)
+      continue;
+    struct carry &c = carries[k];
+    c.active = true;
+    c.offset = b.base + char_offset(k, e.tail);
+    c.text.clear();
+    append(c.text, b, static_cast<enum kind>(k), e.tail, e.count);
+  }
+}
+
+uint64_t
+ros_strings::end_entry()
+{
+  if (previous) {
+    dispatch(previous, current);
+    previous = nullptr;
+  }
+  if (current) {
+    dispatch(current, nullptr);
+    current = nullptr;
+  }
+  while (retire(true))
+    ;
+
+  for (unsigned k = 0; k < kinds; ++k) {
+    struct carry &c = carries[k];
+    if (c.active && c.text.size() >= min_length)
+      emit(static_cast<enum kind>(k), c.offset, c.text.data(), c.text.size());
+    c.active = false;
+  }
+  return found;
+}
+
+struct ros_phase_stats
+ros_strings::take_stats()
+{
+  lock_guard<mutex> guard(lock);
+  struct ros_phase_stats taken = counts;
+  memset(&counts, 0, sizeof(counts));
+  return taken;
+}
+
+void
+ros_strings::work()
+{
+  vector<uint64_t> printable, zero, chars;
+  for (;;) {
+    struct block *b;
+    {
+      unique_lock<mutex> guard(lock);
+      while (queue.empty() && !stopping)
+        work_ready.wait(guard);
+      if (queue.empty())
+        return;
+      b = queue.front();
+      queue.pop_front();
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    scan(*b, printable, zero, chars);
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    {
+      lock_guard<mutex> guard(lock);
+      b->scanned = true;
+      counts.ns += ns;
+      counts.bytes += b->length;
+      ++counts.calls;
+    }
+    work_done.notify_all();
+  }
+}
+
+/* Record the runs of set bits in bits[0, count): those touching either end
+ * of the block as its edges, and those inside it long enough to report
+ */
+void
+ros_strings::find_runs(struct block &b, enum kind kind, const uint64_t *bits, unsigned count)
+{
+  struct edges &e = b.edges[kind];
+  e.count = count;
+  e.head = 0;
+  e.tail = count;
+
+  const unsigned words = (count + 63) / 64;
+  unsigned i = 0;
+  while (i < count) {
+    unsigned w = i / 64;
+    uint64_t word = bits[w] & (~0ULL << (i % 64));
+    while (!word && ++w < words)
+      word = bits[w];
+    if (!word)
+      break;
+    const unsigned start = w * 64 + __builtin_ctzll(word);
+    if (start >= count)
+      break;
+    word = ~bits[w] & (~0ULL << (start % 64));
+    while (!word && ++w < words)
+      word = ~bits[w];
+    const unsigned end = word && w * 64 + __builtin_ctzll(word) < count ? w * 64 + __builtin_ctzll(word) : count;
+
+    if (start == 0)
+      e.head = end;
+    else if (end == count)
+      e.tail = start;
+    else if (end - start >= min_length) {
+      struct run r = { start, end, kind };
+      b.runs.push_back(r);
+    }
+    i = end;
+  }
+}
+
+/* Classify the block's bytes and find the strings of each kind in it */
+void
+ros_strings::scan(struct block &b, vector<uint64_t> &printable, vector<uint64_t> &zero, vector<uint64_t> &chars)
+{
+  const unsigned available = b.length + b.extension;
+  const unsigned words = (available + 63) / 64;
+  if (printable.size() < words + 1) {
+    printable.resize(words + 1);
+    zero.resize(words + 1);
+    chars.resize(words / 2 + 1);
+  }
+  classify(reinterpret_cast<const unsigned char *>(b.buffer), available, &printable[0], &zero[0]);
+  zero[words] = 0;
+
+  find_runs(b, KIND_ASCII, &printable[0], b.length);
+
+  for (unsigned k = KIND_UTF16_EVEN; k < kinds; ++k) {
+    // a character at an offset of this parity is a printable byte followed by a zero one
+    const unsigned parity = k == KIND_UTF16_ODD;
+    for (unsigned w = 0; w < words; ++w) {
+      uint64_t pairs = printable[w] & (zero[w] >> 1 | zero[w + 1] << 63);
+      uint64_t half = even_bits(pairs >> parity);
+      if (w & 1)
+        chars[w / 2] |= half << 32;
+      else
+        chars[w / 2] = half;
+    }
+    find_runs(b, static_cast<enum kind>(k), &chars[0], b.length > parity ? (b.length - parity + 1) / 2 : 0);
+  }
+
+  // the kinds were found one after another
+  if (kinds > 1)
+    sort(b.runs.begin(), b.runs.end(), [](const struct run &x, const struct run &y) {
+      return char_offset(x.kind, x.start) < char_offset(y.kind, y.start);
+    });
+}
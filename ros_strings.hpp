@@ -0,0 +1,148 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * List the printable strings in entry data.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_STRINGS_HPP__
+#define __ROS_STRINGS_HPP__
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ros_format.hpp"
+#include "ros_pool.hpp"
+#include "ros_stats.hpp"
+
+/* Finds runs of at least min_length printable characters (ASCII 0x20 to
+ * 0x7E and tab, as strings(1) takes them) in the data of an entry as it
+ * streams past, and optionally UTF-16LE runs of the same characters each
+ * followed by a zero byte. Each is written to out as it is found, with the
+ * entry's name and its offset in the entry's data: a line of
+ * ENTRY OFFSET ascii|utf16le STRING, or a JSON string record.
+ *
+ * The data is copied into blocks that are classified by a pool of worker
+ * threads, 64 bytes at a time with AVX2 or SSE2 where the CPU has them,
+ * into bitmaps of printable and zero bytes from which the runs are read a
+ * word at a time. A worker reports the strings wholly inside its block and
+ * the runs that touch either end of it; the thread feeding the data joins
+ * those up with the blocks either side as it retires the blocks in data
+ * order, so a string straddling any number of blocks is reported once. A
+ * block carries a copy of the first byte of the next one for the high byte
+ * of a UTF-16 character that straddles them.
+ *
+ * One thread feeds it and writes to out; the workers live as long as it does.
+ */
+class ros_strings {
+  public:
+    ros_strings(ros_writer &out, bool json, unsigned min_length, bool utf16, unsigned workers);
+    ~ros_strings();
+
+    void set_file(const char *file);      // the archive named in JSON records
+    void begin_entry(const char *name);
+    void feed(const char *data, unsigned length);
+    uint64_t end_entry();                 // the number of strings found
+
+    /* time and bytes the workers spent classifying since the last call */
+    struct ros_phase_stats take_stats();
+
+  private:
+    ros_strings(const ros_strings &);
+    ros_strings &operator=(const ros_strings &);
+
+    // the characters of ASCII strings are bytes, those of UTF-16 strings pairs at even or odd offsets
+    enum kind { KIND_ASCII = 0, KIND_UTF16_EVEN, KIND_UTF16_ODD, KIND_MAX };
+
+    struct run {
+      uint32_t start;     // characters of its kind from the start of the block
+      uint32_t end;
+      enum kind kind;
+    };
+
+    struct edges {
+      uint32_t count;     // characters of the kind that start in the block
+      uint32_t head;      // length of the run at the start of the block, count if it fills it
+      uint32_t tail;      // start of the run reaching the end of the block, count if none does
+    };
+
+    struct block {
+      char *buffer;
+      unsigned length;      // bytes of the entry at base
+      unsigned extension;   // bytes of the following data copied after them
+      uint64_t base;        // offset of buffer in the entry's data
+      bool scanned;
+      struct edges edges[KIND_MAX];
+      std::vector<struct run> runs;  // strings that touch neither end, in data order
+    };
+
+    struct carry {
+      bool active;
+      uint64_t offset;      // where it starts in the entry's data
+      std::string text;
+    };
+
+    void work();
+    void scan(struct block &b, std::vector<uint64_t> &printable, std::vector<uint64_t> &zero,
+              std::vector<uint64_t> &chars);
+    void find_runs(struct block &b, enum kind kind, const uint64_t *bits, unsigned count);
+    struct block *get_block();
+    void dispatch(struct block *b, const struct block *next);
+    bool retire(bool wait);
+    void report(const struct block &b);
+    void append(std::string &text, const struct block &b, enum kind kind, unsigned start, unsigned end) const;
+    void emit(enum kind kind, uint64_t offset, const char *text, size_t length);
+
+    static const unsigned block_size = 1024 * 1024;
+
+    ros_writer &out;
+    const bool json;
+    const unsigned min_length;
+    const unsigned kinds;         // KIND_ASCII only, or all three
+    const unsigned reach;         // bytes of the next block a block carries
+    ros_buffer_pool buffers;
+    std::vector<struct block *> blocks;
+
+    // the feeding thread's entry
+    std::string file;
+    std::string name;
+    uint64_t position;
+    uint64_t found;
+    struct block *current;    // being filled
+    struct block *previous;   // full, waiting for the start of the next block
+    std::deque<struct block *> in_flight;   // dispatched, in data order
+    std::vector<struct block *> free_blocks;
+    struct carry carries[KIND_MAX];   // runs reaching the end of the last block retired
+    std::string text;         // a UTF-16 string being written
+
+    std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::deque<struct block *> queue;   // waiting for a worker
+    bool stopping;
+    struct ros_phase_stats counts;
+    std::vector<std::thread> threads;
+};
+
+#endif
@@ -0,0 +1,770 @@
+/* VxWorks ROS Firmware encoder tuning
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Reports, for each entry of ROS PACK archives, the size and the encode and
+ * decode times of storing it and of LZMA presets and filter chains, and
+ * recommends the settings that fit a target image size with the fastest
+ * decoding on the device.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <lzma.h>
+#include "rospack.h"
+#include "ros_format.hpp"
+#include "ros_lzma.hpp"
+#include "ros_util.hpp"
+
+using namespace std;
+
+
+// command-line switches
+const char *switch_target = "--target=";
+const char *switch_presets = "--presets=";
+const char *switch_filters = "--filters=";
+const char *switch_sample = "--sample=";
+const char *switch_jobs = "--jobs=";
+const char *switch_memory = "--memory=";
+const char *switch_output = "--output=";
+const char *switch_help = "--help";
+
+uint64_t target = 0;                // bytes of entry data per archive; 0 for the current size
+uint64_t sample_size = 256 * 1024;  // of an entry, tried with every method before the shortlist
+unsigned jobs = 0;                  // trials run at once; 0 for one per CPU
+uint64_t memory_budget = 0;         // of the trials running at once, and of the decoder reading the archives
+bool json = false;
+
+const unsigned sample_slices = 16;        // the sample is cut from this many places in the entry
+const unsigned shortlist_max = 4;         // compressed methods tried on the whole entry
+const double incompressible = 7.9;        // bits per byte above which only the fastest preset is tried
+const double timing_ms = 20;              // decoding is repeated for at least this long
+
+/* LZMA in the .lzma format the archives hold it in, and in .xz LZMA2 alone
+ * and behind the branch/call/jump filters for the code of the CPUs VxWorks
+ * devices use
+ */
+struct tune_chain {
+  const char *name;
+  lzma_vli bcj;                     // LZMA_VLI_UNKNOWN for no filter
+  bool alone;                       // .lzma rather than .xz
+};
+
+const struct tune_chain known_chains[] = {
+  { "lzma", LZMA_VLI_UNKNOWN, true },
+  { "lzma2", LZMA_VLI_UNKNOWN },
+  { "x86", LZMA_FILTER_X86 },
+  { "powerpc", LZMA_FILTER_POWERPC },
+  { "arm", LZMA_FILTER_ARM },
+  { "armthumb", LZMA_FILTER_ARMTHUMB },
+  { "sparc", LZMA_FILTER_SPARC },
+#if defined LZMA_FILTER_ARM64
+  { "arm64", LZMA_FILTER_ARM64 },
+#endif
+};
+
+vector<const struct tune_chain *> chains;
+vector<uint32_t> presets;
+
+struct tune_method {
+  bool store;                       // as it is, not compressed
+  const struct tune_chain *chain;
+  uint32_t preset;
+};
+
+struct tune_result {
+  struct tune_method method;
+  bool ok;
+  uint64_t size;
+  double encode_ms;
+  double decode_ms;
+  uint64_t decode_memory;
+};
+
+struct tune_entry {
+  const struct rospack_entry *entry;
+  vector<char> data;                // uncompressed
+  int error;                        // uncompressing it
+  double entropy;                   // bits per byte, of the sample
+  vector<char> sample;              // empty if the entry is no larger than a sample
+  vector<struct tune_result> sampled;
+  vector<struct tune_result> full;  // sorted by decode time; the hull of size against it
+  unsigned chosen;                  // in full
+};
+
+void
+method_name(const struct tune_method &method, char *name, size_t length)
+{
+  const char *extreme = method.preset & LZMA_PRESET_EXTREME ? "e" : "";
+  if (method.store)
+    snprintf(name, length, "store");
+  else if (method.chain->alone)
+    snprintf(name, length, "lzma -%u%s", method.preset & LZMA_PRESET_LEVEL_MASK, extreme);
+  else if (method.chain->bcj == LZMA_VLI_UNKNOWN)
+    snprintf(name, length, "lzma2 -%u%s", method.preset & LZMA_PRESET_LEVEL_MASK, extreme);
+  else
+    snprintf(name, length, "%s+lzma2 -%u%s", method.chain->name, method.preset & LZMA_PRESET_LEVEL_MASK, extreme);
+}
+
+/* Order-0 entropy of the bytes, in bits per byte */
+double
+entropy(const char *data, size_t length)
+{
+  if (!length)
+    return 0;
+  uint64_t counts[256] = { 0 };
+  for (size_t i = 0; i < length; ++i)
+    ++counts[static_cast<unsigned char>(data[i])];
+  double bits = 0;
+  for (unsigned b = 0; b < 256; ++b)
+    if (counts[b]) {
+      double p = static_cast<double>(counts[b]) / length;
+      bits -= p * log2(p);
+    }
+  return bits;
+}
+
+/* Slices from across the entry, so a sample sees its code and its data */
+void
+take_sample(struct tune_entry &tuned)
+{
+  size_t length = tuned.data.size();
+  if (length <= sample_size)
+    return;
+  size_t slice = sample_size / sample_slices;
+  tuned.sample.reserve(slice * sample_slices);
+  for (unsigned s = 0; s < sample_slices; ++s) {
+    size_t offset = (length - slice) / (sample_slices - 1) * s;
+    tuned.sample.insert(tuned.sample.end(), tuned.data.begin() + offset, tuned.data.begin() + offset + slice);
+  }
+}
+
+/* All of in through a coder, into out (which is large enough) */
+bool
+code_all(lzma_stream &stream, const uint8_t *in, size_t in_length, uint8_t *out, size_t &out_length)
+{
+  stream.next_in = in;
+  stream.avail_in = in_length;
+  stream.next_out = out;
+  stream.avail_out = out_length;
+  lzma_ret ret;
+  do
+    ret = lzma_code(&stream, LZMA_FINISH);
+  while (ret == LZMA_OK && stream.avail_out);
+  out_length -= stream.avail_out;
+  lzma_end(&stream);
+  return ret == LZMA_STREAM_END;
+}
+
+/* The filter chain of a method that is not store; false if its preset is not valid */
+bool
+method_filters(const struct tune_method &method, lzma_options_lzma &options, lzma_filter filters[3])
+{
+  if (lzma_lzma_preset(&options, method.preset))
+    return false;
+  unsigned n = 0;
+  if (method.chain->bcj != LZMA_VLI_UNKNOWN) {
+    filters[n].id = method.chain->bcj;
+    filters[n++].options = nullptr;
+  }
+  filters[n].id = method.chain->alone ? LZMA_FILTER_LZMA1 : LZMA_FILTER_LZMA2;
+  filters[n++].options = &options;
+  filters[n].id = LZMA_VLI_UNKNOWN;
+  filters[n].options = nullptr;
+  return true;
+}
+
+/* The most memory trying the method on length bytes takes at once: the
+ * encoder, or later the decoder, beside the encoded and decoded copies
+ */
+uint64_t
+trial_memory(const struct tune_method &method, size_t length)
+{
+  lzma_options_lzma options;
+  lzma_filter filters[3];
+  if (method.store || !method_filters(method, options, filters))
+    return 0;
+  uint64_t coder = max(lzma_raw_encoder_memusage(filters), lzma_raw_decoder_memusage(filters));
+  if (coder == UINT64_MAX)
+    return UINT64_MAX;
+  return coder + lzma_stream_buffer_bound(length) + length;
+}
+
+/* Encode the data with the method, then decode it again for the time the
+ * device would take, and check that it comes back the same
+ */
+struct tune_result
+try_method(const struct tune_method &method, const vector<char> &data, bool time_decode)
+{
+  struct tune_result result;
+  memset(&result, 0, sizeof(result));
+  result.method = method;
+  if (method.store) {
+    result.ok = true;
+    result.size = data.size();
+    return result;
+  }
+
+  lzma_options_lzma options;
+  lzma_filter filters[3];
+  if (!method_filters(method, options, filters))
+    return result;
+  result.decode_memory = lzma_raw_decoder_memusage(filters);
+
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(data.data());
+  vector<uint8_t> encoded(lzma_stream_buffer_bound(data.size()));
+  size_t encoded_length = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (method.chain->alone) {
+    lzma_stream stream = LZMA_STREAM_INIT;
+    encoded_length = encoded.size();
+    if (lzma_alone_encoder(&stream, &options) != LZMA_OK
+        || !code_all(stream, in, data.size(), encoded.data(), encoded_length))
+      return result;
+  }
+  else if (lzma_stream_buffer_encode(filters, LZMA_CHECK_CRC32, nullptr, in, data.size(),
+                                     encoded.data(), &encoded_length, encoded.size()) != LZMA_OK)
+    return result;
+  result.encode_ms = ros_elapsed_ms(start);
+  result.size = encoded_length;
+  if (!time_decode) {
+    result.ok = true;
+    return result;
+  }
+
+  vector<uint8_t> decoded(data.size());
+  unsigned rounds = 0;
+  start = chrono::steady_clock::now();
+  do {
+    uint64_t memlimit = UINT64_MAX;
+    size_t in_pos = 0, out_pos = 0;
+    if (method.chain->alone) {
+      lzma_stream stream = LZMA_STREAM_INIT;
+      out_pos = decoded.size();
+      if (lzma_alone_decoder(&stream, memlimit) != LZMA_OK
+          || !code_all(stream, encoded.data(), encoded_length, decoded.data(), out_pos))
+        return result;
+    }
+    else if (lzma_stream_buffer_decode(&memlimit, 0, nullptr, encoded.data(), &in_pos, encoded_length,
+                                       decoded.data(), &out_pos, decoded.size()) != LZMA_OK)
+      return result;
+    if (out_pos != data.size())
+      return result;
+    ++rounds;
+  } while (ros_elapsed_ms(start) < timing_ms);
+  result.decode_ms = ros_elapsed_ms(start) / rounds;
+  result.ok = memcmp(decoded.data(), in, data.size()) == 0;
+  return result;
+}
+
+/* Run count tasks on up to jobs threads, in order, starting one only while
+ * the memory of those running stays within memory_budget; a task that needs
+ * more than the whole budget runs on its own
+ */
+void
+run_parallel(size_t count, const function<uint64_t(size_t)> &memory, const function<void(size_t)> &task)
+{
+  mutex lock;
+  condition_variable changed;
+  size_t next = 0;
+  uint64_t in_use = 0;
+  unsigned running = 0;
+  auto work = [&]() {
+    for (;;) {
+      size_t i;
+      uint64_t need;
+      {
+        unique_lock<mutex> guard(lock);
+        if (next >= count)
+          return;
+        i = next++;
+        need = min(memory(i), memory_budget);
+        changed.wait(guard, [&]() { return !running || in_use + need <= memory_budget; });
+        in_use += need;
+        ++running;
+      }
+      task(i);
+      {
+        lock_guard<mutex> guard(lock);
+        in_use -= need;
+        --running;
+      }
+      changed.notify_all();
+    }
+  };
+  vector<thread> threads;
+  for (unsigned t = 1; t < jobs && t < count; ++t)
+    threads.push_back(thread(work));
+  work();
+  for (size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
+
+/* The sampled methods worth trying on the whole entry: those that no other
+ * method beats on both size and encode time, spread from the smallest to the
+ * fastest. Decoding LZMA2 costs about the same for every preset, so encode
+ * time stands in for it on the sample.
+ */
+vector<struct tune_method>
+shortlist(const struct tune_entry &tuned)
+{
+  vector<struct tune_result> front;
+  for (size_t i = 0; i < tuned.sampled.size(); ++i) {
+    const struct tune_result &r = tuned.sampled[i];
+    if (!r.ok || r.method.store)
+      continue;
+    bool dominated = false;
+    for (size_t j = 0; j < tuned.sampled.size() && !dominated; ++j) {
+      const struct tune_result &o = tuned.sampled[j];
+      dominated = j != i && o.ok && !o.method.store && o.size <= r.size && o.encode_ms <= r.encode_ms
+                  && (o.size < r.size || o.encode_ms < r.encode_ms);
+    }
+    if (!dominated)
+      front.push_back(r);
+  }
+  sort(front.begin(), front.end(), [](const struct tune_result &a, const struct tune_result &b) { return a.size < b.size; });
+
+  vector<struct tune_method> methods(1);
+  methods[0].store = true;
+  for (unsigned i = 0; i < shortlist_max && i < front.size(); ++i) {
+    size_t pick = front.size() <= shortlist_max ? i : i * (front.size() - 1) / (shortlist_max - 1);
+    methods.push_back(front[pick].method);
+  }
+  return methods;
+}
+
+/* Keep the results that are smaller than every one that decodes faster */
+void
+keep_hull(vector<struct tune_result> &results)
+{
+  sort(results.begin(), results.end(), [](const struct tune_result &a, const struct tune_result &b) {
+    return a.decode_ms != b.decode_ms ? a.decode_ms < b.decode_ms : a.size < b.size;
+  });
+  vector<struct tune_result> hull;
+  for (size_t i = 0; i < results.size(); ++i)
+    if (results[i].ok && (hull.empty() || results[i].size < hull.back().size))
+      hull.push_back(results[i]);
+  results.swap(hull);
+}
+
+/* Start every entry at its fastest decode, then take the step down in size
+ * that costs the least decode time per byte saved until the total fits
+ */
+bool
+recommend(vector<struct tune_entry> &entries, uint64_t budget, uint64_t &total, double &decode_ms)
+{
+  total = 0;
+  for (size_t e = 0; e < entries.size(); ++e) {
+    entries[e].chosen = 0;
+    if (!entries[e].full.empty())
+      total += entries[e].full[0].size;
+  }
+  while (total > budget) {
+    size_t best = entries.size();
+    double best_rate = 0;
+    for (size_t e = 0; e < entries.size(); ++e) {
+      const struct tune_entry &tuned = entries[e];
+      if (tuned.chosen + 1 >= tuned.full.size())
+        continue;
+      const struct tune_result &now = tuned.full[tuned.chosen], &next = tuned.full[tuned.chosen + 1];
+      double rate = (now.size - next.size) / max(next.decode_ms - now.decode_ms, 1e-6);
+      if (best == entries.size() || rate > best_rate) {
+        best = e;
+        best_rate = rate;
+      }
+    }
+    if (best == entries.size())
+      break;
+    struct tune_entry &tuned = entries[best];
+    total -= tuned.full[tuned.chosen].size - tuned.full[tuned.chosen + 1].size;
+    ++tuned.chosen;
+  }
+  decode_ms = 0;
+  for (size_t e = 0; e < entries.size(); ++e)
+    if (!entries[e].full.empty())
+      decode_ms += entries[e].full[entries[e].chosen].decode_ms;
+  return total <= budget;
+}
+
+void
+json_result(ros_writer &out, const struct tune_result &r, bool recommended)
+{
+  char name[32];
+  method_name(r.method, name, sizeof(name));
+  out.begin_object()
+     .key("method").string(name)
+     .key("filters").string(r.method.store ? "none" : r.method.chain->name)
+     .key("format").string(r.method.store ? "none" : r.method.chain->alone ? "lzma" : "xz")
+     .key("preset");
+  if (r.method.store)
+    out.null();
+  else
+    out.number(r.method.preset & LZMA_PRESET_LEVEL_MASK);
+  out.key("extreme").boolean(!r.method.store && (r.method.preset & LZMA_PRESET_EXTREME));
+  out.key("size").number(r.size)
+     .key("encode_ms").real(r.encode_ms)
+     .key("decode_ms").real(r.decode_ms)
+     .key("decode_memory").number(r.decode_memory)
+     .key("recommended").boolean(recommended)
+     .end_object();
+}
+
+void
+text_result(const struct tune_result &r, uint64_t length, bool recommended)
+{
+  char name[32], line[160];
+  method_name(r.method, name, sizeof(name));
+  snprintf(line, sizeof(line), "  %c %-18s %10llu %6.1f%% %9.2f ms %9.2f ms %7llu KiB",
+           recommended ? '*' : ' ', name, static_cast<unsigned long long>(r.size),
+           length ? 100.0 * r.size / length : 100.0, r.encode_ms, r.decode_ms,
+           static_cast<unsigned long long>(r.decode_memory / 1024));
+  cout << line << "\n";
+}
+
+int
+tune_archive(const char *path, rospack_decoder *decoder, ros_writer *out)
+{
+  rospack_archive *archive;
+  int error = rospack_open_path(path, &archive);
+  if (error != ROSPACK_OK) {
+    cerr << "Error opening " << path << ": " << rospack_strerror(error) << endl;
+    return 1;
+  }
+
+  // the entries' data as the archive holds it now is the default target
+  unsigned count = rospack_entry_count(archive);
+  vector<struct tune_entry> entries(count);
+  uint64_t current = 0;
+  for (unsigned i = 0; i < count; ++i) {
+    struct tune_entry &tuned = entries[i];
+    tuned.entry = rospack_entry(archive, i);
+    current += tuned.entry->data_length;
+    if (tuned.entry->compressed)
+      tuned.error = rospack_decode(decoder, archive, i, ros_append_output, &tuned.data);
+    else {
+      const void *data;
+      size_t length;
+      tuned.error = rospack_entry_data(archive, i, &data, &length);
+      if (tuned.error == ROSPACK_OK)
+        tuned.data.assign(static_cast<const char *>(data), static_cast<const char *>(data) + length);
+    }
+    take_sample(tuned);
+    const vector<char> &sample = tuned.sample.empty() ? tuned.data : tuned.sample;
+    tuned.entropy = entropy(sample.data(), sample.size());
+  }
+  uint64_t budget = target ? target : current;
+
+  // every method on the samples, high entropy data with only the fastest
+  struct trial { size_t entry; struct tune_method method; };
+  vector<struct trial> trials;
+  for (size_t e = 0; e < count; ++e) {
+    struct tune_entry &tuned = entries[e];
+    if (tuned.error != ROSPACK_OK)
+      continue;
+    struct tune_method method;
+    method.store = true;
+    method.chain = nullptr;
+    method.preset = 0;
+    trials.push_back({ e, method });
+    method.store = false;
+    for (size_t c = 0; c < chains.size(); ++c)
+      for (size_t p = 0; p < presets.size(); ++p) {
+        method.chain = chains[c];
+        method.preset = presets[p];
+        if (tuned.entropy < incompressible || (c == 0 && p == 0))
+          trials.push_back({ e, method });
+      }
+  }
+  vector<struct tune_result> results(trials.size());
+  run_parallel(trials.size(), [&](size_t t) {
+    const struct tune_entry &tuned = entries[trials[t].entry];
+    return trial_memory(trials[t].method, tuned.sample.empty() ? tuned.data.size() : tuned.sample.size());
+  }, [&](size_t t) {
+    const struct tune_entry &tuned = entries[trials[t].entry];
+    // an entry no larger than a sample is tried whole, with its decode timed
+    results[t] = try_method(trials[t].method, tuned.sample.empty() ? tuned.data : tuned.sample, tuned.sample.empty());
+  });
+  for (size_t t = 0; t < trials.size(); ++t)
+    entries[trials[t].entry].sampled.push_back(results[t]);
+
+  // the shortlist on the whole of the larger entries
+  trials.clear();
+  for (size_t e = 0; e < count; ++e) {
+    struct tune_entry &tuned = entries[e];
+    if (tuned.error != ROSPACK_OK)
+      continue;
+    if (tuned.sample.empty()) {
+      tuned.full = tuned.sampled;
+      continue;
+    }
+    vector<struct tune_method> methods = shortlist(tuned);
+    for (size_t m = 0; m < methods.size(); ++m)
+      trials.push_back({ e, methods[m] });
+  }
+  results.assign(trials.size(), tune_result());
+  run_parallel(trials.size(), [&](size_t t) {
+    return trial_memory(trials[t].method, entries[trials[t].entry].data.size());
+  }, [&](size_t t) {
+    results[t] = try_method(trials[t].method, entries[trials[t].entry].data, true);
+  });
+  for (size_t t = 0; t < trials.size(); ++t)
+    entries[trials[t].entry].full.push_back(results[t]);
+  for (size_t e = 0; e < count; ++e)
+    keep_hull(entries[e].full);
+
+  uint64_t total;
+  double decode_ms;
+  bool fits = recommend(entries, budget, total, decode_ms);
+
+  if (out) {
+    for (size_t e = 0; e < count; ++e) {
+      const struct tune_entry &tuned = entries[e];
+      out->begin_object()
+          .key("type").string("tune")
+          .key("file").string(path)
+          .key("index").number(tuned.entry->index)
+          .key("filename").string(tuned.entry->filename)
+          .key("length").number(tuned.data.size())
+          .key("stored_length").number(tuned.entry->data_length)
+          .key("error");
+      if (tuned.error != ROSPACK_OK)
+        out->string(rospack_strerror(tuned.error));
+      else
+        out->null();
+      out->key("entropy").real(tuned.entropy)
+          .key("sampled").boolean(!tuned.sample.empty())
+          .key("results").begin_array();
+      for (size_t r = 0; r < tuned.full.size(); ++r)
+        json_result(*out, tuned.full[r], r == tuned.chosen);
+      out->end_array().end_object().end_record();
+    }
+    out->begin_object()
+        .key("type").string("tune_archive")
+        .key("file").string(path)
+        .key("target").number(budget)
+        .key("total").number(total)
+        .key("fits").boolean(fits)
+        .key("decode_ms").real(decode_ms)
+        .end_object().end_record();
+    out->flush();
+  }
+  else {
+    cout << "Tuning " << path << ": " << count << " entries, target " << budget << " bytes"
+         << (target ? "" : " (their size now)") << "\n";
+    cout << "    method                   bytes  ratio      encode      decode  decoder\n";
+    for (size_t e = 0; e < count; ++e) {
+      const struct tune_entry &tuned = entries[e];
+      if (tuned.error != ROSPACK_OK) {
+        cerr << "Error uncompressing " << tuned.entry->filename << ": " << rospack_strerror(tuned.error) << endl;
+        continue;
+      }
+      char line[160];
+      snprintf(line, sizeof(line), "%s: %zu bytes, entropy %.2f bits/byte%s", tuned.entry->filename,
+               tuned.data.size(), tuned.entropy, tuned.sample.empty() ? "" : ", sampled");
+      cout << line << "\n";
+      for (size_t r = 0; r < tuned.full.size(); ++r)
+        text_result(tuned.full[r], tuned.data.size(), r == tuned.chosen);
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "%s: %llu bytes %s the target of %llu, decoding in %.2f ms\n",
+             fits ? "Recommended" : "Smallest", static_cast<unsigned long long>(total),
+             fits ? "within" : "over", static_cast<unsigned long long>(budget), decode_ms);
+    cout << line;
+    cout.flush();
+  }
+
+  rospack_close(archive);
+  return fits ? 0 : 2;
+}
+
+void
+usage(char *prog_name)
+{
+  cout << "Usage: " << prog_name << " ["
+       << " " << switch_target << "SIZE"
+       << " " << switch_presets << "LIST"
+       << " " << switch_filters << "LIST"
+       << " " << switch_sample << "SIZE"
+       << " " << switch_jobs << "N"
+       << " " << switch_memory << "SIZE"
+       << " " << switch_output << "text|json"
+       << " " << switch_help
+       << " ] FILENAME..." << endl
+       << switch_target << ": total bytes of entry data to fit each archive in, with suffix K, M or G (default: as now)" << endl
+       << switch_presets << ": LZMA presets to try, e.g. 0,3,6e (default 0,1,3,6,9)" << endl
+       << switch_filters << ": filter chains to try, of:";
+  for (size_t c = 0; c < sizeof(known_chains) / sizeof(known_chains[0]); ++c)
+    cout << " " << known_chains[c].name;
+  cout << " (default all)" << endl
+       << switch_sample << ": bytes of an entry tried with every method, before the best on all of it (default 256K)" << endl
+       << switch_jobs << ": run N trials at once (default: one per CPU)" << endl
+       << switch_memory << ": memory budget of the trials run at once, and limit of the LZMA decoder reading the archives (default: a quarter of RAM)" << endl
+       << switch_output << ": report as text or as one JSON record per entry and per archive" << endl
+       << switch_help << ": display this help text" << endl;
+}
+
+/* Comma-separated presets, each 0 to 9 with an optional e for extreme */
+bool
+parse_presets(const char *text)
+{
+  presets.clear();
+  while (*text) {
+    char *end;
+    unsigned long preset = strtoul(text, &end, 10);
+    if (end == text || preset > 9)
+      return false;
+    if (*end == 'e') {
+      preset |= LZMA_PRESET_EXTREME;
+      ++end;
+    }
+    presets.push_back(preset);
+    if (*end == ',')
+      ++end;
+    else if (*end)
+      return false;
+    text = end;
+  }
+  return !presets.empty();
+}
+
+bool
+parse_filters(const char *text)
+{
+  chains.clear();
+  while (*text) {
+    size_t length = strcspn(text, ",");
+    size_t c = 0;
+    while (c < sizeof(known_chains) / sizeof(known_chains[0])
+           && (strlen(known_chains[c].name) != length || strncmp(known_chains[c].name, text, length) != 0))
+      ++c;
+    if (c == sizeof(known_chains) / sizeof(known_chains[0]))
+      return false;
+    chains.push_back(&known_chains[c]);
+    text += length;
+    if (*text == ',')
+      ++text;
+  }
+  return !chains.empty();
+}
+
+int
+main(int argc, char **argv, char **env)
+{
+  parse_presets("0,1,3,6,9");
+  for (size_t c = 0; c < sizeof(known_chains) / sizeof(known_chains[0]); ++c)
+    chains.push_back(&known_chains[c]);
+
+  vector<const char *> files;
+  for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
+    char *end;
+    if (strncmp(argv[i], switch_help, 3) == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (strncmp(argv[i], switch_target, strlen(switch_target)) == 0) {
+      target = ros_parse_size(argv[i] + strlen(switch_target));
+      if (!target) {
+        cerr << "Error: invalid target size: " << argv[i] + strlen(switch_target) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_presets, strlen(switch_presets)) == 0) {
+      if (!parse_presets(argv[i] + strlen(switch_presets))) {
+        cerr << "Error: invalid presets: " << argv[i] + strlen(switch_presets) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_filters, strlen(switch_filters)) == 0) {
+      if (!parse_filters(argv[i] + strlen(switch_filters))) {
+        cerr << "Error: invalid filter chains: " << argv[i] + strlen(switch_filters) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_sample, strlen(switch_sample)) == 0) {
+      sample_size = ros_parse_size(argv[i] + strlen(switch_sample));
+      if (sample_size < sample_slices) {
+        cerr << "Error: invalid sample size: " << argv[i] + strlen(switch_sample) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_jobs, strlen(switch_jobs)) == 0) {
+      jobs = strtoul(argv[i] + strlen(switch_jobs), &end, 10);
+      if (*end || jobs < 1) {
+        cerr << "Error: invalid number of jobs: " << argv[i] + strlen(switch_jobs) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_memory, strlen(switch_memory)) == 0) {
+      memory_budget = ros_parse_size(argv[i] + strlen(switch_memory));
+      if (!memory_budget) {
+        cerr << "Error: invalid memory budget: " << argv[i] + strlen(switch_memory) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_output, strlen(switch_output)) == 0) {
+      const char *format = argv[i] + strlen(switch_output);
+      if (strcmp(format, "json") == 0)
+        json = true;
+      else if (strcmp(format, "text") == 0)
+        json = false;
+      else {
+        cerr << "Error: unknown output format: " << format << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    else
+      files.push_back(argv[i]);
+  }
+  if (files.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!jobs)
+    jobs = thread::hardware_concurrency() ? thread::hardware_concurrency() : 1;
+  if (!memory_budget)
+    memory_budget = ros_lzma_default_budget();
+
+  rospack_decoder *decoder = rospack_decoder_new(memory_budget);
+  ros_writer *out = json ? new ros_writer(STDOUT_FILENO) : nullptr;
+  int result = 0;
+  for (size_t f = 0; f < files.size(); ++f)
+    result = max(result, tune_archive(files[f], decoder, out));
+  delete out;
+  rospack_decoder_free(decoder);
+  return result;
+}
@@ -26,43 +26,100 @@
 
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <string>
 #include <string.h>
 #include <sstream>
+#include <vector>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "ros_pack.hpp"
+#include "ros_archive.hpp"
+#include "ros_devices.hpp"
+#include "ros_format.hpp"
+#include "ros_io.hpp"
+#include "ros_payload.hpp"
+#include "ros_pipeline.hpp"
+#include "ros_sched.hpp"
+#include "ros_stats.hpp"
+#include "ros_stream.hpp"
+#include "ros_view.hpp"
+#include "ros_util.hpp"
 
 using namespace std;
 
 const struct _version version = { 0, 6};
 
-struct data_sig data_sigs[] = {
-  { { '7', 'z', (char)0xBC, (char)0xAF, (char)0x27, (char)0x1C}, 6, "7z archive"},
-  { {(char)0x5D, (char)0x00}, 2, "LZMA compressed"}
-};
-
-const unsigned int buffer_size = 1024*1024; // payload data read/write buffer size
+const unsigned int header_batch = 64;       // archives whose headers are read in one batch
 
 // command-line switches
 const char *switch_verbose = "--verbose";
 const char *switch_extract = "--extract";
+const char *switch_extract_to = "--extract-to=";
 const char *switch_uncompress = "--uncompress";
+const char *switch_stats = "--stats";
+const char *switch_stats_json = "--stats=json";
+const char *switch_output = "--output=";
+const char *switch_io = "--io=";
+const char *switch_jobs = "--jobs=";
+const char *switch_memory = "--memory=";
+const char *switch_signatures = "--signatures=";
+const char *switch_carve = "--carve";
+const char *switch_carve_extract = "--carve=extract";
+const char *switch_strings = "--strings";
+const char *switch_strings_utf16 = "--strings-utf16";
+const char *switch_entropy = "--entropy";
+const char *switch_digests = "--digests";
 const char *switch_help = "--help";
 
+enum carve_mode {
+  CARVE_NONE,
+  CARVE_REPORT,   // list the objects found in entry data
+  CARVE_EXTRACT   // and write each to a file
+};
+
+enum output_format {
+  OUTPUT_TEXT,
+  OUTPUT_JSON   // one NDJSON record per entry and per archive
+};
+
 bool verbose = false;
 bool extract = false;
 bool uncompress = false;
+enum carve_mode carve = CARVE_NONE;
+enum output_format output = OUTPUT_TEXT;
+enum ros_io_backend io_backend = ROS_IO_AUTO;
+unsigned jobs = 1;              // parallel uncompress workers
+uint64_t memory_budget = 0;     // for the LZMA decoders, 0 for the default
+ros_stream *stream = nullptr;   // extracting to a tar or cpio stream
+unsigned strings_min = 0;       // list strings of at least this many characters, 0 for none
+bool strings_utf16 = false;     // UTF-16LE as well as ASCII
+ros_strings *strings = nullptr;
+ros_writer *strings_text = nullptr;   // the strings listed in the text report
+unsigned entropy_block = 0;     // profile entry entropy in blocks of this many bytes, 0 for none
+bool digests = false;           // SHA-256 and CRC32C of the archive and its entries
+
+ros_stats stats;
+ros_sig_db signatures;      // built-in payload data types plus any loaded
+
+union header_v1_v2 {
+   ros_header_v1 v1;
+   ros_header_v2 v2;
+};
 
-unsigned int payload_checksum = 0;
-
-unsigned int
-checksum_calc(unsigned int checksum, const char *data, unsigned int length)
-{
-  for (const unsigned char *p = reinterpret_cast<const unsigned char *>(data); p && p < reinterpret_cast<const unsigned char *>(data) + length; ++p)
-    checksum += *p;
-
-  return checksum;
-}
+/* An archive opened for processing with its primary header already read */
+struct archive_source {
+  const char *path;
+  int fd;
+  int error;                        // errno of a failed open or fstat
+  unsigned long length;
+  union header_v1_v2 header;
+  struct ros_io_request request;    // header read; result is the bytes read or -errno
+  ros_stats_mark opened;
+  uint64_t header_ns;               // from the open to the header read's completion
+};
 
 void
 usage(char *prog_name)
@@ -70,29 +127,687 @@ usage(char *prog_name)
   cout << "Usage: " << prog_name << " ["
        << " " << switch_verbose
        << " " << switch_extract
+       << " " << switch_extract_to << "tar|cpio:FILE"
        << " " << switch_uncompress
+       << " " << switch_stats << "[=json]"
+       << " " << switch_output << "text|json"
+       << " " << switch_io << "auto|uring|pread"
+       << " " << switch_jobs << "N"
+       << " " << switch_memory << "SIZE"
+       << " " << switch_signatures << "FILE"
+       << " " << switch_carve << "[=extract]"
+       << " " << switch_strings << "[=MIN]"
+       << " " << switch_strings_utf16 << "[=MIN]"
+       << " " << switch_entropy << "[=SIZE]"
+       << " " << switch_digests
        << " " << switch_help
-       <<  " ] FILENAME" << endl
+       <<  " ] FILENAME..." << endl
        << switch_verbose << ": be verbose about progress" << endl
        << switch_extract << ": extract archive contents to current directory" << endl
+       << switch_extract_to << ": extract archive contents as one tar or cpio archive to FILE, or - for stdout" << endl
        << switch_uncompress << ": uncompress payload data files to current directory" << endl
+       << switch_stats << ": report per-phase timings, byte counts and the slowest entries" << endl
+       << switch_stats_json << ": as " << switch_stats << " but report in JSON form" << endl
+       << switch_output << "json: report one JSON record per line for each entry and archive" << endl
+       << switch_io << ": I/O back-end, io_uring where the kernel allows it (auto) or pread/pwrite" << endl
+       << switch_jobs << ": uncompress up to N entries in parallel" << endl
+       << switch_memory << ": memory budget of the LZMA decoders, with suffix K, M or G (default: a quarter of RAM)" << endl
+       << switch_signatures << ": add the data type signatures in FILE, lines of OFFSET HEX-MAGIC TITLE" << endl
+       << switch_carve << ": find objects embedded in entry data, uncompressed if it is LZMA" << endl
+       << switch_carve_extract << ": as " << switch_carve << " and write each to ENTRY-OFFSET" << endl
+       << switch_strings << ": list the strings of at least MIN (default 4) printable characters in entry data, uncompressed if it is LZMA" << endl
+       << switch_strings_utf16 << ": as " << switch_strings << " and list UTF-16LE strings too" << endl
+       << switch_entropy << ": profile the entropy of entry data, uncompressed if it is LZMA, in blocks of SIZE (default 64K)" << endl
+       << switch_digests << ": report the SHA-256 and CRC32C of the archive, and of each entry as stored and of its data, uncompressed if it is LZMA" << endl
        << switch_help    << ": display this help text" << endl
-       << "FILENAME: the ROS PACK archive file to process" << endl;
+       << "FILENAME: the ROS PACK archive file(s) to process" << endl;
 }
 
+/* The original switches may be given as any abbreviation of 3 or more
+ * characters (e.g. --ver); the others only in full, so --signatures or
+ * --extract-to without their values are not taken for --stats or --extract.
+ */
+static bool
+abbreviates(const char *arg, const char *name)
+{
+  size_t length = strlen(arg);
+  return length >= 3 && strncmp(arg, name, length) == 0;
+}
+
+/* Report a failure on stderr and, for structured output, as an error record */
+int
+report_error(ros_writer *json, const char *target_file, int code, const string &message)
+{
+  cerr << message << endl;
+  if (json)
+    json->begin_object()
+         .key("type").string("error")
+         .key("file").string(target_file)
+         .key("code").number(code)
+         .key("message").string(message.c_str())
+         .end_object()
+         .end_record();
+  return code;
+}
+
+static void
+json_timestamp(ros_writer &out, const struct ros_header_timestamp &timestamp, int link_year)
+{
+  out.key("link_time").begin_string()
+     .dec(timestamp.link_hour, 2).put(':').dec(timestamp.link_minute, 2).put(':').dec(timestamp.link_second, 2)
+     .end_string()
+     .key("link_date").begin_string()
+     .dec(link_year, 4).put('-').dec(timestamp.link_month, 2).put('-').dec(timestamp.link_day, 2)
+     .end_string();
+}
+
+static void
+json_checksum(ros_writer &out, const char *name, const struct ros_header_checksum &checksum)
+{
+  out.key(name).begin_object()
+     .key("length").number(checksum.length)
+     .key("checksum").number(checksum.checksum)
+     .end_object();
+}
+
+/* The SHA-256 in hex, as sha256sum(1) writes it */
+static string
+sha256_hex(const struct ros_digests &digests)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  string text;
+  for (unsigned i = 0; i < sizeof(digests.sha256); ++i)
+    text.append(1, hex_digits[digests.sha256[i] >> 4]).append(1, hex_digits[digests.sha256[i] & 0xF]);
+  return text;
+}
+
+static string
+crc32c_hex(const struct ros_digests &digests)
+{
+  char text[9];
+  snprintf(text, sizeof(text), "%08x", digests.crc32c);
+  return text;
+}
+
+static void
+json_digests(ros_writer &out, const char *name, const struct ros_digests &digests)
+{
+  out.key(name);
+  if (digests.valid)
+    out.begin_object()
+       .key("length").number(digests.length)
+       .key("sha256").string(sha256_hex(digests).c_str())
+       .key("crc32c").string(crc32c_hex(digests).c_str())
+       .end_object();
+  else
+    out.null();
+}
+
+static void
+text_digests(const char *filename, const char *what, const struct ros_digests &digests)
+{
+  cout << "Digests of " << filename << " " << what << ": ";
+  if (digests.valid)
+    cout << "sha256 " << sha256_hex(digests) << " crc32c " << crc32c_hex(digests) << "\n";
+  else
+    cout << "not all of it was read\n";
+}
+
+static void
+text_entry(const struct ros_entry &entry)
+{
+  cout << "\n"
+       << "Entry:               " << entry.index << "\n"
+       << "Filename:            " << entry.dirent.filename << "\n"
+       << "Length:              " << showbase << hex << entry.dirent.length << " (" << dec << entry.dirent.length << ")" << "\n"
+       << "Payload Offset:      " << showbase << hex << entry.dirent.offset << " (" << dec << entry.dirent.offset << ")" << "\n"
+       << "Next Offset:         " << showbase << hex << static_cast<uint64_t>(entry.dirent.offset) + entry.dirent.length << dec << "\n";
+
+  if (entry.sub_header) {
+    string arc_sub_index(entry.arc_header.version.arc_index, sizeof ros_arc_header::version.arc_index);
+
+    cout << "  Sub-header found" << "\n"
+         << "  Magic Index:         " << arc_sub_index << "\n"
+         << "  Uncompressed length: " << entry.uncompressed_length << (entry.uncompressed_length_64 ? " (64-bit)" : "") << "\n"
+         << "  Link Time:           " << setw(2) << static_cast<int>(entry.arc_header.timestamp.link_hour) << ":" << setw(2) << static_cast<int>(entry.arc_header.timestamp.link_minute) << ":" << setw(2) << static_cast<int>(entry.arc_header.timestamp.link_second) << "\n"
+         << "  Link Date:           " << setw(4) << entry.link_year << "-" << setw(2) << static_cast<int>(entry.arc_header.timestamp.link_month) << "-" << setw(2) << static_cast<int>(entry.arc_header.timestamp.link_day);
+    if (entry.link_year_swapped)
+      cout << " (Swapping big-endian year value, unlikely to be " << static_cast<int>(entry.arc_header.timestamp.link_year) << ")";
+    cout << "\n";
+  }
+
+  if (entry.data_sig != DATA_SIG_NONE)
+    cout << "Data type:           " << signatures.title(entry.data_sig) << "\n";
+}
+
+/* The file an object carved from an entry is written to */
+static string
+carved_filename(const struct ros_entry &entry, const struct ros_carve_match &found)
+{
+  ostringstream name;
+  name << string(entry.dirent.filename, strnlen(entry.dirent.filename, sizeof entry.dirent.filename))
+       << "-" << hex << setfill('0') << setw(8) << found.offset;
+  return name.str();
+}
+
+static void
+json_entry(ros_writer &out, const char *target_file, const struct ros_entry &entry)
+{
+  uint64_t data_offset = static_cast<uint64_t>(entry.dirent.offset) + (entry.sub_header ? sizeof(struct ros_arc_header) : 0);
+  uint64_t data_length = entry.dirent.length - (entry.sub_header ? sizeof(struct ros_arc_header) : 0);
+
+  out.begin_object()
+     .key("type").string("entry")
+     .key("file").string(target_file)
+     .key("index").number(entry.index)
+     .key("filename").string(entry.dirent.filename, sizeof ros_dirent::filename)
+     .key("offset").number(entry.dirent.offset)
+     .key("length").number(entry.dirent.length)
+     .key("next_offset").number(static_cast<uint64_t>(entry.dirent.offset) + entry.dirent.length)
+     .key("unknown1").number(entry.dirent.unknown1)
+     .key("unknown2").number(entry.dirent.unknown2)
+     .key("data_offset").number(data_offset)
+     .key("data_length").number(data_length)
+     .key("sub_header");
+  if (entry.sub_header) {
+    out.begin_object()
+       .key("arc_magic").string(entry.arc_header.version.arc_magic, sizeof ros_header_version::arc_magic)
+       .key("arc_index").string(entry.arc_header.version.arc_index, sizeof ros_header_version::arc_index)
+       .key("uncompressed_length").number(entry.uncompressed_length)
+       .key("uncompressed_length_64").boolean(entry.uncompressed_length_64)
+       .key("unknown1").number(entry.arc_header.unknown1)
+       .key("unknown2").number(entry.arc_header.unknown2)
+       .key("unknown3").number(entry.arc_header.unknown3);
+    json_timestamp(out, entry.arc_header.timestamp, entry.link_year);
+    out.key("link_year_swapped").boolean(entry.link_year_swapped)
+       .end_object();
+  }
+  else
+    out.null();
+  out.key("data_type");
+  if (entry.data_sig != DATA_SIG_NONE)
+    out.string(signatures.title(entry.data_sig));
+  else
+    out.null();
+  out.key("uncompressed");
+  if (entry.decode) {
+    out.begin_object()
+       .key("length").number(entry.decoded_length)
+       .key("memory").number(entry.decode_memory)
+       .key("over_budget").boolean(entry.over_budget)
+       .key("error").boolean(entry.decode_error)
+       .key("length_mismatch").boolean(entry.length_mismatch)
+       .end_object();
+  }
+  else
+    out.null();
+  out.key("carved");
+  if (carve != CARVE_NONE) {
+    out.begin_array();
+    for (unsigned i = 0; i < entry.carved.size(); ++i) {
+      const struct ros_carve_match &found = entry.carved[i];
+      out.begin_object()
+         .key("offset").number(found.offset)
+         .key("length").number(found.length)
+         .key("data_type").string(signatures.title(found.sig))
+         .key("file");
+      if (carve == CARVE_EXTRACT)
+        out.string(carved_filename(entry, found).c_str());
+      else
+        out.null();
+      out.key("extracted").boolean(found.extracted)
+         .end_object();
+    }
+    out.end_array();
+  }
+  else
+    out.null();
+  out.key("strings");
+  if (strings)
+    out.number(entry.strings);
+  else
+    out.null();
+  out.key("entropy");
+  if (entropy_block && entry.entropy.block_size) {
+    static const char hex_digits[] = "0123456789abcdef";
+    const struct ros_entropy_profile &profile = entry.entropy;
+    out.begin_object()
+       .key("length").number(profile.length)
+       .key("bits").real(profile.entropy)
+       .key("class").string(ros_entropy_class_name(profile.guess))
+       .key("block_size").number(profile.block_size)
+       .key("blocks").begin_object();
+    for (unsigned c = 0; c < ENTROPY_CLASSES; ++c)
+      out.key(ros_entropy_class_name(c)).number(profile.classes[c]);
+    // each block's entropy in 1/32 bits per byte, two hex digits a block
+    out.end_object()
+       .key("profile").begin_string();
+    for (unsigned b = 0; b < profile.blocks.size(); ++b)
+      out.put(hex_digits[profile.blocks[b] >> 4]).put(hex_digits[profile.blocks[b] & 0xF]);
+    out.end_string()
+       .end_object();
+  }
+  else
+    out.null();
+  out.key("digests");
+  if (digests) {
+    out.begin_object();
+    json_digests(out, "stored", entry.raw_digests);
+    json_digests(out, "data", entry.data_digests);
+    out.end_object();
+  }
+  else
+    out.null();
+  out.key("extracted").boolean(entry.extracted)
+     .end_object()
+     .end_record();
+}
+
+/* Time a header read as it completes, for its archive's --stats, which begin
+ * only when the archive is processed; a synchronous read was timed as it was
+ * submitted
+ */
+bool
+header_read(ros_io *io, struct ros_io_request *request)
+{
+  if (!request)
+    return false;
+  struct archive_source *source = static_cast<struct archive_source *>(request->user);
+  if (!io->synchronous())
+    source->header_ns = stats.mark() - source->opened;
+  return true;
+}
+
+/* Open a batch of archives and read all their primary headers with one submission */
+void
+open_sources(ros_io *io, struct archive_source *sources, unsigned count)
+{
+  for (unsigned i = 0; i < count; ++i) {
+    struct archive_source &source = sources[i];
+    struct stat st;
+    source.error = 0;
+    source.length = 0;
+    source.request.result = -EIO;
+    source.request.user = &source;
+    source.opened = stats.mark();
+    source.header_ns = 0;
+    source.fd = open(source.path, O_RDONLY);
+    if (source.fd < 0 || fstat(source.fd, &st) < 0) {
+      source.error = errno;
+      continue;
+    }
+    source.length = st.st_size;
+    while (!io->submit_read(&source.request, source.fd, reinterpret_cast<char *>(&source.header), sizeof(source.header), 0)) {
+      io->submit();
+      header_read(io, io->wait());
+    }
+    if (io->synchronous())
+      source.header_ns = stats.mark() - source.opened;
+  }
+  io->submit();
+  while (header_read(io, io->wait()))
+    ;
+}
+
+int
+process_archive(struct archive_source &source, ros_archive &archive, ros_io *io, ros_pipeline &pipeline, ros_scheduler *scheduler,
+                ros_writer *json)
+{
+  const char *target_file = source.path;
+  unsigned long target_length = source.length;
+  unsigned int payload_checksum = 0;
+
+  if (source.fd < 0)
+    return report_error(json, target_file, 2, string("Error opening ") + target_file + " for reading");
+  if (source.error) {
+    close(source.fd);
+    return report_error(json, target_file, 3, string("Error seeking to end of ") + target_file);
+  }
+
+  stats.begin_archive(target_file, target_length);
+  struct ros_phase_stats header = { source.header_ns, static_cast<uint64_t>(source.request.result > 0 ? source.request.result : 0), 1 };
+  stats.add_phase(PHASE_HEADER, header);
+  enum ros_archive_status status = archive.parse_header(&source.header, source.request.result > 0 ? source.request.result : 0, target_length);
+  const struct ros_archive_header &info = archive.header();
+
+  // extract fixed-width char arrays for output via ostream
+  string arc_magic(info.arc.arc_magic, sizeof(((ros_header_version*)0)->arc_magic));
+  string arc_index(info.arc.arc_index, sizeof(((ros_header_version*)0)->arc_index));
+  if (status == ROS_ARCHIVE_SHORT_HEADER) {
+    close(source.fd);
+    return report_error(json, target_file, status, string("Error reading header version from ") + target_file);
+  }
+  if (status == ROS_ARCHIVE_UNKNOWN_VERSION) {
+    close(source.fd);
+    return report_error(json, target_file, status, "Error: Unknown header version: " + arc_magic + arc_index);
+  }
+  const enum ros_byte_order order = archive.order();
+  const struct ros_header_version &version = info.arc;
+  const struct ros_header_timestamp &timestamp = info.timestamp;
+  const unsigned int ros_header_version = info.version;
+  const unsigned int dir_entries_qty = info.dir_entries_qty;
+  const struct ros_header_checksum &payload_hdr_checksum = archive.payload();
+
+  string arc_signature(info.signature.signature, sizeof(ros_header_signature));
+
+  const struct ros_device *device = ros_device_identify(version.arc_magic, version.arc_index,
+                                                        ros_header_version > 1 ? info.firmware_version : nullptr,
+                                                        sizeof info.firmware_version);
+
+  unsigned int header_checksum_stored = ros_header_version > 1 ? info.header_checksum.checksum : 0;
+  unsigned int header_checksum_calculated = archive.header_checksum();
+
+  // Give a summary from the primary header
+  if (output == OUTPUT_TEXT) {
+    cout << "Filename:          " << target_file << "\n"
+         << "File length:       " << target_length <<  " (" << showbase << hex << target_length << dec << ")" << "\n"
+         << "ARC Magic:         " << arc_magic << "\n"
+         << "ARC Index:         " << arc_index << "\n"
+         << "Header    version: " << ros_header_version << "\n"
+         << "           length: " << (ros_header_version >= 2 ? sizeof(struct ros_header_v2) : sizeof(struct ros_header_v1)) << "\n";
+    if ( ros_header_version > 1) {
+      cout
+         << "         checksum: " << dec << header_checksum_stored << " (" << showbase << hex << header_checksum_stored << ")" << "\n"
+         << "       calculated: " << dec << header_checksum_calculated << " (" << showbase << hex << header_checksum_calculated << ")" << "\n";
+    }
+    cout << "Payload" << (ros_header_version > 1 ? " (outer)" : "") << "\n"
+         << "           length: " << dec << info.payload.length << " (" << showbase << hex << info.payload.length << ")" << "\n"
+         << "         checksum: " << dec << info.payload.checksum << " (" << showbase << hex << info.payload.checksum << ")" << "\n";
+    switch (ros_header_version) {
+      case 2:
+        cout
+         << "Payload (inner)" << "\n"
+         << "           length: " << dec << info.payload_inner.length << " (" << showbase << hex << info.payload_inner.length << dec << ")" << "\n"
+         << "         checksum: " << dec << info.payload_inner.checksum << " (" << showbase << hex << info.payload_inner.checksum << ")" << "\n"
+         << "Firmware version:  " << string(info.firmware_version, strnlen(info.firmware_version, sizeof info.firmware_version)) << "\n";
+        break;
+    }
+    if (device) {
+      cout << "Device:            " << device->manufacturer;
+      if (device->model[0])
+        cout << " " << device->model;
+      if (device->alternate_model[0])
+        cout << " (" << device->alternate_model << ")";
+      cout << "\n";
+    }
+    cout.fill('0');
+    cout << dec
+         << "Link Time:         " << setw(2) << static_cast<int>(timestamp.link_hour) << ":" << setw(2) << static_cast<int>(timestamp.link_minute) << ":" << setw(2) << static_cast<int>(timestamp.link_second) << "\n"
+         << "Link Date:         " << setw(4) << static_cast<int>(timestamp.link_year) << "-" << setw(2) << static_cast<int>(timestamp.link_month) << "-" << setw(2) << static_cast<int>(timestamp.link_day) << "\n"
+         << "Signature:         " << arc_signature << "\n"
+         << "Dir Entries:       " << dec << dir_entries_qty << "\n";
+  }
+
+  // Read all the payload directory entries at once, as stored
+  unsigned long dirents_length = archive.directory_length();
+  ros_stats_mark mark = stats.mark();
+  ssize_t dirents_read = io->read_at(source.fd, archive.directory_buffer(), dirents_length, archive.directory_offset());
+  stats.add(PHASE_HEADER, mark, dirents_read > 0 ? dirents_read : 0);
+
+  /* The archive digests are of the whole file, from the header and directory
+   * already read and the entries as the pipeline reads them, so only when the
+   * entries follow the directory and each other to the end of the file.
+   */
+  ros_hasher archive_hasher;
+  bool whole_file = digests && info.length <= sizeof(source.header) && source.request.result >= static_cast<ssize_t>(info.length) &&
+                    dirents_read == static_cast<ssize_t>(dirents_length);
+  if (whole_file) { // before load_directory() puts the directory in host order
+    archive_hasher.update(reinterpret_cast<const char *>(&source.header), info.length);
+    archive_hasher.update(archive.directory_buffer(), dirents_length);
+  }
+
+  mark = stats.mark();
+  status = archive.load_directory(dirents_read > 0 ? dirents_read : 0);
+  if (status != ROS_ARCHIVE_OK) {
+    close(source.fd);
+    return report_error(json, target_file, status, string("Error reading directory entries from ") + target_file);
+  }
+  payload_checksum = archive.directory_checksum();
+  stats.add(PHASE_CHECKSUM, mark, dirents_length);
+
+  // now read, check and extract the payload contents
+  if (stream)
+    stream->begin_archive(target_file, timestamp);
+  if (strings) {
+    strings->set_file(target_file);
+    if (strings_text)
+      cout.flush(); // the strings are written around it
+  }
+  struct ros_entry *entries = archive.entries();
+  uint64_t end = archive.directory_offset() + dirents_length;
+  for (unsigned i = 0; i < dir_entries_qty && whole_file; ++i) {
+    whole_file = entries[i].dirent.offset == end;
+    end += entries[i].dirent.length;
+  }
+  whole_file = whole_file && end == target_length;
+  pipeline.set_digests(digests, whole_file ? &archive_hasher : nullptr);
+  payload_checksum = pipeline.run(source.fd, order, version.arc_magic, entries, dir_entries_qty,
+                                  payload_checksum, extract,
+                                  !uncompress && carve == CARVE_NONE && !strings && !entropy_block && !digests ? DECODE_NONE : scheduler ? DECODE_DEFER : DECODE_STREAM);
+  if (strings_text)
+    strings_text->flush();
+  if (scheduler) {
+    // the pipeline probed the LZMA entries; uncompress them in parallel within the memory budget
+    for (unsigned i = 0; i < dir_entries_qty; ++i) {
+      if (!entries[i].deferred)
+        continue;
+      unsigned skip = entries[i].sub_header ? sizeof(struct ros_arc_header) : 0;
+      struct ros_decode_job job = { &entries[i], static_cast<uint64_t>(entries[i].dirent.offset) + skip, entries[i].read_length - skip, entries[i].decode_memory };
+      scheduler->add(job);
+    }
+    scheduler->run(source.fd, extract);
+  }
+
+  uint64_t total_extracted = dir_entries_qty * sizeof(struct ros_dirent);
+  for (unsigned i = 0; i < dir_entries_qty; ++i) {
+    const struct ros_entry &entry = entries[i];
+    char filename[sizeof(entry.dirent.filename) + 1];
+    memcpy(filename, entry.dirent.filename, sizeof(entry.dirent.filename));
+    filename[sizeof(entry.dirent.filename)] = '\0';
+
+    stats.begin_entry(i, filename, entry.dirent.length);
+    if (entry.sub_header)
+      stats.set_uncompressed_length(entry.uncompressed_length);
+    for (unsigned p = 0; p < PHASE_MAX; ++p)
+      stats.add_entry_time(entry.ns[p]);
+    total_extracted += entry.read_length;
+
+    if (output == OUTPUT_TEXT) {
+      if (verbose)
+        text_entry(entry);
+      const bool skipped = extract && uncompress && entry.over_budget;  // nothing was written
+      if (extract && entry.write_error)
+        cerr << "Error writing " << filename << endl;
+      else if (skipped)
+        cerr << "Skipped " << filename << ": the decoder needs " << entry.decode_memory
+             << " bytes, over the memory budget of " << memory_budget << " bytes" << endl;
+      else if (extract) {
+        unsigned skip = entry.sub_header ? sizeof(struct ros_arc_header) : 0;
+        cout << "Extracted " << filename << " from offset " << static_cast<uint64_t>(entry.dirent.offset) + skip;
+        cout << " (" << dec << entry.dirent.length - skip << " bytes)" << "\n";
+      }
+      if (entry.over_budget) {
+        if (!skipped)
+          cerr << "Error uncompressing " << filename << ": the decoder needs " << entry.decode_memory
+               << " bytes, over the memory budget of " << memory_budget << " bytes" << endl;
+      }
+      else if (entry.decode && entry.decode_error)
+        cerr << "Error uncompressing " << filename << endl;
+      else if (entry.decode && uncompress)
+        cout << "Uncompressed " << filename << " (" << dec << entry.decoded_length << " bytes)" << "\n";
+      if (entry.length_mismatch)
+        cerr << "Warning: " << filename << " uncompressed to " << dec << entry.decoded_length
+             << " bytes but its sub-header gives " << entry.uncompressed_length << endl;
+      for (unsigned c = 0; c < entry.carved.size(); ++c) {
+        const struct ros_carve_match &found = entry.carved[c];
+        if (found.write_error) {
+          cerr << "Error writing " << carved_filename(entry, found) << endl;
+          continue;
+        }
+        cout << "Carved " << signatures.title(found.sig) << " from " << filename << " at offset " << dec << found.offset
+             << " (" << found.length << " bytes)";
+        if (found.extracted)
+          cout << " to " << carved_filename(entry, found);
+        cout << "\n";
+      }
+      if (digests) {
+        text_digests(filename, "as stored", entry.raw_digests);
+        text_digests(filename, entry.decode ? "uncompressed" : "data", entry.data_digests);
+      }
+      if (entropy_block && entry.entropy.block_size) {
+        const struct ros_entropy_profile &profile = entry.entropy;
+        char bits[16];
+        snprintf(bits, sizeof(bits), "%.3f", profile.entropy);
+        cout << "Entropy of " << filename << ": " << bits << " bits per byte";
+        if (profile.guess >= 0)
+          cout << ", mostly " << ros_entropy_class_name(profile.guess);
+        cout << " (blocks of " << dec << profile.block_size << ":";
+        for (unsigned c = 0; c < ENTROPY_CLASSES; ++c)
+          cout << (c ? ", " : " ") << profile.classes[c] << " " << ros_entropy_class_name(c);
+        cout << ")\n  |";
+        for (unsigned b = 0; b < profile.blocks.size(); ++b)
+          cout << ros_entropy_glyph(profile.blocks[b]);
+        cout << "|\n";
+      }
+    }
+    else
+      json_entry(*json, target_file, entry);
+  }
+  stats.end_entry();
+
+  struct ros_digests archive_digests = ros_digests();
+  if (whole_file) {
+    archive_hasher.end(archive_digests);
+    archive_digests.valid = archive_digests.length == target_length;
+  }
+
+  close(source.fd);
+  stats.end_archive();
+
+  if (output == OUTPUT_TEXT) {
+    cout << "\n"
+         << "Payload      length: " << dec << payload_hdr_checksum.length << " (" << showbase << hex << payload_hdr_checksum.length << ")" << "\n"
+         << "Payload   extracted: " << dec << total_extracted << " (" << showbase << hex << total_extracted << ")" << "\n"
+         << "Payload    checksum: " << dec << payload_hdr_checksum.checksum << " (" << showbase << hex << payload_hdr_checksum.checksum << ")" << "\n"
+         << "Calculated checksum: " << dec << payload_checksum << " (" << showbase << hex << payload_checksum << ")" << "\n";
+    if (archive_digests.valid)
+      cout << "Archive      sha256: " << sha256_hex(archive_digests) << "\n"
+           << "Archive      crc32c: " << crc32c_hex(archive_digests) << "\n";
+    else if (digests)
+      cout << "Archive     digests: not available, the file is not wholly its header, directory and entries" << "\n";
+    cout << "\n";
+  }
+  else {
+    // the archive record follows its entries and carries the verification results
+    json->begin_object()
+         .key("type").string("archive")
+         .key("file").string(target_file)
+         .key("file_length").number(target_length)
+         .key("arc_magic").string(version.arc_magic, sizeof ros_header_version::arc_magic)
+         .key("arc_index").string(version.arc_index, sizeof ros_header_version::arc_index)
+         .key("header_version").number(ros_header_version)
+         .key("header_length").number(ros_header_version >= 2 ? sizeof(struct ros_header_v2) : sizeof(struct ros_header_v1))
+         .key("byte_order").string(order == ROS_BIG_ENDIAN ? "big" : "little");
+    if (ros_header_version > 1) {
+      json->key("header_checksum").begin_object()
+           .key("stored").number(header_checksum_stored)
+           .key("calculated").number(header_checksum_calculated)
+           .key("valid").boolean(header_checksum_stored == header_checksum_calculated)
+           .end_object();
+      json_checksum(*json, "payload_outer", info.payload);
+      json_checksum(*json, "payload_inner", info.payload_inner);
+      json->key("firmware_version").string(info.firmware_version, sizeof info.firmware_version);
+    }
+    else
+      json_checksum(*json, "payload", info.payload);
+    if (device) {
+      json->key("manufacturer").string(device->manufacturer);
+      if (device->model[0])
+        json->key("model").string(device->model);
+      if (device->alternate_model[0])
+        json->key("alternate_model").string(device->alternate_model);
+    }
+    json_timestamp(*json, timestamp, timestamp.link_year);
+    json->key("signature").string(arc_signature.c_str())
+         .key("dir_entries").number(dir_entries_qty)
+         .key("payload_length").number(payload_hdr_checksum.length)
+         .key("payload_extracted").number(total_extracted)
+         .key("payload_checksum").number(payload_hdr_checksum.checksum)
+         .key("calculated_checksum").number(payload_checksum)
+         .key("valid").boolean(payload_checksum == payload_hdr_checksum.checksum && total_extracted == payload_hdr_checksum.length);
+    if (digests)
+      json_digests(*json, "digests", archive_digests);
+    json->end_object()
+         .end_record();
+  }
+
+  if (json)
+    stats.report(*json);
+  else if (stats.is_json()) {
+    ros_writer stats_out(STDOUT_FILENO, 16 * 1024);
+    cout.flush();
+    stats.report(stats_out);
+  }
+  else
+    stats.report(cout);
+
+  return 0;
+}
 
 int
 main(int argc, char **argv, char **env)
 {
-  char *target_file = nullptr;
-  unsigned long target_length;
-  fstream target;
-  fstream payload;
+  int result = 0;
+  vector<const char *> targets;
 
-  cout << "ROS PACK firmware archive payload extractor" << endl
-       << "Version " << version.major << "." << version.minor << endl
-       << "(c) Copyright 2015 TJ <hacker@iam.tj>" << endl
-       << "Licensed on the terms of the GNU General Public License version 2" << endl << endl;
+  for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
+    if (strncmp(argv[i], switch_output, strlen(switch_output)) == 0) {
+      const char *format = argv[i] + strlen(switch_output);
+      if (strcmp(format, "json") == 0)
+        output = OUTPUT_JSON;
+      else if (strcmp(format, "text") == 0)
+        output = OUTPUT_TEXT;
+      else {
+        cerr << "Error: unknown output format: " << format << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_extract_to, strlen(switch_extract_to)) == 0) {
+      // opened before anything is written, as it may take the place of stdout
+      const char *target = argv[i] + strlen(switch_extract_to);
+      enum ros_stream_format format;
+      if (strncmp(target, "tar:", 4) == 0)
+        format = ROS_STREAM_TAR;
+      else if (strncmp(target, "cpio:", 5) == 0)
+        format = ROS_STREAM_CPIO;
+      else {
+        cerr << "Error: unknown extract format: " << target << endl;
+        return 1;
+      }
+      target = strchr(target, ':') + 1;
+      int fd;
+      if (strcmp(target, "-") == 0) {
+        // the reports move to stderr
+        fd = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+      }
+      else
+        fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (fd < 0) {
+        cerr << "Error: cannot create " << target << ": " << strerror(errno) << endl;
+        return 1;
+      }
+      delete stream;
+      stream = new ros_stream(fd, format);
+      extract = true;
+    }
+  }
+
+  if (output == OUTPUT_TEXT)
+    cout << "ROS PACK firmware archive payload extractor" << endl
+         << "Version " << version.major << "." << version.minor << endl
+         << "(c) Copyright 2015 TJ <hacker@iam.tj>" << endl
+         << "Licensed on the terms of the GNU General Public License version 2" << endl << endl;
 
   if (argc < 2) {
     usage(argv[0]);
@@ -100,229 +815,190 @@ main(int argc, char **argv, char **env)
   }
 
   for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
-    if (strncmp(argv[i], switch_help, 3) == 0) {
+    if (abbreviates(argv[i], switch_help)) {
       usage(argv[0]);
       return 0;
     }
-    else if (strncmp(argv[i], switch_verbose, 3) == 0) {
+    else if (abbreviates(argv[i], switch_verbose)) {
       verbose = true;
     }
-    else if (strncmp(argv[i], switch_extract, 3) == 0) {
+    else if (strncmp(argv[i], switch_entropy, strlen(switch_entropy)) == 0) {
+      const char *size = argv[i] + strlen(switch_entropy);
+      entropy_block = 64 * 1024;
+      if (*size) {
+        // checked in 64 bits before it is narrowed, whole blocks filling the profiler's work blocks
+        uint64_t block = *size == '=' ? ros_parse_size(size + 1) : 0;
+        if (block < ros_entropy::min_block_size || block > ros_entropy::work_size || (block & (block - 1))) {
+          cerr << "Error: the entropy block size must be a power of two from " << ros_entropy::min_block_size
+               << " to " << ros_entropy::work_size << ": " << argv[i] << endl;
+          return 1;
+        }
+        entropy_block = block;
+      }
+    }
+    else if (strncmp(argv[i], switch_extract_to, strlen(switch_extract_to)) == 0) {
+      // handled above, before the banner
+    }
+    else if (strncmp(argv[i], switch_digests, strlen(switch_digests)) == 0) {
+      digests = true;
+    }
+    else if (abbreviates(argv[i], switch_extract)) {
       extract = true;
     }
-    else if(strncmp(argv[i], switch_uncompress, 3) == 0) {
+    else if (abbreviates(argv[i], switch_uncompress)) {
       uncompress = true;
       if (!extract) // uncompress infers extract
         extract = true;
     }
-    else {
-      target_file = argv[i];
-      target.open(target_file, ios_base::in);
-      if (!target.good()) {
-        cerr << "Error opening " << target_file << " for reading" << endl;
-        return 2;
+    else if (strncmp(argv[i], switch_signatures, strlen(switch_signatures)) == 0) {
+      string error;
+      if (!signatures.load(argv[i] + strlen(switch_signatures), error)) {
+        cerr << "Error: signatures: " << error << endl;
+        return 1;
       }
+    }
+    else if (strncmp(argv[i], switch_carve, strlen(switch_carve)) == 0) {
+      if (strcmp(argv[i], switch_carve) == 0)
+        carve = CARVE_REPORT;
+      else if (strcmp(argv[i], switch_carve_extract) == 0)
+        carve = CARVE_EXTRACT;
       else {
-        target.seekg(0, target.end);
-        if (!target.good()) {
-          cerr << "Error seeking to end of " << target_file << endl;
-          target.close();
-          return 3;
+        cerr << "Error: unknown carve mode: " << argv[i] << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_strings, strlen(switch_strings)) == 0) {
+      const bool utf16 = strncmp(argv[i], switch_strings_utf16, strlen(switch_strings_utf16)) == 0;
+      const char *length = argv[i] + strlen(utf16 ? switch_strings_utf16 : switch_strings);
+      strings_utf16 = strings_utf16 || utf16;
+      strings_min = 4;
+      if (*length) {
+        char *end;
+        strings_min = *length == '=' ? strtoul(length + 1, &end, 10) : 0;
+        if (!strings_min || *length != '=' || *end) {
+          cerr << "Error: invalid minimum string length: " << argv[i] << endl;
+          return 1;
         }
-        target_length = target.tellg();
       }
     }
-  }
-
-  struct ros_header_version version;
-  if (target_file && target.good()) {
-    target.seekg(0, target.beg);
-    target.read(reinterpret_cast<char *>(&version), sizeof(struct ros_header_version));
-    if (!target.good()) {
-      cerr << "Error reading header version from " << target_file << endl;
-      target.close();
-      return 4;
+    else if (strcmp(argv[i], switch_stats) == 0 || strcmp(argv[i], switch_stats_json) == 0) {
+      stats.enable(strcmp(argv[i], switch_stats_json) == 0);
     }
-
-    // extract fixed-width char arrays for output via ostream
-    string arc_magic(version.arc_magic, sizeof(((ros_header_version*)0)->arc_magic));
-    string arc_index(version.arc_index, sizeof(((ros_header_version*)0)->arc_index));
-    unsigned int ros_header_version = 0;
-
-    union header_v1_v2 {
-       ros_header_v1 v1;
-       ros_header_v2 v2;
-    } header;
-
-    target.seekg(0, target.beg);
-    target.read(reinterpret_cast<char *>(&header), sizeof(union header_v1_v2));
-
-    struct ros_header_timestamp timestamp;
-    struct ros_header_directory directory;
-    struct ros_header_checksum payload_hdr_checksum;
-
-    switch (arc_index.substr(0,1)[0]) {
-        case '1':
-            ros_header_version = 1;
-            version = header.v1.version;
-            timestamp = header.v1.timestamp;
-            directory = header.v1.directory;
-            payload_hdr_checksum = header.v1.payload_checksum_v1;
-            target.seekg(sizeof(struct ros_header_v1), target.beg);
-          break;
-        case '2':
-            ros_header_version = 2;
-            version = header.v2.version;
-            timestamp = header.v2.timestamp;
-            directory = header.v2.directory;
-            payload_hdr_checksum = header.v2.payload_checksum_v2;
-            target.seekg(sizeof(struct ros_header_v2), target.beg);
-          break;
-        default:
-          cerr << "Error: Unknown header version: " << arc_magic << arc_index << endl;
-          target.close();
-          return 5;
+    else if (strncmp(argv[i], switch_output, strlen(switch_output)) == 0) {
+      // handled above, before the banner
     }
-
-    string arc_signature(header.v1.signature.signature, sizeof(ros_header_signature));
-
-    // Give a summary from the primary header
-    cout << "Filename:          " << target_file << endl
-         << "File length:       " << target_length <<  " (" << showbase << hex << target_length << dec << ")" << endl
-         << "ARC Magic:         " << arc_magic << endl
-         << "ARC Index:         " << arc_index << endl
-         << "Header    version: " << ros_header_version << endl
-         << "           length: " << (ros_header_version >= 2 ? sizeof(struct ros_header_v2) : sizeof(struct ros_header_v1)) << endl;
-    if ( ros_header_version > 1) {
-      cout
-         << "         checksum: " << dec << header.v2.header_checksum.checksum << " (" << showbase << hex << header.v2.header_checksum.checksum << ")" << endl;
-        header.v2.header_checksum.checksum = 0;
-        unsigned int checksum_header = 0xFFFFFFFF - checksum_calc(0, reinterpret_cast<const char *>(&header), sizeof(struct ros_header_v2));
-        cout
-         << "       calculated: " << dec << checksum_header << " (" << showbase << hex << checksum_header << ")" << endl;
+    else if (strncmp(argv[i], switch_jobs, strlen(switch_jobs)) == 0) {
+      char *end;
+      jobs = strtoul(argv[i] + strlen(switch_jobs), &end, 10);
+      if (*end || jobs < 1) {
+        cerr << "Error: invalid number of jobs: " << argv[i] + strlen(switch_jobs) << endl;
+        return 1;
+      }
     }
-    cout << "Payload" << (ros_header_version > 1 ? " (outer)" : "") << endl
-         << "           length: " << dec << header.v1.payload_checksum_v1.length << " (" << showbase << hex << header.v1.payload_checksum_v1.length << ")" << endl
-         << "         checksum: " << dec << header.v1.payload_checksum_v1.checksum << " (" << showbase << hex << header.v1.payload_checksum_v1.checksum << ")" << endl;
-    switch (ros_header_version) {
-      case 2:
-        cout
-         << "Payload (inner)" << endl
-         << "           length: " << dec << header.v2.payload_checksum_v2.length << " (" << showbase << hex << header.v2.payload_checksum_v2.length << dec << ")" << endl
-         << "         checksum: " << dec << header.v2.payload_checksum_v2.checksum << " (" << showbase << hex << header.v2.payload_checksum_v2.checksum << ")" << endl
-         << "Firmware version:  " << header.v2.firmware_version << endl;
-        break;
+    else if (strncmp(argv[i], switch_memory, strlen(switch_memory)) == 0) {
+      memory_budget = ros_parse_size(argv[i] + strlen(switch_memory));
+      if (!memory_budget) {
+        cerr << "Error: invalid memory budget: " << argv[i] + strlen(switch_memory) << endl;
+        return 1;
+      }
     }
-    cout.fill('0');
-    cout << dec
-         << "Link Time:         " << setw(2) << static_cast<int>(timestamp.link_hour) << ":" << setw(2) << static_cast<int>(timestamp.link_minute) << ":" << setw(2) << static_cast<int>(timestamp.link_second) << endl
-         << "Link Date:         " << setw(4) << static_cast<int>(timestamp.link_year) << "-" << setw(2) << static_cast<int>(timestamp.link_month) << "-" << setw(2) << static_cast<int>(timestamp.link_day) << endl
-    // cout.fill(cout_prev_fill);
-         << "Signature:         " << arc_signature << endl
-         << "Dir Entries:       " << dec << directory.dir_entries_qty << endl;
-
-    // Iterate over the payload directory entries
-    struct ros_dirent *dirents = new struct ros_dirent[directory.dir_entries_qty];
-    for (unsigned i = 0; i < directory.dir_entries_qty; ++i) {
-      target.read(reinterpret_cast<char *>(&dirents[i]), sizeof(struct ros_dirent));
-      payload_checksum = checksum_calc(payload_checksum, reinterpret_cast<const char *>(&dirents[i]), sizeof(struct ros_dirent));
+    else if (strncmp(argv[i], switch_io, strlen(switch_io)) == 0) {
+      const char *backend = argv[i] + strlen(switch_io);
+      if (strcmp(backend, "auto") == 0)
+        io_backend = ROS_IO_AUTO;
+      else if (strcmp(backend, "uring") == 0)
+        io_backend = ROS_IO_URING;
+      else if (strcmp(backend, "pread") == 0)
+        io_backend = ROS_IO_PREAD;
+      else {
+        cerr << "Error: unknown I/O back-end: " << backend << endl;
+        return 1;
+      }
     }
-
-    // now read and interpret the payload contents
-    char *buffer = new char[buffer_size];
-    if (!buffer) {
-      cout << "Error allocating memory for read buffer" << endl;
-      delete[] dirents;
-      target.close();
-      return 5;
+    else if (strncmp(argv[i], "--", 2) == 0) {
+      cerr << "Error: unknown option: " << argv[i] << endl;
+      return 1;
     }
-    unsigned int total_extracted = (directory.dir_entries_qty * sizeof(struct ros_dirent));
-    for (unsigned i = 0; i < directory.dir_entries_qty; ++i) {
-      target.seekg(dirents[i].offset, target.beg);
-      if (extract) {
-        payload.open(dirents[i].filename, ios_base::out);
-      }
-      // read buffer-sized chunks of payload data
-      unsigned int remaining = dirents[i].length;
-      while (remaining > 0 && target.good() && payload.good()) {
-        unsigned int chunk_length = remaining > buffer_size ? buffer_size : remaining;
-
-        unsigned real_offset = 0; // adjustments for writing payload
-        int real_chunk_offset = 0;
-
-        target.read(buffer, chunk_length);
-        payload_checksum = checksum_calc(payload_checksum, reinterpret_cast<const char *>(buffer), chunk_length);
-        if (remaining == dirents[i].length) { // first chunk - may need to disregard a header
-          struct ros_arc_header *arc_header = reinterpret_cast<ros_arc_header *>(buffer);
-
-          if (verbose) cout << endl
-               << "Entry:               " << i << endl
-               << "Filename:            " << dirents[i].filename << endl
-               << "Length:              " << showbase << hex << dirents[i].length << " (" << dec << dirents[i].length << ")" << endl
-               << "Payload Offset:      " << showbase << hex << dirents[i].offset << " (" << dec << dirents[i].offset << ")" << endl
-               << "Next Offset:         " << showbase << hex << dirents[i].offset + dirents[i].length << dec << endl;
-
-          // examine the ARC sub-header
-          if (strncmp(arc_header->version.arc_magic, version.arc_magic, sizeof ros_header_version::arc_magic) == 0) {
-            // found an ARC sub-header - adjust the offset and length of data to be written
-            real_offset = sizeof(struct ros_arc_header);
-            real_chunk_offset = -sizeof(struct ros_arc_header);
-            dirents[i].offset += real_offset;
-            dirents[i].length -= real_offset;
-
-            string arc_sub_index(arc_header->version.arc_index, sizeof ros_arc_header::version.arc_index);
-
-            if (verbose)
-              cout << "  Sub-header found" << endl
-                   << "  Magic Index:         " << arc_sub_index << endl
-                   << "  Uncompressed length: " << arc_header->uncompressed_length << endl
-                   << "  Link Time:           " << setw(2) << static_cast<int>(arc_header->timestamp.link_hour) << ":" << setw(2) << static_cast<int>(arc_header->timestamp.link_minute) << ":" << setw(2) << static_cast<int>(arc_header->timestamp.link_second) << endl;
-              int link_year = static_cast<int>(arc_header->timestamp.link_year);
-              stringstream ss;
-              if (link_year > 2100) { // probably need to swap byte order
-                ss << " (Swapping big-endian year value, unlikely to be " << link_year << ")";
-                link_year = ((link_year & 0xFF) << 8) | ((link_year & 0xFF00) >> 8);
-              }
-
-              if (verbose)
-                cout << "  Link Date:           " << setw(4) << link_year << "-" << setw(2) << static_cast<int>(arc_header->timestamp.link_month) << "-" << setw(2) << static_cast<int>(arc_header->timestamp.link_day) << (verbose && ss.str().length() ? ss.str() : "") << endl;
-
-          }
-
-          // try to identify the payload data type
-          for (unsigned j = 0; j < sizeof(data_sigs); ++j) {
-            if (strncmp(buffer + real_offset, data_sigs[j].magic, sizeof(data_sigs[j].magic)) == 0) {
-              if (verbose)
-                cout << "Data type:           " << data_sigs[j].title << endl;
-              break;
-            }
-          }
+    else {
+      targets.push_back(argv[i]);
+    }
+  }
 
-        }
-        if (extract)
-          payload.write(buffer + real_offset, chunk_length + real_chunk_offset);
+  ros_io *io = ros_io::create(io_backend, header_batch);
+  if (!io) {
+    cerr << "Error: the io_uring I/O back-end is not available" << endl;
+    return 1;
+  }
 
-        remaining -= chunk_length;
-        total_extracted += chunk_length;
-      }
-      if (extract) {
-        payload.close();
-        cout << "Extracted " << dirents[i].filename << " from offset " << dirents[i].offset;
-        cout << " (" << dec << dirents[i].length << " bytes)" << endl;
-      }
+  ros_writer *json = output == OUTPUT_JSON ? new ros_writer(STDOUT_FILENO) : nullptr;
+  struct archive_source *sources = new struct archive_source[header_batch];
+  if (!memory_budget)
+    memory_budget = ros_lzma_default_budget();
+  ros_archive archive;    // its tables are reused from archive to archive
+  ros_pipeline pipeline(io, stats, signatures);
+  pipeline.set_memory_limit(memory_budget);
+  // carving, listing strings, profiling entropy and hashing work on the decoded stream, so they keep the LZMA entries in
+  // the pipeline, as does a tar or cpio stream, whose members are written in order
+  ros_scheduler *scheduler = uncompress && jobs > 1 && carve == CARVE_NONE && !strings_min && !entropy_block && !digests && !stream ? new ros_scheduler(io, stats, jobs, memory_budget) : nullptr;
+  if (uncompress && jobs > 1 && !scheduler && !stream)
+    cerr << "Warning: --carve, --strings, --entropy and --digests uncompress the LZMA entries one at a time;"
+         << " --jobs=" << jobs << " sets only the threads that search them" << endl;
+  pipeline.set_uncompress(uncompress);
+  pipeline.set_stream(stream);
+  ros_carver *carver = nullptr;
+  if (carve != CARVE_NONE) {
+    carver = new ros_carver(io, signatures, jobs > 1 ? jobs : thread::hardware_concurrency(), carve == CARVE_EXTRACT);
+    pipeline.set_carver(carver);
+  }
+  if (strings_min) {
+    if (!json)
+      strings_text = new ros_writer(STDOUT_FILENO);
+    strings = new ros_strings(json ? *json : *strings_text, json != nullptr, strings_min, strings_utf16,
+                              jobs > 1 ? jobs : thread::hardware_concurrency());
+    pipeline.set_strings(strings);
+  }
+  ros_entropy *entropy = nullptr;
+  if (entropy_block) {
+    entropy = new ros_entropy(entropy_block, jobs > 1 ? jobs : thread::hardware_concurrency());
+    pipeline.set_entropy(entropy);
+  }
 
+  for (unsigned first = 0; first < targets.size(); first += header_batch) {
+    unsigned count = targets.size() - first < header_batch ? targets.size() - first : header_batch;
+    for (unsigned i = 0; i < count; ++i)
+      sources[i].path = targets[first + i];
+    open_sources(io, sources, count);
+
+    for (unsigned i = 0; i < count; ++i) {
+      int ret = process_archive(sources[i], archive, io, pipeline, scheduler, json);
+      if (ret)
+        result = ret;
+      // one flush per archive
+      if (json)
+        json->flush();
+      else
+        cout.flush();
     }
-    delete[] buffer;
-    cout << endl
-         << "Payload      length: " << dec << payload_hdr_checksum.length << " (" << showbase << hex << payload_hdr_checksum.length << ")" << endl
-         << "Payload   extracted: " << dec << total_extracted << " (" << showbase << hex << total_extracted << ")" << endl
-         << "Payload    checksum: " << dec << payload_hdr_checksum.checksum << " (" << showbase << hex << payload_hdr_checksum.checksum << ")" << endl
-         << "Calculated checksum: " << dec << payload_checksum << " (" << showbase << hex << payload_checksum << ")" << endl
-         << endl;
-    target.close();
+  }
 
+  if (stream && !stream->finish()) {
+    cerr << "Error writing the extracted archive stream" << endl;
+    result = 1;
+  }
+  else if (stream && stream->failures()) {
+    // each is also reported as an error writing its entry
+    cerr << "Error: " << stream->failures() << " members of the extracted archive stream do not hold their entry's data in full" << endl;
+    result = 1;
   }
 
-  return 0;
+  delete[] sources;
+  delete stream;
+  delete carver;
+  delete strings;
+  delete strings_text;
+  delete entropy;
+  delete scheduler;
+  delete json;
+  delete io;
+  return result;
 }
-
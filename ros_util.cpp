@@ -0,0 +1,69 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Helpers shared by the command-line tools.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <vector>
+#include "ros_util.hpp"
+
+using namespace std;
+
+uint64_t
+ros_parse_size(const char *text)
+{
+  if (!isdigit(static_cast<unsigned char>(*text)))  // strtoull() would take a sign or spaces
+    return 0;
+  char *end;
+  errno = 0;
+  uint64_t size = strtoull(text, &end, 10);
+  if (errno == ERANGE)
+    return 0;
+  unsigned shift = 0;
+  switch (*end) {
+    case 'G': case 'g': shift = 30; break;
+    case 'M': case 'm': shift = 20; break;
+    case 'K': case 'k': shift = 10; break;
+  }
+  if (shift)
+    ++end;
+  if (*end || size > UINT64_MAX >> shift)
+    return 0;
+  return size << shift;
+}
+
+int
+ros_append_output(void *user, const void *data, size_t length)
+{
+  vector<char> *output = static_cast<vector<char> *>(user);
+  const char *bytes = static_cast<const char *>(data);
+  output->insert(output->end(), bytes, bytes + length);
+  return 0;
+}
+
+double
+ros_elapsed_ms(chrono::steady_clock::time_point start)
+{
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
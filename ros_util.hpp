@@ -0,0 +1,45 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Helpers shared by the command-line tools.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_UTIL_HPP__
+#define __ROS_UTIL_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+
+/* A byte count with an optional K, M or G suffix; 0 if it is not valid or
+ * does not fit in 64 bits
+ */
+uint64_t ros_parse_size(const char *text);
+
+/* A rospack_output_fn that appends the data to the std::vector<char> user
+ * points at
+ */
+int ros_append_output(void *user, const void *data, size_t length);
+
+/* Milliseconds since start */
+double ros_elapsed_ms(std::chrono::steady_clock::time_point start);
+
+#endif
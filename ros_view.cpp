@@ -0,0 +1,134 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Byte-order detection and host-order parsing of archive headers.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "ros_view.hpp"
+
+/* How well the header fields read in ORDER fit the file */
+template<enum ros_byte_order ORDER>
+static unsigned
+order_score(const void *header, size_t length, uint64_t file_length)
+{
+  ros_header_v1_view<ORDER> v1(header);
+  ros_header_v2_view<ORDER> v2(header);
+  unsigned score = 0;
+
+  switch (v1.arc_index()[0]) {
+    case '1':
+      if (length < ros_header_v1_view<ORDER>::size)
+        break;
+      if (ros_header_v1_view<ORDER>::size + uint64_t(v1.payload_length()) == file_length)
+        score += 2;
+      if (ros_header_v1_view<ORDER>::size + uint64_t(v1.dir_entries_qty()) * sizeof(struct ros_dirent) <= file_length)
+        ++score;
+      break;
+    case '2':
+      if (length < ros_header_v2_view<ORDER>::size)
+        break;
+      if (v2.header_length() == ros_header_v2_view<ORDER>::size)
+        score += 2;
+      if (ros_header_v2_view<ORDER>::size + uint64_t(v2.payload_outer_length()) == file_length)
+        score += 2;
+      if (ros_header_v2_view<ORDER>::size + uint64_t(v2.dir_entries_qty()) * sizeof(struct ros_dirent) <= file_length)
+        ++score;
+      break;
+  }
+  return score;
+}
+
+enum ros_byte_order
+ros_detect_order(const void *header, size_t length, uint64_t file_length)
+{
+  if (order_score<ROS_BIG_ENDIAN>(header, length, file_length) > order_score<ROS_LITTLE_ENDIAN>(header, length, file_length))
+    return ROS_BIG_ENDIAN;
+  return ROS_LITTLE_ENDIAN;
+}
+
+template<enum ros_byte_order ORDER>
+static bool
+parse_header(const void *header, struct ros_archive_header &out)
+{
+  ros_header_v1_view<ORDER> v1(header);
+  ros_header_v2_view<ORDER> v2(header);
+
+  memset(&out, 0, sizeof(out));
+  out.order = ORDER;
+  memcpy(out.arc.arc_magic, v1.arc_magic(), sizeof(out.arc.arc_magic));
+  memcpy(out.arc.arc_index, v1.arc_index(), sizeof(out.arc.arc_index));
+
+  switch (out.arc.arc_index[0]) {
+    case '1':
+      out.version = 1;
+      out.length = ros_header_v1_view<ORDER>::size;
+      memcpy(out.signature.signature, v1.signature(), sizeof(out.signature.signature));
+      out.timestamp = v1.timestamp().host();
+      out.dir_entries_qty = v1.dir_entries_qty();
+      out.payload.length = v1.payload_length();
+      out.payload.checksum = v1.payload_checksum();
+      return true;
+    case '2':
+      out.version = 2;
+      out.length = ros_header_v2_view<ORDER>::size;
+      memcpy(out.signature.signature, v2.signature(), sizeof(out.signature.signature));
+      out.timestamp = v2.timestamp().host();
+      out.dir_entries_qty = v2.dir_entries_qty();
+      out.payload.length = v2.payload_outer_length();
+      out.payload.checksum = v2.payload_outer_checksum();
+      out.header_checksum.length = v2.header_length();
+      out.header_checksum.checksum = v2.header_checksum();
+      out.payload_inner.length = v2.payload_inner_length();
+      out.payload_inner.checksum = v2.payload_inner_checksum();
+      memcpy(out.firmware_version, v2.firmware_version(), sizeof(out.firmware_version));
+      return true;
+  }
+  return false;
+}
+
+bool
+ros_parse_header(const void *header, enum ros_byte_order order, struct ros_archive_header &out)
+{
+  return order == ROS_BIG_ENDIAN ? parse_header<ROS_BIG_ENDIAN>(header, out) : parse_header<ROS_LITTLE_ENDIAN>(header, out);
+}
+
+template<enum ros_byte_order ORDER>
+static void
+load_dirents(const void *stored, unsigned count, struct ros_dirent *out)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(stored);
+  for (unsigned i = 0; i < count; ++i, p += ros_dirent_view<ORDER>::size)
+    out[i] = ros_dirent_view<ORDER>(p).host();
+}
+
+void
+ros_load_dirents(const void *stored, unsigned count, enum ros_byte_order order, struct ros_dirent *out)
+{
+  if (order == ros_host_order) { // already in host order
+    if (stored != out)
+      memmove(out, stored, count * sizeof(struct ros_dirent));
+    return;
+  }
+  if (order == ROS_BIG_ENDIAN)
+    load_dirents<ROS_BIG_ENDIAN>(stored, count, out);
+  else
+    load_dirents<ROS_LITTLE_ENDIAN>(stored, count, out);
+}
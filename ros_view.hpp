@@ -0,0 +1,292 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Byte-order aware typed views over the stored archive structures.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROS_VIEW_HPP__
+#define __ROS_VIEW_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "ros_pack.hpp"
+
+/* The structures in ros_pack.hpp describe the stored layout, but their
+ * multi-byte fields are only correct on a host of the same byte order as
+ * the archive. The views here read the fields straight out of the stored
+ * bytes instead: each field has a compile-time descriptor (type and offset,
+ * checked against the structure), and each view is specialised for one byte
+ * order, so an archive's byte order is decided once and every access after
+ * that is an unaligned load plus, when the orders differ, a byte swap,
+ * without branches or copies.
+ */
+
+enum ros_byte_order {
+  ROS_LITTLE_ENDIAN = 0,
+  ROS_BIG_ENDIAN = 1
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+const enum ros_byte_order ros_host_order = ROS_BIG_ENDIAN;
+#else
+const enum ros_byte_order ros_host_order = ROS_LITTLE_ENDIAN;
+#endif
+
+inline uint8_t ros_bswap(uint8_t v) { return v; }
+inline uint16_t ros_bswap(uint16_t v) { return __builtin_bswap16(v); }
+inline uint32_t ros_bswap(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t ros_bswap(uint64_t v) { return __builtin_bswap64(v); }
+
+/* Load a T stored in ORDER at p, which need not be aligned */
+template<enum ros_byte_order ORDER, typename T>
+inline T ros_load(const unsigned char *p)
+{
+  T v;
+  memcpy(&v, p, sizeof(v));
+  return ORDER == ros_host_order ? v : ros_bswap(v);
+}
+
+/* Descriptor of a stored field: its type and offset. SIZE is the size of the
+ * structure member it describes, which must match the type.
+ */
+template<typename T, size_t OFFSET, size_t SIZE>
+struct ros_field {
+  static_assert(sizeof(T) == SIZE, "ros_field type does not match the structure member");
+  typedef T type;
+  static constexpr size_t offset = OFFSET;
+  static constexpr size_t end = OFFSET + SIZE;
+};
+
+#define ROS_FIELD(STRUCT, MEMBER, TYPE) \
+  ros_field<TYPE, offsetof(STRUCT, MEMBER), sizeof(((STRUCT *)0)->MEMBER)>
+
+// accessor for a field descriptor, in a view class with data and ORDER
+#define ROS_VIEW_FIELD(NAME, FIELD) \
+  typename FIELD::type NAME() const { return ros_load<ORDER, typename FIELD::type>(data + FIELD::offset); }
+
+struct ros_timestamp_fields {
+  typedef ROS_FIELD(ros_header_timestamp, link_second, uint8_t) link_second;
+  typedef ROS_FIELD(ros_header_timestamp, link_minute, uint8_t) link_minute;
+  typedef ROS_FIELD(ros_header_timestamp, link_hour, uint8_t) link_hour;
+  typedef ROS_FIELD(ros_header_timestamp, link_day, uint8_t) link_day;
+  typedef ROS_FIELD(ros_header_timestamp, link_month, uint8_t) link_month;
+  typedef ROS_FIELD(ros_header_timestamp, link_year, uint16_t) link_year;
+};
+
+struct ros_header_v1_fields {
+  typedef ROS_FIELD(ros_header_v1, timestamp, struct ros_header_timestamp) timestamp;
+  typedef ROS_FIELD(ros_header_v1, payload_checksum_v1.length, uint32_t) payload_length;
+  typedef ROS_FIELD(ros_header_v1, payload_checksum_v1.checksum, uint32_t) payload_checksum;
+  typedef ROS_FIELD(ros_header_v1, signature, struct ros_header_signature) signature;
+  typedef ROS_FIELD(ros_header_v1, directory.dir_entries_qty, uint32_t) dir_entries_qty;
+};
+
+struct ros_header_v2_fields {
+  typedef ROS_FIELD(ros_header_v2, header_checksum.length, uint32_t) header_length;
+  typedef ROS_FIELD(ros_header_v2, header_checksum.checksum, uint32_t) header_checksum;
+  typedef ROS_FIELD(ros_header_v2, payload_checksum_v1.length, uint32_t) payload_outer_length;
+  typedef ROS_FIELD(ros_header_v2, payload_checksum_v1.checksum, uint32_t) payload_outer_checksum;
+  typedef ROS_FIELD(ros_header_v2, signature, struct ros_header_signature) signature;
+  typedef ROS_FIELD(ros_header_v2, directory.dir_entries_qty, uint32_t) dir_entries_qty;
+  typedef ROS_FIELD(ros_header_v2, timestamp, struct ros_header_timestamp) timestamp;
+  typedef ROS_FIELD(ros_header_v2, payload_checksum_v2.length, uint32_t) payload_inner_length;
+  typedef ROS_FIELD(ros_header_v2, payload_checksum_v2.checksum, uint32_t) payload_inner_checksum;
+  typedef ROS_FIELD(ros_header_v2, firmware_version, char[16]) firmware_version;
+};
+
+struct ros_dirent_fields {
+  typedef ROS_FIELD(ros_dirent, offset, uint32_t) offset;
+  typedef ROS_FIELD(ros_dirent, length, uint32_t) length;
+  typedef ROS_FIELD(ros_dirent, unknown1, uint32_t) unknown1;
+  typedef ROS_FIELD(ros_dirent, unknown2, uint32_t) unknown2;
+};
+
+struct ros_arc_header_fields {
+  typedef ROS_FIELD(ros_arc_header, timestamp, struct ros_header_timestamp) timestamp;
+  typedef ROS_FIELD(ros_arc_header, unknown1, uint32_t) unknown1;
+  typedef ROS_FIELD(ros_arc_header, uncompressed_length, uint32_t) uncompressed_length;
+  typedef ROS_FIELD(ros_arc_header, unknown2, uint32_t) unknown2;
+  typedef ROS_FIELD(ros_arc_header, unknown3, uint32_t) unknown3;
+};
+
+static_assert(sizeof(struct ros_header_v1) == 48, "ros_header_v1 layout");
+static_assert(sizeof(struct ros_header_v2) == 80, "ros_header_v2 layout");
+static_assert(sizeof(struct ros_dirent) == 32, "ros_dirent layout");
+static_assert(sizeof(struct ros_arc_header) == 32, "ros_arc_header layout");
+static_assert(ros_header_v1_fields::signature::offset == 0x18 && ros_header_v2_fields::signature::offset == 0x18,
+              "the PACK signature is at 0x18");
+
+template<enum ros_byte_order ORDER>
+class ros_timestamp_view {
+  public:
+    explicit ros_timestamp_view(const void *data) : data(static_cast<const unsigned char *>(data)) {}
+
+    ROS_VIEW_FIELD(link_second, ros_timestamp_fields::link_second)
+    ROS_VIEW_FIELD(link_minute, ros_timestamp_fields::link_minute)
+    ROS_VIEW_FIELD(link_hour, ros_timestamp_fields::link_hour)
+    ROS_VIEW_FIELD(link_day, ros_timestamp_fields::link_day)
+    ROS_VIEW_FIELD(link_month, ros_timestamp_fields::link_month)
+    ROS_VIEW_FIELD(link_year, ros_timestamp_fields::link_year)
+
+    struct ros_header_timestamp host() const {  // in host order
+      struct ros_header_timestamp timestamp;
+      memcpy(&timestamp, data, sizeof(timestamp));
+      timestamp.link_year = link_year();
+      return timestamp;
+    }
+
+  private:
+    const unsigned char *data;
+};
+
+// accessors for the ros_header_version at the start of a view
+#define ROS_VIEW_VERSION \
+  const char *arc_magic() const { return reinterpret_cast<const char *>(data) + offsetof(ros_header_version, arc_magic); } \
+  const char *arc_index() const { return reinterpret_cast<const char *>(data) + offsetof(ros_header_version, arc_index); }
+
+template<enum ros_byte_order ORDER>
+class ros_header_v1_view {
+  public:
+    static const size_t size = sizeof(struct ros_header_v1);
+    explicit ros_header_v1_view(const void *data) : data(static_cast<const unsigned char *>(data)) {}
+
+    ROS_VIEW_VERSION
+    const char *signature() const { return reinterpret_cast<const char *>(data) + ros_header_v1_fields::signature::offset; }
+
+    ros_timestamp_view<ORDER> timestamp() const { return ros_timestamp_view<ORDER>(data + ros_header_v1_fields::timestamp::offset); }
+    ROS_VIEW_FIELD(payload_length, ros_header_v1_fields::payload_length)
+    ROS_VIEW_FIELD(payload_checksum, ros_header_v1_fields::payload_checksum)
+    ROS_VIEW_FIELD(dir_entries_qty, ros_header_v1_fields::dir_entries_qty)
+
+  private:
+    const unsigned char *data;
+};
+
+template<enum ros_byte_order ORDER>
+class ros_header_v2_view {
+  public:
+    static const size_t size = sizeof(struct ros_header_v2);
+    explicit ros_header_v2_view(const void *data) : data(static_cast<const unsigned char *>(data)) {}
+
+    ROS_VIEW_VERSION
+    const char *signature() const { return reinterpret_cast<const char *>(data) + ros_header_v2_fields::signature::offset; }
+
+    ROS_VIEW_FIELD(header_length, ros_header_v2_fields::header_length)
+    ROS_VIEW_FIELD(header_checksum, ros_header_v2_fields::header_checksum)
+    ROS_VIEW_FIELD(payload_outer_length, ros_header_v2_fields::payload_outer_length)
+    ROS_VIEW_FIELD(payload_outer_checksum, ros_header_v2_fields::payload_outer_checksum)
+    ROS_VIEW_FIELD(dir_entries_qty, ros_header_v2_fields::dir_entries_qty)
+    ros_timestamp_view<ORDER> timestamp() const { return ros_timestamp_view<ORDER>(data + ros_header_v2_fields::timestamp::offset); }
+    ROS_VIEW_FIELD(payload_inner_length, ros_header_v2_fields::payload_inner_length)
+    ROS_VIEW_FIELD(payload_inner_checksum, ros_header_v2_fields::payload_inner_checksum)
+    const char *firmware_version() const { return reinterpret_cast<const char *>(data) + ros_header_v2_fields::firmware_version::offset; }
+
+  private:
+    const unsigned char *data;
+};
+
+template<enum ros_byte_order ORDER>
+class ros_dirent_view {
+  public:
+    static const size_t size = sizeof(struct ros_dirent);
+    explicit ros_dirent_view(const void *data) : data(static_cast<const unsigned char *>(data)) {}
+
+    const char *filename() const { return reinterpret_cast<const char *>(data); } // not terminated
+    ROS_VIEW_FIELD(offset, ros_dirent_fields::offset)
+    ROS_VIEW_FIELD(length, ros_dirent_fields::length)
+    ROS_VIEW_FIELD(unknown1, ros_dirent_fields::unknown1)
+    ROS_VIEW_FIELD(unknown2, ros_dirent_fields::unknown2)
+
+    struct ros_dirent host() const {  // in host order
+      struct ros_dirent dirent;
+      memcpy(dirent.filename, data, sizeof(dirent.filename));
+      dirent.offset = offset();
+      dirent.length = length();
+      dirent.unknown1 = unknown1();
+      dirent.unknown2 = unknown2();
+      return dirent;
+    }
+
+  private:
+    const unsigned char *data;
+};
+
+template<enum ros_byte_order ORDER>
+class ros_arc_header_view {
+  public:
+    static const size_t size = sizeof(struct ros_arc_header);
+    explicit ros_arc_header_view(const void *data) : data(static_cast<const unsigned char *>(data)) {}
+
+    ROS_VIEW_VERSION
+    ros_timestamp_view<ORDER> timestamp() const { return ros_timestamp_view<ORDER>(data + ros_arc_header_fields::timestamp::offset); }
+    ROS_VIEW_FIELD(unknown1, ros_arc_header_fields::unknown1)
+    ROS_VIEW_FIELD(uncompressed_length, ros_arc_header_fields::uncompressed_length)
+    ROS_VIEW_FIELD(unknown2, ros_arc_header_fields::unknown2)
+    ROS_VIEW_FIELD(unknown3, ros_arc_header_fields::unknown3)
+    /* uncompressed_length read as 64 bits, taking in unknown2, for the sub-headers that store it so */
+    uint64_t uncompressed_length64() const {
+      return ros_load<ORDER, uint64_t>(data + ros_arc_header_fields::uncompressed_length::offset);
+    }
+
+    struct ros_arc_header host() const {  // in host order
+      struct ros_arc_header header;
+      memcpy(&header.version, data, sizeof(header.version));
+      header.timestamp = timestamp().host();
+      header.unknown1 = unknown1();
+      header.uncompressed_length = uncompressed_length();
+      header.unknown2 = unknown2();
+      header.unknown3 = unknown3();
+      return header;
+    }
+
+  private:
+    const unsigned char *data;
+};
+
+/* The primary header of an archive in host order, whichever its version */
+struct ros_archive_header {
+  enum ros_byte_order order;
+  unsigned version;                       // 1 or 2
+  unsigned length;                        // of the primary header, the directory follows
+  struct ros_header_version arc;
+  struct ros_header_signature signature;
+  struct ros_header_timestamp timestamp;
+  unsigned dir_entries_qty;
+  struct ros_header_checksum payload;     // v1, and the outer payload of v2
+  struct ros_header_checksum header_checksum;  // v2: header length and checksum
+  struct ros_header_checksum payload_inner;    // v2
+  char firmware_version[16];              // v2, not terminated
+};
+
+/* Work out the byte order of an archive from its primary header: the order
+ * in which the lengths it records agree with the file length and the
+ * header version. Little-endian unless big-endian fits better.
+ */
+enum ros_byte_order ros_detect_order(const void *header, size_t length, uint64_t file_length);
+
+/* Parse the primary header in the given byte order; false if the version is unknown */
+bool ros_parse_header(const void *header, enum ros_byte_order order, struct ros_archive_header &out);
+
+/* Convert count stored directory entries to host order */
+void ros_load_dirents(const void *stored, unsigned count, enum ros_byte_order order, struct ros_dirent *out);
+
+#endif
@@ -0,0 +1,737 @@
+/* VxWorks ROS Firmware drop directory watcher
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Verifies, catalogues and optionally extracts each ROS PACK archive as it
+ * arrives in the directories it watches, and remembers the archives it has
+ * done so that none is missed or done twice across restarts.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rospack.h"
+#include "ros_format.hpp"
+#include "ros_util.hpp"
+
+using namespace std;
+
+
+const unsigned int probe_length = 32;       // bytes read from the start of each file
+const unsigned int signature_offset = 0x18; // of "PACK"
+
+// command-line switches
+const char *switch_extract_to = "--extract-to=";
+const char *switch_uncompress = "--uncompress";
+const char *switch_checkpoint = "--checkpoint=";
+const char *switch_jobs = "--jobs=";
+const char *switch_memory = "--memory=";
+const char *switch_output = "--output=";
+const char *switch_help = "--help";
+
+string extract_to;                  // extract each archive to a directory of its path under here
+bool uncompress = false;            // write LZMA entries uncompressed
+const char *checkpoint_path = nullptr;
+unsigned jobs = 0;                  // archives processed at once; 0 for one per CPU
+uint64_t memory_budget = 0;         // of each decoder
+bool json = false;
+
+volatile sig_atomic_t stopping = 0;
+
+/* A file as it is now: a different inode, size or modification time is a
+ * different file, so an archive replaced under the same name is done again
+ */
+struct file_identity {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  int64_t mtime_ns;
+
+  bool operator==(const struct file_identity &other) const {
+    return dev == other.dev && ino == other.ino && size == other.size && mtime_ns == other.mtime_ns;
+  }
+};
+
+struct file_identity
+identify(const struct stat &st)
+{
+  struct file_identity identity;
+  identity.dev = st.st_dev;
+  identity.ino = st.st_ino;
+  identity.size = st.st_size;
+  identity.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  return identity;
+}
+
+/* The archives done, by path, as they were when they were done. Each one
+ * is appended to the checkpoint file as it completes and synced, so a
+ * restart picks up after the last archive finished; the file is compacted
+ * when it is loaded.
+ */
+class checkpoint {
+  public:
+    checkpoint() : fd(-1) {}
+    ~checkpoint() { if (fd >= 0) close(fd); }
+
+    bool load(const char *path, string &error) {
+      FILE *in = fopen(path, "r");
+      if (!in && errno != ENOENT) {
+        error = string("cannot read ") + path + ": " + strerror(errno);
+        return false;
+      }
+      if (in) {
+        char line[PATH_MAX + 128];
+        while (fgets(line, sizeof(line), in)) {
+          unsigned long long dev, ino, size;
+          long long mtime_ns;
+          int name;
+          size_t length = strlen(line);
+          if (!length || line[length - 1] != '\n')
+            continue;   // cut short by a crash
+          line[length - 1] = '\0';
+          if (sscanf(line, "%llu %llu %llu %lld %n", &dev, &ino, &size, &mtime_ns, &name) != 4)
+            continue;
+          struct file_identity identity = { static_cast<dev_t>(dev), static_cast<ino_t>(ino),
+                                            static_cast<off_t>(size), mtime_ns };
+          done[line + name] = identity;
+        }
+        fclose(in);
+      }
+
+      // rewrite it with one line per archive still there
+      string temporary = string(path) + ".tmp";
+      fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd < 0) {
+        error = string("cannot write ") + temporary + ": " + strerror(errno);
+        return false;
+      }
+      for (map<string, struct file_identity>::iterator i = done.begin(); i != done.end(); ) {
+        struct stat st;
+        if (stat(i->first.c_str(), &st) < 0) {
+          done.erase(i++);
+          continue;
+        }
+        if (!append(i->first, i->second)) {
+          error = string("cannot write ") + temporary + ": " + strerror(errno);
+          return false;
+        }
+        ++i;
+      }
+      if (fdatasync(fd) < 0 || rename(temporary.c_str(), path) < 0) {
+        error = string("cannot replace ") + path + ": " + strerror(errno);
+        return false;
+      }
+      return true;
+    }
+
+    bool seen(const string &path, const struct file_identity &identity) {
+      lock_guard<mutex> guard(lock);
+      map<string, struct file_identity>::const_iterator found = done.find(path);
+      return found != done.end() && found->second == identity;
+    }
+
+    void record(const string &path, const struct file_identity &identity) {
+      lock_guard<mutex> guard(lock);
+      done[path] = identity;
+      // a path with a newline in it cannot be written, so it is only remembered until exit
+      if (fd >= 0 && path.find('\n') == string::npos && (!append(path, identity) || fdatasync(fd) < 0))
+        cerr << "Error: cannot write the checkpoint: " << strerror(errno) << endl;
+    }
+
+  private:
+    bool append(const string &path, const struct file_identity &identity) {
+      char numbers[96];
+      snprintf(numbers, sizeof(numbers), "%llu %llu %llu %lld ",
+               static_cast<unsigned long long>(identity.dev), static_cast<unsigned long long>(identity.ino),
+               static_cast<unsigned long long>(identity.size), static_cast<long long>(identity.mtime_ns));
+      string line = numbers + path + '\n';
+      return write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+    }
+
+    mutex lock;
+    map<string, struct file_identity> done;
+    int fd;     // appended to
+};
+
+/* Archives waiting for a worker. A path is queued once however many events
+ * name it while it waits; the worker looks at the file as it is when it
+ * takes it.
+ */
+class ingest_queue {
+  public:
+    ingest_queue() : closed(false) {}
+
+    bool push(const string &path) {
+      {
+        lock_guard<mutex> guard(lock);
+        if (!queued.insert(path).second)
+          return false;
+        waiting.push_back(path);
+      }
+      changed.notify_one();
+      return true;
+    }
+
+    bool pop(string &path) {
+      unique_lock<mutex> guard(lock);
+      while (waiting.empty() && !closed)
+        changed.wait(guard);
+      if (closed)
+        return false;
+      path.swap(waiting.front());
+      waiting.pop_front();
+      queued.erase(path);
+      return true;
+    }
+
+    /* Stop handing out paths; those still waiting are not done, so the
+     * next start finds them again
+     */
+    void close() {
+      {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+        waiting.clear();
+        queued.clear();
+      }
+      changed.notify_all();
+    }
+
+  private:
+    mutex lock;
+    condition_variable changed;
+    deque<string> waiting;
+    set<string> queued;
+    bool closed;
+};
+
+struct watch_counts {
+  uint64_t events;        // archives notified or found by a scan
+  uint64_t duplicates;    // of them, queued or done already
+  uint64_t archives;
+  uint64_t failed;
+};
+
+checkpoint done_archives;
+ingest_queue queue;
+mutex output_lock;            // serialises records and counts
+struct watch_counts counts;
+
+void
+usage(char *prog_name)
+{
+  cout << "Usage: " << prog_name << " ["
+       << " " << switch_extract_to << "DIR"
+       << " " << switch_uncompress
+       << " " << switch_checkpoint << "FILE"
+       << " " << switch_jobs << "N"
+       << " " << switch_memory << "SIZE"
+       << " " << switch_output << "text|json"
+       << " " << switch_help
+       << " ] DIRECTORY..." << endl
+       << switch_extract_to << ": extract each archive's entries to a directory of its path under DIR" << endl
+       << switch_uncompress << ": extract LZMA entries uncompressed" << endl
+       << switch_checkpoint << ": remember the archives done in FILE, so a restart only does those that are new" << endl
+       << switch_jobs << ": process up to N archives at once (default: one per CPU)" << endl
+       << switch_memory << ": memory limit of each LZMA decoder, with suffix K, M or G (default: a quarter of RAM)" << endl
+       << switch_output << "json: report one JSON record per line for each archive" << endl
+       << switch_help << ": display this help text" << endl
+       << "DIRECTORY: drop directories to watch for new archives, written or moved into them" << endl;
+}
+
+/* Queue the file at path if it is a ROS PACK archive that has not been
+ * done as it is now, with a single pread of the bytes that hold the signature
+ */
+void
+consider(const string &path)
+{
+  char header[probe_length];
+  struct stat st;
+
+  int fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return;   // gone again already
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return;
+  }
+  ssize_t length = pread(fd, header, sizeof(header), 0);
+  close(fd);
+  if (length < static_cast<ssize_t>(probe_length) || memcmp(header + signature_offset, "PACK", 4) != 0)
+    return;
+
+  bool queued = !done_archives.seen(path, identify(st)) && queue.push(path);
+  lock_guard<mutex> guard(output_lock);
+  ++counts.events;
+  if (!queued)
+    ++counts.duplicates;
+}
+
+/* Consider every file already in a directory */
+void
+scan_directory(const string &directory)
+{
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) {
+    cerr << "Error: cannot read " << directory << ": " << strerror(errno) << endl;
+    return;
+  }
+  while (struct dirent *entry = readdir(dir))
+    if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) && entry->d_name[0] != '.')
+      consider(directory + "/" + entry->d_name);
+  closedir(dir);
+}
+
+/* The entry's file name as a single path component */
+string
+entry_file_name(const struct rospack_entry *entry)
+{
+  string name(entry->filename);
+  for (unsigned i = 0; i < name.size(); ++i)
+    if (name[i] == '/')
+      name[i] = '_';
+  if (name.empty() || name == "." || name == "..")
+    name = to_string(entry->index);
+  return name;
+}
+
+int
+write_output(void *user, const void *data, size_t length)
+{
+  int fd = *static_cast<int *>(user);
+  const char *bytes = static_cast<const char *>(data);
+  while (length) {
+    ssize_t written = write(fd, bytes, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return ROSPACK_ERR_IO;
+    bytes += written;
+    length -= written;
+  }
+  return 0;
+}
+
+/* Create directory and any of its parents that are missing */
+bool
+make_directories(const string &directory, string &error)
+{
+  for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+    string part = directory.substr(0, slash);
+    if (mkdir(part.c_str(), 0777) < 0 && errno != EEXIST) {
+      error = string("cannot create ") + part + ": " + strerror(errno);
+      return false;
+    }
+    if (slash == string::npos)
+      return true;
+  }
+}
+
+/* Write every entry of the archive to a file in directory; false with a
+ * description in error at the first that cannot be
+ */
+bool
+extract_archive(rospack_decoder *decoder, const rospack_archive *archive, const string &directory, string &error)
+{
+  if (!make_directories(directory, error))
+    return false;
+  for (unsigned i = 0; i < rospack_entry_count(archive); ++i) {
+    const struct rospack_entry *entry = rospack_entry(archive, i);
+    string dest = directory + "/" + entry_file_name(entry);
+    int fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      error = string("cannot create ") + dest + ": " + strerror(errno);
+      return false;
+    }
+    int result;
+    if (uncompress && entry->compressed)
+      result = rospack_decode(decoder, archive, i, write_output, &fd);
+    else {
+      const void *data;
+      size_t length;
+      result = rospack_entry_data(archive, i, &data, &length);
+      if (result == ROSPACK_OK)
+        result = write_output(&fd, data, length);
+    }
+    if (close(fd) < 0 && result == ROSPACK_OK)
+      result = ROSPACK_ERR_IO;
+    if (result != ROSPACK_OK) {
+      error = string(result == ROSPACK_ERR_IO ? "cannot write " : "cannot extract ") + dest + ": " +
+              (result == ROSPACK_ERR_IO ? strerror(errno) : rospack_strerror(result));
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+json_time(ros_writer &out, const struct rospack_time &t)
+{
+  out.begin_string()
+     .dec(t.year, 4).put('-').dec(t.month, 2).put('-').dec(t.day, 2).put(' ')
+     .dec(t.hour, 2).put(':').dec(t.minute, 2).put(':').dec(t.second, 2)
+     .end_string();
+}
+
+/* The catalogue record of an archive */
+void
+report(ros_writer &out, const string &path, const rospack_archive *archive, int verified, uint32_t calculated,
+       const string &extracted, const string &error, uint64_t us)
+{
+  const struct rospack_header *header = archive ? rospack_header(archive) : nullptr;
+  const uint32_t stored = header ? (header->version > 1 ? header->inner_checksum : header->payload_checksum) : 0;
+
+  if (!json) {
+    out.raw(!archive ? "FAILED " : verified == ROSPACK_OK ? "OK " : "BAD ").raw(path.c_str());
+    if (header) {
+      out.raw(": v").dec(header->version).put(' ').raw(header->arc_magic).put(' ');
+      if (header->version > 1 && header->firmware_version[0])
+        out.raw(header->firmware_version).put(' ');
+      if (header->manufacturer)
+        out.raw(header->manufacturer).put(' ');
+      if (header->model)
+        out.raw(header->model).put(' ');
+      out.dec(header->entries).raw(" entries");
+      if (verified != ROSPACK_OK)
+        out.raw(", checksum ").hex(calculated).raw(" should be ").hex(stored);
+    }
+    if (!extracted.empty())
+      out.raw(", extracted to ").raw(extracted.c_str());
+    if (!error.empty())
+      out.raw(": ").raw(error.c_str());
+    out.put('\n');
+    return;
+  }
+
+  out.begin_object()
+     .key("type").string("archive")
+     .key("file").string(path.c_str())
+     .key("ok").boolean(archive && verified == ROSPACK_OK && error.empty());
+  if (header) {
+    out.key("version").number(header->version)
+       .key("byte_order").string(header->big_endian ? "big" : "little")
+       .key("arc_magic").string(header->arc_magic)
+       .key("arc_index").string(header->arc_index)
+       .key("link_time");
+    json_time(out, header->link);
+    if (header->version > 1)
+      out.key("firmware_version").string(header->firmware_version)
+         .key("header_checksum_ok").boolean(header->header_checksum == header->header_checksum_calculated);
+    if (header->manufacturer)
+      out.key("manufacturer").string(header->manufacturer);
+    if (header->model)
+      out.key("model").string(header->model);
+    out.key("payload_checksum").number(stored)
+       .key("calculated_checksum").number(calculated)
+       .key("valid").boolean(verified == ROSPACK_OK);
+
+    out.key("entries").begin_array();
+    for (unsigned i = 0; i < rospack_entry_count(archive); ++i) {
+      const struct rospack_entry *entry = rospack_entry(archive, i);
+      out.begin_object()
+         .key("index").number(entry->index)
+         .key("filename").string(entry->filename)
+         .key("length").number(entry->length)
+         .key("data_type");
+      if (entry->data_type_title)
+        out.string(entry->data_type_title);
+      else
+        out.null();
+      out.key("compressed").boolean(entry->compressed);
+      if (entry->sub_header)
+        out.key("uncompressed_length").number(entry->uncompressed_length);
+      out.end_object();
+    }
+    out.end_array();
+  }
+  out.key("extracted");
+  if (!extracted.empty())
+    out.string(extracted.c_str());
+  else
+    out.null();
+  if (!error.empty())
+    out.key("error").string(error.c_str());
+  out.key("us").number(us)
+     .end_object()
+     .end_record();
+}
+
+/* Verify, catalogue and extract one archive, then record it as done */
+void
+process(rospack_decoder *decoder, const string &path)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  rospack_archive *archive = nullptr;
+  int verified = ROSPACK_ERR_IO;
+  uint32_t calculated = 0;
+  string extracted, error;
+
+  // the archive is identified and mapped through one descriptor, so what is recorded is what was read
+  int fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    if (fd >= 0)
+      close(fd);
+    return;   // gone before its turn came
+  }
+  struct file_identity identity = identify(st);
+  if (done_archives.seen(path, identity)) {
+    close(fd);
+    return;
+  }
+  int result = rospack_open_fd(fd, &archive);
+  close(fd);
+
+  if (result != ROSPACK_OK) {
+    archive = nullptr;
+    error = rospack_strerror(result);
+  }
+  else {
+    verified = rospack_verify(archive, &calculated);
+    if (!extract_to.empty()) {
+      // the watched directories are absolute, so archives of the same name in two of them stay apart
+      extracted = extract_to + path;
+      if (!extract_archive(decoder, archive, extracted, error))
+        extracted.clear();
+    }
+  }
+  uint64_t us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+  {
+    lock_guard<mutex> guard(output_lock);
+    ros_writer out(STDOUT_FILENO, 16 * 1024);
+    report(out, path, archive, verified, calculated, extracted, error, us);
+    out.flush();
+    ++counts.archives;
+    if (!archive || verified != ROSPACK_OK || !error.empty())
+      ++counts.failed;
+  }
+  if (archive)
+    rospack_close(archive);
+  // an archive that failed is not tried again until it changes
+  done_archives.record(path, identity);
+}
+
+void
+worker()
+{
+  rospack_decoder *decoder = rospack_decoder_new(memory_budget);
+  if (!decoder) {
+    cerr << "Error: cannot create a decoder" << endl;
+    exit(1);
+  }
+  string path;
+  while (queue.pop(path))
+    process(decoder, path);
+  rospack_decoder_free(decoder);
+}
+
+void
+stop(int signal_number)
+{
+  stopping = 1;
+}
+
+int
+main(int argc, char **argv, char **env)
+{
+  vector<string> directories;
+
+  for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
+    char *end;
+    if (strncmp(argv[i], switch_help, 3) == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (strncmp(argv[i], switch_extract_to, strlen(switch_extract_to)) == 0) {
+      extract_to = argv[i] + strlen(switch_extract_to);
+      if (extract_to.empty()) {
+        cerr << "Error: no directory to extract to" << endl;
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], switch_uncompress) == 0) {
+      uncompress = true;
+    }
+    else if (strncmp(argv[i], switch_checkpoint, strlen(switch_checkpoint)) == 0) {
+      checkpoint_path = argv[i] + strlen(switch_checkpoint);
+    }
+    else if (strncmp(argv[i], switch_jobs, strlen(switch_jobs)) == 0) {
+      jobs = strtoul(argv[i] + strlen(switch_jobs), &end, 10);
+      if (*end || jobs < 1) {
+        cerr << "Error: invalid number of jobs: " << argv[i] + strlen(switch_jobs) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_memory, strlen(switch_memory)) == 0) {
+      memory_budget = ros_parse_size(argv[i] + strlen(switch_memory));
+      if (!memory_budget) {
+        cerr << "Error: invalid memory budget: " << argv[i] + strlen(switch_memory) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_output, strlen(switch_output)) == 0) {
+      const char *format = argv[i] + strlen(switch_output);
+      if (strcmp(format, "json") == 0)
+        json = true;
+      else if (strcmp(format, "text") == 0)
+        json = false;
+      else {
+        cerr << "Error: unknown output format: " << format << endl;
+        return 1;
+      }
+    }
+    else if (argv[i][0] == '-' && argv[i][1] == '-') {
+      usage(argv[0]);
+      return 1;
+    }
+    else {
+      char *path = realpath(argv[i], nullptr);
+      if (!path) {
+        cerr << "Error: cannot watch " << argv[i] << ": " << strerror(errno) << endl;
+        return 1;
+      }
+      directories.push_back(path);
+      free(path);
+    }
+  }
+  if (directories.empty() || (uncompress && extract_to.empty())) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!jobs)
+    jobs = thread::hardware_concurrency() ? thread::hardware_concurrency() : 1;
+
+  string error;
+  if (checkpoint_path && !done_archives.load(checkpoint_path, error)) {
+    cerr << "Error: checkpoint: " << error << endl;
+    return 1;
+  }
+
+  // watch before looking at what is there already, so nothing arrives unseen in between
+  int notify = inotify_init1(IN_CLOEXEC);
+  if (notify < 0) {
+    cerr << "Error: inotify: " << strerror(errno) << endl;
+    return 1;
+  }
+  map<int, string> watches;
+  for (unsigned i = 0; i < directories.size(); ++i) {
+    int wd = inotify_add_watch(notify, directories[i].c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0) {
+      cerr << "Error: cannot watch " << directories[i] << ": " << strerror(errno) << endl;
+      return 1;
+    }
+    watches[wd] = directories[i];
+  }
+
+  // the signals are blocked, in the workers too, but while waiting for events: ppoll() unblocks them
+  // atomically, so one that comes before the wait ends it at once rather than being missed
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  sigset_t stop_signals, waiting_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &waiting_mask);
+  sigdelset(&waiting_mask, SIGINT);
+  sigdelset(&waiting_mask, SIGTERM);
+
+  vector<thread> workers;
+  for (unsigned i = 0; i < jobs; ++i)
+    workers.push_back(thread(worker));
+  cerr << "Watching " << directories.size() << " directories with " << jobs << " workers" << endl;
+
+  for (unsigned i = 0; i < directories.size(); ++i)
+    scan_directory(directories[i]);
+
+  // room for many events at once; each is followed by its name
+  vector<char> events(64 * (sizeof(struct inotify_event) + NAME_MAX + 1));
+  while (!stopping) {
+    struct pollfd ready;
+    ready.fd = notify;
+    ready.events = POLLIN;
+    if (ppoll(&ready, 1, nullptr, &waiting_mask) < 0) {
+      if (errno == EINTR)
+        continue;
+      cerr << "Error: waiting for events: " << strerror(errno) << endl;
+      break;
+    }
+    ssize_t length = read(notify, events.data(), events.size());
+    if (length < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      cerr << "Error: reading events: " << strerror(errno) << endl;
+      break;
+    }
+    for (ssize_t position = 0; position < length; ) {
+      const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(events.data() + position);
+      position += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        // events were lost, so look at everything again; the archives done are not done twice
+        for (unsigned i = 0; i < directories.size(); ++i)
+          scan_directory(directories[i]);
+      }
+      else if (event->mask & IN_IGNORED) {
+        cerr << "Error: " << watches[event->wd] << " is no longer watched" << endl;
+        watches.erase(event->wd);
+        if (watches.empty())
+          stopping = 1;
+      }
+      // hidden files are those still being uploaded, by rsync and others, before a rename
+      else if (event->len && !(event->mask & IN_ISDIR) && event->name[0] != '.')
+        consider(watches[event->wd] + "/" + event->name);
+    }
+  }
+
+  // let the archives being processed finish, so the checkpoint has them
+  close(notify);
+  queue.close();
+  for (unsigned i = 0; i < workers.size(); ++i)
+    workers[i].join();
+
+  cerr << "Processed " << counts.archives << " archives, " << counts.failed << " failed; "
+       << counts.duplicates << " of " << counts.events << " notifications were for archives queued or done already" << endl;
+  return 0;
+}
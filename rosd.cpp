@@ -0,0 +1,1009 @@
+/* VxWorks ROS Firmware analysis daemon
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Answers list, verify, extract and uncompress requests for ROS PACK archives
+ * on a Unix domain socket, keeping parsed archives, decoders and recently
+ * uncompressed entries warm between requests.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "rospack.h"
+#include "ros_format.hpp"
+#include "ros_util.hpp"
+
+using namespace std;
+
+
+// command-line switches
+const char *switch_socket = "--socket=";
+const char *switch_jobs = "--jobs=";
+const char *switch_queue = "--queue=";
+const char *switch_cache = "--cache=";
+const char *switch_archives = "--archives=";
+const char *switch_memory = "--memory=";
+const char *switch_help = "--help";
+
+unsigned jobs = 0;                  // connections served at once; 0 for one per CPU
+unsigned queue_max = 64;            // connections waiting for a worker before more are refused
+uint64_t entry_cache_budget = 256ULL * 1024 * 1024;
+unsigned archive_cache_max = 64;
+uint64_t memory_budget = 0;         // of each decoder
+const unsigned idle_seconds = 30;   // a connection with no request for this long is closed
+const size_t request_max = 4096;    // bytes in one request line
+const uint64_t decoded_max = 256ULL * 1024 * 1024;  // uncompressed bytes one request may hold in memory
+
+char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+/* A file as it is now: a different inode, size or modification time is a
+ * different file, so a cached archive never outlives a change to it
+ */
+struct file_identity {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  int64_t mtime_ns;
+
+  bool operator<(const struct file_identity &other) const {
+    if (dev != other.dev) return dev < other.dev;
+    if (ino != other.ino) return ino < other.ino;
+    if (size != other.size) return size < other.size;
+    return mtime_ns < other.mtime_ns;
+  }
+};
+
+struct entry_key {
+  struct file_identity file;
+  unsigned index;
+
+  bool operator<(const struct entry_key &other) const {
+    if (file < other.file || other.file < file)
+      return file < other.file;
+    return index < other.index;
+  }
+};
+
+/* A parsed archive shared by every request for the same file; it is only
+ * closed when it has left the cache and the last request using it is done
+ */
+struct cached_archive {
+  rospack_archive *archive;
+  const char *mapping;              // of the whole file, which the archive reads in place
+  size_t length;
+  struct file_identity identity;    // its uncompressed entries are cached under
+  volatile sig_atomic_t shrunk;     // the file was cut short under the mapping; set by bus_error()
+  mutex verify_lock;                // one request calculates the checksum, the others wait for it
+  bool verified;
+  int verify_result;
+  uint32_t calculated;
+
+  cached_archive(rospack_archive *archive, const char *mapping, size_t length, const struct file_identity &identity)
+    : archive(archive), mapping(mapping), length(length), identity(identity), shrunk(0),
+      verified(false), verify_result(ROSPACK_OK), calculated(0) {}
+  ~cached_archive() {
+    rospack_close(archive);
+    munmap(const_cast<char *>(mapping), length);
+  }
+};
+
+typedef shared_ptr<struct cached_archive> archive_ref;
+typedef shared_ptr<const vector<char> > entry_ref;
+
+long page_size;
+thread_local struct cached_archive *reading;  // the archive the worker's request reads, for bus_error()
+const char *shrunk_error = "the file was cut short while it was read";
+
+/* Least recently used values up to a budget of their summed costs; a value
+ * costing more than the whole budget is not kept at all
+ */
+template <typename K, typename V>
+class lru_cache {
+  public:
+    explicit lru_cache(uint64_t budget) : budget(budget), used(0), hits(0), misses(0) {}
+
+    bool find(const K &key, V &value) {
+      lock_guard<mutex> guard(lock);
+      typename map<K, typename order_list::iterator>::iterator found = index.find(key);
+      if (found == index.end()) {
+        ++misses;
+        return false;
+      }
+      order.splice(order.begin(), order, found->second);
+      value = found->second->value;
+      ++hits;
+      return true;
+    }
+
+    void insert(const K &key, const V &value, uint64_t cost) {
+      lock_guard<mutex> guard(lock);
+      typename map<K, typename order_list::iterator>::iterator found = index.find(key);
+      if (found != index.end()) {   // another request got there first
+        used -= found->second->cost;
+        order.erase(found->second);
+        index.erase(found);
+      }
+      if (cost > budget)
+        return;
+      while (used + cost > budget) {
+        used -= order.back().cost;
+        index.erase(order.back().key);
+        order.pop_back();
+      }
+      order.push_front(item(key, value, cost));
+      index[key] = order.begin();
+      used += cost;
+    }
+
+    void counts(uint64_t &items, uint64_t &cost, uint64_t &hit_count, uint64_t &miss_count) {
+      lock_guard<mutex> guard(lock);
+      items = order.size();
+      cost = used;
+      hit_count = hits;
+      miss_count = misses;
+    }
+
+  private:
+    struct item {
+      K key;
+      V value;
+      uint64_t cost;
+      item(const K &key, const V &value, uint64_t cost) : key(key), value(value), cost(cost) {}
+    };
+    typedef list<item> order_list;    // most recently used first
+
+    mutex lock;
+    order_list order;
+    map<K, typename order_list::iterator> index;
+    uint64_t budget;
+    uint64_t used;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+lru_cache<struct file_identity, archive_ref> *archive_cache;   // each archive costs 1
+lru_cache<struct entry_key, entry_ref> *entry_cache;           // each entry costs its length
+
+enum request_command {
+  COMMAND_LIST,
+  COMMAND_VERIFY,
+  COMMAND_EXTRACT,
+  COMMAND_UNCOMPRESS,
+  COMMAND_STATS,
+  COMMAND_COUNT
+};
+
+const char *command_names[COMMAND_COUNT] = { "list", "verify", "extract", "uncompress", "stats" };
+
+/* Latencies in power of two buckets of microseconds, enough for percentiles */
+const unsigned latency_buckets = 40;
+
+struct request_metrics {
+  uint64_t count;
+  uint64_t errors;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t buckets[latency_buckets];
+};
+
+mutex metrics_lock;
+struct request_metrics metrics[COMMAND_COUNT];
+uint64_t connections_refused;
+
+void
+record_latency(enum request_command command, bool ok, uint64_t ns)
+{
+  unsigned bucket = 0;
+  for (uint64_t us = ns / 1000; us && bucket < latency_buckets - 1; us >>= 1)
+    ++bucket;
+
+  lock_guard<mutex> guard(metrics_lock);
+  struct request_metrics &m = metrics[command];
+  ++m.count;
+  if (!ok)
+    ++m.errors;
+  m.total_ns += ns;
+  if (ns > m.max_ns)
+    m.max_ns = ns;
+  ++m.buckets[bucket];
+}
+
+/* The upper bound in microseconds of the bucket holding the given fraction of requests */
+uint64_t
+latency_percentile(const struct request_metrics &m, double fraction)
+{
+  uint64_t wanted = static_cast<uint64_t>(m.count * fraction + 0.5);
+  uint64_t seen = 0;
+  for (unsigned b = 0; b < latency_buckets; ++b) {
+    seen += m.buckets[b];
+    if (seen >= wanted && seen)
+      return b ? (1ULL << b) - 1 : 0;
+  }
+  return 0;
+}
+
+/* Connections accepted but not yet taken by a worker */
+class connection_queue {
+  public:
+    bool push(int fd) {
+      {
+        lock_guard<mutex> guard(lock);
+        if (waiting.size() >= queue_max)
+          return false;
+        waiting.push_back(fd);
+      }
+      changed.notify_one();
+      return true;
+    }
+
+    int pop() {
+      unique_lock<mutex> guard(lock);
+      while (waiting.empty())
+        changed.wait(guard);
+      int fd = waiting.front();
+      waiting.pop_front();
+      return fd;
+    }
+
+  private:
+    mutex lock;
+    condition_variable changed;
+    deque<int> waiting;
+};
+
+connection_queue connections;
+
+void
+usage(char *prog_name)
+{
+  cout << "Usage: " << prog_name << " ["
+       << " " << switch_socket << "PATH"
+       << " " << switch_jobs << "N"
+       << " " << switch_queue << "N"
+       << " " << switch_cache << "SIZE"
+       << " " << switch_archives << "N"
+       << " " << switch_memory << "SIZE"
+       << " " << switch_help
+       << " ]" << endl
+       << switch_socket << ": the Unix domain socket to listen on (default $XDG_RUNTIME_DIR/rosd.sock or /tmp/rosd-UID.sock)" << endl
+       << switch_jobs << ": serve up to N connections at once (default: one per CPU)" << endl
+       << switch_queue << ": connections waiting for a worker before more are refused (default " << queue_max << ")" << endl
+       << switch_cache << ": memory kept for uncompressed entries, with suffix K, M or G (default 256M)" << endl
+       << switch_archives << ": number of parsed archives kept (default " << archive_cache_max << ")" << endl
+       << switch_memory << ": memory limit of each LZMA decoder, with suffix K, M or G (default: a quarter of RAM)" << endl
+       << switch_help << ": display this help text" << endl
+       << "Requests, one per line: list PATH | verify PATH | extract PATH ENTRY [DEST] |" << endl
+       << "  uncompress PATH ENTRY [DEST] | stats" << endl;
+}
+
+bool
+write_all(int fd, const char *data, size_t length)
+{
+  while (length) {
+    ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    length -= written;
+  }
+  return true;
+}
+
+/* The archive at path, parsed now or earlier. The descriptor is only open
+ * long enough to identify the file and map it.
+ */
+int
+open_archive(const string &path, archive_ref &found, bool &cached)
+{
+  int fd = open(path.c_str(), O_RDONLY | O_NOCTTY);
+  if (fd < 0)
+    return ROSPACK_ERR_IO;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return ROSPACK_ERR_IO;
+  }
+  struct file_identity identity;
+  identity.dev = st.st_dev;
+  identity.ino = st.st_ino;
+  identity.size = st.st_size;
+  identity.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+  // one cut short under an earlier request is opened again, replacing it in the cache
+  cached = archive_cache->find(identity, found) && !found->shrunk;
+  if (cached) {
+    close(fd);
+    return ROSPACK_OK;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return ROSPACK_ERR_SHORT;
+  }
+
+  // mapped here rather than by rospack_open_fd(), so bus_error() knows its bounds
+  void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return ROSPACK_ERR_IO;
+  madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+  rospack_archive *archive;
+  int result = rospack_open_memory(mapping, st.st_size, &archive);
+  if (result != ROSPACK_OK) {
+    munmap(mapping, st.st_size);
+    return result;
+  }
+  found = make_shared<struct cached_archive>(archive, static_cast<const char *>(mapping), st.st_size, identity);
+  archive_cache->insert(identity, found, 1);
+  return ROSPACK_OK;
+}
+
+/* A file cut short while a request reads its mapping raises SIGBUS at the
+ * first page past its new end. That page is replaced by zeros so the access
+ * can complete, and the archive is marked so the request fails instead of
+ * the daemon; a fault anywhere else takes the default action when the
+ * access is retried.
+ */
+void
+bus_error(int signal_number, siginfo_t *info, void *context)
+{
+  struct cached_archive *archive = reading;
+  const char *address = static_cast<const char *>(info->si_addr);
+  if (archive && address >= archive->mapping && address < archive->mapping + archive->length) {
+    archive->shrunk = 1;
+    void *page = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(address) & ~static_cast<uintptr_t>(page_size - 1));
+    if (mmap(page, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+      return;
+  }
+  signal(signal_number, SIG_DFL);
+}
+
+/* Read a byte of every page of data in the archive's mapping, so a file that
+ * has been cut short faults here, where it is caught, rather than in send()
+ */
+void
+touch_pages(const char *data, size_t length)
+{
+  volatile char sink;
+  for (size_t offset = 0; offset < length; offset += page_size)
+    sink = data[offset];
+  if (length)
+    sink = data[length - 1];
+  (void)sink;
+}
+
+/* An entry by its file name, or failing that by its index */
+int
+find_entry(const rospack_archive *archive, const string &name)
+{
+  unsigned count = rospack_entry_count(archive);
+  for (unsigned i = 0; i < count; ++i)
+    if (name == rospack_entry(archive, i)->filename)
+      return i;
+
+  char *end;
+  unsigned long index = strtoul(name.c_str(), &end, 10);
+  if (name.empty() || *end || index >= count)
+    return -1;
+  return index;
+}
+
+/* Uncompressed data kept in memory, stopping the decoder past a limit */
+struct capped_output {
+  vector<char> *data;
+  uint64_t limit;
+  bool over;
+};
+
+int
+append_capped(void *user, const void *data, size_t length)
+{
+  struct capped_output *output = static_cast<struct capped_output *>(user);
+  if (output->data->size() + length > output->limit) {
+    output->over = true;
+    return 1;
+  }
+  return ros_append_output(output->data, data, length);
+}
+
+/* Uncompressed data written to a file as it is decoded */
+struct file_output {
+  int fd;
+  uint64_t length;
+  int error;          // errno of a failed write
+};
+
+bool
+write_fd(int fd, const char *data, size_t length)
+{
+  while (length) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    length -= written;
+  }
+  return true;
+}
+
+int
+write_output(void *user, const void *data, size_t length)
+{
+  struct file_output *output = static_cast<struct file_output *>(user);
+  if (!write_fd(output->fd, static_cast<const char *>(data), length)) {
+    output->error = errno ? errno : EIO;
+    return 1;
+  }
+  output->length += length;
+  return 0;
+}
+
+/* State a worker keeps for every connection it serves */
+struct worker_state {
+  rospack_decoder *decoder;         // warm across requests
+  vector<char> line;
+};
+
+void
+json_time(ros_writer &out, const struct rospack_time &t)
+{
+  out.begin_string()
+     .dec(t.year, 4).put('-').dec(t.month, 2).put('-').dec(t.day, 2).put(' ')
+     .dec(t.hour, 2).put(':').dec(t.minute, 2).put(':').dec(t.second, 2)
+     .end_string();
+}
+
+void
+list_archive(ros_writer &out, const rospack_archive *archive)
+{
+  const struct rospack_header *header = rospack_header(archive);
+
+  out.key("version").number(header->version)
+     .key("byte_order").string(header->big_endian ? "big" : "little")
+     .key("arc_magic").string(header->arc_magic)
+     .key("link_time");
+  json_time(out, header->link);
+  out.key("payload_length").number(header->version > 1 ? header->inner_length : header->payload_length)
+     .key("payload_checksum").number(header->version > 1 ? header->inner_checksum : header->payload_checksum);
+  if (header->version > 1)
+    out.key("firmware_version").string(header->firmware_version)
+       .key("header_checksum_ok").boolean(header->header_checksum == header->header_checksum_calculated);
+  if (header->manufacturer)
+    out.key("manufacturer").string(header->manufacturer);
+  if (header->model)
+    out.key("model").string(header->model);
+
+  out.key("entries").begin_array();
+  for (unsigned i = 0; i < rospack_entry_count(archive); ++i) {
+    const struct rospack_entry *entry = rospack_entry(archive, i);
+    out.begin_object()
+       .key("index").number(entry->index)
+       .key("filename").string(entry->filename)
+       .key("offset").number(entry->offset)
+       .key("length").number(entry->length)
+       .key("data_length").number(entry->data_length)
+       .key("truncated").boolean(entry->truncated)
+       .key("data_type");
+    if (entry->data_type_title)
+      out.string(entry->data_type_title);
+    else
+      out.null();
+    out.key("compressed").boolean(entry->compressed);
+    if (entry->sub_header)
+      out.key("uncompressed_length").number(entry->uncompressed_length)
+         .key("uncompressed_length_64").boolean(entry->uncompressed_length_64);
+    out.end_object();
+  }
+  out.end_array();
+}
+
+/* Write data to dest on this side of the socket */
+bool
+write_file(const string &dest, const char *data, size_t length, string &error)
+{
+  int dest_fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY, 0644);
+  if (dest_fd < 0) {
+    error = string("cannot create ") + dest + ": " + strerror(errno);
+    return false;
+  }
+  if (!write_fd(dest_fd, data, length)) {
+    error = string("cannot write ") + dest + ": " + strerror(errno);
+    close(dest_fd);
+    return false;
+  }
+  if (close(dest_fd) < 0) {
+    error = string("cannot write ") + dest + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void
+report_stats(ros_writer &out)
+{
+  struct request_metrics copy[COMMAND_COUNT];
+  uint64_t refused;
+  {
+    lock_guard<mutex> guard(metrics_lock);
+    memcpy(copy, metrics, sizeof(copy));
+    refused = connections_refused;
+  }
+
+  out.key("requests").begin_object();
+  for (unsigned c = 0; c < COMMAND_COUNT; ++c) {
+    const struct request_metrics &m = copy[c];
+    out.key(command_names[c]).begin_object()
+       .key("count").number(m.count)
+       .key("errors").number(m.errors)
+       .key("mean_us").number(m.count ? m.total_ns / m.count / 1000 : 0)
+       .key("p50_us").number(min(latency_percentile(m, 0.50), m.max_ns / 1000))
+       .key("p99_us").number(min(latency_percentile(m, 0.99), m.max_ns / 1000))
+       .key("max_us").number(m.max_ns / 1000)
+       .end_object();
+  }
+  out.end_object();
+
+  uint64_t items, cost, hits, misses;
+  archive_cache->counts(items, cost, hits, misses);
+  out.key("archives").begin_object()
+     .key("cached").number(items)
+     .key("hits").number(hits)
+     .key("misses").number(misses)
+     .end_object();
+  entry_cache->counts(items, cost, hits, misses);
+  out.key("uncompressed").begin_object()
+     .key("cached").number(items)
+     .key("bytes").number(cost)
+     .key("hits").number(hits)
+     .key("misses").number(misses)
+     .end_object();
+  out.key("workers").number(jobs)
+     .key("connections_refused").number(refused);
+}
+
+/* Uncompress an entry straight into dest, for one too big to hold in memory */
+bool
+uncompress_file(struct worker_state &state, const rospack_archive *archive, unsigned index, const string &dest,
+                size_t &length, string &error)
+{
+  struct file_output output;
+  output.fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY, 0644);
+  output.length = 0;
+  output.error = 0;
+  if (output.fd < 0) {
+    error = string("cannot create ") + dest + ": " + strerror(errno);
+    return false;
+  }
+  int result = rospack_decode(state.decoder, archive, index, write_output, &output);
+  if (close(output.fd) < 0 && !output.error)
+    output.error = errno;
+  if (output.error)
+    error = string("cannot write ") + dest + ": " + strerror(output.error);
+  else if (result != ROSPACK_OK)
+    error = rospack_strerror(result);
+  length = output.length;
+  return error.empty();
+}
+
+/* Answer one request with a JSON line, followed by the data of an inline
+ * extract or uncompress. Returns false if the connection is no longer usable.
+ */
+bool
+serve_request(struct worker_state &state, ros_writer &out, int fd, const char *line)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<string> words;
+  for (const char *p = line; *p; ) {
+    while (*p == ' ' || *p == '\t')
+      ++p;
+    const char *word = p;
+    while (*p && *p != ' ' && *p != '\t')
+      ++p;
+    if (p > word)
+      words.push_back(string(word, p - word));
+  }
+  if (words.empty())
+    return true;
+
+  unsigned command = 0;
+  while (command < COMMAND_COUNT && words[0] != command_names[command])
+    ++command;
+
+  out.begin_object();
+  if (command < COMMAND_COUNT)
+    out.key("command").string(command_names[command]);
+
+  string error;
+  int result = ROSPACK_OK;
+  bool cached = false;
+  archive_ref archive;
+  entry_ref decoded;                // both keep inline data alive until it is sent
+  const char *data = NULL;
+  size_t length = 0;
+  bool send_data = false;
+  bool written = false;             // already uncompressed into DEST
+  unsigned want = command == COMMAND_STATS ? 1 : command == COMMAND_LIST || command == COMMAND_VERIFY ? 2 : 3;
+
+  if (command == COMMAND_COUNT)
+    error = "unknown request: " + words[0];
+  else if (words.size() < want || words.size() > (want == 3 ? 4 : want))
+    error = string("wrong number of arguments for ") + command_names[command];
+  else if (command == COMMAND_STATS)
+    report_stats(out);
+  else if (words[1][0] != '/' || (words.size() > 3 && words[3][0] != '/'))
+    error = "paths must be absolute";   // the daemon's working directory is not the client's
+  else {
+    const string &path = words[1];
+    result = open_archive(path, archive, cached);
+    if (result == ROSPACK_OK)
+      reading = archive.get();
+    if (result != ROSPACK_OK)
+      error = path + ": " + rospack_strerror(result);
+    else if (command == COMMAND_LIST) {
+      out.key("file").string(path.c_str());
+      list_archive(out, archive->archive);
+    }
+    else if (command == COMMAND_VERIFY) {
+      cached = false;               // of the checksum, rather than the archive
+      {
+        lock_guard<mutex> guard(archive->verify_lock);
+        if (!archive->verified) {
+          archive->verify_result = rospack_verify(archive->archive, &archive->calculated);
+          archive->verified = true;
+        }
+        else
+          cached = true;
+      }
+      const struct rospack_header *header = rospack_header(archive->archive);
+      if (archive->shrunk)
+        error = path + ": " + shrunk_error;
+      else {
+        out.key("file").string(path.c_str())
+           .key("stored").number(header->version > 1 ? header->inner_checksum : header->payload_checksum)
+           .key("calculated").number(archive->calculated)
+           .key("match").boolean(archive->verify_result == ROSPACK_OK);
+        if (archive->verify_result == ROSPACK_ERR_TRUNCATED)
+          error = rospack_strerror(archive->verify_result);
+      }
+    }
+    else {
+      int index = find_entry(archive->archive, words[2]);
+      const string dest = words.size() > 3 ? words[3] : string();
+
+      if (index < 0)
+        error = "no such entry: " + words[2];
+      else if (command == COMMAND_EXTRACT) {
+        const void *span;
+        result = rospack_entry_data(archive->archive, index, &span, &length);
+        if (result != ROSPACK_OK)
+          error = rospack_strerror(result);
+        data = static_cast<const char *>(span);
+        touch_pages(data, length);  // it is sent straight from the mapping
+      }
+      else {
+        struct entry_key key;
+        key.file = archive->identity;
+        key.index = index;
+        const struct rospack_entry *entry = rospack_entry(archive->archive, index);
+        // only a sub-header says the data fits in memory; with a DEST anything else is written as it is decoded
+        const bool fits = entry->sub_header && entry->uncompressed_length <= decoded_max;
+        if (!(cached = entry_cache->find(key, decoded))) {
+          try {
+            if (!fits && !dest.empty())
+              written = uncompress_file(state, archive->archive, index, dest, length, error);
+            else {
+              shared_ptr<vector<char> > output = make_shared<vector<char> >();
+              if (fits && entry->uncompressed_length <= entry_cache_budget)
+                output->reserve(entry->uncompressed_length);
+              struct capped_output capped = { output.get(), decoded_max, false };
+              result = rospack_decode(state.decoder, archive->archive, index, append_capped, &capped);
+              if (capped.over)
+                error = "uncompressed data over " + to_string(decoded_max) + " bytes: give a DEST to write it to";
+              else if (result != ROSPACK_OK)
+                error = rospack_strerror(result);
+              else {
+                decoded = output;
+                if (!archive->shrunk)
+                  entry_cache->insert(key, decoded, output->size());
+              }
+            }
+          }
+          catch (const bad_alloc &) {
+            decoded.reset();
+            error = rospack_strerror(ROSPACK_ERR_NOMEM);
+          }
+        }
+        if (decoded) {
+          data = decoded->data();
+          length = decoded->size();
+        }
+      }
+
+      if (archive->shrunk) {
+        decoded.reset();
+        error = path + ": " + shrunk_error;
+      }
+      if (error.empty()) {
+        out.key("file").string(path.c_str())
+           .key("entry").string(rospack_entry(archive->archive, index)->filename)
+           .key("length").number(length);
+        if (dest.empty())
+          send_data = true;         // the data follows the response
+        else if (written || write_file(dest, data, length, error))
+          out.key("dest").string(dest.c_str());
+      }
+    }
+    if (error.empty())
+      out.key("cached").boolean(cached);
+  }
+  reading = nullptr;
+
+  out.key("ok").boolean(error.empty());
+  if (!error.empty())
+    out.key("error").string(error.c_str());
+  else if (send_data)
+    out.key("inline").boolean(true);
+  out.key("us").number(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count())
+     .end_object()
+     .end_record();
+  bool ok = out.flush() && (!send_data || write_all(fd, data, length));
+
+  if (command < COMMAND_COUNT)
+    record_latency(static_cast<enum request_command>(command), error.empty(),
+                   chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+  return ok;
+}
+
+/* Requests on one connection until the client closes it or falls idle */
+void
+serve_connection(struct worker_state &state, int fd)
+{
+  struct timeval idle;
+  idle.tv_sec = idle_seconds;
+  idle.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+
+  ros_writer out(fd, 64 * 1024);
+  vector<char> &line = state.line;
+  char buffer[4096];
+  line.clear();
+
+  for (;;) {
+    ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      return;
+
+    for (ssize_t i = 0; i < length; ++i) {
+      if (buffer[i] != '\n') {
+        if (buffer[i] != '\r')
+          line.push_back(buffer[i]);
+        if (line.size() > request_max) {
+          out.begin_object().key("ok").boolean(false).key("error").string("request too long").end_object().end_record();
+          out.flush();
+          return;
+        }
+        continue;
+      }
+      line.push_back('\0');
+      bool usable = serve_request(state, out, fd, line.data());
+      line.clear();
+      if (!usable)
+        return;
+    }
+  }
+}
+
+void
+worker()
+{
+  struct worker_state state;
+  state.decoder = rospack_decoder_new(memory_budget);
+  if (!state.decoder) {
+    cerr << "Error: cannot create a decoder" << endl;
+    exit(1);
+  }
+
+  for (;;) {
+    int fd = connections.pop();
+    serve_connection(state, fd);
+    close(fd);
+  }
+}
+
+void
+stop(int signal_number)
+{
+  unlink(socket_path);
+  _exit(0);
+}
+
+/* Listen on path, replacing a socket left behind by a daemon that is no
+ * longer running but not one that still answers
+ */
+int
+listen_socket(const char *path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    cerr << "Error: socket path too long: " << path << endl;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    cerr << "Error: cannot create socket: " << strerror(errno) << endl;
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0) {
+    cerr << "Error: another daemon is listening on " << path << endl;
+    close(fd);
+    return -1;
+  }
+  unlink(path);
+
+  // requests read and write files as this user, so only this user may make them
+  mode_t mask = umask(0177);
+  int bound = bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+  umask(mask);
+  if (bound < 0 || listen(fd, 128) < 0) {
+    cerr << "Error: cannot listen on " << path << ": " << strerror(errno) << endl;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int
+main(int argc, char **argv, char **env)
+{
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  if (runtime && *runtime)
+    snprintf(socket_path, sizeof(socket_path), "%s/rosd.sock", runtime);
+  else
+    snprintf(socket_path, sizeof(socket_path), "/tmp/rosd-%u.sock", static_cast<unsigned>(getuid()));
+
+  for (unsigned i = 1; i < static_cast<unsigned>(argc); ++i) {
+    char *end;
+    if (strncmp(argv[i], switch_help, 3) == 0) {
+      usage(argv[0]);
+      return 0;
+    }
+    else if (strncmp(argv[i], switch_socket, strlen(switch_socket)) == 0) {
+      const char *path = argv[i] + strlen(switch_socket);
+      if (strlen(path) >= sizeof(socket_path)) {
+        cerr << "Error: socket path too long: " << path << endl;
+        return 1;
+      }
+      strcpy(socket_path, path);
+    }
+    else if (strncmp(argv[i], switch_jobs, strlen(switch_jobs)) == 0) {
+      jobs = strtoul(argv[i] + strlen(switch_jobs), &end, 10);
+      if (*end || jobs < 1) {
+        cerr << "Error: invalid number of jobs: " << argv[i] + strlen(switch_jobs) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_queue, strlen(switch_queue)) == 0) {
+      queue_max = strtoul(argv[i] + strlen(switch_queue), &end, 10);
+      if (*end) {
+        cerr << "Error: invalid queue length: " << argv[i] + strlen(switch_queue) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_cache, strlen(switch_cache)) == 0) {
+      const char *size = argv[i] + strlen(switch_cache);
+      entry_cache_budget = ros_parse_size(size);
+      if (!entry_cache_budget && strcmp(size, "0") != 0) {
+        cerr << "Error: invalid cache size: " << size << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_archives, strlen(switch_archives)) == 0) {
+      archive_cache_max = strtoul(argv[i] + strlen(switch_archives), &end, 10);
+      if (*end) {
+        cerr << "Error: invalid number of archives: " << argv[i] + strlen(switch_archives) << endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], switch_memory, strlen(switch_memory)) == 0) {
+      memory_budget = ros_parse_size(argv[i] + strlen(switch_memory));
+      if (!memory_budget) {
+        cerr << "Error: invalid memory budget: " << argv[i] + strlen(switch_memory) << endl;
+        return 1;
+      }
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!jobs)
+    jobs = thread::hardware_concurrency() ? thread::hardware_concurrency() : 1;
+
+  archive_cache = new lru_cache<struct file_identity, archive_ref>(archive_cache_max);
+  entry_cache = new lru_cache<struct entry_key, entry_ref>(entry_cache_budget);
+
+  int listener = listen_socket(socket_path);
+  if (listener < 0)
+    return 1;
+  signal(SIGPIPE, SIG_IGN);
+  page_size = sysconf(_SC_PAGESIZE);
+  struct sigaction bus;
+  memset(&bus, 0, sizeof(bus));
+  bus.sa_sigaction = bus_error;
+  bus.sa_flags = SA_SIGINFO;
+  sigaction(SIGBUS, &bus, nullptr);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  for (unsigned i = 0; i < jobs; ++i)
+    thread(worker).detach();
+  cerr << "Listening on " << socket_path << " with " << jobs << " workers" << endl;
+
+  for (;;) {
+    int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EINTR && errno != ECONNABORTED)
+        cerr << "Error: accept: " << strerror(errno) << endl;
+      continue;
+    }
+    if (!connections.push(fd)) {
+      static const char busy[] = "{\"ok\":false,\"error\":\"busy\"}\n";
+      write_all(fd, busy, sizeof(busy) - 1);
+      close(fd);
+      lock_guard<mutex> guard(metrics_lock);
+      ++connections_refused;
+    }
+  }
+}
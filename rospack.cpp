@@ -0,0 +1,363 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * librospack: C interface for reading ROS PACK firmware archives.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <new>
+#include <vector>
+#include "rospack.h"
+#include "ros_archive.hpp"
+#include "ros_devices.hpp"
+#include "ros_lzma.hpp"
+#include "ros_sigs.hpp"
+
+struct rospack_archive {
+  const char *data;             // the whole archive
+  size_t length;
+  void *mapping;                // when the library mapped it
+  ros_archive archive;
+  struct rospack_header header;
+  std::vector<struct rospack_entry> entries;
+};
+
+struct rospack_decoder {
+  ros_decoder decoder;
+  uint64_t memlimit;
+  uint8_t *buffer;
+  size_t size;
+};
+
+static const size_t decode_buffer_size = 1024 * 1024;
+static const uint64_t probe_length = 1024 * 1024;  // of entry data, as the pipeline's first chunk
+
+/* Built once, then only read */
+static const ros_sig_db &
+signatures()
+{
+  static const ros_sig_db sigs;
+  return sigs;
+}
+
+static void
+copy_chars(char *to, const char *from, size_t length)
+{
+  size_t n = strnlen(from, length);
+  memcpy(to, from, n);
+  to[n] = '\0';
+}
+
+static void
+copy_time(struct rospack_time &to, const struct ros_header_timestamp &from, unsigned year)
+{
+  to.year = year;
+  to.month = from.link_month;
+  to.day = from.link_day;
+  to.hour = from.link_hour;
+  to.minute = from.link_minute;
+  to.second = from.link_second;
+}
+
+static int
+parse(struct rospack_archive *a)
+{
+  ros_archive &archive = a->archive;
+  switch (archive.parse_header(a->data, a->length, a->length)) {
+    case ROS_ARCHIVE_OK:
+      break;
+    case ROS_ARCHIVE_SHORT_HEADER:
+      return ROSPACK_ERR_SHORT;
+    default:
+      return ROSPACK_ERR_VERSION;
+  }
+  if (archive.directory_offset() > a->length ||
+      archive.load_directory(a->data + archive.directory_offset(), a->length - archive.directory_offset()) != ROS_ARCHIVE_OK)
+    return ROSPACK_ERR_DIRECTORY;
+
+  const struct ros_archive_header &info = archive.header();
+  struct rospack_header &h = a->header;
+  memset(&h, 0, sizeof(h));
+  h.version = info.version;
+  h.length = info.length;
+  h.big_endian = info.order == ROS_BIG_ENDIAN;
+  copy_chars(h.arc_magic, info.arc.arc_magic, sizeof info.arc.arc_magic);
+  copy_chars(h.arc_index, info.arc.arc_index, sizeof info.arc.arc_index);
+  copy_chars(h.signature, info.signature.signature, sizeof info.signature.signature);
+  copy_time(h.link, info.timestamp, info.timestamp.link_year);
+  h.entries = info.dir_entries_qty;
+  h.payload_length = info.payload.length;
+  h.payload_checksum = info.payload.checksum;
+  if (info.version > 1) {
+    h.inner_length = info.payload_inner.length;
+    h.inner_checksum = info.payload_inner.checksum;
+    h.header_checksum = info.header_checksum.checksum;
+    h.header_checksum_calculated = archive.header_checksum();
+    copy_chars(h.firmware_version, info.firmware_version, sizeof info.firmware_version);
+  }
+  const struct ros_device *device = ros_device_identify(info.arc.arc_magic, info.arc.arc_index,
+                                                        info.version > 1 ? info.firmware_version : nullptr,
+                                                        sizeof info.firmware_version);
+  if (device) {
+    h.manufacturer = device->manufacturer;
+    h.model = device->model[0] ? device->model : nullptr;
+  }
+
+  a->entries.resize(archive.entry_count());
+  for (unsigned i = 0; i < archive.entry_count(); ++i) {
+    struct ros_entry &entry = archive.entries()[i];
+    struct rospack_entry &e = a->entries[i];
+    memset(&e, 0, sizeof(e));
+
+    uint64_t offset = entry.dirent.offset < a->length ? entry.dirent.offset : a->length;
+    uint64_t held = a->length - offset < entry.dirent.length ? a->length - offset : entry.dirent.length;
+    unsigned skip = probe_entry(entry, signatures(), info.order, info.arc.arc_magic, a->data + offset,
+                                held < probe_length ? held : probe_length);
+
+    e.index = i;
+    copy_chars(e.filename, entry.dirent.filename, sizeof entry.dirent.filename);
+    e.offset = entry.dirent.offset;
+    e.length = entry.dirent.length;
+    e.unknown1 = entry.dirent.unknown1;
+    e.unknown2 = entry.dirent.unknown2;
+    e.sub_header = entry.sub_header;
+    if (entry.sub_header) {
+      copy_chars(e.arc_index, entry.arc_header.version.arc_index, sizeof entry.arc_header.version.arc_index);
+      e.uncompressed_length = entry.uncompressed_length;
+      e.uncompressed_length_64 = entry.uncompressed_length_64;
+      copy_time(e.link, entry.arc_header.timestamp, entry.link_year);
+    }
+    e.data_offset = offset + skip;
+    e.data_length = held - skip;
+    e.truncated = held < entry.dirent.length;
+    e.data_type = entry.data_sig;
+    e.data_type_title = signatures().title(entry.data_sig);
+    e.compressed = ros_sig_db::decodable(entry.data_sig);
+  }
+  return ROSPACK_OK;
+}
+
+int
+rospack_open_memory(const void *data, size_t length, rospack_archive **archive)
+{
+  struct rospack_archive *a = new (std::nothrow) struct rospack_archive;
+  if (!a)
+    return ROSPACK_ERR_NOMEM;
+  a->data = static_cast<const char *>(data);
+  a->length = length;
+  a->mapping = nullptr;
+  int ret = parse(a);
+  if (ret != ROSPACK_OK) {
+    delete a;
+    return ret;
+  }
+  *archive = a;
+  return ROSPACK_OK;
+}
+
+int
+rospack_open_fd(int fd, rospack_archive **archive)
+{
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return ROSPACK_ERR_IO;
+  if (st.st_size == 0)
+    return ROSPACK_ERR_SHORT;
+  void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED)
+    return ROSPACK_ERR_IO;
+  madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+  int ret = rospack_open_memory(mapping, st.st_size, archive);
+  if (ret != ROSPACK_OK) {
+    munmap(mapping, st.st_size);
+    return ret;
+  }
+  (*archive)->mapping = mapping;
+  return ROSPACK_OK;
+}
+
+int
+rospack_open_path(const char *path, rospack_archive **archive)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return ROSPACK_ERR_IO;
+  int ret = rospack_open_fd(fd, archive);
+  close(fd);  // the mapping stays
+  return ret;
+}
+
+void
+rospack_close(rospack_archive *archive)
+{
+  if (!archive)
+    return;
+  if (archive->mapping)
+    munmap(archive->mapping, archive->length);
+  delete archive;
+}
+
+const struct rospack_header *
+rospack_header(const rospack_archive *archive)
+{
+  return &archive->header;
+}
+
+unsigned
+rospack_entry_count(const rospack_archive *archive)
+{
+  return archive->entries.size();
+}
+
+const struct rospack_entry *
+rospack_entry(const rospack_archive *archive, unsigned index)
+{
+  return index < archive->entries.size() ? &archive->entries[index] : nullptr;
+}
+
+int
+rospack_entry_data(const rospack_archive *archive, unsigned index, const void **data, size_t *length)
+{
+  if (index >= archive->entries.size())
+    return ROSPACK_ERR_RANGE;
+  const struct rospack_entry &e = archive->entries[index];
+  *data = archive->data + e.data_offset;
+  *length = e.data_length;
+  return e.truncated ? ROSPACK_ERR_TRUNCATED : ROSPACK_OK;
+}
+
+int
+rospack_foreach_entry(const rospack_archive *archive, rospack_entry_fn fn, void *user)
+{
+  for (unsigned i = 0; i < archive->entries.size(); ++i) {
+    const struct rospack_entry &e = archive->entries[i];
+    int ret = fn(user, &e, archive->data + e.data_offset, e.data_length);
+    if (ret)
+      return ret;
+  }
+  return ROSPACK_OK;
+}
+
+int
+rospack_verify(const rospack_archive *archive, uint32_t *calculated)
+{
+  unsigned int checksum = archive->archive.directory_checksum();
+  bool truncated = false;
+  for (unsigned i = 0; i < archive->entries.size(); ++i) {
+    // the sub-header counts as payload
+    const struct rospack_entry &e = archive->entries[i];
+    uint64_t skip = e.data_offset - (e.offset < archive->length ? e.offset : archive->length);
+    checksum = checksum_calc(checksum, archive->data + e.data_offset - skip, e.data_length + skip);
+    truncated |= e.truncated;
+  }
+  if (calculated)
+    *calculated = checksum;
+  if (truncated)
+    return ROSPACK_ERR_TRUNCATED;
+  return checksum == archive->archive.payload().checksum ? ROSPACK_OK : ROSPACK_ERR_CHECKSUM;
+}
+
+rospack_decoder *
+rospack_decoder_new(uint64_t memlimit)
+{
+  struct rospack_decoder *d = new (std::nothrow) struct rospack_decoder;
+  if (!d)
+    return nullptr;
+  d->memlimit = memlimit ? memlimit : ros_lzma_default_budget();
+  d->size = decode_buffer_size;
+  d->buffer = new (std::nothrow) uint8_t[d->size];
+  if (!d->buffer) {
+    delete d;
+    return nullptr;
+  }
+  return d;
+}
+
+void
+rospack_decoder_free(rospack_decoder *decoder)
+{
+  if (!decoder)
+    return;
+  delete[] decoder->buffer;
+  delete decoder;
+}
+
+int
+rospack_decode(rospack_decoder *decoder, const rospack_archive *archive, unsigned index,
+               rospack_output_fn fn, void *user)
+{
+  if (index >= archive->entries.size())
+    return ROSPACK_ERR_RANGE;
+  const struct rospack_entry &e = archive->entries[index];
+  if (!e.compressed)
+    return ROSPACK_ERR_TYPE;
+  if (!decoder->decoder.begin(decoder->memlimit))
+    return ROSPACK_ERR_NOMEM;
+
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(archive->data + e.data_offset);
+  size_t in_length = e.data_length;
+  int ret = ROSPACK_OK;
+  for (;;) {
+    uint8_t *out = decoder->buffer;
+    size_t out_length = decoder->size;
+    lzma_ret status = decoder->decoder.decode(in, in_length, out, out_length, true);
+    size_t produced = decoder->size - out_length;
+    if (produced && (ret = fn(user, decoder->buffer, produced)) != 0)
+      break;
+    if (status == LZMA_STREAM_END)
+      break;
+    if (status == LZMA_MEMLIMIT_ERROR) {
+      ret = ROSPACK_ERR_MEMLIMIT;
+      break;
+    }
+    if (status != LZMA_OK) {
+      ret = e.truncated && status == LZMA_BUF_ERROR ? ROSPACK_ERR_TRUNCATED : ROSPACK_ERR_DECODE;
+      break;
+    }
+  }
+  decoder->decoder.end();
+  return ret;
+}
+
+const char *
+rospack_strerror(int error)
+{
+  switch (error) {
+    case ROSPACK_OK:              return "success";
+    case ROSPACK_ERR_IO:          return "cannot open or map the archive";
+    case ROSPACK_ERR_SHORT:       return "the archive is too short to hold a header";
+    case ROSPACK_ERR_VERSION:     return "unknown header version";
+    case ROSPACK_ERR_DIRECTORY:   return "the directory runs past the end of the archive";
+    case ROSPACK_ERR_TRUNCATED:   return "an entry runs past the end of the archive";
+    case ROSPACK_ERR_CHECKSUM:    return "the payload checksum does not match";
+    case ROSPACK_ERR_RANGE:       return "no such entry";
+    case ROSPACK_ERR_TYPE:        return "the entry is not compressed in a known way";
+    case ROSPACK_ERR_MEMLIMIT:    return "the decoder needs more memory than its limit";
+    case ROSPACK_ERR_DECODE:      return "the compressed data is corrupt";
+    case ROSPACK_ERR_NOMEM:       return "out of memory";
+  }
+  return "unknown error";
+}
@@ -0,0 +1,149 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * librospack: C interface for reading ROS PACK firmware archives.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#if !defined __ROSPACK_H__
+#define __ROSPACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/* An archive is opened from a path or a file descriptor, which are mapped
+ * into memory, or from memory the caller already holds. Everything about
+ * it is parsed when it is opened; after that an archive is only read, so
+ * it may be used from any number of threads at once. Entry data is handed
+ * out as spans of the mapped file, never copied.
+ *
+ * A decoder uncompresses one entry at a time and may be reused for any
+ * number of entries and archives without allocating again; each thread
+ * uses its own. The library keeps no other state.
+ *
+ * Functions returning int return ROSPACK_OK or a negative enum rospack_error.
+ */
+typedef struct rospack_archive rospack_archive;
+typedef struct rospack_decoder rospack_decoder;
+
+enum rospack_error {
+  ROSPACK_OK = 0,
+  ROSPACK_ERR_IO = -1,          /* opening, examining or mapping the file failed */
+  ROSPACK_ERR_SHORT = -2,       /* not even the header version is there */
+  ROSPACK_ERR_VERSION = -3,     /* unknown header version */
+  ROSPACK_ERR_DIRECTORY = -4,   /* the directory runs past the end of the archive */
+  ROSPACK_ERR_TRUNCATED = -5,   /* an entry runs past the end of the archive */
+  ROSPACK_ERR_CHECKSUM = -6,    /* the payload checksum does not match */
+  ROSPACK_ERR_RANGE = -7,       /* no such entry */
+  ROSPACK_ERR_TYPE = -8,        /* the entry is not compressed in a known way */
+  ROSPACK_ERR_MEMLIMIT = -9,    /* the decoder needs more than its memory limit */
+  ROSPACK_ERR_DECODE = -10,     /* the compressed data is corrupt */
+  ROSPACK_ERR_NOMEM = -11
+};
+
+struct rospack_time {
+  unsigned year, month, day;
+  unsigned hour, minute, second;
+};
+
+struct rospack_header {
+  unsigned version;             /* 1 or 2 */
+  unsigned length;              /* of the primary header */
+  int big_endian;
+  char arc_magic[5];            /* NUL terminated */
+  char arc_index[5];
+  char signature[5];
+  struct rospack_time link;
+  unsigned entries;
+  uint32_t payload_length;      /* v1, the outer payload of v2 */
+  uint32_t payload_checksum;
+  uint32_t inner_length;        /* v2 */
+  uint32_t inner_checksum;
+  uint32_t header_checksum;     /* v2: as stored */
+  uint32_t header_checksum_calculated;
+  char firmware_version[17];    /* v2 */
+  const char *manufacturer;     /* of the device identified from known_devices.csv, or NULL */
+  const char *model;            /* NULL as well when the header does not single out the model */
+};
+
+struct rospack_entry {
+  unsigned index;
+  char filename[17];            /* NUL terminated */
+  uint64_t offset;              /* of the entry in the archive */
+  uint64_t length;
+  uint32_t unknown1, unknown2;
+  int sub_header;               /* the data is preceded by an ARC sub-header */
+  char arc_index[5];            /* of the sub-header */
+  uint64_t uncompressed_length; /* from the sub-header */
+  int uncompressed_length_64;   /* which stores it in 64 bits */
+  struct rospack_time link;     /* from the sub-header */
+  uint64_t data_offset;         /* of the data in the archive, after any sub-header */
+  uint64_t data_length;         /* as much as the archive holds */
+  int truncated;                /* the archive ends before the entry does */
+  int data_type;                /* -1 if not recognised */
+  const char *data_type_title;  /* NULL if not recognised */
+  int compressed;               /* rospack_decode() can uncompress it */
+};
+
+/* Called with entries and decoded data; a non-zero return stops the
+ * iteration or decoding and is returned from the function that called it
+ */
+typedef int (*rospack_entry_fn)(void *user, const struct rospack_entry *entry, const void *data, size_t length);
+typedef int (*rospack_output_fn)(void *user, const void *data, size_t length);
+
+int rospack_open_path(const char *path, rospack_archive **archive);
+int rospack_open_fd(int fd, rospack_archive **archive);   /* the descriptor stays the caller's */
+int rospack_open_memory(const void *data, size_t length, rospack_archive **archive); /* kept until closed */
+void rospack_close(rospack_archive *archive);
+
+const struct rospack_header *rospack_header(const rospack_archive *archive);
+unsigned rospack_entry_count(const rospack_archive *archive);
+const struct rospack_entry *rospack_entry(const rospack_archive *archive, unsigned index);
+
+/* The data of an entry after any sub-header, in place */
+int rospack_entry_data(const rospack_archive *archive, unsigned index, const void **data, size_t *length);
+
+/* Each entry in directory order with its data */
+int rospack_foreach_entry(const rospack_archive *archive, rospack_entry_fn fn, void *user);
+
+/* Calculate the payload checksum into *calculated (may be NULL) and
+ * compare it with the one in the header
+ */
+int rospack_verify(const rospack_archive *archive, uint32_t *calculated);
+
+/* memlimit 0 for a quarter of physical memory */
+rospack_decoder *rospack_decoder_new(uint64_t memlimit);
+void rospack_decoder_free(rospack_decoder *decoder);
+
+/* Uncompress an entry, passing the output to fn as it is produced */
+int rospack_decode(rospack_decoder *decoder, const rospack_archive *archive, unsigned index,
+                   rospack_output_fn fn, void *user);
+
+const char *rospack_strerror(int error);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,271 @@
+/* VxWorks ROS Firmware Toolkit
+ * (c) Copyright 2015 TJ <hacker@iam.tj>
+ * https://github.com/iam-TJ/ros_pack
+ *
+ * Checks that ros_unpack --extract-to writes each entry as --extract does.
+ *
+ * Licensed on the terms of the GMU General Public License version 2
+ * contained in the file COPYRIGHT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+// Usage: extract_to ROS_UNPACK
+// Writes a small archive with a stored entry and an LZMA entry behind an ARC
+// sub-header, then extracts it with --extract and with --extract-to=tar:,
+// with and without the switches that decode the LZMA entries for analysis,
+// and compares every tar member with the file --extract wrote. A truncated
+// copy of the archive must fail to extract.
+
+#include <lzma.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "../ros_pack.hpp"
+
+using namespace std;
+
+static const char arc_magic[] = "NG01";
+
+struct test_entry {
+  const char *name;
+  vector<char> data;    // as stored
+};
+
+unsigned int
+byte_sum(const char *data, size_t length)
+{
+  unsigned int sum = 0;
+  for (size_t i = 0; i < length; ++i)
+    sum += static_cast<unsigned char>(data[i]);
+  return sum;
+}
+
+struct ros_header_timestamp
+link_time()
+{
+  struct ros_header_timestamp timestamp;
+  memset(&timestamp, 0, sizeof(timestamp));
+  timestamp.link_second = 1;
+  timestamp.link_minute = 2;
+  timestamp.link_hour = 11;
+  timestamp.link_day = 4;
+  timestamp.link_month = 5;
+  timestamp.link_year = 2014;
+  return timestamp;
+}
+
+/* data in the .lzma format, behind an ARC sub-header that records its length */
+vector<char>
+lzma_entry(const string &data)
+{
+  struct ros_arc_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.version.arc_magic, arc_magic, 4);
+  memcpy(header.version.arc_index, "2.00", 4);
+  header.timestamp = link_time();
+  header.uncompressed_length = data.size();
+
+  vector<char> entry(reinterpret_cast<const char *>(&header), reinterpret_cast<const char *>(&header) + sizeof(header));
+  lzma_stream strm = LZMA_STREAM_INIT;
+  lzma_options_lzma options;
+  lzma_lzma_preset(&options, 4);
+  if (lzma_alone_encoder(&strm, &options) != LZMA_OK)
+    return vector<char>();
+  vector<uint8_t> encoded(data.size() + data.size() / 2 + 4096);
+  strm.next_in = reinterpret_cast<const uint8_t *>(data.data());
+  strm.avail_in = data.size();
+  strm.next_out = encoded.data();
+  strm.avail_out = encoded.size();
+  lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+  size_t length = encoded.size() - strm.avail_out;
+  lzma_end(&strm);
+  if (ret != LZMA_STREAM_END)
+    return vector<char>();
+  entry.insert(entry.end(), encoded.begin(), encoded.begin() + length);
+  return entry;
+}
+
+bool
+write_archive(const string &path, const vector<struct test_entry> &entries)
+{
+  vector<char> payload;
+  unsigned int offset = sizeof(struct ros_header_v2) + entries.size() * sizeof(struct ros_dirent);
+  for (unsigned i = 0; i < entries.size(); ++i) {
+    struct ros_dirent dirent;
+    memset(&dirent, 0, sizeof(dirent));
+    strncpy(dirent.filename, entries[i].name, sizeof(dirent.filename));
+    dirent.offset = offset;
+    dirent.length = entries[i].data.size();
+    payload.insert(payload.end(), reinterpret_cast<const char *>(&dirent), reinterpret_cast<const char *>(&dirent) + sizeof(dirent));
+    offset += dirent.length;
+  }
+  for (unsigned i = 0; i < entries.size(); ++i)
+    payload.insert(payload.end(), entries[i].data.begin(), entries[i].data.end());
+
+  struct ros_header_v2 header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.version.arc_magic, arc_magic, 4);
+  memcpy(header.version.arc_index, "2.00", 4);
+  header.header_checksum.length = sizeof(header);
+  header.payload_checksum_v1.length = payload.size();
+  header.payload_checksum_v1.checksum = byte_sum(payload.data(), payload.size());
+  memcpy(header.signature.signature, "PACK", 4);
+  header.directory.dir_entries_qty = entries.size();
+  header.timestamp = link_time();
+  header.payload_checksum_v2 = header.payload_checksum_v1;
+  strncpy(header.firmware_version, "5.2.0.11", sizeof(header.firmware_version));
+  header.header_checksum.checksum = 0xFFFFFFFF - byte_sum(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  ofstream out(path.c_str(), ios::binary);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(payload.data(), payload.size());
+  return out.good();
+}
+
+bool
+read_file(const string &path, vector<char> &data)
+{
+  ifstream in(path.c_str(), ios::binary);
+  if (!in)
+    return false;
+  data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  return true;
+}
+
+/* The ustar members of a tar file by name; false if it is not well formed */
+bool
+read_tar(const string &path, vector<string> &names, vector<vector<char> > &members)
+{
+  vector<char> tar;
+  if (!read_file(path, tar))
+    return false;
+  for (size_t at = 0; at + 512 <= tar.size(); ) {
+    const char *block = tar.data() + at;
+    if (!block[0])
+      return true;  // the end-of-archive marker
+    if (memcmp(block + 257, "ustar", 5) != 0)
+      return false;
+    string size_field(block + 124, 11);
+    uint64_t size = strtoull(size_field.c_str(), nullptr, 8);
+    at += 512;
+    if (at + size > tar.size())
+      return false;
+    names.push_back(string(block, strnlen(block, 100)));
+    members.push_back(vector<char>(tar.begin() + at, tar.begin() + at + size));
+    at += (size + 511) / 512 * 512;
+  }
+  return false;
+}
+
+int
+run(const string &command)
+{
+  int status = system((command + " >/dev/null").c_str());
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " ROS_UNPACK" << endl;
+    return 2;
+  }
+  char *unpack = realpath(argv[1], nullptr);
+  char work_template[] = "/tmp/ros_extract_to.XXXXXX";
+  const char *work = mkdtemp(work_template);
+  if (!unpack || !work || chdir(work) != 0) {
+    cerr << "Error: cannot set up the work directory" << endl;
+    return 2;
+  }
+
+  string text;
+  for (unsigned i = 0; i < 20000; ++i)
+    text += "line " + to_string(i) + " of some vxworks image text\n";
+  vector<struct test_entry> entries(3);
+  entries[0].name = "DATETIME_C";
+  string stamp = "2014-05-04 11:01:59 build\n";
+  entries[0].data.assign(stamp.begin(), stamp.end());
+  entries[1].name = "RSCODE";
+  entries[1].data = lzma_entry(text);
+  entries[2].name = "CLI_FILE";
+  entries[2].data = lzma_entry(string("configure\nexit\n") + text.substr(0, 600));
+  if (entries[1].data.empty() || entries[2].data.empty() || !write_archive("test.ros", entries)) {
+    cerr << "Error: cannot write the test archive" << endl;
+    return 2;
+  }
+
+  int failures = 0;
+  const char *modes[] = { "", "--carve", "--strings", "--entropy", "--digests", "--uncompress" };
+  for (unsigned m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+    const string mode = modes[m];
+    const string label = mode.empty() ? "--extract-to" : "--extract-to " + mode;
+    if (run("rm -rf files && mkdir files && cd files && " + string(unpack) + " --extract " + mode + " ../test.ros") != 0 ||
+        run(string(unpack) + " --extract-to=tar:test.tar " + mode + " test.ros") != 0) {
+      cerr << "FAIL " << label << ": ros_unpack failed" << endl;
+      ++failures;
+      continue;
+    }
+    vector<string> names;
+    vector<vector<char> > members;
+    if (!read_tar("test.tar", names, members)) {
+      cerr << "FAIL " << label << ": test.tar is not a well formed tar file" << endl;
+      ++failures;
+      continue;
+    }
+    for (unsigned i = 0; i < entries.size(); ++i) {
+      const string name = string("test.ros/") + entries[i].name;
+      vector<char> expected;
+      unsigned n = 0;
+      while (n < names.size() && names[n] != name)
+        ++n;
+      if (n == names.size())
+        cerr << "FAIL " << label << ": no member " << name << endl;
+      else if (!read_file(string("files/") + entries[i].name, expected))
+        cerr << "FAIL " << label << ": --extract did not write " << entries[i].name << endl;
+      else if (members[n] != expected)
+        cerr << "FAIL " << label << ": member " << name << " has " << members[n].size()
+             << " bytes, not the " << expected.size() << " bytes --extract wrote" << endl;
+      else
+        continue;
+      ++failures;
+    }
+  }
+
+  // an archive cut short inside an entry leaves that member short of the size in its header
+  if (run("cp test.ros short.ros") != 0 || truncate("short.ros", sizeof(struct ros_header_v2) + 100) != 0) {
+    cerr << "Error: cannot write the truncated test archive" << endl;
+    ++failures;
+  }
+  else if (run(string(unpack) + " --extract-to=tar:short.tar short.ros 2>/dev/null") == 0) {
+    cerr << "FAIL --extract-to: a truncated archive was extracted without an error" << endl;
+    ++failures;
+  }
+
+  run(string("rm -rf ") + work);
+  free(unpack);
+  if (failures) {
+    cerr << failures << " failures" << endl;
+    return 1;
+  }
+  cout << "extract_to: all members match" << endl;
+  return 0;
+}